@@ -0,0 +1,355 @@
+#define _POSIX_C_SOURCE 200809L /* clock_gettime */
+
+#include "mosaic.h"
+#include "xor_key.h"
+#include "kernels.h"
+#include "lz.h"
+#include "search.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Throughput benchmark over a generated corpus: prose, JSON log lines and
+ * random bytes. Doubles as the training run for `make pgo`.
+ * usage: mosaicBench [size_mb] */
+
+#define MIN_SECONDS 0.2
+
+typedef struct {
+  const char *name;
+  uint8_t *data;
+  size_t len;
+} corpus;
+
+static double now_sec(void){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/* xorshift, so every run (and every PGO training run) sees the same corpus */
+static uint32_t rng_state = 2463534242u;
+static uint32_t rng(void){
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 17;
+  rng_state ^= rng_state << 5;
+  return rng_state;
+}
+
+static void fill_text(uint8_t *p, size_t n){
+  static const char *const words[] = {
+    "the", "mosaic", "cipher", "block", "window", "of", "and", "noise", "key",
+    "rotates", "every", "stream", "checksum", "a", "to", "encoded", "bytes"
+  };
+  size_t o = 0;
+  while(o < n){
+    const char *w = words[rng() % (sizeof(words) / sizeof(words[0]))];
+    for(size_t i = 0; w[i] && o < n; i++) p[o++] = (uint8_t)w[i];
+    if(o < n) p[o++] = (rng() % 12 == 0) ? '\n' : ' ';
+  }
+}
+
+static void fill_json(uint8_t *p, size_t n){
+  static const char *const levels[] = { "info", "warn", "debug", "error" };
+  size_t o = 0;
+  char line[160];
+  while(o < n){
+    int len = snprintf(line, sizeof(line),
+                       "{\"ts\":%u,\"level\":\"%s\",\"msg\":\"request served\",\"latency_us\":%u}\n",
+                       1700000000u + (unsigned)(o / 64), levels[rng() % 4], rng() % 5000);
+    for(int i = 0; i < len && o < n; i++) p[o++] = (uint8_t)line[i];
+  }
+}
+
+static void fill_random(uint8_t *p, size_t n){
+  for(size_t i = 0; i < n; i++) p[i] = (uint8_t)rng();
+}
+
+/* runs fn until MIN_SECONDS pass and reports MB/s of `bytes` per run */
+#define BENCH(label, corpus_name, bytes, stmt) do { \
+    size_t reps_ = 0; \
+    double t0_ = now_sec(), el_; \
+    do { stmt; reps_++; el_ = now_sec() - t0_; } while(el_ < MIN_SECONDS); \
+    printf("%-8s %-16s %9.1f MB/s\n", corpus_name, label, \
+           (double)(bytes) * (double)reps_ / el_ / 1e6); \
+  } while(0)
+
+static int run_corpus(const corpus *c){
+  size_t cap = mosaic_encode_ex(c->data, c->len, NULL, 0, 0u);
+  char *enc = malloc(cap);
+  char *enc_c = malloc(cap);
+  char *enc_w = malloc(cap);
+  uint8_t *dec = malloc(c->len + 8);
+  uint8_t *scratch = malloc(c->len);
+  if(!enc || !enc_c || !enc_w || !dec || !scratch){
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+
+  size_t enc_len = 0, enc_c_len = 0, enc_w_len = 0, dec_len = 0;
+  BENCH("encode", c->name, c->len, enc_len = mosaic_encode(c->data, c->len, enc, cap));
+  BENCH("encode compact", c->name, c->len,
+        enc_c_len = mosaic_encode_ex(c->data, c->len, enc_c, cap, MOSAIC_OPT_COMPACT));
+  BENCH("decode", c->name, c->len, dec_len = mosaic_decode(enc, enc_len, dec, c->len + 8));
+  if(dec_len != c->len || memcmp(dec, c->data, c->len) != 0){
+    fprintf(stderr, "%s: decode mismatch\n", c->name);
+    return 1;
+  }
+  BENCH("decode compact", c->name, c->len, dec_len = mosaic_decode(enc_c, enc_c_len, dec, c->len + 8));
+  if(dec_len != c->len || memcmp(dec, c->data, c->len) != 0){
+    fprintf(stderr, "%s: compact decode mismatch\n", c->name);
+    return 1;
+  }
+  /* wide-compact blocks are shorter than the compact ones, so cap holds them */
+  BENCH("encode wide", c->name, c->len,
+        enc_w_len = mosaic_encode_ex(c->data, c->len, enc_w, cap, MOSAIC_OPT_WIDE | MOSAIC_OPT_COMPACT));
+  BENCH("decode wide", c->name, c->len, dec_len = mosaic_decode(enc_w, enc_w_len, dec, c->len + 8));
+  if(dec_len != c->len || memcmp(dec, c->data, c->len) != 0){
+    fprintf(stderr, "%s: wide decode mismatch\n", c->name);
+    return 1;
+  }
+  memcpy(scratch, c->data, c->len);
+  BENCH("xor", c->name, c->len, xor_with_key(scratch, c->len, "benchmark-key"));
+
+  printf("%-8s %-16s %9.3f x (compact %.3f x, wide compact %.3f x)\n", c->name, "expansion",
+         (double)enc_len / (double)c->len, (double)enc_c_len / (double)c->len,
+         (double)enc_w_len / (double)c->len);
+
+  free(enc);
+  free(enc_c);
+  free(enc_w);
+  free(dec);
+  free(scratch);
+  return 0;
+}
+
+/* the optional compression stage: what LZ costs per plaintext byte, and
+ * what it saves the encode and decode behind it. Random data shows the
+ * floor: every frame is stored, so it only adds the scan and the headers. */
+static int run_compress(const corpus *c){
+  size_t zcap = mosaic_lz_bound(c->len);
+  uint8_t *z = malloc(zcap);
+  uint8_t *back = malloc(c->len);
+  size_t cap = z ? mosaic_encode_ex(z, zcap, NULL, 0, MOSAIC_OPT_COMPRESS) : 0;
+  char *enc = malloc(cap);
+  if(!z || !back || !enc){
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+
+  size_t z_len = 0, enc_len = 0, dec_len = 0, back_len = 0;
+  BENCH("lz compress", c->name, c->len, z_len = mosaic_lz_compress(c->data, c->len, z, zcap));
+  BENCH("lz decompress", c->name, c->len, back_len = mosaic_lz_decompress(z, z_len, back, c->len));
+  if(back_len != c->len || memcmp(back, c->data, c->len) != 0){
+    fprintf(stderr, "%s: lz round trip mismatch\n", c->name);
+    return 1;
+  }
+  BENCH("lz+encode", c->name, c->len,
+        z_len = mosaic_lz_compress(c->data, c->len, z, zcap);
+        enc_len = mosaic_encode_ex(z, z_len, enc, cap, MOSAIC_OPT_COMPRESS));
+  BENCH("decode+lz", c->name, c->len,
+        dec_len = mosaic_decode(enc, enc_len, z, zcap);
+        back_len = mosaic_lz_decompress(z, dec_len, back, c->len));
+  if(dec_len != z_len || back_len != c->len || memcmp(back, c->data, c->len) != 0){
+    fprintf(stderr, "%s: compressed decode mismatch\n", c->name);
+    return 1;
+  }
+
+  printf("%-8s %-16s %9.3f x (lz ratio %.3f)\n", c->name, "expansion lz",
+         (double)enc_len / (double)c->len, (double)z_len / (double)c->len);
+
+  free(z);
+  free(back);
+  free(enc);
+  return 0;
+}
+
+/* many small messages: one mosaic_encrypt()/mosaic_decrypt() each against
+ * the batch calls with the same key, on one thread and on four. MB/s are
+ * of plaintext, so the per-message overhead shows directly. */
+#define BATCH_MSGS 10000
+
+static int run_batch(const corpus *c){
+  mosaic_msg *msgs = malloc(BATCH_MSGS * sizeof *msgs);
+  char *strs = malloc(BATCH_MSGS * 65);
+  size_t *offsets = malloc((BATCH_MSGS + 1) * sizeof *offsets);
+  size_t *back_offsets = malloc((BATCH_MSGS + 1) * sizeof *back_offsets);
+  if(!msgs || !strs || !offsets || !back_offsets){
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+
+  /* 16..64 byte slices of the corpus, also kept as C strings for the
+   * one-at-a-time calls */
+  size_t bytes = 0, at = 0;
+  for(size_t i = 0; i < BATCH_MSGS; i++){
+    size_t len = 16 + rng() % 49;
+    if(at + len > c->len) at = 0;
+    char *s = strs + i * 65;
+    memcpy(s, c->data + at, len);
+    s[len] = '\0';
+    msgs[i].data = s;
+    msgs[i].len = len;
+    at += len;
+    bytes += len;
+  }
+
+  size_t cap = mosaic_encode_batch(msgs, BATCH_MSGS, NULL, 0, NULL, "benchmark-key", 0u, 1, 1);
+  char *enc = malloc(cap);
+  mosaic_msg *cmsgs = malloc(BATCH_MSGS * sizeof *cmsgs);
+  if(!enc || !cmsgs){
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+
+  BENCH("encrypt each", c->name, bytes,
+        for(size_t i = 0; i < BATCH_MSGS; i++) free(mosaic_encrypt(msgs[i].data, "benchmark-key")));
+  size_t enc_len = 0;
+  BENCH("encode batch", c->name, bytes,
+        enc_len = mosaic_encode_batch(msgs, BATCH_MSGS, enc, cap, offsets, "benchmark-key", 0u, 1, 1));
+  BENCH("encode batch x4", c->name, bytes,
+        enc_len = mosaic_encode_batch(msgs, BATCH_MSGS, enc, cap, offsets, "benchmark-key", 0u, 1, 4));
+  if(enc_len == (size_t)-1){
+    fprintf(stderr, "%s: batch encode failed\n", c->name);
+    return 1;
+  }
+
+  for(size_t i = 0; i < BATCH_MSGS; i++){
+    cmsgs[i].data = enc + offsets[i];
+    cmsgs[i].len = offsets[i + 1] - offsets[i];
+  }
+  size_t dcap = mosaic_decode_batch(cmsgs, BATCH_MSGS, NULL, 0, NULL, NULL, "benchmark-key", 1);
+  uint8_t *dec = malloc(dcap);
+  char *one = malloc(cap + 1);
+  if(!dec || !one){
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+  /* mosaic_decrypt() takes C strings, so each message is copied out first */
+  BENCH("decrypt each", c->name, bytes,
+        for(size_t i = 0; i < BATCH_MSGS; i++){
+          memcpy(one, cmsgs[i].data, cmsgs[i].len);
+          one[cmsgs[i].len] = '\0';
+          free(mosaic_decrypt(one, "benchmark-key"));
+        });
+  size_t dec_len = 0;
+  BENCH("decode batch", c->name, bytes,
+        dec_len = mosaic_decode_batch(cmsgs, BATCH_MSGS, dec, dcap, back_offsets, NULL,
+                                      "benchmark-key", 1));
+  BENCH("decode batch x4", c->name, bytes,
+        dec_len = mosaic_decode_batch(cmsgs, BATCH_MSGS, dec, dcap, back_offsets, NULL,
+                                      "benchmark-key", 4));
+  int bad = dec_len != bytes;
+  for(size_t i = 0; i < BATCH_MSGS && !bad; i++){
+    bad = back_offsets[i + 1] - back_offsets[i] != msgs[i].len ||
+          memcmp(dec + back_offsets[i], msgs[i].data, msgs[i].len) != 0;
+  }
+  if(bad) fprintf(stderr, "%s: batch round trip mismatch\n", c->name);
+
+  free(msgs);
+  free(strs);
+  free(offsets);
+  free(back_offsets);
+  free(enc);
+  free(cmsgs);
+  free(dec);
+  free(one);
+  return bad;
+}
+
+/* grep over keyed ciphertext: decrypting the whole stream and scanning
+ * the copy, against the searcher, which holds one 64 KiB slice at a time */
+static size_t count_matches(const uint8_t *p, size_t len, const uint8_t *pat, size_t m){
+  size_t n = 0;
+  for(size_t i = 0; i + m <= len; i++) n += p[i] == pat[0] && memcmp(p + i, pat, m) == 0;
+  return n;
+}
+
+static int run_search(const corpus *c){
+  size_t cap = mosaic_encode_ex(c->data, c->len, NULL, 0, 0u);
+  uint8_t *plain = malloc(c->len + 8);
+  char *enc = malloc(cap);
+  if(!plain || !enc){
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+  memcpy(plain, c->data, c->len);
+  xor_with_key(plain, c->len, "benchmark-key");
+  size_t enc_len = mosaic_encode(plain, c->len, enc, cap);
+
+  /* a phrase near the end of the corpus, so both passes see everything */
+  uint8_t pat[12];
+  memcpy(pat, c->data + c->len - 64, sizeof pat);
+  size_t want = count_matches(c->data, c->len, pat, sizeof pat), found = 0;
+
+  BENCH("decrypt+scan", c->name, c->len,
+        size_t n = mosaic_decode(enc, enc_len, plain, c->len + 8);
+        xor_with_key(plain, n, "benchmark-key");
+        found = count_matches(plain, n, pat, sizeof pat));
+  int bad = found != want;
+  BENCH("search", c->name, c->len,
+        mosaic_searcher s;
+        mosaic_search_init(&s, pat, sizeof pat, "benchmark-key");
+        bad |= mosaic_search_update(&s, enc, enc_len, NULL, NULL) != 0 || mosaic_search_final(&s) != 0;
+        found = s.matches;
+        mosaic_search_free(&s));
+  bad |= found != want;
+  if(bad) fprintf(stderr, "%s: search found %zu of %zu matches\n", c->name, found, want);
+
+  free(plain);
+  free(enc);
+  return bad;
+}
+
+/* the hex path goes through C strings, so only the NUL-free text corpus */
+static int run_hex(const corpus *c){
+  char *text = malloc(c->len + 1);
+  if(!text) return 1;
+  memcpy(text, c->data, c->len);
+  text[c->len] = '\0';
+
+  char *hex = NULL;
+  BENCH("xor+hex encode", c->name, c->len, free(hex); hex = xor_encrypt(text, "benchmark-key"));
+  char *back = NULL;
+  BENCH("xor+hex decode", c->name, c->len, free(back); back = xor_decrypt(hex, "benchmark-key"));
+  int bad = !back || strcmp(back, text) != 0;
+  if(bad) fprintf(stderr, "%s: hex round trip mismatch\n", c->name);
+  free(hex);
+  free(back);
+  free(text);
+  return bad;
+}
+
+int main(int argc, char **argv){
+  size_t mb = argc > 1 ? (size_t)strtoul(argv[1], NULL, 10) : 4;
+  if(mb == 0) mb = 1;
+  size_t n = mb << 20;
+
+  corpus corpora[3] = {
+    { "text", malloc(n), n },
+    { "json", malloc(n), n },
+    { "random", malloc(n), n }
+  };
+  for(int i = 0; i < 3; i++){
+    if(!corpora[i].data){
+      fprintf(stderr, "out of memory\n");
+      return 1;
+    }
+  }
+  fill_text(corpora[0].data, n);
+  fill_json(corpora[1].data, n);
+  fill_random(corpora[2].data, n);
+
+  printf("kernels: %s, corpus: %zu MiB each\n", mosaic_kernels_get()->name, mb);
+  int rc = 0;
+  for(int i = 0; i < 3 && rc == 0; i++) rc = run_corpus(&corpora[i]);
+  for(int i = 0; i < 3 && rc == 0; i++) rc = run_compress(&corpora[i]);
+  if(rc == 0) rc = run_batch(&corpora[1]);
+  if(rc == 0) rc = run_search(&corpora[0]);
+  if(rc == 0) rc = run_hex(&corpora[0]);
+
+  for(int i = 0; i < 3; i++) free(corpora[i].data);
+  return rc;
+}
@@ -0,0 +1,44 @@
+#ifndef APPEND_H
+#define APPEND_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "pipeline.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Appending to a finished Mosaic stream in place. Only the end of the
+ * stream is read back: the trailer (and with it the pad count) and the last
+ * checksum window, which is decoded to recover the payload bytes it holds.
+ * The encoder then restarts at that window's block index and key phase
+ * (mosaic_encoder_init_at), is fed those bytes and the new plaintext, and
+ * overwrites the old window and trailer with the blocks that now follow
+ * plus a new trailer. Nothing before the last window is touched.
+ *
+ * The block index comes from the file size in compact streams, whose
+ * windows have a fixed size, so there the cost depends on the new data
+ * alone. Noise gives a noisy stream no such layout: its blocks are counted
+ * by their terminators, a plain scan of the file but still a full one.
+ *
+ * The new plaintext is XORed with the key at the stream's payload offset
+ * and, in MOSAIC_OPT_COMPRESS streams, compressed into frames of its own,
+ * so the result decodes exactly like a stream written in one go. An empty
+ * file, or an empty stream, is started afresh with `opts`; otherwise the
+ * marks of the stream decide. The old tail is overwritten in place, but
+ * every chunk goes out with a provisional trailer that the next one
+ * overwrites: a failure halfway, or a wait on in_fd, leaves a stream that
+ * decodes to what was appended so far. */
+
+/* 0 on success, -1 with errno set on failure (EILSEQ: fd does not end in a
+ * well-formed stream). fd must be open for reading and writing; in_fd is
+ * read to its end. res may be NULL; bytes_out counts the chars written,
+ * the rewritten tail included. */
+int mosaic_append(int fd, int in_fd, const char *key, unsigned opts, mosaic_pipe_result *res);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Bump allocator for data that lives exactly as long as one operation (one
+ * CLI command, say). Allocation is a pointer bump; nothing is freed on its
+ * own. mosaic_arena_reset() zeroes everything handed out -- plaintext and key
+ * copies included -- and rewinds, keeping one chunk sized to the high-water
+ * mark so steady-state use never reaches malloc. */
+
+typedef struct mosaic_arena_chunk mosaic_arena_chunk;
+
+typedef struct {
+  mosaic_arena_chunk *head;   // current chunk; older ones follow
+  size_t chunk_size;          // minimum size of a new chunk
+} mosaic_arena;
+
+void mosaic_arena_init(mosaic_arena *a, size_t chunk_size);
+void *mosaic_arena_alloc(mosaic_arena *a, size_t n); // 16-byte aligned, NULL if out of memory
+char *mosaic_arena_strdup(mosaic_arena *a, const char *s);
+void mosaic_arena_reset(mosaic_arena *a);
+void mosaic_arena_free(mosaic_arena *a);             // zeroes, then releases every chunk
+
+/* For APIs taking an optional arena: allocate from `a`, or from the heap when
+ * a is NULL. mosaic_release() frees heap memory and ignores arena memory. */
+void *mosaic_alloc(mosaic_arena *a, size_t n);
+void mosaic_release(mosaic_arena *a, void *p);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef BULK_H
+#define BULK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "pipeline.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Directory engine: encrypts or decrypts every regular file under a tree on
+ * a pool of worker threads. Each worker keeps a deque of tasks: it takes its
+ * own newest task first (depth first through the tree) and, when it runs
+ * dry, steals the oldest task of another worker. Walking a directory is a
+ * task that queues its files and subdirectories.
+ *
+ * Encrypting writes <name>.mosaic and leaves files already named so alone;
+ * decrypting takes only *.mosaic files and strips the suffix. With dst_dir
+ * the same directory as src_dir the results land next to their sources,
+ * otherwise in a mirrored tree under dst_dir. Every result is written to a
+ * temporary file in its final directory and renamed into place, so a
+ * result is either whole or absent.
+ *
+ * Files above split_size are cut into window-aligned parts that run as
+ * tasks of their own, so one huge file keeps every worker busy. Each part
+ * writes at its own offset in the output: encoding first predicts every
+ * part's size (mosaic_encoder_predict), decoding only splits compact
+ * streams whose size adds up to whole windows, which then have fixed
+ * offsets. Compressed and noisy streams are decoded whole, and so is a
+ * compact stream one of whose parts finds no window where the layout put
+ * it (line breaks or noise inside): the whole-file decoder reads it the
+ * noisy way, and reports the error if it is damaged. */
+
+#define MOSAIC_BULK_SUFFIX ".mosaic"
+#define MOSAIC_BULK_SPLIT (64u << 20) // default part size, plaintext bytes
+#define MOSAIC_BULK_PIECE (256u << 10) // per-worker I/O buffer
+
+typedef struct {
+  mosaic_pipe_mode mode;
+  unsigned opts;              // MOSAIC_OPT_* when encrypting
+  const char *key;            // XOR key; NULL or "" for none
+  int threads;                // 0 = one per online CPU
+  uint64_t split_size;        // 0 = MOSAIC_BULK_SPLIT
+} mosaic_bulk_config;
+
+typedef struct {
+  char *path;                 // source file or directory
+  int err;                    // errno value; EILSEQ for malformed ciphertext
+} mosaic_bulk_error;
+
+typedef struct {
+  uint64_t files;             // results written
+  uint64_t skipped;           // not regular files, or the wrong suffix
+  uint64_t bytes_in;
+  uint64_t bytes_out;
+  double seconds;
+  int threads;
+  mosaic_bulk_error *errors;  // per-file failures, in no particular order
+  size_t n_errors;
+} mosaic_bulk_result;
+
+/* 0 once the whole tree has been visited, even if some files failed (they
+ * are listed in res); -1 with errno set when the run could not start
+ * (EINVAL: dst_dir lies inside src_dir). res is required; release it with
+ * mosaic_bulk_result_free(). */
+int mosaic_bulk_run(const char *src_dir, const char *dst_dir, const mosaic_bulk_config *cfg,
+                    mosaic_bulk_result *res);
+void mosaic_bulk_result_free(mosaic_bulk_result *res);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
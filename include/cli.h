@@ -14,6 +14,7 @@ const char *cli_get_key(void);
 void cli_set_cipher(const char *name);
 const char *cli_get_cipher(void);
 int cli_execute(const char *line);
+int cli_run_args(int argc, char **argv);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,52 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Hot-path kernels, built once per ISA. The best variant the CPU supports is
+ * picked on first use; MOSAIC_ISA=scalar|sse4.2|avx2|avx512 in the environment
+ * caps that choice (for benchmarking and cross-checking variants). */
+
+#define MOSAIC_XOR_WIDE 64          // widest vector load the XOR kernels make
+#define MOSAIC_XOR_MAX_KEY 256      // longer keys take the plain scalar loop
+#define MOSAIC_EKEY_SIZE (MOSAIC_XOR_MAX_KEY + 2 * MOSAIC_XOR_WIDE)
+
+typedef struct {
+  const char *name;
+  /* data[i] ^= ekey[(phase + i) % period], where ekey comes from
+   * mosaic_stretch_key() and phase < period */
+  void (*xor_stream)(unsigned char *data, size_t len, const unsigned char *ekey,
+                     size_t period, size_t phase);
+  /* writes 2 * len uppercase hex digits, no terminator */
+  void (*hex_encode)(const unsigned char *in, size_t len, char *out);
+  /* reads 2 * n_bytes hex digits of either case; -1 on a bad digit */
+  int (*hex_decode)(const char *in, size_t n_bytes, unsigned char *out);
+  /* length of the leading run with no noise (a-z) and no whitespace */
+  size_t (*span_clean)(const char *in, size_t len);
+} mosaic_kernels;
+
+const mosaic_kernels *mosaic_kernels_get(void);
+
+/* Repeat key (1..MOSAIC_XOR_MAX_KEY bytes) into ekey (MOSAIC_EKEY_SIZE bytes)
+ * and return the period to pass to xor_stream: the smallest multiple of klen
+ * that is at least MOSAIC_XOR_WIDE, so kernels can step by a whole vector and
+ * wrap with a single subtraction. */
+size_t mosaic_stretch_key(unsigned char *ekey, const unsigned char *key, size_t klen);
+
+extern const mosaic_kernels mosaic_kernels_scalar;
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MOSAIC_HAVE_X86_KERNELS 1
+extern const mosaic_kernels mosaic_kernels_sse42;
+extern const mosaic_kernels mosaic_kernels_avx2;
+extern const mosaic_kernels mosaic_kernels_avx512;
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef LZ_H
+#define LZ_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* In-tree LZ77 codec for the optional compression stage (MOSAIC_OPT_COMPRESS).
+ * It runs on the plaintext before the XOR and the Mosaic encode, and after
+ * them on the way back. The compressed form is a sequence of frames:
+ *
+ *   kind (1 byte) | raw length (u32 LE) | body length (u32 LE) | body
+ *
+ * kind 0 stores the bytes as they are, kind 1 holds an LZ body: LZ4-style
+ * sequences of a token (literal count << 4 | match length - 4, with 255-run
+ * extensions), the literals, and a 2-byte little-endian match distance; the
+ * last sequence is literals only. A frame never holds more than
+ * MOSAIC_LZ_FRAME_MAX raw bytes and is stored whenever LZ would not shrink
+ * it, so incompressible input grows by one header per frame. Frames stand
+ * alone: any split of the input into frames decodes to the same bytes. */
+
+#define MOSAIC_LZ_FRAME_HDR 9
+#define MOSAIC_LZ_FRAME_MAX (1u << 20)
+
+/* worst-case compressed size of in_len bytes */
+size_t mosaic_lz_bound(size_t in_len);
+
+/* compresses in into frames; returns bytes written, (size_t)-1 if out_cap
+ * is below mosaic_lz_bound(in_len) */
+size_t mosaic_lz_compress(const uint8_t *in, size_t in_len, uint8_t *out, size_t out_cap);
+
+/* size of the whole frame starting at in, with its raw length in *raw_len:
+ * 0 while in holds only part of it, (size_t)-1 for a bad header */
+size_t mosaic_lz_frame(const uint8_t *in, size_t in_len, size_t *raw_len);
+
+/* raw size of a whole frame sequence, (size_t)-1 if it is malformed */
+size_t mosaic_lz_decompressed_len(const uint8_t *in, size_t in_len);
+
+/* decompresses whole frames; returns bytes written, (size_t)-1 if the input
+ * is malformed or truncated or out_cap is too small */
+size_t mosaic_lz_decompress(const uint8_t *in, size_t in_len, uint8_t *out, size_t out_cap);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -3,6 +3,7 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include "arena.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -18,14 +19,134 @@ typedef struct {
     int checksum_period;    // blocks per checksum
 } mosaic_params;
 
+// Encode options (bitmask)
+#define MOSAIC_OPT_COMPACT 0x1u // no noise; every 4-block window is exactly 37 chars
+// the payload is an LZ frame stream (lz.h). The codec calls only mark the
+// stream with it; mosaic_encrypt_ex() and the pipeline compress before the
+// XOR and decompress after it
+#define MOSAIC_OPT_COMPRESS 0x2u
+// wide blocks: 8 bytes as 12 symbols (mosaic_get_params_wide()), about
+// 1.66x instead of 1.85x in compact mode; marked with a leading 'w'
+#define MOSAIC_OPT_WIDE 0x4u
+
 // Core API
 size_t mosaic_encode(const uint8_t *in, size_t in_len, char *out, size_t out_cap);
+size_t mosaic_encode_ex(const uint8_t *in, size_t in_len, char *out, size_t out_cap, unsigned opts);
+// noise placement comes from `seed` alone: same input, opts and seed give
+// the same ciphertext (the other encoders seed from the clock)
+size_t mosaic_encode_seeded(const uint8_t *in, size_t in_len, char *out, size_t out_cap,
+                            unsigned opts, uint64_t seed);
 size_t mosaic_decode(const char *in, size_t in_len, uint8_t *out, size_t out_cap);
 const mosaic_params* mosaic_get_params(void);
+const mosaic_params* mosaic_get_params_wide(void); // the MOSAIC_OPT_WIDE preset
+// MOSAIC_OPT_* bits announced by the marks at the start of a ciphertext
+unsigned mosaic_stream_opts(const char *in, size_t in_len);
+
+// Recovering decode: damaged checksum windows are zero-filled and reported
+// instead of failing the whole stream
+typedef struct {
+    size_t offset;          // first damaged output byte
+    size_t len;             // number of damaged (zeroed) bytes
+} mosaic_damage;
+
+size_t mosaic_decode_recover(const char *in, size_t in_len, uint8_t *out, size_t out_cap,
+                             mosaic_damage *damage, size_t damage_cap, size_t *damage_count);
+
+// Streaming API: feed input in pieces of any size. Output is byte-identical
+// to the one-shot calls (modulo noise placement). Blocks are only emitted a
+// whole checksum window at a time, so chunk sizes that are multiples of
+// MOSAIC_WINDOW_BYTES pass straight through without being carried over.
+#define MOSAIC_WINDOW_BYTES 20 // block_bytes * checksum_period
+#define MOSAIC_WIDE_WINDOW_BYTES 32 // the same with MOSAIC_OPT_WIDE
+
+typedef struct {
+    unsigned opts;          // MOSAIC_OPT_* bits
+    size_t blocks;          // blocks written so far (selects the rotation)
+    uint64_t in_total;      // bytes consumed so far
+    uint8_t carry[MOSAIC_WIDE_WINDOW_BYTES]; // partial window held for the next call
+    size_t carry_len;
+    int marked;             // leading marks already written
+    uint64_t rng;           // noise PRNG state
+} mosaic_encoder;
+
+void mosaic_encoder_init(mosaic_encoder *e, unsigned opts);
+// same output as mosaic_encode_seeded() with the same seed
+void mosaic_encoder_init_seeded(mosaic_encoder *e, unsigned opts, uint64_t seed);
+// worst-case output of one update or final call fed in_len bytes
+size_t mosaic_encoder_bound(size_t in_len, unsigned opts);
+size_t mosaic_encoder_update(mosaic_encoder *e, const uint8_t *in, size_t in_len,
+                             char *out, size_t out_cap);
+// flushes the carried bytes and writes the trailer
+size_t mosaic_encoder_final(mosaic_encoder *e, char *out, size_t out_cap);
+// Encoding a stream in parts, e.g. on several threads: cut the input at
+// multiples of the window bytes and start one encoder per part at its
+// offset. Only the part at offset 0 writes the marks and only the last one
+// calls final; the parts' outputs, concatenated, are one stream. Each part
+// can draw its noise from its own seed.
+void mosaic_encoder_init_at(mosaic_encoder *e, unsigned opts, uint64_t seed, uint64_t offset);
+// exact number of chars e writes for its next in_len bytes, however they
+// are split across update calls, plus the final call when `final` is set
+uint64_t mosaic_encoder_predict(const mosaic_encoder *e, uint64_t in_len, int final);
+
+typedef struct {
+    int state;              // position in the block grammar
+    int k;                  // symbols read of the current block
+    int digits[12];
+    size_t blocks;          // blocks decoded so far
+    uint8_t window[MOSAIC_WIDE_WINDOW_BYTES]; // current checksum window
+    uint8_t held[8];        // last block, held back until the pad is known
+    int have_held;
+    unsigned opts;          // MOSAIC_OPT_* marks read at the start
+} mosaic_decoder;
+
+void mosaic_decoder_init(mosaic_decoder *d);
+// worst-case output of one update call fed in_len chars
+size_t mosaic_decoder_bound(size_t in_len);
+size_t mosaic_decoder_update(mosaic_decoder *d, const char *in, size_t in_len,
+                             uint8_t *out, size_t out_cap);
+// 0 once the trailer has been read, -1 if the stream was cut short
+int mosaic_decoder_final(mosaic_decoder *d);
+// Decoding in parts: a decoder for the part of a stream with the given
+// marks that starts `offset` bytes into the plaintext, at a window
+// boundary, with its input starting right there (past the marks, for the
+// first part). In compact streams the boundaries sit at fixed places:
+// every window is block_symbols + 1 chars per block plus the checksum.
+void mosaic_decoder_init_at(mosaic_decoder *d, unsigned opts, uint64_t offset);
+// for a part that ends at a window boundary before the stream does, in
+// place of final: writes the block held back in case the trailer pads it
+// (out_cap must hold 8 bytes). Returns bytes written, (size_t)-1 if the
+// input did not end at a window boundary.
+size_t mosaic_decoder_flush(mosaic_decoder *d, uint8_t *out, size_t out_cap);
+
+// Batched calls for many small messages: the tables, the stretched key and
+// the noise seeding are set up once per batch, and the results are packed
+// into one buffer, message i at out[offsets[i] .. offsets[i + 1]) (offsets
+// holds n + 1 entries). `key` (NULL or "" for none) is XORed into each
+// message from its first byte, as mosaic_encrypt_ex() does. threads > 1
+// splits the batch into up to that many runs of messages, one thread each;
+// the output does not depend on it. out == NULL returns the capacity to
+// pass. MOSAIC_OPT_COMPRESS is per stream and not offered here.
+typedef struct {
+    const void *data;
+    size_t len;
+} mosaic_msg;
+
+// message i is mosaic_encode_seeded() of the XORed bytes with seed + i
+size_t mosaic_encode_batch(const mosaic_msg *msgs, size_t n, char *out, size_t out_cap,
+                           size_t *offsets, const char *key, unsigned opts, uint64_t seed,
+                           int threads);
+// with status == NULL any bad message fails the batch; otherwise status[i]
+// is 0 or -1 and a bad message gets an empty range
+size_t mosaic_decode_batch(const mosaic_msg *msgs, size_t n, uint8_t *out, size_t out_cap,
+                           size_t *offsets, int *status, const char *key, int threads);
 
 // CLI-friendly wrappers
-char* mosaic_encrypt(const char *plaintext); // returns malloced string
-char* mosaic_decrypt(const char *ciphertext); // returns malloced string
+char* mosaic_encrypt(const char *plaintext, const char *key); // returns malloced string
+char* mosaic_decrypt(const char *ciphertext, const char *key); // returns malloced string
+// _ex variants draw scratch and result from `arena` when it is non-NULL;
+// the result then belongs to the arena and must not be freed
+char* mosaic_encrypt_ex(const char *plaintext, const char *key, unsigned opts, mosaic_arena *arena);
+char* mosaic_decrypt_ex(const char *ciphertext, const char *key, mosaic_arena *arena);
 
 #ifdef __cplusplus
 }
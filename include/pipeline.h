@@ -0,0 +1,62 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* File/pipe processing engine: reads in_fd in chunks, XORs with the key and
+ * encodes (or decodes and XORs), and writes the result to out_fd. Several
+ * chunk buffers are kept in flight so the read of chunk N+1 and the write of
+ * chunk N-1 overlap the codec work on chunk N. On Linux this runs on
+ * io_uring with registered buffers; elsewhere, or when the kernel refuses a
+ * ring, it falls back to a reader and a writer thread around the codec. */
+
+typedef enum {
+  MOSAIC_PIPE_ENCODE,
+  MOSAIC_PIPE_DECODE
+} mosaic_pipe_mode;
+
+typedef enum {
+  MOSAIC_ENGINE_AUTO,     // io_uring when available, else threads
+  MOSAIC_ENGINE_URING,
+  MOSAIC_ENGINE_THREADS,
+  MOSAIC_ENGINE_INLINE    // no helper threads: read, codec and write take turns
+                          // on the calling thread, one chunk buffer (for
+                          // callers that run many small pipes side by side)
+} mosaic_pipe_engine;
+
+#define MOSAIC_PIPE_CHUNK (1u << 20) // default input bytes per chunk
+#define MOSAIC_PIPE_DEPTH 4          // default chunk buffers in flight
+
+typedef struct {
+  mosaic_pipe_mode mode;
+  unsigned opts;              // MOSAIC_OPT_* when encoding; decoding reads the marks
+  const char *key;            // XOR key; NULL or "" for none
+  size_t chunk_size;          // 0 = MOSAIC_PIPE_CHUNK; rounded down to whole windows
+  int depth;                  // 0 = MOSAIC_PIPE_DEPTH
+  mosaic_pipe_engine engine;
+} mosaic_pipe_config;
+
+typedef struct {
+  uint64_t bytes_in;
+  uint64_t bytes_out;
+  double seconds;
+  mosaic_pipe_engine engine;  // the engine that actually ran
+} mosaic_pipe_result;
+
+/* 0 on success, -1 with errno set on failure (EILSEQ: malformed ciphertext,
+ * ENOSYS: MOSAIC_ENGINE_URING asked for but unavailable). Output already
+ * written is left in place on failure. res may be NULL. */
+int mosaic_pipe_run(int in_fd, int out_fd, const mosaic_pipe_config *cfg, mosaic_pipe_result *res);
+
+const char *mosaic_pipe_engine_name(mosaic_pipe_engine engine);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
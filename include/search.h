@@ -0,0 +1,81 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "mosaic.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Plaintext search over ciphertext, without decrypting it anywhere. A
+ * searcher runs the streaming decoder over its input a slice at a time,
+ * XORs the decoded bytes with the key at their stream offset and scans them
+ * for the pattern. The last pattern_len - 1 plaintext bytes are carried
+ * over, so matches that straddle blocks, windows or input pieces are found
+ * exactly once. Memory is fixed: one slice of plaintext plus the carry,
+ * and for MOSAIC_OPT_COMPRESS streams one LZ frame in each form. */
+
+#define MOSAIC_SEARCH_SLICE (64u << 10)   // ciphertext chars decoded at a time
+#define MOSAIC_SEARCH_PATTERN_MAX 4096
+
+/* called with the plaintext offset of every match, in order; nonzero stops
+ * the search */
+typedef int (*mosaic_match_fn)(void *ctx, uint64_t offset);
+
+typedef struct {
+  mosaic_decoder dec;
+  const char *key;        // XOR key; NULL or "" for none
+  uint8_t *pattern;
+  size_t pattern_len;
+  uint64_t payload;       // decoded bytes so far (XOR key phase)
+  uint64_t plain;         // plaintext bytes so far (match offsets)
+  uint64_t matches;
+  uint8_t *win;           // room for the carry, then a decoded slice
+  uint8_t *tail;          // the carry: last bytes seen, up to pattern_len - 1
+  size_t carry;
+  uint8_t *z;             // compressed streams: the frame being gathered
+  size_t z_len;
+  uint8_t *raw;           // ... and the decompressed frame, after room for the carry
+  int stopped;
+} mosaic_searcher;
+
+/* 0, or -1 with errno set (EINVAL: empty or too long pattern, ENOMEM).
+ * The pattern is copied; the key must outlive the searcher. */
+int mosaic_search_init(mosaic_searcher *s, const void *pattern, size_t pattern_len,
+                       const char *key);
+/* feeds in_len ciphertext chars: 0 to go on, 1 once fn has stopped the
+ * search (later calls do nothing), -1 with errno EILSEQ for malformed
+ * ciphertext or ENOMEM */
+int mosaic_search_update(mosaic_searcher *s, const char *in, size_t in_len,
+                         mosaic_match_fn fn, void *ctx);
+/* 0 if the stream ended properly (or the search was stopped), else -1 with
+ * errno EILSEQ */
+int mosaic_search_final(mosaic_searcher *s);
+void mosaic_search_free(mosaic_searcher *s);
+
+/* Searching many files at once: up to `threads` workers (0 = one per
+ * online CPU) each take the next file and stream it through a searcher.
+ * on_match sees (ctx, file index, offset) from one thread at a time, and
+ * the matches of one file in order. With first_only each file stops at its
+ * first match. results[i] gets file i's match count and 0 or an errno
+ * value (EILSEQ for malformed ciphertext). Returns 0, or -1 with errno set
+ * when the search could not start. */
+typedef struct {
+  uint64_t matches;
+  int err;
+} mosaic_search_result;
+
+typedef int (*mosaic_file_match_fn)(void *ctx, size_t file, uint64_t offset);
+
+int mosaic_search_files(const char *const *paths, size_t n, const void *pattern,
+                        size_t pattern_len, const char *key, int first_only, int threads,
+                        mosaic_file_match_fn on_match, void *ctx,
+                        mosaic_search_result *results);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Per-thread codec counters and latency histograms.
+ * Build with -DMOSAIC_NO_STATS to compile the recording hooks out entirely;
+ * the query functions then report zeros. */
+
+#define MOSAIC_STATS_BUCKETS 32     // bucket i holds latencies in [2^i, 2^(i+1)) ns
+#define MOSAIC_STATS_MAX_COMMANDS 32
+
+typedef enum {
+  MOSAIC_OP_ENCODE,
+  MOSAIC_OP_DECODE,
+  MOSAIC_OP_RECOVER,
+  MOSAIC_OP_XOR,
+  MOSAIC_OP_COMMAND,
+  MOSAIC_OP_COUNT
+} mosaic_stats_op;
+
+typedef enum {
+  MOSAIC_FAIL_SYMBOL,     // character not in the (rotated) alphabet
+  MOSAIC_FAIL_TERMINATOR, // missing or misplaced block terminator
+  MOSAIC_FAIL_CHECKSUM,   // window checksum mismatch
+  MOSAIC_FAIL_TRAILER,    // bad pad digit, data after trailer, or no trailer
+  MOSAIC_FAIL_CAPACITY,   // output buffer too small
+  MOSAIC_FAIL_COUNT
+} mosaic_stats_fail;
+
+typedef struct {
+  uint64_t calls;
+  uint64_t bytes_in;
+  uint64_t bytes_out;
+  uint64_t blocks;
+  uint64_t latency[MOSAIC_STATS_BUCKETS];
+} mosaic_op_stats;
+
+typedef struct {
+  mosaic_op_stats op[MOSAIC_OP_COUNT];
+  uint64_t noise_emitted;
+  uint64_t noise_skipped;
+  uint64_t fail[MOSAIC_FAIL_COUNT];
+  const char *command_name[MOSAIC_STATS_MAX_COMMANDS]; // NULL-terminated if short
+  uint64_t command_calls[MOSAIC_STATS_MAX_COMMANDS];
+} mosaic_stats;
+
+/* sum of every thread's counters, including threads that have exited */
+void mosaic_stats_snapshot(mosaic_stats *out);
+/* zeroes every counter; exact unless other threads record meanwhile, when
+ * a counter they touch may keep its count (see stats.c) */
+void mosaic_stats_reset(void);
+/* human-readable table, or a single JSON object when json != 0 */
+void mosaic_stats_print(FILE *f, const mosaic_stats *s, int json);
+
+/* recording hooks; use the STATS_* macros below so they compile out */
+uint64_t mosaic_stats_now(void);
+void mosaic_stats_record(mosaic_stats_op op, uint64_t t0, uint64_t bytes_in,
+                         uint64_t bytes_out, uint64_t blocks);
+void mosaic_stats_noise(uint64_t emitted, uint64_t skipped);
+void mosaic_stats_failure(mosaic_stats_fail reason);
+void mosaic_stats_command(const char *name); // name must outlive the process
+
+#ifndef MOSAIC_NO_STATS
+#define STATS_NOW()                      mosaic_stats_now()
+#define STATS_RECORD(op, t0, in, out, b) mosaic_stats_record((op), (t0), (in), (out), (b))
+#define STATS_NOISE(emitted, skipped)    mosaic_stats_noise((emitted), (skipped))
+#define STATS_FAIL(reason)               mosaic_stats_failure(reason)
+#define STATS_COMMAND(name)              mosaic_stats_command(name)
+#else
+#define STATS_NOW()                      ((uint64_t)0)
+#define STATS_RECORD(op, t0, in, out, b) ((void)(t0), (void)(in), (void)(out), (void)(b))
+#define STATS_NOISE(emitted, skipped)    ((void)(emitted), (void)(skipped))
+#define STATS_FAIL(reason)               ((void)0)
+#define STATS_COMMAND(name)              ((void)0)
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
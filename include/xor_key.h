@@ -2,14 +2,23 @@
 #define XOR_KEY_H
 
 #include <stddef.h>
+#include "arena.h"
 
 /* simple XOR helper that is used by both encrypt AND decrypt */
 void xor_with_key(unsigned char *data, size_t len, const char *key);
 
+/* same, for data that starts `offset` bytes into a longer stream, so a
+ * stream can be XORed piece by piece */
+void xor_with_key_at(unsigned char *data, size_t len, const char *key, unsigned long long offset);
+
 /* hex-encode(XOR(plaintext, key)) */
 char *xor_encrypt(const char *plaintext, const char *key);
 
 /* XOR(hex-decode(ciphertext), key) */
 char *xor_decrypt(const char *ciphertext, const char *key);
 
+/* same, allocating from `arena` when non-NULL (result owned by the arena) */
+char *xor_encrypt_ex(const char *plaintext, const char *key, mosaic_arena *arena);
+char *xor_decrypt_ex(const char *ciphertext, const char *key, mosaic_arena *arena);
+
 #endif
\ No newline at end of file
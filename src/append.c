@@ -0,0 +1,339 @@
+#define _POSIX_C_SOURCE 200809L /* pread(), pwrite(), clock_gettime() */
+
+#include "append.h"
+#include "mosaic.h"
+#include "xor_key.h"
+#include "lz.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TAIL_READ 4096          // first guess at the chars covering the last window
+#define SCAN_CHUNK (1u << 20)   // chars counted at a time in noisy streams
+
+static void wipe(void *p, size_t n){
+  volatile unsigned char *v = (volatile unsigned char *)p;
+  while(n--) *v++ = 0;
+}
+
+static double now_seconds(void){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static const mosaic_params *params_for(unsigned opts){
+  return (opts & MOSAIC_OPT_WIDE) ? mosaic_get_params_wide() : mosaic_get_params();
+}
+
+static int read_at(int fd, char *buf, size_t len, uint64_t off){
+  while(len){
+    ssize_t n = pread(fd, buf, len, (off_t)off);
+    if(n < 0 && errno == EINTR) continue;
+    if(n < 0) return -1;
+    if(n == 0){ errno = EILSEQ; return -1; } /* the file shrank under us */
+    buf += n;
+    len -= (size_t)n;
+    off += (uint64_t)n;
+  }
+  return 0;
+}
+
+static int write_at(int fd, const char *buf, size_t len, uint64_t off){
+  while(len){
+    ssize_t n = pwrite(fd, buf, len, (off_t)off);
+    if(n < 0 && errno == EINTR) continue;
+    if(n < 0) return -1;
+    buf += n;
+    len -= (size_t)n;
+    off += (uint64_t)n;
+  }
+  return 0;
+}
+
+/* bytes read, short only at the end of the input; (size_t)-1 on error */
+static size_t read_full(int fd, uint8_t *buf, size_t len){
+  size_t got = 0;
+  while(got < len){
+    ssize_t n = read(fd, buf + got, len - got);
+    if(n < 0 && errno == EINTR) continue;
+    if(n < 0) return (size_t)-1;
+    if(n == 0) break;
+    got += (size_t)n;
+  }
+  return got;
+}
+
+/* blocks before `end` in a noisy stream: each ends in the one terminator
+ * char it holds, and noise, checksums and marks never are one */
+static int count_blocks(int fd, uint64_t end, char term, uint64_t *blocks){
+  char *buf = malloc(SCAN_CHUNK);
+  if(!buf){ errno = ENOMEM; return -1; }
+  uint64_t n = 0;
+  for(uint64_t off = 0; off < end; ){
+    size_t len = end - off < SCAN_CHUNK ? (size_t)(end - off) : SCAN_CHUNK;
+    if(read_at(fd, buf, len, off) != 0){
+      free(buf);
+      return -1;
+    }
+    for(size_t i = 0; i < len; i++) n += buf[i] == term;
+    off += len;
+  }
+  free(buf);
+  *blocks = n;
+  return 0;
+}
+
+/* ---------------- The end of the stream ---------------- */
+
+/* where the new blocks go */
+typedef struct {
+  unsigned opts;
+  uint64_t payload;       // payload bytes in the stream (XOR key phase)
+  uint64_t cut;           // file offset the rewrite starts at
+  uint64_t base;          // payload offset of the first byte written there
+  uint8_t carry[MOSAIC_WIDE_WINDOW_BYTES]; // payload of the last window, re-encoded
+  size_t carry_len;
+} append_point;
+
+/* file offset of the last window's first block, k blocks before the
+ * trailer at buf[trailer]: just past the checksum that closes the window
+ * before it. 1 when found, 0 when buf does not reach back that far, -1 for
+ * a malformed stream. */
+static int find_window(const char *buf, size_t trailer, uint64_t buf_off, size_t k, char term,
+                       uint64_t *start){
+  size_t seen = 0;
+  for(size_t i = trailer; i-- > 0; ){
+    if(buf[i] != term || ++seen <= k) continue;
+    size_t j = i + 1; /* the checksum, maybe behind noise */
+    while(j < trailer && (islower((unsigned char)buf[j]) || isspace((unsigned char)buf[j]))) j++;
+    if(j >= trailer) return -1;
+    *start = buf_off + j + 1;
+    return 1;
+  }
+  return 0;
+}
+
+/* Reads back as much of the end of fd as the last window needs, decodes
+ * that window and fills *pt. `blocks` comes from the file size while the
+ * stream is compact and looks it; anything that does not add up falls back
+ * to counting the terminators. */
+static int find_point(int fd, uint64_t size, unsigned opts, append_point *pt){
+  memset(pt, 0, sizeof *pt);
+  pt->opts = opts;
+  if(size == 0) return 0;
+
+  char head[16];
+  size_t head_len = size < sizeof head ? (size_t)size : sizeof head;
+  if(read_at(fd, head, head_len, 0) != 0) return -1;
+  unsigned marks = mosaic_stream_opts(head, head_len);
+  uint64_t lead = 0;
+  while(lead < head_len && isspace((unsigned char)head[lead])) lead++;
+  lead += ((marks & MOSAIC_OPT_COMPACT) != 0) + ((marks & MOSAIC_OPT_WIDE) != 0) +
+          ((marks & MOSAIC_OPT_COMPRESS) != 0);
+
+  const mosaic_params *P = params_for(marks);
+  const uint64_t B = (uint64_t)P->block_bytes;
+  const size_t period = (size_t)P->checksum_period;
+  const uint64_t block_chars = (uint64_t)P->block_symbols + 1;
+  const uint64_t window_chars = block_chars * period + 1;
+
+  int counted = !(marks & MOSAIC_OPT_COMPACT), known = 0;
+  uint64_t blocks = 0;
+  size_t want = TAIL_READ;
+  char *buf = NULL;
+  uint8_t *out = NULL;
+  size_t out_cap = 0;
+  int rc = -1;
+
+  for(;;){
+    size_t len = size < want ? (size_t)size : want;
+    uint64_t buf_off = size - len;
+    free(buf);
+    buf = malloc(len);
+    if(!buf){ errno = ENOMEM; break; }
+    if(read_at(fd, buf, len, buf_off) != 0) break;
+
+    size_t end = len;
+    while(end && isspace((unsigned char)buf[end - 1])) end--;
+    if(end < 3 && buf_off){ want *= 2; continue; }
+    const char *pad_at = end >= 3 ? strchr(P->alphabet, buf[end - 1]) : NULL;
+    if(end < 3 || buf[end - 3] != P->term_char || buf[end - 2] != P->term_char ||
+       !pad_at || !*pad_at || (uint64_t)(pad_at - P->alphabet) >= B){
+      errno = EILSEQ;
+      break;
+    }
+    const uint64_t pad = (uint64_t)(pad_at - P->alphabet);
+    const size_t trailer = end - 3;
+
+    if(!known && !counted){
+      /* marks, whole windows, then up to period - 1 blocks */
+      const uint64_t at = buf_off + trailer;
+      uint64_t body = at - lead, rest = body % window_chars;
+      if(at >= lead && rest % block_chars == 0 && rest / block_chars < period){
+        blocks = body / window_chars * period + rest / block_chars;
+        known = 1;
+      } else {
+        counted = 1;
+      }
+    }
+    if(!known){
+      if(count_blocks(fd, buf_off + trailer, P->term_char, &blocks) != 0) break;
+      known = 1;
+    }
+
+    if(blocks == 0){
+      if(pad){ errno = EILSEQ; break; }
+      rc = 0; /* an empty stream: start over, with the caller's opts */
+      break;
+    }
+
+    /* the last window: k blocks, the last one padded */
+    const size_t k = (size_t)((blocks - 1) % period) + 1;
+    uint64_t start = lead;
+    if(blocks > k){
+      int f = find_window(buf, trailer, buf_off, k, P->term_char, &start);
+      if(f == 0 && buf_off){ want *= 2; continue; }
+      if(f <= 0 || (!counted && start != lead + (blocks - k) / period * window_chars)){
+        if(counted){ errno = EILSEQ; break; }
+        counted = 1;
+        known = 0;
+        continue;
+      }
+    } else if(buf_off > lead){
+      want *= 2;
+      continue;
+    }
+
+    size_t n = (size_t)(buf_off + end - start);
+    if(mosaic_decoder_bound(n) > out_cap){
+      if(out){ wipe(out, out_cap); free(out); }
+      out_cap = mosaic_decoder_bound(n);
+      out = malloc(out_cap);
+      if(!out){ out_cap = 0; errno = ENOMEM; break; }
+    }
+    mosaic_decoder d;
+    mosaic_decoder_init_at(&d, marks, (blocks - k) * B);
+    size_t w = mosaic_decoder_update(&d, buf + (start - buf_off), n, out, out_cap);
+    if(w == (size_t)-1 || mosaic_decoder_final(&d) != 0 || (uint64_t)w != k * B - pad){
+      if(counted){ errno = EILSEQ; break; }
+      counted = 1;
+      known = 0;
+      continue;
+    }
+
+    pt->opts = marks;
+    pt->payload = blocks * B - pad;
+    if(k == period && !pad){
+      /* a whole window ends the stream: only the trailer goes */
+      pt->cut = buf_off + trailer;
+      pt->base = blocks * B;
+    } else {
+      /* the first window also rewrites the marks */
+      pt->cut = blocks > k ? start : 0;
+      pt->base = (blocks - k) * B;
+      memcpy(pt->carry, out, w);
+      pt->carry_len = w;
+    }
+    rc = 0;
+    break;
+  }
+
+  free(buf);
+  if(out){ wipe(out, out_cap); free(out); }
+  return rc;
+}
+
+/* ---------------- Entry point ---------------- */
+
+int mosaic_append(int fd, int in_fd, const char *key, unsigned opts, mosaic_pipe_result *res){
+  if(fd < 0 || in_fd < 0){ errno = EINVAL; return -1; }
+  double t0 = now_seconds();
+
+  struct stat st;
+  if(fstat(fd, &st) != 0) return -1;
+  append_point pt;
+  if(find_point(fd, (uint64_t)st.st_size, opts, &pt) != 0) return -1;
+
+  const int keyed = key && *key;
+  const size_t chunk = MOSAIC_PIPE_CHUNK; /* one LZ frame at most */
+  const size_t z_cap = (pt.opts & MOSAIC_OPT_COMPRESS) ? mosaic_lz_bound(chunk) : 0;
+  const size_t out_cap = mosaic_encoder_bound(z_cap ? z_cap : chunk, pt.opts) +
+                         mosaic_encoder_bound(0, pt.opts); /* + final */
+  uint8_t *in = malloc(chunk);
+  uint8_t *z = z_cap ? malloc(z_cap) : NULL;
+  char *out = malloc(out_cap);
+  int rc = -1;
+  if(!in || !out || (z_cap && !z)){
+    errno = ENOMEM;
+    goto done;
+  }
+
+  mosaic_encoder e;
+  mosaic_encoder_init_at(&e, pt.opts, (uint64_t)time(NULL) ^ ((uint64_t)(uintptr_t)&e << 16),
+                         pt.base);
+  uint64_t pos = pt.cut, payload = pt.payload, bytes_in = 0;
+  /* less than a window: held in the encoder's carry, nothing written yet */
+  size_t w = mosaic_encoder_update(&e, pt.carry, pt.carry_len, out, out_cap);
+
+  for(;;){
+    size_t len = read_full(in_fd, in, chunk);
+    if(len == (size_t)-1) goto done;
+    const int last = len < chunk;
+    if(len){
+      uint8_t *p = in;
+      size_t n = len;
+      if(z){
+        n = mosaic_lz_compress(in, len, z, z_cap);
+        if(n == (size_t)-1){ errno = EINVAL; goto done; }
+        p = z;
+      }
+      if(keyed) xor_with_key_at(p, n, key, payload);
+      payload += n;
+      bytes_in += len;
+      size_t u = mosaic_encoder_update(&e, p, n, out + w, out_cap - w);
+      if(u == (size_t)-1){ errno = EINVAL; goto done; }
+      w += u;
+    }
+    if(last){
+      size_t t = mosaic_encoder_final(&e, out + w, out_cap - w);
+      if(t == (size_t)-1){ errno = EINVAL; goto done; }
+      w += t;
+      if(write_at(fd, out, w, pos) != 0) goto done;
+      pos += w;
+      break;
+    }
+    /* a provisional trailer, from a copy of the encoder, goes out with the
+     * blocks and is overwritten by the next chunk: while in_fd keeps us
+     * waiting, or if we die meanwhile, the file still decodes */
+    mosaic_encoder tmp = e;
+    size_t t = mosaic_encoder_final(&tmp, out + w, out_cap - w);
+    wipe(&tmp, sizeof tmp);
+    if(t == (size_t)-1){ errno = EINVAL; goto done; }
+    if(write_at(fd, out, w + t, pos) != 0 || ftruncate(fd, (off_t)(pos + w + t)) != 0) goto done;
+    pos += w;
+    w = 0;
+  }
+  /* a noisy window may come out shorter than the one it replaced */
+  if(ftruncate(fd, (off_t)pos) != 0) goto done;
+
+  if(res){
+    res->bytes_in = bytes_in;
+    res->bytes_out = pos - pt.cut;
+    res->seconds = now_seconds() - t0;
+    res->engine = MOSAIC_ENGINE_INLINE;
+  }
+  rc = 0;
+
+done:
+  wipe(&pt, sizeof pt);
+  if(in){ wipe(in, chunk); free(in); }
+  if(z){ wipe(z, z_cap); free(z); }
+  if(out){ wipe(out, out_cap); free(out); }
+  return rc;
+}
@@ -0,0 +1,99 @@
+#include "arena.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_ALIGN 16u
+#define ARENA_MAX_RETAINED ((size_t)1 << 20) /* don't hold on to huge one-offs */
+
+struct mosaic_arena_chunk {
+  mosaic_arena_chunk *next;
+  size_t cap;
+  size_t used;
+  /* keeps data[] 16-byte aligned on common ABIs */
+  size_t pad_;
+  unsigned char data[];
+};
+
+static void zero_bytes(void *v, size_t n){
+  volatile unsigned char *p = (volatile unsigned char *)v;
+  while(n--) *p++ = 0;
+}
+
+static mosaic_arena_chunk *new_chunk(size_t cap){
+  mosaic_arena_chunk *c = (mosaic_arena_chunk*)malloc(sizeof(*c) + cap);
+  if(!c) return NULL;
+  c->next = NULL;
+  c->cap = cap;
+  c->used = 0;
+  return c;
+}
+
+void mosaic_arena_init(mosaic_arena *a, size_t chunk_size){
+  if(!a) return;
+  a->head = NULL;
+  a->chunk_size = chunk_size ? chunk_size : 4096;
+}
+
+void *mosaic_arena_alloc(mosaic_arena *a, size_t n){
+  if(!a) return NULL;
+  if(n == 0) n = 1;
+  if(n > SIZE_MAX - ARENA_ALIGN) return NULL;
+  n = (n + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+  mosaic_arena_chunk *c = a->head;
+  if(!c || c->cap - c->used < n){
+    size_t cap = n > a->chunk_size ? n : a->chunk_size;
+    mosaic_arena_chunk *fresh = new_chunk(cap);
+    if(!fresh) return NULL;
+    fresh->next = c;
+    a->head = c = fresh;
+  }
+  void *p = c->data + c->used;
+  c->used += n;
+  return p;
+}
+
+char *mosaic_arena_strdup(mosaic_arena *a, const char *s){
+  if(!s) return NULL;
+  size_t n = strlen(s) + 1;
+  char *r = (char*)mosaic_arena_alloc(a, n);
+  if(r) memcpy(r, s, n);
+  return r;
+}
+
+void mosaic_arena_reset(mosaic_arena *a){
+  if(!a || !a->head) return;
+
+  size_t total = 0;
+  for(mosaic_arena_chunk *c = a->head; c; c = c->next){
+    zero_bytes(c->data, c->used);
+    c->used = 0;
+    total += c->cap;
+  }
+  if(!a->head->next) return;
+
+  /* it took several chunks: swap them for one that fits next time */
+  mosaic_arena_chunk *c = a->head;
+  while(c){
+    mosaic_arena_chunk *next = c->next;
+    free(c);
+    c = next;
+  }
+  a->head = new_chunk(total < ARENA_MAX_RETAINED ? total : a->chunk_size);
+}
+
+void mosaic_arena_free(mosaic_arena *a){
+  if(!a) return;
+  mosaic_arena_reset(a);
+  free(a->head);
+  a->head = NULL;
+}
+
+void *mosaic_alloc(mosaic_arena *a, size_t n){
+  return a ? mosaic_arena_alloc(a, n) : malloc(n);
+}
+
+void mosaic_release(mosaic_arena *a, void *p){
+  if(!a) free(p);
+}
@@ -0,0 +1,770 @@
+#define _GNU_SOURCE /* mkstemp(), realpath(), pread()/pwrite() */
+
+#include "bulk.h"
+#include "mosaic.h"
+#include "xor_key.h"
+
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/* temporary results; never picked up by the walk */
+#define TMP_PREFIX ".mosaic-tmp-"
+#define MAX_WORKERS 256
+
+static void wipe(void *p, size_t n){
+  volatile unsigned char *v = (volatile unsigned char *)p;
+  while(n--) *v++ = 0;
+}
+
+static double now_seconds(void){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static char *join_path(const char *dir, const char *name, const char *suffix){
+  size_t a = strlen(dir), b = strlen(name), c = strlen(suffix);
+  char *p = malloc(a + b + c + 2);
+  if(!p) return NULL;
+  memcpy(p, dir, a);
+  p[a] = '/';
+  memcpy(p + a + 1, name, b);
+  memcpy(p + a + 1 + b, suffix, c + 1);
+  return p;
+}
+
+static int has_suffix(const char *name, const char *suffix){
+  size_t a = strlen(name), b = strlen(suffix);
+  return a > b && strcmp(name + a - b, suffix) == 0;
+}
+
+/* ---------------- Tasks ---------------- */
+
+enum { TASK_DIR, TASK_FILE, TASK_SIZE, TASK_PART };
+
+/* a file cut into parts. Encoding runs two phases of one task per part:
+ * SIZE predicts each part's output, and once all are in, PART tasks write
+ * at the offsets they add up to. Decoding knows the offsets up front; if a
+ * part finds no stream where the layout put one, the file is redone whole. */
+typedef struct {
+  char *src, *dst, *tmp;
+  int in_fd, out_fd;
+  unsigned opts;              // encode options, or the stream's marks
+  mode_t mode;                // of the source, for the result
+  uint64_t in_size;
+  uint64_t lead;              // decode: mark chars before the first block
+  uint64_t part_in;           // input bytes (encode) or chars (decode) per part
+  uint64_t part_out;          // decode: plaintext bytes per whole part
+  size_t n_parts;
+  uint64_t seed;              // part k draws its noise from seed + k
+  uint64_t *out_at;           // encode: n_parts + 1 output offsets
+  pthread_mutex_t lock;       // guards left and err
+  size_t left;                // tasks of the current phase still to finish
+  int err;
+  uint64_t bytes_in, bytes_out; // of the parts done, counted once f is
+} bulk_file;
+
+typedef struct {
+  int kind;
+  char *src;                  // DIR, FILE
+  char *dst;                  // DIR: output directory; FILE: result path
+  bulk_file *file;            // SIZE, PART
+  size_t part;
+} bulk_task;
+
+/* a worker's tasks: a ring, newest at the back */
+typedef struct {
+  bulk_task **items;
+  size_t cap, head, count;
+  pthread_mutex_t lock;
+} task_deque;
+
+static int deque_push(task_deque *q, bulk_task *t){
+  pthread_mutex_lock(&q->lock);
+  if(q->count == q->cap){
+    size_t cap = q->cap ? q->cap * 2 : 64;
+    bulk_task **items = malloc(cap * sizeof *items);
+    if(!items){
+      pthread_mutex_unlock(&q->lock);
+      return -1;
+    }
+    for(size_t i = 0; i < q->count; i++) items[i] = q->items[(q->head + i) % q->cap];
+    free(q->items);
+    q->items = items;
+    q->cap = cap;
+    q->head = 0;
+  }
+  q->items[(q->head + q->count) % q->cap] = t;
+  q->count++;
+  pthread_mutex_unlock(&q->lock);
+  return 0;
+}
+
+/* the owner takes its newest task, a thief the oldest */
+static bulk_task *deque_take(task_deque *q, int oldest){
+  bulk_task *t = NULL;
+  pthread_mutex_lock(&q->lock);
+  if(q->count){
+    if(oldest){
+      t = q->items[q->head];
+      q->head = (q->head + 1) % q->cap;
+    } else {
+      t = q->items[(q->head + q->count - 1) % q->cap];
+    }
+    q->count--;
+  }
+  pthread_mutex_unlock(&q->lock);
+  return t;
+}
+
+/* ---------------- Pool ---------------- */
+
+typedef struct bulk_pool bulk_pool;
+
+typedef struct {
+  bulk_pool *pool;
+  int id;
+  task_deque q;
+  pthread_t thread;
+  uint8_t *in, *out;          // part I/O buffers
+  size_t out_cap;
+  uint64_t files, skipped, bytes_in, bytes_out, started;
+} bulk_worker;
+
+struct bulk_pool {
+  const mosaic_bulk_config *cfg;
+  int in_place;
+  uint64_t split;
+  uint64_t seed;
+  bulk_worker *workers;
+  int n_workers;
+  pthread_mutex_t lock;       // guards everything below
+  pthread_cond_t wake;
+  size_t pending;             // tasks queued or running
+  uint64_t gen;               // bumped by every push, so sleepers miss none
+  int sleepers;
+  mosaic_bulk_error *errors;
+  size_t n_errors, errors_cap;
+};
+
+static void record_error(bulk_pool *p, const char *path, int err){
+  pthread_mutex_lock(&p->lock);
+  if(p->n_errors == p->errors_cap){
+    size_t cap = p->errors_cap ? p->errors_cap * 2 : 16;
+    mosaic_bulk_error *e = realloc(p->errors, cap * sizeof *e);
+    if(e){
+      p->errors = e;
+      p->errors_cap = cap;
+    }
+  }
+  if(p->n_errors < p->errors_cap){
+    p->errors[p->n_errors].path = strdup(path);
+    p->errors[p->n_errors].err = err ? err : EIO;
+    if(p->errors[p->n_errors].path) p->n_errors++;
+  }
+  pthread_mutex_unlock(&p->lock);
+}
+
+static void free_task(bulk_task *t){
+  free(t->src);
+  free(t->dst);
+  free(t);
+}
+
+/* queues a task on w and takes ownership of src and dst, even on failure.
+ * A failed DIR or FILE task is recorded here; a part's caller deals with it. */
+static int push_task(bulk_worker *w, int kind, char *src, char *dst, bulk_file *f, size_t part){
+  bulk_pool *p = w->pool;
+  bulk_task *t = malloc(sizeof *t);
+  if(!t || !(f || (src && dst))) goto fail;
+  t->kind = kind;
+  t->src = src;
+  t->dst = dst;
+  t->file = f;
+  t->part = part;
+
+  /* counted before it can be stolen, so pending never dips to 0 early */
+  pthread_mutex_lock(&p->lock);
+  p->pending++;
+  pthread_mutex_unlock(&p->lock);
+  if(deque_push(&w->q, t) != 0){
+    pthread_mutex_lock(&p->lock);
+    p->pending--;
+    pthread_mutex_unlock(&p->lock);
+    goto fail;
+  }
+
+  pthread_mutex_lock(&p->lock);
+  p->gen++;
+  if(p->sleepers) pthread_cond_signal(&p->wake);
+  pthread_mutex_unlock(&p->lock);
+  return 0;
+
+fail:
+  if(!f) record_error(p, src ? src : "?", ENOMEM);
+  free(t);
+  free(src);
+  free(dst);
+  return -1;
+}
+
+/* ---------------- Whole files ---------------- */
+
+/* a fresh temporary file next to where dst will go */
+static int open_temp(const char *dst, mode_t mode, char **tmp_path){
+  const char *slash = strrchr(dst, '/');
+  size_t dir = slash ? (size_t)(slash - dst) + 1 : 0;
+  char *tmp = malloc(dir + sizeof(TMP_PREFIX "XXXXXX"));
+  if(!tmp){ errno = ENOMEM; return -1; }
+  memcpy(tmp, dst, dir);
+  memcpy(tmp + dir, TMP_PREFIX "XXXXXX", sizeof(TMP_PREFIX "XXXXXX"));
+  int fd = mkstemp(tmp);
+  if(fd < 0){
+    free(tmp);
+    return -1;
+  }
+  fchmod(fd, mode & 0777);
+  *tmp_path = tmp;
+  return fd;
+}
+
+/* the result is complete: move it into place */
+static int commit(int out_fd, const char *tmp, const char *dst, int err){
+  if(close(out_fd) != 0 && !err) err = errno;
+  if(!err && rename(tmp, dst) != 0) err = errno;
+  if(err) unlink(tmp);
+  return err;
+}
+
+static void run_whole(bulk_worker *w, const char *src, const char *dst, int in_fd, mode_t mode){
+  bulk_pool *p = w->pool;
+  char *tmp;
+  int out_fd = open_temp(dst, mode, &tmp);
+  if(out_fd < 0){
+    record_error(p, src, errno);
+    return;
+  }
+
+  mosaic_pipe_config cfg = { p->cfg->mode, p->cfg->opts, p->cfg->key, MOSAIC_BULK_PIECE, 1,
+                             MOSAIC_ENGINE_INLINE };
+  mosaic_pipe_result res;
+  int err = mosaic_pipe_run(in_fd, out_fd, &cfg, &res) == 0 ? 0 : errno;
+  err = commit(out_fd, tmp, dst, err);
+  free(tmp);
+  if(err){
+    record_error(p, src, err);
+    return;
+  }
+  w->files++;
+  w->bytes_in += res.bytes_in;
+  w->bytes_out += res.bytes_out;
+}
+
+/* ---------------- Parts ---------------- */
+
+static int read_full(int fd, uint8_t *buf, size_t n, uint64_t at){
+  size_t got = 0;
+  while(got < n){
+    ssize_t r = pread(fd, buf + got, n - got, (off_t)(at + got));
+    if(r < 0 && errno == EINTR) continue;
+    if(r <= 0) return r < 0 ? errno : EIO; /* the file shrank under us */
+    got += (size_t)r;
+  }
+  return 0;
+}
+
+static int write_full(int fd, const uint8_t *buf, size_t n, uint64_t at){
+  size_t done = 0;
+  while(done < n){
+    ssize_t r = pwrite(fd, buf + done, n - done, (off_t)(at + done));
+    if(r < 0 && errno == EINTR) continue;
+    if(r < 0) return errno;
+    done += (size_t)r;
+  }
+  return 0;
+}
+
+static void free_file(bulk_file *f){
+  pthread_mutex_destroy(&f->lock);
+  free(f->src);
+  free(f->dst);
+  free(f->tmp);
+  free(f->out_at);
+  free(f);
+}
+
+/* one task of f's current phase is done; the last one moves f on */
+static void part_done(bulk_worker *w, bulk_file *f, int err, int sizing){
+  pthread_mutex_lock(&f->lock);
+  if(err && !f->err) f->err = err;
+  int last = --f->left == 0;
+  if(last && sizing && !f->err) f->left = f->n_parts;
+  err = f->err;
+  pthread_mutex_unlock(&f->lock);
+  if(!last) return;
+
+  if(sizing && !err){
+    /* every part's size is in: turn them into offsets and start writing */
+    for(size_t k = 0; k < f->n_parts; k++) f->out_at[k + 1] += f->out_at[k];
+    /* f may be gone once the last part is queued: count on a copy */
+    size_t n = f->n_parts;
+    for(size_t k = 0; k < n; k++){
+      if(push_task(w, TASK_PART, NULL, NULL, f, k) != 0) part_done(w, f, ENOMEM, 0);
+    }
+    return;
+  }
+
+  if(err == EILSEQ && w->pool->cfg->mode == MOSAIC_PIPE_DECODE){
+    /* whitespace or noise that moved the windows off their fixed offsets
+     * (or real damage): the whole-file decoder reads the stream the noisy
+     * way, and is the one to report what is wrong with it */
+    close(f->out_fd);
+    unlink(f->tmp);
+    if(lseek(f->in_fd, 0, SEEK_SET) == 0){
+      run_whole(w, f->src, f->dst, f->in_fd, f->mode);
+    } else {
+      record_error(w->pool, f->src, errno);
+    }
+    close(f->in_fd);
+    free_file(f);
+    return;
+  }
+
+  close(f->in_fd);
+  err = commit(f->out_fd, f->tmp, f->dst, err);
+  if(err){
+    record_error(w->pool, f->src, err);
+  } else {
+    w->files++;
+    w->bytes_in += f->bytes_in;
+    w->bytes_out += f->bytes_out;
+  }
+  free_file(f);
+}
+
+static uint64_t part_len(const bulk_file *f, size_t k){
+  uint64_t start = f->lead + (uint64_t)k * f->part_in;
+  return k + 1 == f->n_parts ? f->in_size - start : f->part_in;
+}
+
+static void run_size(bulk_worker *w, bulk_file *f, size_t k){
+  mosaic_encoder e;
+  mosaic_encoder_init_at(&e, f->opts, f->seed + k, (uint64_t)k * f->part_in);
+  f->out_at[k + 1] = mosaic_encoder_predict(&e, part_len(f, k), k + 1 == f->n_parts);
+  part_done(w, f, 0, 1);
+}
+
+static int encode_part(bulk_worker *w, bulk_file *f, size_t k, uint64_t *in, uint64_t *out){
+  const char *key = w->pool->cfg->key;
+  const int last = k + 1 == f->n_parts;
+  uint64_t off = (uint64_t)k * f->part_in, end = off + part_len(f, k);
+  uint64_t at = f->out_at[k];
+  mosaic_encoder e;
+  mosaic_encoder_init_at(&e, f->opts, f->seed + k, off);
+
+  while(off < end){
+    size_t n = end - off < MOSAIC_BULK_PIECE ? (size_t)(end - off) : MOSAIC_BULK_PIECE;
+    int err = read_full(f->in_fd, w->in, n, off);
+    if(err) return err;
+    if(key && *key) xor_with_key_at(w->in, n, key, off);
+    size_t o = mosaic_encoder_update(&e, w->in, n, (char*)w->out, w->out_cap);
+    if(o == (size_t)-1) return EINVAL;
+    if((err = write_full(f->out_fd, w->out, o, at)) != 0) return err;
+    *in += n;
+    *out += o;
+    at += o;
+    off += n;
+  }
+  if(last){
+    size_t o = mosaic_encoder_final(&e, (char*)w->out, w->out_cap);
+    if(o == (size_t)-1) return EINVAL;
+    int err = write_full(f->out_fd, w->out, o, at);
+    if(err) return err;
+    *out += o;
+    at += o;
+  }
+  return at == f->out_at[k + 1] ? 0 : EIO; /* the prediction must hold */
+}
+
+static int decode_part(bulk_worker *w, bulk_file *f, size_t k, uint64_t *in, uint64_t *out){
+  const char *key = w->pool->cfg->key;
+  uint64_t off = f->lead + (uint64_t)k * f->part_in, end = off + part_len(f, k);
+  uint64_t at = (uint64_t)k * f->part_out;
+  mosaic_decoder d;
+  mosaic_decoder_init_at(&d, f->opts, at);
+
+  for(int tail = 0; off < end || !tail;){
+    size_t n = 0, o;
+    if(off < end){
+      n = end - off < MOSAIC_BULK_PIECE ? (size_t)(end - off) : MOSAIC_BULK_PIECE;
+      int err = read_full(f->in_fd, w->in, n, off);
+      if(err) return err;
+      o = mosaic_decoder_update(&d, (const char*)w->in, n, w->out, w->out_cap);
+    } else {
+      /* the end of the part: the trailer, or the block held back for it */
+      tail = 1;
+      if(k + 1 == f->n_parts) o = mosaic_decoder_final(&d) == 0 ? 0 : (size_t)-1;
+      else o = mosaic_decoder_flush(&d, w->out, w->out_cap);
+    }
+    if(o == (size_t)-1) return EILSEQ;
+    if(key && *key) xor_with_key_at(w->out, o, key, at);
+    int err = write_full(f->out_fd, w->out, o, at);
+    if(err) return err;
+    *in += n;
+    *out += o;
+    at += o;
+    off += n;
+  }
+  if(k + 1 < f->n_parts && at != (uint64_t)(k + 1) * f->part_out) return EILSEQ;
+  return 0;
+}
+
+static void run_part(bulk_worker *w, bulk_file *f, size_t k){
+  pthread_mutex_lock(&f->lock);
+  int err = f->err; /* a part already failed: the file is lost anyway */
+  pthread_mutex_unlock(&f->lock);
+  if(!err){
+    uint64_t in = 0, out = 0;
+    err = w->pool->cfg->mode == MOSAIC_PIPE_ENCODE ? encode_part(w, f, k, &in, &out)
+                                                   : decode_part(w, f, k, &in, &out);
+    pthread_mutex_lock(&f->lock);
+    f->bytes_in += in;
+    f->bytes_out += out;
+    pthread_mutex_unlock(&f->lock);
+  }
+  part_done(w, f, err, 0);
+}
+
+/* how a file splits, or 0 parts when it is better done whole */
+static size_t plan_parts(bulk_pool *p, bulk_file *f){
+  const mosaic_params *P = (f->opts & MOSAIC_OPT_WIDE) ? mosaic_get_params_wide() : mosaic_get_params();
+  uint64_t win = (uint64_t)P->block_bytes * (uint64_t)P->checksum_period;
+  uint64_t windows = p->split / win ? p->split / win : 1;
+
+  if(p->cfg->mode == MOSAIC_PIPE_ENCODE){
+    f->part_in = windows * win;
+    if(f->in_size <= f->part_in) return 0;
+    return (size_t)((f->in_size + f->part_in - 1) / f->part_in);
+  }
+
+  /* compact windows are window_chars apart; the last part keeps at least
+   * a window and the trailer, so the pad always lands in it */
+  uint64_t window_chars = (uint64_t)(P->block_symbols + 1) * (uint64_t)P->checksum_period + 1;
+  f->part_in = windows * window_chars;
+  f->part_out = windows * win;
+  uint64_t body = f->in_size - f->lead;
+  if(body < f->part_in + window_chars + 3) return 0;
+  return (size_t)(1 + (body - window_chars - 3) / f->part_in);
+}
+
+/* decoding splits only plain compact streams with the marks right at the
+ * start and nothing but whole blocks and the trailer after them, trailing
+ * whitespace aside; *lead gets the marks' length. Anything else is decoded
+ * whole: whitespace or noise inside would move the windows off the offsets
+ * the parts are cut at. */
+static unsigned stream_marks(int fd, uint64_t size, uint64_t *lead){
+  char head[4], tail[64];
+  ssize_t n = pread(fd, head, sizeof head, 0);
+  if(n <= 0 || isspace((unsigned char)head[0])) return 0;
+  unsigned opts = mosaic_stream_opts(head, (size_t)n);
+  *lead = ((opts & MOSAIC_OPT_COMPACT) != 0) + ((opts & MOSAIC_OPT_WIDE) != 0) +
+          ((opts & MOSAIC_OPT_COMPRESS) != 0);
+  if(!(opts & MOSAIC_OPT_COMPACT)) return opts;
+
+  size_t t = size < sizeof tail ? (size_t)size : sizeof tail;
+  if(pread(fd, tail, t, (off_t)(size - t)) != (ssize_t)t) return 0;
+  uint64_t end = size;
+  while(t && isspace((unsigned char)tail[t - 1])){ t--; end--; }
+  const mosaic_params *P = (opts & MOSAIC_OPT_WIDE) ? mosaic_get_params_wide() : mosaic_get_params();
+  const uint64_t block_chars = (uint64_t)P->block_symbols + 1;
+  const uint64_t window_chars = block_chars * (uint64_t)P->checksum_period + 1;
+  if(!t || end < *lead + 3) return 0;
+  uint64_t rest = (end - *lead - 3) % window_chars;
+  if(rest % block_chars != 0 || rest / block_chars >= (uint64_t)P->checksum_period) return 0;
+  return opts;
+}
+
+static void run_file(bulk_worker *w, bulk_task *t){
+  bulk_pool *p = w->pool;
+  int in_fd = open(t->src, O_RDONLY);
+  struct stat st;
+  if(in_fd < 0 || fstat(in_fd, &st) != 0){
+    record_error(p, t->src, errno);
+    if(in_fd >= 0) close(in_fd);
+    return;
+  }
+
+  bulk_file *f = calloc(1, sizeof *f);
+  size_t parts = 0;
+  if(f){
+    f->in_size = (uint64_t)st.st_size;
+    if(p->cfg->mode == MOSAIC_PIPE_ENCODE){
+      f->opts = p->cfg->opts;
+      if(!(f->opts & MOSAIC_OPT_COMPRESS)) parts = plan_parts(p, f);
+    } else {
+      f->opts = stream_marks(in_fd, f->in_size, &f->lead);
+      if((f->opts & MOSAIC_OPT_COMPACT) && !(f->opts & MOSAIC_OPT_COMPRESS)) parts = plan_parts(p, f);
+    }
+  }
+  if(parts < 2){
+    free(f);
+    run_whole(w, t->src, t->dst, in_fd, st.st_mode);
+    close(in_fd);
+    return;
+  }
+
+  f->in_fd = in_fd;
+  f->mode = st.st_mode;
+  f->n_parts = parts;
+  f->seed = p->seed ^ ((uint64_t)w->id << 48) ^ (w->started++ << 24);
+  f->out_at = calloc(parts + 1, sizeof *f->out_at);
+  f->out_fd = f->out_at ? open_temp(t->dst, st.st_mode, &f->tmp) : -1;
+  if(f->out_fd < 0){
+    record_error(p, t->src, f->out_at ? errno : ENOMEM);
+    close(in_fd);
+    free(f->out_at);
+    free(f);
+    return;
+  }
+  pthread_mutex_init(&f->lock, NULL);
+  f->left = parts;
+  f->src = t->src;
+  f->dst = t->dst;
+  t->src = t->dst = NULL;
+
+  int kind = p->cfg->mode == MOSAIC_PIPE_ENCODE ? TASK_SIZE : TASK_PART;
+  for(size_t k = 0; k < parts; k++){
+    if(push_task(w, kind, NULL, NULL, f, k) != 0) part_done(w, f, ENOMEM, kind == TASK_SIZE);
+  }
+}
+
+/* ---------------- Directories ---------------- */
+
+static int wanted(const bulk_pool *p, const char *name){
+  if(strncmp(name, TMP_PREFIX, sizeof(TMP_PREFIX) - 1) == 0) return 0;
+  return has_suffix(name, MOSAIC_BULK_SUFFIX) == (p->cfg->mode == MOSAIC_PIPE_DECODE);
+}
+
+static void run_dir(bulk_worker *w, bulk_task *t){
+  bulk_pool *p = w->pool;
+  if(!p->in_place && mkdir(t->dst, 0755) != 0 && errno != EEXIST){
+    record_error(p, t->src, errno);
+    return;
+  }
+  DIR *d = opendir(t->src);
+  if(!d){
+    record_error(p, t->src, errno);
+    return;
+  }
+
+  struct dirent *e;
+  while((e = readdir(d)) != NULL){
+    const char *name = e->d_name;
+    if(strcmp(name, ".") == 0 || strcmp(name, "..") == 0) continue;
+    char *src = join_path(t->src, name, "");
+    struct stat st;
+    if(!src || lstat(src, &st) != 0){
+      record_error(p, src ? src : t->src, src ? errno : ENOMEM);
+      free(src);
+      continue;
+    }
+
+    if(S_ISDIR(st.st_mode)){
+      push_task(w, TASK_DIR, src, join_path(t->dst, name, ""), NULL, 0);
+    } else if(S_ISREG(st.st_mode) && wanted(p, name)){
+      char *dst;
+      if(p->cfg->mode == MOSAIC_PIPE_ENCODE){
+        dst = join_path(t->dst, name, MOSAIC_BULK_SUFFIX);
+      } else {
+        dst = join_path(t->dst, name, "");
+        if(dst) dst[strlen(dst) - (sizeof(MOSAIC_BULK_SUFFIX) - 1)] = '\0';
+      }
+      push_task(w, TASK_FILE, src, dst, NULL, 0);
+    } else {
+      w->skipped++;
+      free(src);
+    }
+  }
+  closedir(d);
+}
+
+/* ---------------- Workers ---------------- */
+
+static bulk_task *next_task(bulk_worker *w){
+  bulk_pool *p = w->pool;
+  bulk_task *t = deque_take(&w->q, 0);
+  for(int i = 1; !t && i < p->n_workers; i++){
+    t = deque_take(&p->workers[(w->id + i) % p->n_workers].q, 1);
+  }
+  return t;
+}
+
+static void *worker_main(void *arg){
+  bulk_worker *w = arg;
+  bulk_pool *p = w->pool;
+  for(;;){
+    pthread_mutex_lock(&p->lock);
+    uint64_t gen = p->gen;
+    pthread_mutex_unlock(&p->lock);
+
+    bulk_task *t = next_task(w);
+    if(t){
+      switch(t->kind){
+      case TASK_DIR:  run_dir(w, t); break;
+      case TASK_FILE: run_file(w, t); break;
+      case TASK_SIZE: run_size(w, t->file, t->part); break;
+      default:        run_part(w, t->file, t->part); break;
+      }
+      free_task(t);
+      pthread_mutex_lock(&p->lock);
+      if(--p->pending == 0) pthread_cond_broadcast(&p->wake);
+      pthread_mutex_unlock(&p->lock);
+      continue;
+    }
+
+    /* nothing to take: done once nothing is running either, else wait
+     * for a push (unless one came in while we looked) */
+    pthread_mutex_lock(&p->lock);
+    if(p->pending == 0){
+      pthread_mutex_unlock(&p->lock);
+      return NULL;
+    }
+    if(p->gen == gen){
+      p->sleepers++;
+      pthread_cond_wait(&p->wake, &p->lock);
+      p->sleepers--;
+    }
+    pthread_mutex_unlock(&p->lock);
+  }
+}
+
+/* ---------------- Entry point ---------------- */
+
+int mosaic_bulk_run(const char *src_dir, const char *dst_dir, const mosaic_bulk_config *cfg,
+                    mosaic_bulk_result *res){
+  if(!res){ errno = EINVAL; return -1; }
+  memset(res, 0, sizeof *res);
+  if(!src_dir || !dst_dir || !cfg){ errno = EINVAL; return -1; }
+
+  struct stat st;
+  if(stat(src_dir, &st) != 0) return -1;
+  if(!S_ISDIR(st.st_mode)){ errno = ENOTDIR; return -1; }
+  if(mkdir(dst_dir, 0755) != 0 && errno != EEXIST) return -1;
+
+  /* a mirror inside its own source would be walked into forever */
+  char *src_real = realpath(src_dir, NULL), *dst_real = realpath(dst_dir, NULL);
+  if(!src_real || !dst_real){
+    int e = errno;
+    free(src_real);
+    free(dst_real);
+    errno = e;
+    return -1;
+  }
+  size_t sl = strlen(src_real);
+  int in_place = strcmp(src_real, dst_real) == 0;
+  int inside = !in_place && strncmp(dst_real, src_real, sl) == 0 &&
+               (dst_real[sl] == '/' || (sl == 1 && src_real[0] == '/'));
+  free(src_real);
+  free(dst_real);
+  if(inside){ errno = EINVAL; return -1; }
+
+  bulk_pool p;
+  memset(&p, 0, sizeof p);
+  p.cfg = cfg;
+  p.in_place = in_place;
+  p.split = cfg->split_size ? cfg->split_size : MOSAIC_BULK_SPLIT;
+  p.seed = (uint64_t)time(NULL) ^ ((uint64_t)(uintptr_t)&p << 16);
+  p.n_workers = cfg->threads > 0 ? cfg->threads : (int)sysconf(_SC_NPROCESSORS_ONLN);
+  if(p.n_workers < 1) p.n_workers = 1;
+  if(p.n_workers > MAX_WORKERS) p.n_workers = MAX_WORKERS;
+
+  size_t enc_cap = mosaic_encoder_bound(MOSAIC_BULK_PIECE, cfg->opts) + mosaic_encoder_bound(0, cfg->opts);
+  size_t dec_cap = mosaic_decoder_bound(MOSAIC_BULK_PIECE);
+  size_t out_cap = enc_cap > dec_cap ? enc_cap : dec_cap;
+  p.workers = calloc((size_t)p.n_workers, sizeof *p.workers);
+  int ok = p.workers != NULL;
+  for(int i = 0; ok && i < p.n_workers; i++){
+    bulk_worker *w = &p.workers[i];
+    w->pool = &p;
+    w->id = i;
+    w->in = malloc(MOSAIC_BULK_PIECE);
+    w->out = malloc(out_cap);
+    w->out_cap = out_cap;
+    pthread_mutex_init(&w->q.lock, NULL);
+    ok = w->in && w->out;
+  }
+  char *top_src = strdup(src_dir), *top_dst = strdup(dst_dir);
+  if(!ok || !top_src || !top_dst){
+    if(p.workers){
+      for(int i = 0; i < p.n_workers; i++){
+        free(p.workers[i].in);
+        free(p.workers[i].out);
+      }
+    }
+    free(p.workers);
+    free(top_src);
+    free(top_dst);
+    errno = ENOMEM;
+    return -1;
+  }
+  pthread_mutex_init(&p.lock, NULL);
+  pthread_cond_init(&p.wake, NULL);
+
+  double t0 = now_seconds();
+  push_task(&p.workers[0], TASK_DIR, top_src, top_dst, NULL, 0);
+
+  /* the calling thread is worker 0; a worker whose thread will not start
+   * just never runs, and its (empty) deque is never pushed to */
+  int *started = calloc((size_t)p.n_workers, sizeof *started);
+  for(int i = 1; started && i < p.n_workers; i++){
+    started[i] = pthread_create(&p.workers[i].thread, NULL, worker_main, &p.workers[i]) == 0;
+  }
+  worker_main(&p.workers[0]);
+  res->threads = 1;
+  for(int i = 1; started && i < p.n_workers; i++){
+    if(started[i]){
+      pthread_join(p.workers[i].thread, NULL);
+      res->threads++;
+    }
+  }
+  free(started);
+  res->seconds = now_seconds() - t0;
+
+  for(int i = 0; i < p.n_workers; i++){
+    bulk_worker *w = &p.workers[i];
+    res->files += w->files;
+    res->skipped += w->skipped;
+    res->bytes_in += w->bytes_in;
+    res->bytes_out += w->bytes_out;
+    /* either buffer may hold plaintext */
+    wipe(w->in, MOSAIC_BULK_PIECE);
+    wipe(w->out, w->out_cap);
+    free(w->in);
+    free(w->out);
+    free(w->q.items);
+    pthread_mutex_destroy(&w->q.lock);
+  }
+  free(p.workers);
+  pthread_mutex_destroy(&p.lock);
+  pthread_cond_destroy(&p.wake);
+  res->errors = p.errors;
+  res->n_errors = p.n_errors;
+  return 0;
+}
+
+void mosaic_bulk_result_free(mosaic_bulk_result *res){
+  if(!res) return;
+  for(size_t i = 0; i < res->n_errors; i++) free(res->errors[i].path);
+  free(res->errors);
+  res->errors = NULL;
+  res->n_errors = 0;
+}
@@ -1,7 +1,14 @@
+#define _POSIX_C_SOURCE 200809L /* strdup */
+
 #include "cli.h"
 #include "util.h"
 #include "mosaic.h"
 #include "xor_key.h"
+#include "stats.h"
+#include "pipeline.h"
+#include "bulk.h"
+#include "search.h"
+#include "append.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -10,8 +17,12 @@
 #include <stdbool.h>
 #include <time.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #define INPUT_SIZE 4096
+#define CMD_ARENA_SIZE (4 * INPUT_SIZE) /* a full line, its ciphertext and scratch */
+#define MAX_DAMAGE_REPORT 16
 
 typedef enum {
   CIPHER_MOSAIC,
@@ -21,7 +32,12 @@ typedef enum {
 /* globals (session state) */
 static CipherType current_cipher = CIPHER_MOSAIC;
 static char *current_key = NULL; /* session key (may be NULL) */
+static unsigned current_opts = 0u; /* mosaic encode options (MOSAIC_OPT_*) */
 static bool should_exit = false;
+static bool cmd_failed = false; /* set by a handler whose command did not succeed */
+
+/* everything a single command allocates; wiped and rewound after each line */
+static mosaic_arena cmd_arena = { NULL, CMD_ARENA_SIZE };
 
 /* ---------- helpers for safer allocation / zeroing ---------- */
 
@@ -38,9 +54,9 @@ static char *xstrdup(const char *s){
   return r;
 }
 
-static void *xmalloc(size_t n){
-  void *p = malloc(n);
-  if(!p) oom_abort("malloc");
+static void *cmd_alloc(size_t n){
+  void *p = mosaic_arena_alloc(&cmd_arena, n);
+  if(!p) oom_abort("arena");
   return p;
 }
 
@@ -51,18 +67,6 @@ static void secure_memzero(void *v, size_t n){
   while(n--) *p++ = 0;
 }
 
-/* free both args (safe for NULL) and set pointers to NULL */
-static void free_pair(char **a1, char **a2){
-  if(a1 && *a1){
-    free(*a1);
-    *a1 = NULL;
-  }
-  if(a2 && *a2){
-    free(*a2);
-    *a2 = NULL;
-  }
-}
-
 /* -------------------- banner -------------------- */
 
 void print_banner(void){
@@ -101,7 +105,7 @@ static void set_cli_key(const char *k){
 
 /* Helper to extract one token (supports single/double quotes)
  * Advances *in to the next char after token (similar to original lambda intent)
- * Returns 1 if token produced and stores heap-allocated token in *out, else 0.
+ * Returns 1 if token produced and stores arena-allocated token in *out, else 0.
  */
 static int extract_token(const char **in, char **out){
   const char *s = *in;
@@ -125,7 +129,7 @@ static int extract_token(const char **in, char **out){
   }
 
   size_t len = (size_t)(s - start);
-  *out = (char*)xmalloc(len + 1);
+  *out = (char*)cmd_alloc(len + 1);
   memcpy(*out, start, len);
   (*out)[len] = '\0';
 
@@ -135,26 +139,22 @@ static int extract_token(const char **in, char **out){
   return 1;
 }
 
-/* parse up to two arguments from a line (supports quoted strings).
- * Caller must free *arg1 and *arg2 if non-NULL.
- * Returns number of args parsed (0..2).
+/* parse up to `max` arguments from a line (supports quoted strings).
+ * All live in the command arena; nothing to free. Unused slots are NULL.
+ * Returns number of args parsed (0..max).
  */
-static int parse_two_args(const char *line, char **arg1, char **arg2){
-  *arg1 = NULL;
-  *arg2 = NULL;
+static int parse_args(const char *line, char **args, int max){
+  for(int i = 0; i < max; i++) args[i] = NULL;
   if(!line) return 0;
 
-  const char *p = line;
-  while(*p && isspace((unsigned char)*p)) p++;
-  if(!*p) return 0;
-
-  const char *cur = p;
-  int got1 = extract_token(&cur, arg1);
-  while(*cur && isspace((unsigned char)*cur)) cur++;
-  int got2 = 0;
-  if(*cur) got2 = extract_token(&cur, arg2);
-
-  return got1 + got2;
+  const char *cur = line;
+  int n = 0;
+  while(n < max){
+    while(*cur && isspace((unsigned char)*cur)) cur++;
+    if(!*cur || !extract_token(&cur, &args[n])) break;
+    n++;
+  }
+  return n;
 }
 
 /* print one-line command usage/help */
@@ -165,15 +165,25 @@ static void print_command_help(const char *name, const char *hint){
 /* -------------------- commands -------------------- */
 
 /* forward declarations */
-static void cmd_help(const char *rest);
-static void cmd_exit(const char *rest);
-static void cmd_showkey(const char *rest);
-static void cmd_setkey(const char *rest);
-static void cmd_set_cipher(const char *rest);
-static void cmd_encrypt(const char *rest);
-static void cmd_decrypt(const char *rest);
-
-typedef void (*cmd_fn)(const char *);
+static void cmd_help(int argc, char **argv);
+static void cmd_exit(int argc, char **argv);
+static void cmd_showkey(int argc, char **argv);
+static void cmd_setkey(int argc, char **argv);
+static void cmd_set_cipher(int argc, char **argv);
+static void cmd_set_mode(int argc, char **argv);
+static void cmd_set_compress(int argc, char **argv);
+static void cmd_encrypt(int argc, char **argv);
+static void cmd_decrypt(int argc, char **argv);
+static void cmd_recover(int argc, char **argv);
+static void cmd_stats(int argc, char **argv);
+static void cmd_encrypt_file(int argc, char **argv);
+static void cmd_decrypt_file(int argc, char **argv);
+static void cmd_encrypt_dir(int argc, char **argv);
+static void cmd_decrypt_dir(int argc, char **argv);
+static void cmd_grep(int argc, char **argv);
+static void cmd_append(int argc, char **argv);
+
+typedef void (*cmd_fn)(int argc, char **argv); /* the arguments after the command */
 typedef struct {
   const char *name;
   cmd_fn handler;
@@ -188,16 +198,48 @@ static const command_def commands[] = {
   { "showkey",   cmd_showkey,    "show the currently set session key" },
   { "setkey",    cmd_setkey,     "set session key: setkey <key>" },
   { "set_cipher",cmd_set_cipher, "choose algorithm: set_cipher <mosaic|xor>" },
+  { "set_mode",  cmd_set_mode,   "mosaic output: set_mode <standard|compact|wide|wide-compact>" },
+  { "set_compress", cmd_set_compress, "compress before encrypting: set_compress <on|off>" },
   { "encrypt",   cmd_encrypt,    "encrypt text: encrypt <text> [key]" },
   { "encode",    cmd_encrypt,    "alias for encrypt" },
   { "decrypt",   cmd_decrypt,    "decrypt text: decrypt <ciphertext> [key]" },
   { "decode",    cmd_decrypt,    "alias for decrypt" },
+  { "recover",   cmd_recover,    "decrypt damaged mosaic text: recover <ciphertext> [key]" },
+  { "stats",     cmd_stats,      "codec counters and latencies: stats [reset|json]" },
+  { "encrypt-file", cmd_encrypt_file, "encrypt a file: encrypt-file <in|-> <out|-> [key]" },
+  { "decrypt-file", cmd_decrypt_file, "decrypt a file: decrypt-file <in|-> <out|-> [key]" },
+  { "encrypt-dir", cmd_encrypt_dir, "encrypt a tree: encrypt-dir <dir> <out-dir> [key]" },
+  { "decrypt-dir", cmd_decrypt_dir, "decrypt a tree: decrypt-dir <dir> <out-dir> [key]" },
+  { "grep",      cmd_grep,       "find text in mosaic files: grep [-l] [-k key] <pattern> <file>..." },
+  { "append",    cmd_append,     "add to a mosaic file in place: append <file> <in|-> [key]" },
 };
 
 static const size_t commands_len = sizeof(commands) / sizeof(commands[0]);
 
-/* single-line dispatcher: caller provides a modifiable buffer 'work'
- * Returns: 0 = handled, 1 = unknown command, -1 = error
+/* runs cmd (lowercased in place) on its arguments, which live in the
+ * command arena. Returns: 0 = handled, 1 = unknown command
+ */
+static int dispatch(char *cmd, int argc, char **argv){
+  for(char *q = cmd; *q; ++q) *q = (char)tolower((unsigned char)*q);
+
+  for(size_t i = 0; i < commands_len; ++i){
+    if(strcmp(cmd, commands[i].name) == 0){
+      size_t arg_bytes = 0;
+      for(int a = 0; a < argc; a++) arg_bytes += strlen(argv[a]);
+      uint64_t t0 = STATS_NOW();
+      commands[i].handler(argc, argv);
+      STATS_COMMAND(commands[i].name);
+      STATS_RECORD(MOSAIC_OP_COMMAND, t0, arg_bytes, 0, 0);
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+/* single-line dispatcher: caller provides a modifiable buffer 'work', whose
+ * first word becomes the command (for the caller's messages) and the rest
+ * its arguments. Returns: 0 = handled, 1 = unknown command, -1 = error
  */
 static int execute_line(char *work){
   if(!work) return -1;
@@ -213,22 +255,17 @@ static int execute_line(char *work){
     rest = p;
   }
 
-  for(char *q = cmd; *q; ++q) *q = (char)tolower((unsigned char)*q);
-
-  for(size_t i = 0; i < commands_len; ++i){
-    if(strcmp(cmd, commands[i].name) == 0){
-      commands[i].handler(rest);
-      return 0;
-    }
-  }
-
-  return 1;
+  int max = (int)(strlen(rest) / 2) + 2; /* every token takes at least two chars */
+  char **args = cmd_alloc((size_t)max * sizeof *args);
+  int n = parse_args(rest, args, max);
+  return dispatch(cmd, n, args);
 }
 
 /* -------------------- handlers -------------------- */
 
-static void cmd_help(const char *rest){
-  (void)rest;
+static void cmd_help(int argc, char **argv){
+  (void)argc;
+  (void)argv;
   printf("Available commands:\n");
   for(size_t i = 0; i < commands_len; i++){
     print_command_help(commands[i].name, commands[i].help);
@@ -236,15 +273,23 @@ static void cmd_help(const char *rest){
   printf("\nNotes:\n");
   printf("  • Mosaic: key is optional; if omitted, uses the session key if set.\n");
   printf("  • XOR: key is required; if not given, session key is used; if still NULL, a weak default is used.\n");
+  printf("  • Compact mode drops noise characters; decrypt detects it automatically.\n");
+  printf("  • Wide mode packs 8 bytes into 12 symbols for shorter output; also detected.\n");
+  printf("  • Compression shrinks text-like input before the XOR; decrypt detects it too.\n");
+  printf("  • File commands always use the mosaic cipher; '-' means stdin/stdout.\n");
+  printf("  • Directory commands write <name>.mosaic (and back); out-dir = dir writes in place.\n");
+  printf("  • grep prints <file>:<offset> per plaintext match without decrypting; -l lists files.\n");
 }
 
-static void cmd_exit(const char *rest){
-  (void)rest;
+static void cmd_exit(int argc, char **argv){
+  (void)argc;
+  (void)argv;
   should_exit = true;
 }
 
-static void cmd_showkey(const char *rest){
-  (void)rest;
+static void cmd_showkey(int argc, char **argv){
+  (void)argc;
+  (void)argv;
   if(!current_key || !*current_key){
     printf("No key set.\n");
   } else {
@@ -252,26 +297,20 @@ static void cmd_showkey(const char *rest){
   }
 }
 
-static void cmd_setkey(const char *rest){
-  char *a1 = NULL, *a2 = NULL;
-  int n = parse_two_args(rest ? rest : "", &a1, &a2);
-  (void)a2;
-  if(n < 1 || !a1){
+static void cmd_setkey(int argc, char **argv){
+  char *a1 = argc > 0 ? argv[0] : NULL;
+  if(!a1){
     printf("Usage: setkey <key>\n");
   } else {
     set_cli_key(a1);
     printf("Key set%s.\n", current_key ? "" : " (NULL)");
   }
-  free_pair(&a1, &a2);
 }
 
-static void cmd_set_cipher(const char *rest){
-  char *a1 = NULL, *a2 = NULL;
-  int n = parse_two_args(rest ? rest : "", &a1, &a2);
-  (void)a2;
-  if(n < 1 || !a1){
+static void cmd_set_cipher(int argc, char **argv){
+  char *a1 = argc > 0 ? argv[0] : NULL;
+  if(!a1){
     printf("Usage: set_cipher <mosaic|xor>\n");
-    free_pair(&a1, &a2);
     return;
   }
 
@@ -285,15 +324,56 @@ static void cmd_set_cipher(const char *rest){
   } else {
     printf("Unknown cipher: %s\n", a1);
   }
-  free_pair(&a1, &a2);
 }
 
-static void cmd_encrypt(const char *rest){
-  char *arg1 = NULL, *arg2 = NULL;
-  int n = parse_two_args(rest ? rest : "", &arg1, &arg2);
-  if(n < 1 || !arg1){
+static void cmd_set_mode(int argc, char **argv){
+  char *a1 = argc > 0 ? argv[0] : NULL;
+  if(!a1){
+    printf("Usage: set_mode <standard|compact|wide|wide-compact>\n");
+    return;
+  }
+
+  static const struct { const char *name; unsigned opts; } modes[] = {
+    { "standard",     0u },
+    { "compact",      MOSAIC_OPT_COMPACT },
+    { "wide",         MOSAIC_OPT_WIDE },
+    { "wide-compact", MOSAIC_OPT_WIDE | MOSAIC_OPT_COMPACT },
+  };
+  for(char *q = a1; *q; ++q) *q = (char)tolower((unsigned char)*q);
+  for(size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); i++){
+    if(strcmp(a1, modes[i].name) == 0){
+      current_opts = (current_opts & ~(MOSAIC_OPT_COMPACT | MOSAIC_OPT_WIDE)) | modes[i].opts;
+      printf("Mode set to %s\n", modes[i].name);
+      return;
+    }
+  }
+  printf("Unknown mode: %s\n", a1);
+}
+
+static void cmd_set_compress(int argc, char **argv){
+  char *a1 = argc > 0 ? argv[0] : NULL;
+  if(!a1){
+    printf("Usage: set_compress <on|off>\n");
+    return;
+  }
+
+  for(char *q = a1; *q; ++q) *q = (char)tolower((unsigned char)*q);
+  if(strcmp(a1, "on") == 0){
+    current_opts |= MOSAIC_OPT_COMPRESS;
+    printf("Compression on\n");
+  } else if(strcmp(a1, "off") == 0){
+    current_opts &= ~MOSAIC_OPT_COMPRESS;
+    printf("Compression off\n");
+  } else {
+    printf("Unknown setting: %s\n", a1);
+  }
+}
+
+static void cmd_encrypt(int argc, char **argv){
+  char *arg1 = argc > 0 ? argv[0] : NULL;
+  char *arg2 = argc > 1 ? argv[1] : NULL;
+  if(!arg1){
     printf("Usage: encrypt <text> [key]\n");
-    free_pair(&arg1, &arg2);
     return;
   }
 
@@ -305,27 +385,23 @@ static void cmd_encrypt(const char *rest){
 
   char *out = NULL;
   if(current_cipher == CIPHER_MOSAIC){
-    out = mosaic_encrypt(arg1, resolved_key);
+    out = mosaic_encrypt_ex(arg1, resolved_key, current_opts, &cmd_arena);
   } else {
-    out = xor_encrypt(arg1, resolved_key);
+    out = xor_encrypt_ex(arg1, resolved_key, &cmd_arena);
   }
 
   if(!out){
     printf("Encryption failed.\n");
   } else {
     printf("Encrypted: %s\n", out);
-    free(out);
   }
-
-  free_pair(&arg1, &arg2);
 }
 
-static void cmd_decrypt(const char *rest){
-  char *arg1 = NULL, *arg2 = NULL;
-  int n = parse_two_args(rest ? rest : "", &arg1, &arg2);
-  if(n < 1 || !arg1){
+static void cmd_decrypt(int argc, char **argv){
+  char *arg1 = argc > 0 ? argv[0] : NULL;
+  char *arg2 = argc > 1 ? argv[1] : NULL;
+  if(!arg1){
     printf("Usage: decrypt <ciphertext> [key]\n");
-    free_pair(&arg1, &arg2);
     return;
   }
 
@@ -337,23 +413,399 @@ static void cmd_decrypt(const char *rest){
 
   char *plain = NULL;
   if(current_cipher == CIPHER_MOSAIC){
-    plain = mosaic_decrypt(arg1, resolved_key);
+    plain = mosaic_decrypt_ex(arg1, resolved_key, &cmd_arena);
   } else {
-    plain = xor_decrypt(arg1, resolved_key);
+    plain = xor_decrypt_ex(arg1, resolved_key, &cmd_arena);
   }
 
   if(!plain){
     printf("Decryption failed (malformed input, wrong key, or checksum error).\n");
   } else {
     printf("Decrypted: %s\n", plain);
-    free(plain);
+  }
+}
+
+static void cmd_recover(int argc, char **argv){
+  char *arg1 = argc > 0 ? argv[0] : NULL;
+  char *arg2 = argc > 1 ? argv[1] : NULL;
+  if(!arg1){
+    printf("Usage: recover <ciphertext> [key]\n");
+    return;
+  }
+  if(current_cipher != CIPHER_MOSAIC){
+    printf("recover only applies to the mosaic cipher.\n");
+    return;
+  }
+
+  const char *resolved_key = arg2 ? arg2 : current_key;
+  if(!resolved_key || !*resolved_key){
+    resolved_key = "default-key";
+    printf("(No key set, using default key)\n");
+  }
+
+  size_t in_len = strlen(arg1);
+  /* a zero-filled window would garble every frame after it */
+  if(mosaic_stream_opts(arg1, in_len) & MOSAIC_OPT_COMPRESS){
+    printf("recover cannot repair compressed ciphertext; use decrypt.\n");
+    return;
+  }
+  size_t cap = mosaic_decode_recover(arg1, in_len, NULL, 0, NULL, 0, NULL);
+  unsigned char *buf = (unsigned char*)cmd_alloc(cap + 1);
+  mosaic_damage damage[MAX_DAMAGE_REPORT];
+  size_t n_damage = 0;
+  size_t wrote = mosaic_decode_recover(arg1, in_len, buf, cap, damage, MAX_DAMAGE_REPORT, &n_damage);
+
+  if(wrote == (size_t)-1){
+    printf("Recovery failed.\n");
+  } else {
+    xor_with_key(buf, wrote, resolved_key);
+    size_t shown = n_damage < MAX_DAMAGE_REPORT ? n_damage : MAX_DAMAGE_REPORT;
+    for(size_t i = 0; i < shown; i++) memset(buf + damage[i].offset, '?', damage[i].len);
+    buf[wrote] = '\0';
+    printf("Recovered: %s\n", (char*)buf);
+    if(n_damage == 0){
+      printf("No damage found.\n");
+    } else {
+      printf("Damaged bytes:");
+      for(size_t i = 0; i < shown; i++){
+        printf(" %zu-%zu", damage[i].offset, damage[i].offset + damage[i].len - 1);
+      }
+      if(n_damage > shown) printf(" (+%zu more)", n_damage - shown);
+      printf("\n");
+    }
+  }
+}
+
+static void cmd_stats(int argc, char **argv){
+  char *a1 = argc > 0 ? argv[0] : NULL;
+  if(a1) for(char *q = a1; *q; ++q) *q = (char)tolower((unsigned char)*q);
+
+  if(a1 && strcmp(a1, "reset") == 0){
+    mosaic_stats_reset();
+    printf("Statistics reset.\n");
+  } else if(!a1 || strcmp(a1, "json") == 0){
+    mosaic_stats s;
+    mosaic_stats_snapshot(&s);
+    mosaic_stats_print(stdout, &s, a1 != NULL);
+  } else {
+    printf("Usage: stats [reset|json]\n");
+  }
+}
+
+/* shared by encrypt-file / decrypt-file: stream in -> out through the
+ * pipeline engine, then report sizes and throughput */
+static void run_file_command(int argc, char **args, mosaic_pipe_mode mode, const char *name){
+  if(argc < 2){
+    printf("Usage: %s <in|-> <out|-> [key]\n", name);
+    cmd_failed = true;
+    return;
+  }
+
+  /* with the output on stdout, chatter has to go elsewhere */
+  bool to_stdout = strcmp(args[1], "-") == 0;
+  FILE *msg = to_stdout ? stderr : stdout;
+
+  const char *resolved_key = argc > 2 ? args[2] : current_key;
+  if(!resolved_key || !*resolved_key){
+    resolved_key = "default-key";
+    fprintf(msg, "(No key set, using default key)\n");
+  }
+
+  int in_fd = strcmp(args[0], "-") == 0 ? STDIN_FILENO : open(args[0], O_RDONLY);
+  if(in_fd < 0){
+    fprintf(msg, "Cannot open %s: %s\n", args[0], strerror(errno));
+    cmd_failed = true;
+    return;
+  }
+  int out_fd = to_stdout ? STDOUT_FILENO : open(args[1], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if(out_fd < 0){
+    fprintf(msg, "Cannot create %s: %s\n", args[1], strerror(errno));
+    if(in_fd != STDIN_FILENO) close(in_fd);
+    cmd_failed = true;
+    return;
+  }
+
+  if(to_stdout) fflush(stdout); /* nothing buffered may land inside the output */
+
+  /* MOSAIC_ENGINE=threads|io_uring pins the engine, for comparing them */
+  mosaic_pipe_engine engine = MOSAIC_ENGINE_AUTO;
+  const char *env = getenv("MOSAIC_ENGINE");
+  if(env && strcmp(env, "threads") == 0) engine = MOSAIC_ENGINE_THREADS;
+  if(env && strcmp(env, "io_uring") == 0) engine = MOSAIC_ENGINE_URING;
+  if(env && strcmp(env, "inline") == 0) engine = MOSAIC_ENGINE_INLINE;
+
+  mosaic_pipe_config cfg = { mode, current_opts, resolved_key, 0, 0, engine };
+  mosaic_pipe_result res;
+  int rc = mosaic_pipe_run(in_fd, out_fd, &cfg, &res);
+  int err = errno;
+
+  if(in_fd != STDIN_FILENO) close(in_fd);
+  if(out_fd != STDOUT_FILENO && close(out_fd) != 0 && rc == 0){
+    rc = -1;
+    err = errno;
   }
 
-  free_pair(&arg1, &arg2);
+  if(rc != 0){
+    if(err == EILSEQ){
+      fprintf(msg, "%s failed: malformed ciphertext or checksum error.\n", name);
+    } else {
+      fprintf(msg, "%s failed: %s\n", name, strerror(err));
+    }
+    cmd_failed = true;
+    return;
+  }
+
+  double mb = (double)res.bytes_in / (1024.0 * 1024.0);
+  fprintf(msg, "%s: %llu bytes in, %llu bytes out, %.3fs (%.1f MB/s, %s)\n", name,
+          (unsigned long long)res.bytes_in, (unsigned long long)res.bytes_out, res.seconds,
+          res.seconds > 0 ? mb / res.seconds : 0.0, mosaic_pipe_engine_name(res.engine));
+}
+
+static void cmd_encrypt_file(int argc, char **argv){
+  run_file_command(argc, argv, MOSAIC_PIPE_ENCODE, "encrypt-file");
+}
+
+static void cmd_decrypt_file(int argc, char **argv){
+  run_file_command(argc, argv, MOSAIC_PIPE_DECODE, "decrypt-file");
+}
+
+/* shared by encrypt-dir / decrypt-dir: the whole tree through the bulk
+ * engine, then the failures and the totals */
+#define MAX_BULK_ERRORS 20
+
+static void run_dir_command(int argc, char **args, mosaic_pipe_mode mode, const char *name){
+  if(argc < 2){
+    printf("Usage: %s <dir> <out-dir> [key]\n", name);
+    cmd_failed = true;
+    return;
+  }
+
+  const char *resolved_key = argc > 2 ? args[2] : current_key;
+  if(!resolved_key || !*resolved_key){
+    resolved_key = "default-key";
+    printf("(No key set, using default key)\n");
+  }
+
+  /* MOSAIC_THREADS=n overrides one worker per CPU */
+  const char *env = getenv("MOSAIC_THREADS");
+  mosaic_bulk_config cfg = { mode, current_opts, resolved_key, env ? atoi(env) : 0, 0 };
+  mosaic_bulk_result res;
+  if(mosaic_bulk_run(args[0], args[1], &cfg, &res) != 0){
+    if(errno == EINVAL){
+      printf("%s failed: %s lies inside %s\n", name, args[1], args[0]);
+    } else {
+      printf("%s failed: %s\n", name, strerror(errno));
+    }
+    cmd_failed = true;
+    return;
+  }
+
+  for(size_t i = 0; i < res.n_errors && i < MAX_BULK_ERRORS; i++){
+    const mosaic_bulk_error *e = &res.errors[i];
+    printf("  %s: %s\n", e->path,
+           e->err == EILSEQ ? "malformed ciphertext or checksum error" : strerror(e->err));
+  }
+  if(res.n_errors > MAX_BULK_ERRORS){
+    printf("  ... and %zu more\n", res.n_errors - MAX_BULK_ERRORS);
+  }
+
+  double mb = (double)res.bytes_in / (1024.0 * 1024.0);
+  printf("%s: %llu files, %zu failed, %llu skipped; %llu bytes in, %llu bytes out, %.3fs "
+         "(%.1f MB/s, %d threads)\n", name, (unsigned long long)res.files, res.n_errors,
+         (unsigned long long)res.skipped, (unsigned long long)res.bytes_in,
+         (unsigned long long)res.bytes_out, res.seconds, res.seconds > 0 ? mb / res.seconds : 0.0,
+         res.threads);
+  if(res.n_errors) cmd_failed = true;
+  mosaic_bulk_result_free(&res);
+}
+
+static void cmd_encrypt_dir(int argc, char **argv){
+  run_dir_command(argc, argv, MOSAIC_PIPE_ENCODE, "encrypt-dir");
+}
+
+static void cmd_decrypt_dir(int argc, char **argv){
+  run_dir_command(argc, argv, MOSAIC_PIPE_DECODE, "decrypt-dir");
+}
+
+/* grep: every file streams through a searcher, nothing is decrypted to
+ * memory or disk. Matches print as <file>:<plaintext offset>, or with -l
+ * just <file>, once, at its first match. */
+typedef struct {
+  char **files;
+  bool list;
+} grep_output;
+
+static int print_grep_match(void *ctx, size_t file, uint64_t offset){
+  const grep_output *g = ctx;
+  if(g->list){
+    printf("%s\n", g->files[file]);
+  } else {
+    printf("%s:%llu\n", g->files[file], (unsigned long long)offset);
+  }
+  return 0;
+}
+
+static void cmd_grep(int n, char **args){
+  int a = 0;
+  grep_output g = { NULL, false };
+  const char *resolved_key = NULL;
+  for(; a < n && args[a][0] == '-' && args[a][1]; a++){
+    if(strcmp(args[a], "-l") == 0){
+      g.list = true;
+    } else if(strcmp(args[a], "-k") == 0 && a + 1 < n){
+      resolved_key = args[++a];
+    } else {
+      break;
+    }
+  }
+  if(n - a < 2){
+    printf("Usage: grep [-l] [-k key] <pattern> <file>...\n");
+    cmd_failed = true;
+    return;
+  }
+  const char *pattern = args[a++];
+
+  /* every argument after the pattern is a file; the key comes from -k or
+   * the session */
+  if(!resolved_key) resolved_key = current_key;
+  if(!resolved_key || !*resolved_key){
+    resolved_key = "default-key";
+    fprintf(stderr, "(No key set, using default key)\n");
+  }
+
+  g.files = args + a;
+  size_t n_files = (size_t)(n - a);
+  mosaic_search_result *res = cmd_alloc(n_files * sizeof *res);
+
+  /* MOSAIC_THREADS=n overrides one worker per CPU */
+  const char *env = getenv("MOSAIC_THREADS");
+  if(mosaic_search_files((const char *const *)g.files, n_files, pattern, strlen(pattern),
+                         resolved_key, g.list, env ? atoi(env) : 0, print_grep_match, &g,
+                         res) != 0){
+    printf("grep failed: %s\n", errno == EINVAL ? "bad pattern" : strerror(errno));
+    cmd_failed = true;
+    return;
+  }
+  fflush(stdout);
+
+  uint64_t matches = 0;
+  for(size_t i = 0; i < n_files; i++){
+    matches += res[i].matches;
+    if(res[i].err){
+      fprintf(stderr, "grep: %s: %s\n", g.files[i],
+              res[i].err == EILSEQ ? "malformed ciphertext or checksum error"
+                                   : strerror(res[i].err));
+      cmd_failed = true;
+    }
+  }
+  if(!matches) cmd_failed = true; /* like grep: no match is a failure */
+}
+
+/* append: in (or stdin) is encrypted onto the end of an existing mosaic
+ * file, which is created when missing; only its last window is rewritten */
+static void cmd_append(int argc, char **args){
+  if(argc < 2){
+    printf("Usage: append <file> <in|-> [key]\n");
+    cmd_failed = true;
+    return;
+  }
+
+  const char *resolved_key = argc > 2 ? args[2] : current_key;
+  if(!resolved_key || !*resolved_key){
+    resolved_key = "default-key";
+    printf("(No key set, using default key)\n");
+  }
+
+  int in_fd = strcmp(args[1], "-") == 0 ? STDIN_FILENO : open(args[1], O_RDONLY);
+  if(in_fd < 0){
+    printf("Cannot open %s: %s\n", args[1], strerror(errno));
+    cmd_failed = true;
+    return;
+  }
+  int fd = open(args[0], O_RDWR | O_CREAT, 0644);
+  if(fd < 0){
+    printf("Cannot open %s: %s\n", args[0], strerror(errno));
+    if(in_fd != STDIN_FILENO) close(in_fd);
+    cmd_failed = true;
+    return;
+  }
+
+  mosaic_pipe_result res;
+  int rc = mosaic_append(fd, in_fd, resolved_key, current_opts, &res);
+  int err = errno;
+  if(in_fd != STDIN_FILENO) close(in_fd);
+  if(close(fd) != 0 && rc == 0){
+    rc = -1;
+    err = errno;
+  }
+
+  if(rc != 0){
+    if(err == EILSEQ){
+      printf("append failed: %s does not end in a well-formed mosaic stream.\n", args[0]);
+    } else {
+      printf("append failed: %s\n", strerror(err));
+    }
+    cmd_failed = true;
+    return;
+  }
+  printf("append: %llu bytes in, %llu bytes written, %.3fs\n", (unsigned long long)res.bytes_in,
+         (unsigned long long)res.bytes_out, res.seconds);
 }
 
 /* -------------------- main REPL loop -------------------- */
 
+/* reports an unknown command or a failed one, then wipes the command arena:
+ * the line, its tokens and any plaintext the command produced. Returns 0 on
+ * success, 1 for an unknown command and -1 when the command failed. */
+static int finish_command(int rc, const char *cmd){
+  if(rc == 1){
+    printf("Unknown command: %s\n", cmd);
+    printf("Type 'help' for available commands.\n");
+  } else if(rc < 0){
+    fprintf(stderr, "Error: failed to execute command.\n");
+  } else if(cmd_failed){
+    rc = -1;
+  }
+
+  mosaic_arena_reset(&cmd_arena);
+  return rc;
+}
+
+/* run one command line. Returns 0 on success, 1 for an unknown command and
+ * -1 when the command failed. */
+int cli_execute(const char *line){
+  if(!line) return -1;
+
+  /* working copy for tokenization/dispatch (execute_line expects writable buffer) */
+  char *work = mosaic_arena_strdup(&cmd_arena, line);
+  if(!work) {
+    fprintf(stderr, "warning: out of memory, skipping line\n");
+    return -1;
+  }
+
+  cmd_failed = false;
+  return finish_command(execute_line(work), work);
+}
+
+/* one-shot mode: argv[0] is the command, the rest its arguments, passed on
+ * as they are; no quoting can split or merge them. They are copied into the
+ * command arena, which handlers may lowercase and which is wiped after. */
+int cli_run_args(int argc, char **argv){
+  if(argc < 1) return -1;
+
+  char **args = cmd_alloc((size_t)argc * sizeof *args);
+  for(int i = 0; i < argc; i++){
+    args[i] = mosaic_arena_strdup(&cmd_arena, argv[i]);
+    if(!args[i]) oom_abort("arena");
+  }
+
+  cmd_failed = false;
+  int rc = finish_command(dispatch(args[0], argc - 1, args + 1), args[0]);
+  mosaic_arena_free(&cmd_arena);
+  set_cli_key(NULL);
+  return rc;
+}
+
 void cli_loop(void){
   char input[INPUT_SIZE];
 
@@ -371,23 +823,9 @@ void cli_loop(void){
     char *line = skip_spaces(input);
     if(!*line) continue;
 
-    /* working copy for tokenization/dispatch (execute_line expects writable buffer) */
-    char *work = strdup(line);
-    if(!work) {
-      fprintf(stderr, "warning: out of memory, skipping line\n");
-      continue;
-    }
-
-    int rc = execute_line(work);
-    if(rc == 1){
-      printf("Unknown command: %s\n", work);
-      printf("Type 'help' for available commands.\n");
-    } else if(rc < 0){
-      fprintf(stderr, "Error: failed to execute command.\n");
-    }
-
-    free(work);
+    cli_execute(line);
   }
+  mosaic_arena_free(&cmd_arena);
 
   /* cleanup sensitive data */
   if(current_key){
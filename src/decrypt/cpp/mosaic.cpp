@@ -0,0 +1,425 @@
+#include "mosaic.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <string>
+
+namespace mosaic {
+
+namespace {
+
+constexpr std::uint8_t INVALID = 0xFF;
+
+struct Tables {
+    std::array<std::uint8_t, 256> rev_base{};              // index in ALPHABET
+    std::array<std::uint8_t, BASE> rotation{};             // rotation of block b % 47
+    std::array<std::array<std::uint8_t, 256>, BASE> digit{}; // digit[rot][c]
+    std::array<char, 2 * BASE> alpha2{};                   // alphabet twice: rotated = alpha2 + rot
+};
+
+constexpr Tables make_tables() {
+    Tables t;
+    for (auto& v : t.rev_base) v = INVALID;
+    for (int i = 0; i < BASE; ++i) {
+        t.rev_base[static_cast<unsigned char>(ALPHABET[i])] = static_cast<std::uint8_t>(i);
+        t.alpha2[i] = t.alpha2[i + BASE] = ALPHABET[i];
+    }
+    for (int b = 0; b < BASE; ++b) t.rotation[b] = static_cast<std::uint8_t>((b * 13 + 11) % BASE);
+    for (int rot = 0; rot < BASE; ++rot) {
+        for (int c = 0; c < 256; ++c) {
+            auto v = t.rev_base[c];
+            t.digit[rot][c] = v == INVALID ? INVALID : static_cast<std::uint8_t>((v + BASE - rot) % BASE);
+        }
+    }
+    return t;
+}
+
+constexpr Tables T = make_tables();
+
+bool is_noise(char c) { return c >= 'a' && c <= 'z'; }
+
+bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+}
+
+// noise PRNG, the same xorshift64* as src/mosaic.c: one draw per block,
+// bit 0 says whether noise goes in, the high bits pick the letter
+std::uint64_t noise_seed(std::uint64_t seed) {
+    std::uint64_t s = seed ^ 0x9E3779B97F4A7C15ull;
+    return s ? s : 1; // 0 is xorshift's fixed point
+}
+
+std::uint32_t noise_next(std::uint64_t& s) {
+    s ^= s >> 12;
+    s ^= s << 25;
+    s ^= s >> 27;
+    return static_cast<std::uint32_t>((s * 0x2545F4914F6CDD1Dull) >> 32);
+}
+
+std::size_t encode_capacity(std::size_t n, unsigned opts) {
+    std::size_t blocks = (n + BLOCK_BYTES - 1) / BLOCK_BYTES;
+    std::size_t noise = (opts & OPT_COMPACT) ? (blocks ? 1 : 0) : blocks;
+    return blocks * (BLOCK_SYMBOLS + 1) + blocks / CHECKSUM_PERIOD + noise + 3;
+}
+
+std::span<const std::uint8_t> as_bytes(std::string_view s) {
+    return {reinterpret_cast<const std::uint8_t*>(s.data()), s.size()};
+}
+
+} // namespace
+
+std::uint64_t random_seed() {
+    static std::atomic<std::uint64_t> calls{0};
+    auto now = std::chrono::steady_clock::now().time_since_epoch().count();
+    return static_cast<std::uint64_t>(now) ^ (++calls << 40);
+}
+
+void xor_with_key(std::span<std::uint8_t> data, std::string_view key, std::uint64_t offset) {
+    if (key.empty()) return;
+    std::size_t k = offset % key.size();
+    for (auto& b : data) {
+        b ^= static_cast<std::uint8_t>(key[k]);
+        if (++k == key.size()) k = 0;
+    }
+}
+
+decode_error::decode_error(const char* what, std::uint64_t offset)
+    : std::runtime_error(std::string(what) + " at offset " + std::to_string(offset)), offset_(offset) {}
+
+// ---------------- Encoder ----------------
+
+Encoder::Encoder(unsigned opts, std::uint64_t seed) : opts_(opts), rng_(noise_seed(seed)) {}
+
+std::size_t Encoder::bound(std::size_t n, unsigned opts) {
+    // the carry adds at most one window; the mark and trailer are in there
+    return encode_capacity(n + WINDOW_BYTES, opts);
+}
+
+// encode whole windows (or, from finish, the short tail) and advance
+std::size_t Encoder::emit(const std::uint8_t* in, std::size_t len, char* out) {
+    const bool compact = opts_ & OPT_COMPACT;
+    std::size_t o = 0;
+    if (!len) return 0;
+    if (compact && !marked_) {
+        out[o++] = COMPACT_MARK;
+        marked_ = true;
+    }
+    std::uint8_t window = 0;
+    for (std::size_t at = 0; at < len; at += BLOCK_BYTES, ++blocks_) {
+        std::uint64_t v = 0;
+        for (std::size_t i = 0; i < BLOCK_BYTES; ++i) {
+            std::uint8_t b = at + i < len ? in[at + i] : 0;
+            v = v << 8 | b;
+            window ^= b;
+        }
+        const char* rotated = T.alpha2.data() + T.rotation[blocks_ % BASE];
+        for (std::size_t d = BLOCK_SYMBOLS; d-- > 0;) {
+            out[o + d] = rotated[v % BASE];
+            v /= BASE;
+        }
+        o += BLOCK_SYMBOLS;
+        if (!compact) {
+            std::uint32_t r = noise_next(rng_);
+            if (r & 1) out[o++] = NOISE_SET[(r >> 1) % NOISE_SET.size()];
+        }
+        out[o++] = TERM;
+        if (blocks_ % CHECKSUM_PERIOD == CHECKSUM_PERIOD - 1) {
+            out[o++] = ALPHABET[window % BASE];
+            window = 0;
+        }
+    }
+    return o;
+}
+
+std::size_t Encoder::update(std::span<const std::uint8_t> in, char* out) {
+    const std::uint8_t* p = in.data();
+    std::size_t n = in.size();
+    std::size_t o = 0;
+    in_total_ += n;
+
+    // top up a carried partial window first
+    if (carry_len_) {
+        std::size_t take = std::min(WINDOW_BYTES - carry_len_, n);
+        std::memcpy(carry_ + carry_len_, p, take);
+        carry_len_ += take;
+        p += take;
+        n -= take;
+        if (carry_len_ < WINDOW_BYTES) return 0;
+        o += emit(carry_, WINDOW_BYTES, out + o);
+        carry_len_ = 0;
+    }
+
+    std::size_t whole = n - n % WINDOW_BYTES;
+    o += emit(p, whole, out + o);
+    if (n > whole) std::memcpy(carry_, p + whole, n - whole);
+    carry_len_ = n - whole;
+    return o;
+}
+
+std::size_t Encoder::finish(char* out) {
+    std::size_t o = emit(carry_, carry_len_, out);
+    carry_len_ = 0;
+    std::size_t pad = (BLOCK_BYTES - in_total_ % BLOCK_BYTES) % BLOCK_BYTES;
+    out[o++] = TERM;
+    out[o++] = TERM;
+    out[o++] = ALPHABET[pad];
+    return o;
+}
+
+// ---------------- Decoder ----------------
+
+void Decoder::fail(const char* what, std::size_t at) {
+    state_ = State::failed;
+    throw decode_error(what, consumed_ + at);
+}
+
+std::size_t Decoder::end_block(std::uint8_t* out) {
+    std::uint64_t v = 0;
+    for (auto d : digits_) v = v * BASE + d;
+    std::size_t slot = blocks_ % CHECKSUM_PERIOD;
+    std::uint8_t* w = window_ + slot * BLOCK_BYTES;
+    for (std::size_t i = BLOCK_BYTES; i-- > 0; v >>= 8) w[i] = static_cast<std::uint8_t>(v);
+    std::size_t o = 0;
+    if (have_held_) {
+        std::memcpy(out, held_, BLOCK_BYTES);
+        o = BLOCK_BYTES;
+    }
+    std::memcpy(held_, w, BLOCK_BYTES);
+    have_held_ = true;
+    ++blocks_;
+    state_ = slot == CHECKSUM_PERIOD - 1 ? State::checksum : State::block;
+    return o;
+}
+
+std::size_t Decoder::update(std::string_view in, std::uint8_t* out) {
+    if (state_ == State::failed) throw decode_error("decoder already failed", consumed_);
+    std::size_t o = 0;
+    const std::size_t n = in.size();
+    for (std::size_t i = 0; i < n; ++i) {
+        char c = in[i];
+        auto uc = static_cast<unsigned char>(c);
+        switch (state_) {
+        case State::block: {
+            // common case: eight symbols and the terminator, no noise
+            if (n - i > BLOCK_SYMBOLS && in[i + BLOCK_SYMBOLS] == TERM) {
+                const auto& table = T.digit[T.rotation[blocks_ % BASE]];
+                std::uint8_t bad = 0;
+                for (std::size_t k = 0; k < BLOCK_SYMBOLS; ++k) {
+                    digits_[k] = table[static_cast<unsigned char>(in[i + k])];
+                    bad |= digits_[k];
+                }
+                if (!(bad & 0x80)) {
+                    o += end_block(out + o);
+                    i += BLOCK_SYMBOLS; // the loop steps over the terminator
+                    break;
+                }
+            }
+            if (is_space(c)) break;
+            if (c == TERM) {
+                state_ = State::trailer1;
+                break;
+            }
+            // the marks sit before the first block; 'c' (compact) reads as noise
+            if (blocks_ == 0 && (c == COMPRESS_MARK || c == WIDE_MARK))
+                fail("unsupported stream (compressed or wide)", i);
+            // c is the first symbol (or noise): read it again as one
+            state_ = State::symbol;
+            k_ = 0;
+            --i;
+            break;
+        }
+        case State::symbol:
+            if (is_noise(c)) break;
+            if (c == TERM) fail("unexpected terminator", i);
+            digits_[k_] = T.digit[T.rotation[blocks_ % BASE]][uc];
+            if (digits_[k_] == INVALID) fail("invalid symbol", i);
+            if (++k_ == BLOCK_SYMBOLS) state_ = State::term;
+            break;
+        case State::term:
+            if (is_noise(c)) break;
+            if (c != TERM) fail("missing block terminator", i);
+            o += end_block(out + o);
+            break;
+        case State::checksum: {
+            if (is_noise(c)) break;
+            auto v = T.rev_base[uc];
+            if (v == INVALID) fail("invalid checksum symbol", i);
+            std::uint8_t x = 0;
+            for (auto b : window_) x ^= b;
+            if (v != x % BASE) fail("checksum mismatch", i);
+            state_ = State::block;
+            break;
+        }
+        case State::trailer1:
+            if (c != TERM) fail("malformed trailer", i);
+            state_ = State::trailer2;
+            break;
+        case State::trailer2: {
+            std::size_t pad = T.rev_base[uc];
+            if (pad >= BLOCK_BYTES || (pad && !have_held_)) fail("invalid trailer pad digit", i);
+            if (have_held_) {
+                std::memcpy(out + o, held_, BLOCK_BYTES - pad);
+                o += BLOCK_BYTES - pad;
+                have_held_ = false;
+            }
+            state_ = State::done;
+            break;
+        }
+        case State::done: // nothing but whitespace may follow the trailer
+            if (!is_space(c)) fail("extra data after trailer", i);
+            break;
+        case State::failed:
+            break;
+        }
+    }
+    consumed_ += n;
+    return o;
+}
+
+void Decoder::finish() {
+    if (state_ == State::failed) throw decode_error("decoder already failed", consumed_);
+    if (state_ != State::done) fail("no trailer found", 0);
+}
+
+// ---------------- Codec ----------------
+
+Codec::Codec(unsigned opts, std::uint64_t seed) : opts_(opts), seed_(seed) {}
+
+std::string_view Codec::encode(std::span<const std::uint8_t> plain) {
+    Encoder enc(opts_, seed_);
+    // resize() only grows the buffer; reused calls don't reallocate
+    text_.resize(Encoder::bound(plain.size(), opts_));
+    std::size_t n = enc.update(plain, text_.data());
+    n += enc.finish(text_.data() + n);
+    return {text_.data(), n};
+}
+
+std::string_view Codec::encode(std::string_view plain) {
+    return encode(as_bytes(plain));
+}
+
+std::string_view Codec::encrypt(std::string_view plain, std::string_view key) {
+    bytes_.assign(plain.begin(), plain.end());
+    xor_with_key(bytes_, key);
+    auto r = encode(std::span<const std::uint8_t>(bytes_));
+    std::fill(bytes_.begin(), bytes_.end(), 0);
+    return r;
+}
+
+std::span<const std::uint8_t> Codec::decode(std::string_view cipher) {
+    Decoder dec;
+    bytes_.resize(Decoder::bound(cipher.size()));
+    std::size_t n = dec.update(cipher, bytes_.data());
+    dec.finish();
+    return {bytes_.data(), n};
+}
+
+std::span<const std::uint8_t> Codec::decrypt(std::string_view cipher, std::string_view key) {
+    auto plain = decode(cipher);
+    xor_with_key({bytes_.data(), plain.size()}, key);
+    return plain;
+}
+
+// ---------------- ostreambuf ----------------
+
+ostreambuf::ostreambuf(std::streambuf* sink, std::string_view key, unsigned opts,
+                       std::uint64_t seed, std::size_t chunk)
+    : sink_(sink), key_(key), enc_(opts, seed) {
+    // whole windows, so nothing is carried between chunks
+    chunk = std::max(chunk - chunk % WINDOW_BYTES, WINDOW_BYTES);
+    plain_.resize(chunk);
+    cipher_.resize(Encoder::bound(chunk, opts));
+    setp(plain_.data(), plain_.data() + plain_.size());
+}
+
+ostreambuf::~ostreambuf() {
+    try {
+        close();
+    } catch (...) {
+    }
+}
+
+bool ostreambuf::put(const char* s, std::size_t n) {
+    return sink_->sputn(s, static_cast<std::streamsize>(n)) == static_cast<std::streamsize>(n);
+}
+
+// encode and write out what is buffered
+bool ostreambuf::drain() {
+    auto n = static_cast<std::size_t>(pptr() - pbase());
+    setp(plain_.data(), plain_.data() + plain_.size());
+    if (!n) return true;
+    std::span<std::uint8_t> chunk(reinterpret_cast<std::uint8_t*>(plain_.data()), n);
+    xor_with_key(chunk, key_, key_pos_);
+    key_pos_ += n;
+    return put(cipher_.data(), enc_.update(chunk, cipher_.data()));
+}
+
+ostreambuf::int_type ostreambuf::overflow(int_type ch) {
+    if (closed_ || !drain()) return traits_type::eof();
+    if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+        *pptr() = traits_type::to_char_type(ch);
+        pbump(1);
+    }
+    return traits_type::not_eof(ch);
+}
+
+std::streamsize ostreambuf::xsputn(const char* s, std::streamsize n) {
+    std::streamsize done = 0;
+    while (done < n) {
+        if (pptr() == epptr() && overflow(traits_type::eof()) == traits_type::eof()) break;
+        auto take = std::min<std::streamsize>(n - done, epptr() - pptr());
+        std::memcpy(pptr(), s + done, static_cast<std::size_t>(take));
+        pbump(static_cast<int>(take));
+        done += take;
+    }
+    return done;
+}
+
+// pushes whole windows through; the last partial one waits for close()
+int ostreambuf::sync() {
+    if (closed_) return -1;
+    if (!drain()) return -1;
+    return sink_->pubsync();
+}
+
+bool ostreambuf::close() {
+    if (closed_) return true;
+    bool ok = drain();
+    closed_ = true;
+    setp(nullptr, nullptr);
+    ok = ok && put(cipher_.data(), enc_.finish(cipher_.data()));
+    return ok && sink_->pubsync() == 0;
+}
+
+// ---------------- istreambuf ----------------
+
+istreambuf::istreambuf(std::streambuf* source, std::string_view key, std::size_t chunk)
+    : source_(source), key_(key) {
+    chunk = std::max<std::size_t>(chunk, BLOCK_SYMBOLS + 1);
+    cipher_.resize(chunk);
+    plain_.resize(Decoder::bound(chunk));
+    setg(plain_.data(), plain_.data(), plain_.data());
+}
+
+istreambuf::int_type istreambuf::underflow() {
+    while (gptr() == egptr()) {
+        if (eof_) return traits_type::eof();
+        auto got = source_->sgetn(cipher_.data(), static_cast<std::streamsize>(cipher_.size()));
+        if (got <= 0) {
+            eof_ = true;
+            dec_.finish();
+            return traits_type::eof();
+        }
+        auto* out = reinterpret_cast<std::uint8_t*>(plain_.data());
+        std::size_t n = dec_.update({cipher_.data(), static_cast<std::size_t>(got)}, out);
+        xor_with_key({out, n}, key_, key_pos_);
+        key_pos_ += n;
+        setg(plain_.data(), plain_.data(), plain_.data() + n);
+    }
+    return traits_type::to_int_type(*gptr());
+}
+
+} // namespace mosaic
@@ -0,0 +1,209 @@
+// Mosaic codec for C++: encode and decode, byte for byte the same as
+// src/mosaic.c (noise included, given the same seed), plus std::streambuf
+// adapters so any iostream can encrypt or decrypt on the fly.
+//
+//   mosaic::Codec codec;                        // seeded from the clock
+//   std::string_view ct = codec.encrypt("Hello", "key");
+//   auto plain = codec.decrypt(ct, "key");      // span into codec scratch
+//
+//   mosaic::ostreambuf enc(std::cout.rdbuf(), "key");
+//   std::ostream(&enc) << file.rdbuf();
+//   enc.close();                                // writes the trailer
+//
+//   mosaic::istreambuf dec(std::cin.rdbuf(), "key");
+//   std::istream in(&dec);
+//   in.exceptions(std::ios::badbit);            // rethrow decode_error
+//   while (in.read(buf, sizeof buf) || in.gcount()) ...
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace mosaic {
+
+constexpr std::string_view ALPHABET = "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789!@#$%^&*_-?";
+constexpr std::string_view NOISE_SET = "abcdefghijklmnopqrstuvwxyz";
+constexpr char TERM = '~';
+constexpr char COMPACT_MARK = 'c';
+// compressed and wide streams are not supported here; Decoder rejects them
+constexpr char COMPRESS_MARK = 'z';
+constexpr char WIDE_MARK = 'w';
+constexpr int BASE = 47;
+constexpr std::size_t BLOCK_BYTES = 5;
+constexpr std::size_t BLOCK_SYMBOLS = 8;
+constexpr std::size_t CHECKSUM_PERIOD = 4;
+constexpr std::size_t WINDOW_BYTES = BLOCK_BYTES * CHECKSUM_PERIOD;
+
+// encode options (bitmask), as MOSAIC_OPT_* in mosaic.h
+constexpr unsigned OPT_COMPACT = 0x1u; // no noise; every window is exactly 37 chars
+
+// a seed that differs from run to run, like the C encoder's default
+std::uint64_t random_seed();
+
+// XORs data in place with the repeating key, as if data started `offset`
+// bytes into the stream
+void xor_with_key(std::span<std::uint8_t> data, std::string_view key, std::uint64_t offset = 0);
+
+class decode_error : public std::runtime_error {
+public:
+    decode_error(const char* what, std::uint64_t offset);
+    std::uint64_t offset() const noexcept { return offset_; } // ciphertext offset of the bad char
+private:
+    std::uint64_t offset_;
+};
+
+// Incremental encoder, the C++ twin of mosaic_encoder: feed plaintext in
+// pieces of any size, then finish() for the tail and trailer. Blocks are
+// written a whole checksum window at a time.
+class Encoder {
+public:
+    explicit Encoder(unsigned opts = 0, std::uint64_t seed = random_seed());
+
+    // worst-case output of one update() or finish() fed n bytes
+    static std::size_t bound(std::size_t n, unsigned opts);
+
+    // out must hold bound(in.size(), opts) chars; returns chars written
+    std::size_t update(std::span<const std::uint8_t> in, char* out);
+    std::size_t finish(char* out);
+
+private:
+    std::size_t emit(const std::uint8_t* in, std::size_t len, char* out);
+
+    unsigned opts_;
+    std::uint64_t rng_;
+    std::uint64_t blocks_ = 0;
+    std::uint64_t in_total_ = 0;
+    std::uint8_t carry_[WINDOW_BYTES];
+    std::size_t carry_len_ = 0;
+    bool marked_ = false;
+};
+
+// Incremental decoder, the C++ twin of mosaic_decoder. Throws decode_error
+// at the first bad char; whitespace may trail the trailer.
+class Decoder {
+public:
+    // worst-case output of one update() fed n chars
+    static std::size_t bound(std::size_t n) { return (n / (BLOCK_SYMBOLS + 1) + 2) * BLOCK_BYTES; }
+
+    // out must hold bound(in.size()) bytes; returns bytes written
+    std::size_t update(std::string_view in, std::uint8_t* out);
+    // throws unless the trailer has been read
+    void finish();
+    bool done() const noexcept { return state_ == State::done; }
+
+private:
+    enum class State : std::uint8_t { block, symbol, term, checksum, trailer1, trailer2, done, failed };
+
+    [[noreturn]] void fail(const char* what, std::size_t at);
+    std::size_t end_block(std::uint8_t* out);
+
+    State state_ = State::block;
+    int k_ = 0;
+    std::uint8_t digits_[BLOCK_SYMBOLS];
+    std::uint64_t blocks_ = 0;
+    std::uint8_t window_[WINDOW_BYTES];
+    std::uint8_t held_[BLOCK_BYTES];
+    bool have_held_ = false;
+    std::uint64_t consumed_ = 0;
+};
+
+// One-shot encode/decode with reusable scratch. Results are views into the
+// codec's own buffers, valid until its next call, so a long-lived Codec
+// stops allocating once its buffers have grown to the working size.
+// Move-only: the scratch travels with it.
+class Codec {
+public:
+    explicit Codec(unsigned opts = 0, std::uint64_t seed = random_seed());
+
+    Codec(Codec&&) noexcept = default;
+    Codec& operator=(Codec&&) noexcept = default;
+    Codec(const Codec&) = delete;
+    Codec& operator=(const Codec&) = delete;
+
+    // every encode draws its noise from this seed, so its output equals
+    // mosaic_encode_seeded() with the same seed; reseed to vary it
+    void reseed(std::uint64_t seed) { seed_ = seed; }
+    void set_options(unsigned opts) { opts_ = opts; }
+
+    std::string_view encode(std::span<const std::uint8_t> plain);
+    std::string_view encode(std::string_view plain);
+    std::string_view encrypt(std::string_view plain, std::string_view key);
+
+    std::span<const std::uint8_t> decode(std::string_view cipher);
+    std::span<const std::uint8_t> decrypt(std::string_view cipher, std::string_view key);
+
+private:
+    unsigned opts_;
+    std::uint64_t seed_;
+    std::string text_;
+    std::vector<std::uint8_t> bytes_;
+};
+
+// Output adapter: plaintext written through it reaches `sink` as Mosaic
+// ciphertext, in chunks of `chunk` plaintext bytes (rounded to whole
+// windows). close() (or the destructor) writes the tail and trailer.
+class ostreambuf : public std::streambuf {
+public:
+    explicit ostreambuf(std::streambuf* sink, std::string_view key = {}, unsigned opts = 0,
+                        std::uint64_t seed = random_seed(), std::size_t chunk = 64 * 1024);
+    ~ostreambuf() override;
+
+    ostreambuf(const ostreambuf&) = delete;
+    ostreambuf& operator=(const ostreambuf&) = delete;
+
+    // flushes and writes the trailer; false if the sink refused data
+    bool close();
+
+protected:
+    int_type overflow(int_type ch) override;
+    std::streamsize xsputn(const char* s, std::streamsize n) override;
+    int sync() override;
+
+private:
+    bool drain();
+    bool put(const char* s, std::size_t n);
+
+    std::streambuf* sink_;
+    std::string key_;
+    std::uint64_t key_pos_ = 0;
+    Encoder enc_;
+    std::vector<char> plain_;
+    std::vector<char> cipher_;
+    bool closed_ = false;
+};
+
+// Input adapter: reads Mosaic ciphertext from `source` `chunk` chars at a
+// time and yields plaintext. Malformed input throws decode_error out of
+// the read; std::istream turns that into badbit (or rethrows it when
+// exceptions(badbit) is set). Read through an istream, not straight off
+// the buffer with istreambuf_iterator or operator<<(streambuf*), which
+// would swallow the error.
+class istreambuf : public std::streambuf {
+public:
+    explicit istreambuf(std::streambuf* source, std::string_view key = {},
+                        std::size_t chunk = 64 * 1024);
+
+    istreambuf(const istreambuf&) = delete;
+    istreambuf& operator=(const istreambuf&) = delete;
+
+protected:
+    int_type underflow() override;
+
+private:
+    std::streambuf* source_;
+    std::string key_;
+    std::uint64_t key_pos_ = 0;
+    Decoder dec_;
+    std::vector<char> cipher_;
+    std::vector<char> plain_;
+    bool eof_ = false;
+};
+
+} // namespace mosaic
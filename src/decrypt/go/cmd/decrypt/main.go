@@ -0,0 +1,76 @@
+// Usage (from src/decrypt/go):
+//   go run ./cmd/decrypt "<ciphertext>"
+//   go run ./cmd/decrypt "<ciphertext>" "<key>"
+//   go run ./cmd/decrypt - "<key>" < in.txt > out.bin   (stream stdin to stdout)
+// or build:
+//   go build -o mosaic_decode ./cmd/decrypt
+//   ./mosaic_decode "<ciphertext>" "<key>"
+
+package main
+
+import (
+	"bufio"
+	"bytes"
+	"encoding/hex"
+	"fmt"
+	"io"
+	"os"
+	"unicode/utf8"
+
+	"mosaic"
+)
+
+func main() {
+	if len(os.Args) < 2 {
+		fmt.Fprintf(os.Stderr, "Usage: %s '<ciphertext>'|- [key]\n", os.Args[0])
+		os.Exit(1)
+	}
+	s := os.Args[1]
+
+	// match Python/C behavior: if key not provided, use fallback "default-key"
+	var key string
+	if len(os.Args) >= 3 {
+		key = os.Args[2]
+	} else {
+		key = "default-key"
+	}
+
+	if s == "-" {
+		d := mosaic.NewDecoder(os.Stdin)
+		d.SetKey([]byte(key))
+		w := bufio.NewWriterSize(os.Stdout, 64*1024)
+		_, err := io.Copy(w, d)
+		if err == nil {
+			err = w.Flush()
+		}
+		if err != nil {
+			fmt.Fprintln(os.Stderr, "Decoding error:", err)
+			os.Exit(2)
+		}
+		return
+	}
+
+	raw, err := mosaic.Decode(nil, []byte(s))
+	if err != nil {
+		fmt.Fprintln(os.Stderr, "Decoding error:", err)
+		os.Exit(2)
+	}
+
+	mosaic.XORKey(raw, []byte(key), 0)
+
+	fmt.Println("Decoded bytes (hex):", hex.EncodeToString(raw))
+
+	if utf8.Valid(raw) {
+		fmt.Println("Decoded text (utf-8):", string(raw))
+	} else {
+		var buf bytes.Buffer
+		for _, b := range raw {
+			if b >= 32 && b <= 126 {
+				buf.WriteByte(b)
+			} else {
+				buf.WriteString(fmt.Sprintf("\\x%02x", b))
+			}
+		}
+		fmt.Println("Decoded text:", buf.String())
+	}
+}
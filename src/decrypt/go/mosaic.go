@@ -0,0 +1,485 @@
+// Package mosaic decodes Mosaic ciphertext.
+//
+// Decode works on byte slices and appends to a caller-owned buffer, so with
+// a reused buffer it does not allocate. Decoder wraps an io.Reader for
+// constant-memory streaming, and DecodeParallel decodes checksum windows on
+// a pool of goroutines. Symbols are looked up in fixed arrays built once at
+// init: no maps, no per-block strings or slices.
+package mosaic
+
+import (
+	"bytes"
+	"fmt"
+	"io"
+	"runtime"
+	"sync"
+	"sync/atomic"
+)
+
+const (
+	ALPHABET        = "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789!@#$%^&*_-?"
+	TERM            = '~'
+	BASE            = 47
+	BLOCK_BYTES     = 5
+	BLOCK_SYMBOLS   = 8
+	CHECKSUM_PERIOD = 4
+	WINDOW_BYTES    = BLOCK_BYTES * CHECKSUM_PERIOD
+)
+
+const invalid = 0xFF
+
+var (
+	// revBase[c] is c's index in ALPHABET, invalid for non-symbols
+	revBase [256]uint8
+	// rotation[b%BASE] is the rotation of block b; (b*13+11)%47 repeats every 47 blocks
+	rotation [BASE]uint8
+	// digitOf[rot][c] is the digit c stands for in a block with rotation rot
+	digitOf [BASE][256]uint8
+)
+
+func init() {
+	for c := range revBase {
+		revBase[c] = invalid
+	}
+	for i := 0; i < len(ALPHABET); i++ {
+		revBase[ALPHABET[i]] = uint8(i)
+	}
+	for b := 0; b < BASE; b++ {
+		rotation[b] = uint8((b*13 + 11) % BASE)
+	}
+	for rot := 0; rot < BASE; rot++ {
+		for c := 0; c < 256; c++ {
+			digitOf[rot][c] = invalid
+			if v := revBase[c]; v != invalid {
+				digitOf[rot][c] = uint8((int(v) + BASE - rot) % BASE)
+			}
+		}
+	}
+}
+
+func isNoise(c byte) bool {
+	return c >= 'a' && c <= 'z'
+}
+
+func isSpace(c byte) bool {
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v'
+}
+
+// MaxDecodedLen is the most plaintext n bytes of ciphertext can decode to.
+func MaxDecodedLen(n int) int {
+	return (n/(BLOCK_SYMBOLS+1) + 2) * BLOCK_BYTES
+}
+
+// XORKey XORs data in place with the repeating key, as if data started
+// offset bytes into the plaintext.
+func XORKey(data, key []byte, offset uint64) {
+	if len(key) == 0 {
+		return
+	}
+	k := int(offset % uint64(len(key)))
+	for i := range data {
+		data[i] ^= key[k]
+		k++
+		if k == len(key) {
+			k = 0
+		}
+	}
+}
+
+// ErrorKind says what was wrong with the ciphertext.
+type ErrorKind int
+
+const (
+	ErrSymbol      ErrorKind = iota // a byte that is not a symbol, noise or whitespace
+	ErrTerminator                   // block terminator missing or misplaced
+	ErrChecksum                     // window checksum does not match
+	ErrTrailer                      // trailer missing, malformed, or followed by data
+	ErrUnsupported                  // compressed ('z') or wide ('w') stream
+)
+
+// DecodeError reports where decoding stopped.
+type DecodeError struct {
+	Kind   ErrorKind
+	Offset int64 // offset into the ciphertext of the byte that failed
+}
+
+func (e *DecodeError) Error() string {
+	what := [...]string{"invalid symbol", "missing block terminator", "checksum mismatch",
+		"missing or malformed trailer", "unsupported stream (compressed or wide)"}[e.Kind]
+	return fmt.Sprintf("%s at offset %d", what, e.Offset)
+}
+
+// where the next byte lands in "SSSSSSSS~", a window checksum, or "~~P"
+type state uint8
+
+const (
+	stBlock state = iota
+	stSymbol
+	stTerm
+	stChecksum
+	stTrailer1
+	stTrailer2
+	stDone
+	stFailed
+)
+
+// machine is the push decoder under Decode, Decoder and DecodeParallel. The
+// last block is held back until the trailer says how much of it is padding.
+type machine struct {
+	st       state
+	k        int
+	digits   [BLOCK_SYMBOLS]uint8
+	blocks   uint64
+	window   [WINDOW_BYTES]byte
+	held     [BLOCK_BYTES]byte
+	haveHeld bool
+	consumed int64
+	err      error
+}
+
+// reset starts over at block firstBlock, which must open a checksum window
+func (m *machine) reset(firstBlock uint64) {
+	*m = machine{blocks: firstBlock}
+}
+
+func (m *machine) fail(kind ErrorKind, at int) error {
+	m.st = stFailed
+	m.err = &DecodeError{Kind: kind, Offset: m.consumed + int64(at)}
+	return m.err
+}
+
+func (m *machine) endBlock(dst []byte) []byte {
+	var v uint64
+	for _, d := range m.digits {
+		v = v*BASE + uint64(d)
+	}
+	slot := int(m.blocks % CHECKSUM_PERIOD)
+	w := m.window[slot*BLOCK_BYTES : (slot+1)*BLOCK_BYTES]
+	w[0], w[1], w[2], w[3], w[4] = byte(v>>32), byte(v>>24), byte(v>>16), byte(v>>8), byte(v)
+	if m.haveHeld {
+		dst = append(dst, m.held[:]...)
+	}
+	copy(m.held[:], w)
+	m.haveHeld = true
+	m.blocks++
+	if slot == CHECKSUM_PERIOD-1 {
+		m.st = stChecksum
+	} else {
+		m.st = stBlock
+	}
+	return dst
+}
+
+func (m *machine) checksum() uint8 {
+	var x byte
+	for _, b := range m.window {
+		x ^= b
+	}
+	return x % BASE
+}
+
+// update decodes src, appending to dst. It appends at most
+// MaxDecodedLen(len(src)) bytes.
+func (m *machine) update(dst, src []byte) ([]byte, error) {
+	if m.st == stFailed {
+		return dst, m.err
+	}
+	for i := 0; i < len(src); {
+		c := src[i]
+		switch m.st {
+		case stBlock:
+			// common case: eight symbols and the terminator, no noise
+			if len(src)-i > BLOCK_SYMBOLS && src[i+BLOCK_SYMBOLS] == TERM {
+				table := &digitOf[rotation[m.blocks%BASE]]
+				var bad uint8
+				for k := 0; k < BLOCK_SYMBOLS; k++ {
+					d := table[src[i+k]]
+					m.digits[k] = d
+					bad |= d & 0x80
+				}
+				if bad == 0 {
+					dst = m.endBlock(dst)
+					i += BLOCK_SYMBOLS + 1
+					continue
+				}
+			}
+			if isSpace(c) {
+				i++
+				continue
+			}
+			if c == TERM {
+				m.st = stTrailer1
+				i++
+				continue
+			}
+			// the marks sit before the first block; 'c' (compact) reads as noise
+			if m.blocks == 0 && (c == 'z' || c == 'w') {
+				return dst, m.fail(ErrUnsupported, i)
+			}
+			// c is the first symbol (or noise): read it again as one
+			m.st = stSymbol
+			m.k = 0
+			continue
+		case stSymbol:
+			if !isNoise(c) {
+				if c == TERM {
+					return dst, m.fail(ErrTerminator, i)
+				}
+				d := digitOf[rotation[m.blocks%BASE]][c]
+				if d == invalid {
+					return dst, m.fail(ErrSymbol, i)
+				}
+				m.digits[m.k] = d
+				m.k++
+				if m.k == BLOCK_SYMBOLS {
+					m.st = stTerm
+				}
+			}
+		case stTerm:
+			if !isNoise(c) {
+				if c != TERM {
+					return dst, m.fail(ErrTerminator, i)
+				}
+				dst = m.endBlock(dst)
+			}
+		case stChecksum:
+			if !isNoise(c) {
+				v := revBase[c]
+				if v == invalid {
+					return dst, m.fail(ErrSymbol, i)
+				}
+				if v != m.checksum() {
+					return dst, m.fail(ErrChecksum, i)
+				}
+				m.st = stBlock
+			}
+		case stTrailer1:
+			if c != TERM {
+				return dst, m.fail(ErrTerminator, i)
+			}
+			m.st = stTrailer2
+		case stTrailer2:
+			pad := int(revBase[c])
+			if pad >= BLOCK_BYTES || (pad > 0 && !m.haveHeld) {
+				return dst, m.fail(ErrTrailer, i)
+			}
+			if m.haveHeld {
+				dst = append(dst, m.held[:BLOCK_BYTES-pad]...)
+				m.haveHeld = false
+			}
+			m.st = stDone
+		default: // stDone: nothing but whitespace may follow the trailer
+			if !isSpace(c) {
+				return dst, m.fail(ErrTrailer, i)
+			}
+		}
+		i++
+	}
+	m.consumed += int64(len(src))
+	return dst, nil
+}
+
+func (m *machine) finish() error {
+	switch m.st {
+	case stDone:
+		return nil
+	case stFailed:
+		return m.err
+	}
+	return m.fail(ErrTrailer, 0)
+}
+
+// Decode appends the plaintext of src to dst and returns the extended
+// slice. It does not allocate when dst has MaxDecodedLen(len(src)) spare
+// capacity.
+func Decode(dst, src []byte) ([]byte, error) {
+	var m machine
+	dst, err := m.update(dst, src)
+	if err != nil {
+		return dst, err
+	}
+	return dst, m.finish()
+}
+
+const readChunk = 32 * 1024
+
+// Decoder reads ciphertext from an io.Reader and yields plaintext, in
+// constant memory whatever the input size.
+type Decoder struct {
+	r      io.Reader
+	m      machine
+	in     []byte
+	out    []byte
+	pos    int
+	key    []byte
+	keyPos uint64
+	err    error
+}
+
+// NewDecoder returns a Decoder reading ciphertext from r.
+func NewDecoder(r io.Reader) *Decoder {
+	return &Decoder{
+		r:   r,
+		in:  make([]byte, readChunk),
+		out: make([]byte, 0, MaxDecodedLen(readChunk)),
+	}
+}
+
+// SetKey makes the Decoder undo the XOR with key too (nil: no key).
+func (d *Decoder) SetKey(key []byte) {
+	d.key = append(d.key[:0], key...)
+}
+
+// Reset starts over on a new stream, keeping the buffers and the key.
+func (d *Decoder) Reset(r io.Reader) {
+	d.r = r
+	d.m.reset(0)
+	d.out = d.out[:0]
+	d.pos = 0
+	d.keyPos = 0
+	d.err = nil
+}
+
+func (d *Decoder) Read(p []byte) (int, error) {
+	for {
+		if d.pos < len(d.out) {
+			n := copy(p, d.out[d.pos:])
+			d.pos += n
+			return n, nil
+		}
+		if d.err != nil {
+			return 0, d.err
+		}
+		if len(p) == 0 {
+			return 0, nil
+		}
+		n, err := d.r.Read(d.in)
+		d.out, d.pos = d.out[:0], 0
+		if n > 0 {
+			// fits: update never appends more than MaxDecodedLen(len(d.in))
+			d.out, d.err = d.m.update(d.out, d.in[:n])
+			XORKey(d.out, d.key, d.keyPos)
+			d.keyPos += uint64(len(d.out))
+		}
+		if d.err != nil {
+			continue // hand out what decoded before the error first
+		}
+		if err == io.EOF {
+			if d.err = d.m.finish(); d.err == nil {
+				d.err = io.EOF
+			}
+		} else if err != nil {
+			d.err = err
+		}
+	}
+}
+
+// windowsPerTask is how many checksum windows a worker decodes in one go
+// (about 75 KB of noisy ciphertext).
+const windowsPerTask = 2048
+
+// DecodeParallel is Decode with the checksum windows spread over a pool of
+// workers goroutines (0 means GOMAXPROCS). A byte scan finds the window
+// boundaries (every fourth terminator plus the checksum after it); each run
+// of windows then decodes on its own, straight into its place in dst.
+// Errors are reported exactly as Decode reports them.
+func DecodeParallel(dst, src []byte, workers int) ([]byte, error) {
+	if workers <= 0 {
+		workers = runtime.GOMAXPROCS(0)
+	}
+	end := len(src)
+	for end > 0 && isSpace(src[end-1]) {
+		end--
+	}
+	if workers == 1 || end < 3 || src[end-3] != TERM || src[end-2] != TERM {
+		return Decode(dst, src)
+	}
+	body := src[:end-3]
+
+	// offsets where each run of windowsPerTask windows starts
+	const taskBlocks = CHECKSUM_PERIOD * windowsPerTask
+	starts := []int{0}
+	terms := 0
+	for i := 0; i < len(body); i++ {
+		if body[i] != TERM {
+			continue
+		}
+		terms++
+		if terms%taskBlocks == 0 {
+			i++
+			for i < len(body) && isNoise(body[i]) {
+				i++
+			}
+			starts = append(starts, i+1)
+		}
+	}
+	// the last run must hold the last block: only the trailer knows its padding
+	if last := starts[len(starts)-1]; len(starts) > 1 &&
+		(last >= len(body) || bytes.IndexByte(body[last:], TERM) < 0) {
+		starts = starts[:len(starts)-1]
+	}
+	tasks := len(starts) - 1
+	if tasks == 0 {
+		return Decode(dst, src)
+	}
+
+	// every run but the last decodes to exactly taskBlocks blocks, so each
+	// gets a fixed slice of dst; room for the last one is made up front so
+	// appending to it never moves the array under the workers
+	const taskBytes = taskBlocks * BLOCK_BYTES
+	base := len(dst)
+	tail := src[starts[tasks]:]
+	if need := base + tasks*taskBytes + MaxDecodedLen(len(tail)); cap(dst) < need {
+		grown := make([]byte, base, need)
+		copy(grown, dst)
+		dst = grown
+	}
+
+	work := make(chan int, tasks)
+	for t := 0; t < tasks; t++ {
+		work <- t
+	}
+	close(work)
+
+	var failed atomic.Bool
+	var wg sync.WaitGroup
+	if workers > tasks {
+		workers = tasks
+	}
+	for w := 0; w < workers; w++ {
+		wg.Add(1)
+		go func() {
+			defer wg.Done()
+			var m machine
+			for t := range work {
+				if failed.Load() {
+					continue
+				}
+				m.reset(uint64(t * taskBlocks))
+				at := base + t*taskBytes
+				out, err := m.update(dst[at:at:at+taskBytes], src[starts[t]:starts[t+1]])
+				if err != nil || m.st != stBlock || m.blocks != uint64((t+1)*taskBlocks) {
+					failed.Store(true)
+					continue
+				}
+				_ = append(out, m.held[:]...)
+			}
+		}()
+	}
+
+	// the run with the trailer decodes here, meanwhile
+	var m machine
+	m.reset(uint64(tasks * taskBlocks))
+	out, err := m.update(dst[:base+tasks*taskBytes], tail)
+	if err == nil {
+		err = m.finish()
+	}
+	wg.Wait()
+
+	if err != nil || failed.Load() {
+		// the scan can mis-split malformed input; let the serial decoder
+		// say where it really breaks
+		return Decode(dst[:base], src)
+	}
+	return out, nil
+}
@@ -0,0 +1,151 @@
+// Decoder throughput benchmarks. The ciphertext is built here (same format
+// as the C encoder, fixed PRNG seed) so they need nothing but the package.
+//
+//	go test -run '^$' -bench . -benchmem
+//
+// Decode and Decoder report 0 allocs/op once their buffers are warm;
+// DecodeParallel allocates a constant handful per call for its goroutines.
+
+package mosaic
+
+import (
+	"bytes"
+	"io"
+	"sync"
+	"testing"
+)
+
+const benchSize = 4 << 20
+
+var (
+	benchOnce    sync.Once
+	benchPlain   []byte
+	benchNoisy   []byte
+	benchCompact []byte
+)
+
+type xorShift uint64
+
+func (x *xorShift) next() uint64 {
+	*x ^= *x << 13
+	*x ^= *x >> 7
+	*x ^= *x << 17
+	return uint64(*x)
+}
+
+// encode is mosaic_encode_ex: noise before half the terminators, or none
+// and a leading mark in compact mode
+func encode(data []byte, compact bool, rng *xorShift) []byte {
+	out := make([]byte, 0, len(data)/BLOCK_BYTES*11+16)
+	if compact && len(data) > 0 {
+		out = append(out, 'c')
+	}
+	var cs byte
+	for b := 0; b*BLOCK_BYTES < len(data); b++ {
+		var block [BLOCK_BYTES]byte
+		copy(block[:], data[b*BLOCK_BYTES:])
+		var v uint64
+		for _, x := range block {
+			v = v<<8 | uint64(x)
+			cs ^= x
+		}
+		var digits [BLOCK_SYMBOLS]int
+		for k := BLOCK_SYMBOLS - 1; k >= 0; k-- {
+			digits[k] = int(v % BASE)
+			v /= BASE
+		}
+		rot := (b*13 + 11) % BASE
+		for _, d := range digits {
+			out = append(out, ALPHABET[(d+rot)%BASE])
+		}
+		if r := rng.next(); !compact && r&1 == 1 {
+			out = append(out, 'a'+byte((r>>8)%26))
+		}
+		out = append(out, TERM)
+		if b%CHECKSUM_PERIOD == CHECKSUM_PERIOD-1 {
+			out = append(out, ALPHABET[cs%BASE])
+			cs = 0
+		}
+	}
+	pad := (BLOCK_BYTES - len(data)%BLOCK_BYTES) % BLOCK_BYTES
+	return append(out, TERM, TERM, ALPHABET[pad])
+}
+
+func benchData(b *testing.B) {
+	benchOnce.Do(func() {
+		rng := xorShift(0x9E3779B97F4A7C15)
+		benchPlain = make([]byte, benchSize)
+		for i := range benchPlain {
+			benchPlain[i] = byte(rng.next())
+		}
+		benchNoisy = encode(benchPlain, false, &rng)
+		benchCompact = encode(benchPlain, true, &rng)
+	})
+	b.SetBytes(benchSize)
+	b.ReportAllocs()
+}
+
+func checkPlain(b *testing.B, got []byte, err error) {
+	if err != nil {
+		b.Fatal(err)
+	}
+	if !bytes.Equal(got, benchPlain) {
+		b.Fatal("decoded output does not match the plaintext")
+	}
+}
+
+func benchDecode(b *testing.B, compact bool) {
+	benchData(b)
+	src := benchNoisy
+	if compact {
+		src = benchCompact
+	}
+	dst := make([]byte, 0, MaxDecodedLen(len(src)))
+	out, err := Decode(dst, src)
+	checkPlain(b, out, err)
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		if _, err := Decode(dst, src); err != nil {
+			b.Fatal(err)
+		}
+	}
+}
+
+func BenchmarkDecode(b *testing.B)        { benchDecode(b, false) }
+func BenchmarkDecodeCompact(b *testing.B) { benchDecode(b, true) }
+
+func BenchmarkDecoder(b *testing.B) {
+	benchData(b)
+	r := bytes.NewReader(benchNoisy)
+	d := NewDecoder(r)
+	out, err := io.ReadAll(d)
+	checkPlain(b, out, err)
+	buf := make([]byte, 64<<10)
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		r.Reset(benchNoisy)
+		d.Reset(r)
+		for {
+			_, err := d.Read(buf)
+			if err == io.EOF {
+				break
+			}
+			if err != nil {
+				b.Fatal(err)
+			}
+		}
+	}
+}
+
+func BenchmarkDecodeParallel(b *testing.B) {
+	benchData(b)
+	dst := make([]byte, 0, MaxDecodedLen(len(benchNoisy)))
+	out, err := DecodeParallel(dst, benchNoisy, 0)
+	checkPlain(b, out, err)
+	b.ResetTimer()
+	for i := 0; i < b.N; i++ {
+		if _, err := DecodeParallel(dst, benchNoisy, 0); err != nil {
+			b.Fatal(err)
+		}
+	}
+}
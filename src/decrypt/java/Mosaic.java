@@ -0,0 +1,586 @@
+import java.io.IOException;
+import java.io.InputStream;
+import java.nio.BufferOverflowException;
+import java.nio.ByteBuffer;
+import java.util.Arrays;
+import java.util.concurrent.CountDownLatch;
+import java.util.concurrent.Executor;
+import java.util.concurrent.ForkJoinPool;
+import java.util.concurrent.RejectedExecutionException;
+import java.util.concurrent.atomic.AtomicBoolean;
+
+/**
+ * Mosaic decoder.
+ *
+ * <p>Ciphertext comes from a {@link ByteBuffer} or an {@link InputStream}; plaintext goes into a
+ * caller-provided {@link ByteBuffer}, heap or direct. Symbols are looked up in {@code static
+ * final} byte tables built once: no maps, strings or lists, and nothing is allocated per block.
+ * A reused {@link Decoder} allocates nothing at all. {@link #decodeParallel} decodes the checksum
+ * windows on an {@link Executor}.
+ *
+ * <p>Standard and compact streams are supported. Wide and compressed streams (a leading
+ * {@code w} or {@code z}) are rejected; decode those with the C library.
+ */
+public final class Mosaic {
+    public static final String ALPHABET = "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789!@#$%^&*_-?";
+    public static final byte TERM = '~';
+    public static final int BASE = 47;
+    public static final int BLOCK_BYTES = 5;
+    public static final int BLOCK_SYMBOLS = 8;
+    public static final int CHECKSUM_PERIOD = 4;
+    public static final int WINDOW_BYTES = BLOCK_BYTES * CHECKSUM_PERIOD;
+
+    private static final byte INVALID = -1;
+    /** REV_BASE[c] is c's index in ALPHABET, INVALID for non-symbols. */
+    private static final byte[] REV_BASE = new byte[256];
+    /** ROTATION[b % BASE] is the rotation of block b; (b*13+11)%47 repeats every 47 blocks. */
+    private static final byte[] ROTATION = new byte[BASE];
+    /** DIGIT_OF[rot][c] is the digit c stands for in a block with rotation rot. */
+    private static final byte[][] DIGIT_OF = new byte[BASE][256];
+
+    static {
+        Arrays.fill(REV_BASE, INVALID);
+        for (int i = 0; i < BASE; i++) {
+            REV_BASE[ALPHABET.charAt(i)] = (byte) i;
+        }
+        for (int b = 0; b < BASE; b++) {
+            ROTATION[b] = (byte) ((b * 13 + 11) % BASE);
+        }
+        for (int rot = 0; rot < BASE; rot++) {
+            for (int c = 0; c < 256; c++) {
+                int v = REV_BASE[c];
+                DIGIT_OF[rot][c] = v < 0 ? INVALID : (byte) ((v + BASE - rot) % BASE);
+            }
+        }
+    }
+
+    private Mosaic() {}
+
+    static boolean isNoise(int c) {
+        return c >= 'a' && c <= 'z';
+    }
+
+    static boolean isSpace(int c) {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == 0x0b;
+    }
+
+    /** The most plaintext n bytes of ciphertext can decode to. */
+    public static int maxDecodedLength(int n) {
+        return (n / (BLOCK_SYMBOLS + 1) + 2) * BLOCK_BYTES;
+    }
+
+    /**
+     * XORs data[from, to) in place with the repeating key, as if data[from] sat offset bytes
+     * into the plaintext. A null or empty key does nothing.
+     */
+    public static void xorKey(ByteBuffer data, int from, int to, byte[] key, long offset) {
+        if (key == null || key.length == 0) {
+            return;
+        }
+        int k = (int) Long.remainderUnsigned(offset, key.length);
+        for (int i = from; i < to; i++) {
+            data.put(i, (byte) (data.get(i) ^ key[k]));
+            if (++k == key.length) {
+                k = 0;
+            }
+        }
+    }
+
+    /** What was wrong with the ciphertext. */
+    public enum ErrorKind {
+        SYMBOL("invalid symbol"),
+        TERMINATOR("missing block terminator"),
+        CHECKSUM("checksum mismatch"),
+        TRAILER("missing or malformed trailer"),
+        UNSUPPORTED("wide or compressed stream");
+
+        final String what;
+
+        ErrorKind(String what) {
+            this.what = what;
+        }
+    }
+
+    /** Malformed ciphertext, with the offset of the byte where decoding stopped. */
+    public static final class MosaicException extends IllegalArgumentException {
+        private static final long serialVersionUID = 1L;
+        private final ErrorKind kind;
+        private final long offset;
+
+        MosaicException(ErrorKind kind, long offset) {
+            super(kind.what + " at offset " + offset);
+            this.kind = kind;
+            this.offset = offset;
+        }
+
+        public ErrorKind kind() {
+            return kind;
+        }
+
+        public long offset() {
+            return offset;
+        }
+    }
+
+    /**
+     * Push decoder: feed the ciphertext in pieces of any size with {@link #update}, then call
+     * {@link #finish}, or pull it from a stream with {@link #read}. The last block is held back
+     * until the trailer says how much of it is padding. Not thread-safe; reuse it with
+     * {@link #reset}.
+     */
+    public static final class Decoder {
+        // where the next byte lands in "SSSSSSSS~", a window checksum, or "~~P"
+        private static final int ST_BLOCK = 0;
+        private static final int ST_SYMBOL = 1;
+        private static final int ST_TERM = 2;
+        private static final int ST_CHECKSUM = 3;
+        private static final int ST_TRAILER1 = 4;
+        private static final int ST_TRAILER2 = 5;
+        private static final int ST_DONE = 6;
+        private static final int ST_FAILED = 7;
+
+        static final int READ_CHUNK = 32 * 1024;
+
+        private int st;
+        private int k;
+        private final byte[] digits = new byte[BLOCK_SYMBOLS];
+        private long blocks;
+        private final byte[] window = new byte[WINDOW_BYTES];
+        private final byte[] held = new byte[BLOCK_BYTES];
+        private boolean haveHeld;
+        private long consumed;
+        private MosaicException error;
+        private byte[] key;
+        private long keyPos;
+        private byte[] chunk;          // read(): ciphertext, allocated on first use
+        private ByteBuffer chunkBuf;
+        private boolean ended;
+
+        public Decoder() {}
+
+        /** A decoder that also undoes the XOR with key (null: no key). */
+        public Decoder(byte[] key) {
+            setKey(key);
+        }
+
+        public void setKey(byte[] key) {
+            this.key = key == null || key.length == 0 ? null : key.clone();
+        }
+
+        /** Starts over on a new stream, keeping the buffers and the key. */
+        public void reset() {
+            restart(0);
+            keyPos = 0;
+            ended = false;
+        }
+
+        /** Starts over at block firstBlock, which must open a checksum window. */
+        void restart(long firstBlock) {
+            st = ST_BLOCK;
+            k = 0;
+            blocks = firstBlock;
+            haveHeld = false;
+            consumed = 0;
+            error = null;
+        }
+
+        private MosaicException fail(ErrorKind kind, long at) {
+            st = ST_FAILED;
+            error = new MosaicException(kind, consumed + at);
+            return error;
+        }
+
+        private int endBlock(ByteBuffer dst, int o) {
+            long v = 0;
+            for (int d = 0; d < BLOCK_SYMBOLS; d++) {
+                v = v * BASE + digits[d];
+            }
+            int slot = (int) (blocks % CHECKSUM_PERIOD) * BLOCK_BYTES;
+            window[slot] = (byte) (v >>> 32);
+            window[slot + 1] = (byte) (v >>> 24);
+            window[slot + 2] = (byte) (v >>> 16);
+            window[slot + 3] = (byte) (v >>> 8);
+            window[slot + 4] = (byte) v;
+            if (haveHeld) {
+                o = putHeld(dst, o, BLOCK_BYTES);
+            }
+            System.arraycopy(window, slot, held, 0, BLOCK_BYTES);
+            haveHeld = true;
+            blocks++;
+            st = slot == (CHECKSUM_PERIOD - 1) * BLOCK_BYTES ? ST_CHECKSUM : ST_BLOCK;
+            return o;
+        }
+
+        private int putHeld(ByteBuffer dst, int o, int n) {
+            for (int j = 0; j < n; j++) {
+                dst.put(o + j, held[j]);
+            }
+            return o + n;
+        }
+
+        private int checksum() {
+            int x = 0;
+            for (byte b : window) {
+                x ^= b & 0xFF;
+            }
+            return x % BASE;
+        }
+
+        /**
+         * Decodes src[from, end) into dst from index o on, without the key, and returns where the
+         * output ends. dst must have room for maxDecodedLength(end - from) bytes.
+         */
+        private int run(ByteBuffer src, int from, int end, ByteBuffer dst, int o) {
+            if (st == ST_FAILED) {
+                throw error;
+            }
+            for (int i = from; i < end; ) {
+                int c = src.get(i) & 0xFF;
+                switch (st) {
+                case ST_BLOCK:
+                    // common case: eight symbols and the terminator, no noise
+                    if (end - i > BLOCK_SYMBOLS && src.get(i + BLOCK_SYMBOLS) == TERM) {
+                        byte[] table = DIGIT_OF[ROTATION[(int) (blocks % BASE)]];
+                        int bad = 0;
+                        for (int j = 0; j < BLOCK_SYMBOLS; j++) {
+                            byte d = table[src.get(i + j) & 0xFF];
+                            digits[j] = d;
+                            bad |= d;
+                        }
+                        if (bad >= 0) {
+                            o = endBlock(dst, o);
+                            i += BLOCK_SYMBOLS + 1;
+                            continue;
+                        }
+                    }
+                    if (isSpace(c)) {
+                        i++;
+                        continue;
+                    }
+                    if (c == TERM) {
+                        st = ST_TRAILER1;
+                        i++;
+                        continue;
+                    }
+                    // the marks sit before the first block; 'c' (compact) reads as noise
+                    if (blocks == 0 && (c == 'w' || c == 'z')) {
+                        throw fail(ErrorKind.UNSUPPORTED, i - from);
+                    }
+                    // c is the first symbol (or noise): read it again as one
+                    st = ST_SYMBOL;
+                    k = 0;
+                    continue;
+                case ST_SYMBOL:
+                    if (!isNoise(c)) {
+                        if (c == TERM) {
+                            throw fail(ErrorKind.TERMINATOR, i - from);
+                        }
+                        byte d = DIGIT_OF[ROTATION[(int) (blocks % BASE)]][c];
+                        if (d < 0) {
+                            throw fail(ErrorKind.SYMBOL, i - from);
+                        }
+                        digits[k++] = d;
+                        if (k == BLOCK_SYMBOLS) {
+                            st = ST_TERM;
+                        }
+                    }
+                    break;
+                case ST_TERM:
+                    if (!isNoise(c)) {
+                        if (c != TERM) {
+                            throw fail(ErrorKind.TERMINATOR, i - from);
+                        }
+                        o = endBlock(dst, o);
+                    }
+                    break;
+                case ST_CHECKSUM:
+                    if (!isNoise(c)) {
+                        int v = REV_BASE[c];
+                        if (v < 0) {
+                            throw fail(ErrorKind.SYMBOL, i - from);
+                        }
+                        if (v != checksum()) {
+                            throw fail(ErrorKind.CHECKSUM, i - from);
+                        }
+                        st = ST_BLOCK;
+                    }
+                    break;
+                case ST_TRAILER1:
+                    if (c != TERM) {
+                        throw fail(ErrorKind.TERMINATOR, i - from);
+                    }
+                    st = ST_TRAILER2;
+                    break;
+                case ST_TRAILER2: {
+                    int pad = REV_BASE[c];
+                    if (pad < 0 || pad >= BLOCK_BYTES || (pad > 0 && !haveHeld)) {
+                        throw fail(ErrorKind.TRAILER, i - from);
+                    }
+                    if (haveHeld) {
+                        o = putHeld(dst, o, BLOCK_BYTES - pad);
+                        haveHeld = false;
+                    }
+                    st = ST_DONE;
+                    break;
+                }
+                default: // ST_DONE: nothing but whitespace may follow the trailer
+                    if (!isSpace(c)) {
+                        throw fail(ErrorKind.TRAILER, i - from);
+                    }
+                }
+                i++;
+            }
+            consumed += end - from;
+            return o;
+        }
+
+        /**
+         * Decodes all of src into dst and undoes the key, advancing both positions. dst needs
+         * maxDecodedLength(src.remaining()) bytes of room, or a BufferOverflowException is thrown
+         * before anything is read. On malformed input a {@link MosaicException} is thrown and
+         * both positions are left as they were.
+         */
+        public void update(ByteBuffer src, ByteBuffer dst) {
+            if (dst.remaining() < maxDecodedLength(src.remaining())) {
+                throw new BufferOverflowException();
+            }
+            advance(src, src.limit(), dst);
+        }
+
+        private void advance(ByteBuffer src, int end, ByteBuffer dst) {
+            int start = dst.position();
+            int o = run(src, src.position(), end, dst, start);
+            xorKey(dst, start, o, key, keyPos);
+            keyPos += o - start;
+            src.position(end);
+            dst.position(o);
+        }
+
+        /** Checks that the stream ended with its trailer. */
+        public void finish() {
+            if (st == ST_DONE) {
+                return;
+            }
+            if (st == ST_FAILED) {
+                throw error;
+            }
+            throw fail(ErrorKind.TRAILER, 0);
+        }
+
+        /** A whole ciphertext: reset, update and finish. Returns the bytes written to dst. */
+        public int decode(ByteBuffer src, ByteBuffer dst) {
+            int start = dst.position();
+            reset();
+            update(src, dst);
+            finish();
+            return dst.position() - start;
+        }
+
+        /**
+         * Reads ciphertext from in and decodes it into dst, never reading more than dst has room
+         * for. Returns the bytes written (at least one), or -1 once the stream has ended and its
+         * trailer checked out. Throws BufferOverflowException when dst has no room left.
+         */
+        public int read(InputStream in, ByteBuffer dst) throws IOException {
+            if (ended) {
+                return -1;
+            }
+            if (chunk == null) {
+                chunk = new byte[READ_CHUNK];
+                chunkBuf = ByteBuffer.wrap(chunk);
+            }
+            int before = dst.position();
+            while (dst.position() == before) {
+                // the most ciphertext whose plaintext surely fits; a single byte can complete at
+                // most one block
+                int room = dst.remaining();
+                int want = room >= 2 * BLOCK_BYTES
+                        ? (room / BLOCK_BYTES - 2) * (BLOCK_SYMBOLS + 1) + BLOCK_SYMBOLS
+                        : room >= BLOCK_BYTES ? 1 : 0;
+                if (want == 0) {
+                    throw new BufferOverflowException();
+                }
+                int n = in.read(chunk, 0, Math.min(want, chunk.length));
+                if (n < 0) {
+                    finish();
+                    ended = true;
+                    return -1;
+                }
+                chunkBuf.clear();
+                chunkBuf.limit(n);
+                advance(chunkBuf, n, dst);
+            }
+            return dst.position() - before;
+        }
+    }
+
+    /** Decodes a whole ciphertext from src into dst and returns the bytes written. */
+    public static int decode(ByteBuffer src, ByteBuffer dst) {
+        return decode(src, dst, null);
+    }
+
+    /** The same, undoing the XOR with key as well (null: no key). */
+    public static int decode(ByteBuffer src, ByteBuffer dst, byte[] key) {
+        return new Decoder(key).decode(src, dst);
+    }
+
+    /** Decodes everything in from in into dst and returns the bytes written. */
+    public static int decode(InputStream in, ByteBuffer dst, byte[] key) throws IOException {
+        Decoder d = new Decoder(key);
+        int start = dst.position();
+        while (d.read(in, dst) >= 0) {
+            // dst fills up as it goes
+        }
+        return dst.position() - start;
+    }
+
+    /** Checksum windows a task decodes in one go (about 75 KB of noisy ciphertext). */
+    static final int WINDOWS_PER_TASK = 2048;
+
+    /** {@link #decodeParallel(ByteBuffer, ByteBuffer, byte[], Executor)} on the common pool. */
+    public static int decodeParallel(ByteBuffer src, ByteBuffer dst, byte[] key) {
+        return decodeParallel(src, dst, key, ForkJoinPool.commonPool());
+    }
+
+    /**
+     * {@link #decode(ByteBuffer, ByteBuffer, byte[])} with the checksum windows spread over
+     * executor. A byte scan finds the window boundaries (every fourth terminator plus the
+     * checksum after it); each run of windows then decodes on its own, straight into its place
+     * in dst, while the calling thread decodes the run with the trailer. Errors are reported
+     * exactly as the serial decoder reports them.
+     */
+    public static int decodeParallel(ByteBuffer src, ByteBuffer dst, byte[] key,
+                                     Executor executor) {
+        final int from = src.position();
+        int end = src.limit();
+        while (end > from && isSpace(src.get(end - 1) & 0xFF)) {
+            end--;
+        }
+        if (end - from < 3 || src.get(end - 3) != TERM || src.get(end - 2) != TERM) {
+            return decode(src, dst, key);
+        }
+        if (dst.remaining() < maxDecodedLength(src.remaining())) {
+            throw new BufferOverflowException();
+        }
+        final int body = end - 3;
+
+        // where each run of WINDOWS_PER_TASK windows starts
+        final int taskBlocks = CHECKSUM_PERIOD * WINDOWS_PER_TASK;
+        int[] starts = new int[16];
+        int n = 1;
+        starts[0] = from;
+        long terms = 0;
+        for (int i = from; i < body; i++) {
+            if (src.get(i) != TERM) {
+                continue;
+            }
+            if (++terms % taskBlocks == 0) {
+                i++;
+                while (i < body && isNoise(src.get(i))) {
+                    i++;
+                }
+                if (n == starts.length) {
+                    starts = Arrays.copyOf(starts, n * 2);
+                }
+                starts[n++] = i + 1;
+            }
+        }
+        // the last run must hold the last block: only the trailer knows its padding
+        if (n > 1) {
+            boolean hasTerm = false;
+            for (int i = starts[n - 1]; i < body && !hasTerm; i++) {
+                hasTerm = src.get(i) == TERM;
+            }
+            if (!hasTerm) {
+                n--;
+            }
+        }
+        final int tasks = n - 1;
+        if (tasks == 0) {
+            return decode(src, dst, key);
+        }
+
+        // every run but the last decodes to exactly taskBlocks blocks, so each gets a fixed
+        // range of dst
+        final int taskBytes = taskBlocks * BLOCK_BYTES;
+        final int base = dst.position();
+        final int[] runs = starts;
+        final AtomicBoolean failed = new AtomicBoolean();
+        final CountDownLatch done = new CountDownLatch(tasks);
+        for (int t = 0; t < tasks; t++) {
+            final int task = t;
+            Runnable r = () -> {
+                try {
+                    if (!failed.get() && !decodeRun(src.duplicate(), runs[task], runs[task + 1],
+                            dst.duplicate(), base + task * taskBytes, (long) task * taskBlocks,
+                            taskBlocks, key)) {
+                        failed.set(true);
+                    }
+                } catch (RuntimeException e) {
+                    failed.set(true);
+                } finally {
+                    done.countDown();
+                }
+            };
+            try {
+                executor.execute(r);
+            } catch (RejectedExecutionException e) {
+                failed.set(true);
+                done.countDown();
+            }
+        }
+
+        // the run with the trailer decodes here, meanwhile
+        Decoder m = new Decoder();
+        m.restart((long) tasks * taskBlocks);
+        int tailStart = base + tasks * taskBytes;
+        int o = tailStart;
+        boolean ok = true;
+        try {
+            o = m.run(src, runs[tasks], src.limit(), dst, tailStart);
+            m.finish();
+        } catch (MosaicException e) {
+            ok = false;
+        }
+        boolean interrupted = false;
+        while (true) {
+            try {
+                done.await();
+                break;
+            } catch (InterruptedException e) {
+                interrupted = true; // the tasks still write into dst: wait them out
+            }
+        }
+        if (interrupted) {
+            Thread.currentThread().interrupt();
+        }
+
+        if (!ok || failed.get()) {
+            // the scan can mis-split malformed input; let the serial decoder say where it
+            // really breaks
+            return decode(src, dst, key);
+        }
+        xorKey(dst, tailStart, o, key, (long) tasks * taskBytes);
+        src.position(src.limit());
+        dst.position(o);
+        return o - base;
+    }
+
+    /** One run of whole windows into dst[at, at + blocks * BLOCK_BYTES); false if it does not
+     * decode to exactly that. */
+    private static boolean decodeRun(ByteBuffer src, int from, int to, ByteBuffer dst, int at,
+                                     long firstBlock, int blocks, byte[] key) {
+        Decoder m = new Decoder();
+        m.restart(firstBlock);
+        int o = m.run(src, from, to, dst, at);
+        if (m.st != Decoder.ST_BLOCK || m.blocks != firstBlock + blocks || !m.haveHeld) {
+            return false;
+        }
+        o = m.putHeld(dst, o, BLOCK_BYTES);
+        if (o != at + blocks * BLOCK_BYTES) {
+            return false;
+        }
+        xorKey(dst, at, o, key, firstBlock * BLOCK_BYTES);
+        return true;
+    }
+}
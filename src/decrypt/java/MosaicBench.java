@@ -0,0 +1,176 @@
+import java.io.ByteArrayInputStream;
+import java.io.IOException;
+import java.lang.management.ManagementFactory;
+import java.lang.management.ThreadMXBean;
+import java.nio.ByteBuffer;
+import java.util.Arrays;
+
+// Decoder throughput benchmark. Builds its own ciphertext (same format as the C encoder, fixed
+// PRNG seed) so it needs nothing but Mosaic.java.
+//
+//   javac Mosaic.java MosaicBench.java
+//   java MosaicBench [size_mb]
+//
+// Every case first runs untimed until the JIT has had WARMUP_SECONDS with it, then is timed over
+// at least MEASURE_SECONDS. The allocation column counts the calling thread only (HotSpot), so
+// it shows that Decoder and decode() allocate nothing per block; decodeParallel's tasks run on
+// the pool threads.
+public class MosaicBench {
+    private static final double WARMUP_SECONDS = 2.0;
+    private static final double MEASURE_SECONDS = 2.0;
+    private static final int STREAM_CHUNK = 64 * 1024;
+
+    private static long rng = 0x9E3779B97F4A7C15L;
+
+    private static long next() {
+        rng ^= rng << 13;
+        rng ^= rng >>> 7;
+        rng ^= rng << 17;
+        return rng;
+    }
+
+    // mosaic_encode_ex: noise before half the terminators, or none and a leading mark in compact
+    // mode
+    static byte[] encode(byte[] data, boolean compact) {
+        byte[] out = new byte[(data.length / Mosaic.BLOCK_BYTES + 1) * 11 + 16];
+        int o = 0;
+        int cs = 0;
+        if (compact && data.length > 0) {
+            out[o++] = 'c';
+        }
+        int[] digits = new int[Mosaic.BLOCK_SYMBOLS];
+        for (int b = 0; b * Mosaic.BLOCK_BYTES < data.length; b++) {
+            long v = 0;
+            for (int i = 0; i < Mosaic.BLOCK_BYTES; i++) {
+                int at = b * Mosaic.BLOCK_BYTES + i;
+                int x = at < data.length ? data[at] & 0xFF : 0;
+                v = v << 8 | x;
+                cs ^= x;
+            }
+            for (int k = Mosaic.BLOCK_SYMBOLS - 1; k >= 0; k--) {
+                digits[k] = (int) (v % Mosaic.BASE);
+                v /= Mosaic.BASE;
+            }
+            int rot = (b * 13 + 11) % Mosaic.BASE;
+            for (int d : digits) {
+                out[o++] = (byte) Mosaic.ALPHABET.charAt((d + rot) % Mosaic.BASE);
+            }
+            long r = next();
+            if (!compact && (r & 1) != 0) {
+                out[o++] = (byte) ('a' + Long.remainderUnsigned(r >>> 8, 26));
+            }
+            out[o++] = Mosaic.TERM;
+            if (b % Mosaic.CHECKSUM_PERIOD == Mosaic.CHECKSUM_PERIOD - 1) {
+                out[o++] = (byte) Mosaic.ALPHABET.charAt(cs % Mosaic.BASE);
+                cs = 0;
+            }
+        }
+        int pad = (Mosaic.BLOCK_BYTES - data.length % Mosaic.BLOCK_BYTES) % Mosaic.BLOCK_BYTES;
+        out[o++] = Mosaic.TERM;
+        out[o++] = Mosaic.TERM;
+        out[o++] = (byte) Mosaic.ALPHABET.charAt(pad);
+        return Arrays.copyOf(out, o);
+    }
+
+    interface Case {
+        // decodes once into dst (cleared first) and returns the bytes written
+        int run(ByteBuffer dst) throws IOException;
+    }
+
+    private static final ThreadMXBean THREADS = ManagementFactory.getThreadMXBean();
+
+    private static long allocated() {
+        if (THREADS instanceof com.sun.management.ThreadMXBean) {
+            return ((com.sun.management.ThreadMXBean) THREADS).getThreadAllocatedBytes(
+                    Thread.currentThread().getId());
+        }
+        return -1;
+    }
+
+    private static void bench(String name, byte[] plain, ByteBuffer dst, Case c)
+            throws IOException {
+        // the first run doubles as the correctness check
+        dst.clear();
+        int n = c.run(dst);
+        byte[] got = new byte[n];
+        dst.flip();
+        dst.get(got);
+        if (!Arrays.equals(got, plain)) {
+            throw new IllegalStateException(name + ": wrong output");
+        }
+
+        long warmEnd = System.nanoTime() + (long) (WARMUP_SECONDS * 1e9);
+        while (System.nanoTime() < warmEnd) {
+            dst.clear();
+            c.run(dst);
+        }
+
+        int reps = 0;
+        long a0 = allocated();
+        long t0 = System.nanoTime();
+        long elapsed;
+        do {
+            dst.clear();
+            c.run(dst);
+            reps++;
+            elapsed = System.nanoTime() - t0;
+        } while (elapsed < (long) (MEASURE_SECONDS * 1e9));
+        long a1 = allocated();
+
+        double mbps = (double) plain.length * reps / (1024.0 * 1024.0) / (elapsed / 1e9);
+        String alloc = a0 < 0 ? "n/a" : String.format("%d B/op", (a1 - a0) / reps);
+        System.out.printf("%-28s %9.1f MB/s  %12s%n", name, mbps, alloc);
+    }
+
+    public static void main(String[] args) throws IOException {
+        int mb = args.length > 0 ? Integer.parseInt(args[0]) : 16;
+        byte[] plain = new byte[Math.max(mb, 1) << 20];
+        for (int i = 0; i < plain.length; i++) {
+            plain[i] = (byte) next();
+        }
+        byte[] noisy = encode(plain, false);
+        byte[] compact = encode(plain, true);
+        System.out.printf("corpus: %d MiB random, %d cores%n", plain.length >> 20,
+                Runtime.getRuntime().availableProcessors());
+
+        ByteBuffer heap = ByteBuffer.allocate(Mosaic.maxDecodedLength(noisy.length));
+        ByteBuffer direct = ByteBuffer.allocateDirect(Mosaic.maxDecodedLength(noisy.length));
+        ByteBuffer noisyDirect = ByteBuffer.allocateDirect(noisy.length);
+        noisyDirect.put(noisy);
+        ByteBuffer noisyHeap = ByteBuffer.wrap(noisy);
+        ByteBuffer compactHeap = ByteBuffer.wrap(compact);
+        Mosaic.Decoder d = new Mosaic.Decoder();
+
+        bench("decode heap", plain, heap, dst -> {
+            noisyHeap.clear();
+            return d.decode(noisyHeap, dst);
+        });
+        bench("decode heap compact", plain, heap, dst -> {
+            compactHeap.clear();
+            return d.decode(compactHeap, dst);
+        });
+        bench("decode direct", plain, direct, dst -> {
+            noisyDirect.clear();
+            return d.decode(noisyDirect, dst);
+        });
+
+        // drained STREAM_CHUNK bytes of plaintext at a time, as a consumer of a socket would
+        ByteArrayInputStream in = new ByteArrayInputStream(noisy);
+        ByteBuffer out = ByteBuffer.allocate(STREAM_CHUNK);
+        bench("Decoder.read stream", plain, heap, dst -> {
+            in.reset();
+            d.reset();
+            while (d.read(in, out) >= 0) {
+                out.flip();
+                dst.put(out);
+                out.clear();
+            }
+            return dst.position();
+        });
+
+        bench("decodeParallel heap", plain, heap, dst -> {
+            noisyHeap.clear();
+            return Mosaic.decodeParallel(noisyHeap, dst, null);
+        });
+    }
+}
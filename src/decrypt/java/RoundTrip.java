@@ -0,0 +1,158 @@
+import java.io.ByteArrayInputStream;
+import java.io.ByteArrayOutputStream;
+import java.io.IOException;
+import java.nio.ByteBuffer;
+import java.nio.charset.StandardCharsets;
+import java.nio.file.Files;
+import java.nio.file.Paths;
+import java.util.Arrays;
+
+// Checks the decoder against ciphertext written by the C CLI (run by tests/java_roundtrip.sh):
+//
+//   javac Mosaic.java RoundTrip.java
+//   java RoundTrip <key> <plain> <ciphertext>...
+//
+// Standard and compact streams must decode to plain through decode(), Decoder.read and
+// decodeParallel, heap and direct, and a corrupted copy must fail the same way in all of them.
+// Compressed and wide streams must be refused as UNSUPPORTED.
+public class RoundTrip {
+    interface Decode {
+        byte[] run(byte[] ct) throws IOException;
+    }
+
+    private static byte[] key;
+    private static int failures;
+
+    private static byte[] drain(ByteBuffer dst, int n) {
+        byte[] out = new byte[n];
+        dst.flip();
+        dst.get(out);
+        return out;
+    }
+
+    private static ByteBuffer direct(byte[] ct) {
+        ByteBuffer b = ByteBuffer.allocateDirect(ct.length);
+        b.put(ct).flip();
+        return b;
+    }
+
+    private static final String[] NAMES = {
+        "decode", "decode direct", "Decoder.read", "decodeParallel", "decodeParallel direct"
+    };
+
+    private static final Decode[] DECODERS = {
+        ct -> {
+            ByteBuffer dst = ByteBuffer.allocate(Mosaic.maxDecodedLength(ct.length));
+            return drain(dst, Mosaic.decode(ByteBuffer.wrap(ct), dst, key));
+        },
+        ct -> {
+            ByteBuffer dst = ByteBuffer.allocateDirect(Mosaic.maxDecodedLength(ct.length));
+            return drain(dst, Mosaic.decode(direct(ct), dst, key));
+        },
+        ct -> {
+            // an odd-sized buffer, so blocks straddle the reads
+            Mosaic.Decoder d = new Mosaic.Decoder(key);
+            ByteArrayInputStream in = new ByteArrayInputStream(ct);
+            ByteBuffer out = ByteBuffer.allocate(4099);
+            ByteArrayOutputStream all = new ByteArrayOutputStream();
+            while (d.read(in, out) >= 0) {
+                all.write(out.array(), 0, out.position());
+                out.clear();
+            }
+            return all.toByteArray();
+        },
+        ct -> {
+            ByteBuffer dst = ByteBuffer.allocate(Mosaic.maxDecodedLength(ct.length));
+            return drain(dst, Mosaic.decodeParallel(ByteBuffer.wrap(ct), dst, key));
+        },
+        ct -> {
+            ByteBuffer dst = ByteBuffer.allocateDirect(Mosaic.maxDecodedLength(ct.length));
+            return drain(dst, Mosaic.decodeParallel(direct(ct), dst, key));
+        },
+    };
+
+    // the plaintext, or the MosaicException decoding failed with
+    private static Object attempt(Decode d, byte[] ct) throws IOException {
+        try {
+            return d.run(ct);
+        } catch (Mosaic.MosaicException e) {
+            return e;
+        }
+    }
+
+    private static boolean sameFailure(Object a, Object b) {
+        if (!(a instanceof Mosaic.MosaicException) || !(b instanceof Mosaic.MosaicException)) {
+            return false;
+        }
+        Mosaic.MosaicException x = (Mosaic.MosaicException) a;
+        Mosaic.MosaicException y = (Mosaic.MosaicException) b;
+        return x.kind() == y.kind() && x.offset() == y.offset();
+    }
+
+    private static void check(boolean ok, String what) {
+        if (!ok) {
+            System.err.println("RoundTrip: " + what);
+            failures++;
+        }
+    }
+
+    public static void main(String[] args) throws IOException {
+        if (args.length < 3) {
+            System.err.println("Usage: java RoundTrip <key> <plain> <ciphertext>...");
+            System.exit(2);
+        }
+        key = args[0].getBytes(StandardCharsets.UTF_8);
+        byte[] plain = Files.readAllBytes(Paths.get(args[1]));
+        check(plain.length > 2 * Mosaic.WINDOWS_PER_TASK * Mosaic.WINDOW_BYTES,
+                "plaintext too short for decodeParallel to split");
+
+        for (int a = 2; a < args.length; a++) {
+            String file = args[a];
+            byte[] ct = Files.readAllBytes(Paths.get(file));
+            int lead = 0;
+            while (lead < ct.length && Mosaic.isSpace(ct[lead])) {
+                lead++;
+            }
+            boolean unsupported = lead < ct.length && (ct[lead] == 'z' || ct[lead] == 'w');
+
+            for (int d = 0; d < DECODERS.length; d++) {
+                Object got = attempt(DECODERS[d], ct);
+                if (unsupported) {
+                    boolean refused = got instanceof Mosaic.MosaicException
+                            && ((Mosaic.MosaicException) got).kind()
+                                    == Mosaic.ErrorKind.UNSUPPORTED;
+                    check(refused, NAMES[d] + ": " + file + " not refused as unsupported");
+                } else {
+                    check(got instanceof byte[] && Arrays.equals((byte[]) got, plain),
+                            NAMES[d] + ": " + file + " does not decode to the plaintext"
+                                    + (got instanceof Exception ? " (" + got + ")" : ""));
+                }
+            }
+            if (unsupported) {
+                continue;
+            }
+
+            // a terminator where a symbol near the middle should be
+            byte[] bad = ct.clone();
+            int i = bad.length / 2;
+            while (Mosaic.ALPHABET.indexOf(bad[i]) < 0) {
+                i++;
+            }
+            bad[i] = Mosaic.TERM;
+            Object want = attempt(DECODERS[0], bad);
+            check(want instanceof Mosaic.MosaicException, "decode: corrupted " + file
+                    + " accepted");
+            for (int d = 1; d < DECODERS.length; d++) {
+                Object got = attempt(DECODERS[d], bad);
+                check(sameFailure(want, got), NAMES[d] + ": corrupted " + file + " fails as " + got
+                        + ", decode as " + want);
+            }
+        }
+
+        if (failures > 0) {
+            System.err.println("java_roundtrip: " + failures + " check(s) failed");
+            System.exit(1);
+        }
+        System.out.println("java_roundtrip: ok");
+    }
+}
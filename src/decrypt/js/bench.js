@@ -0,0 +1,122 @@
+#!/usr/bin/env node
+// Decoder throughput benchmark. Builds its own ciphertext (same format as
+// the C encoder, fixed PRNG seed) so it needs nothing but mosaic.js.
+//
+//   node bench.js [size_mb]
+
+"use strict";
+
+const { Readable, Writable, pipeline } = require("stream");
+const mosaic = require("./mosaic");
+
+const { ALPHABET, BASE, BLOCK_BYTES, BLOCK_SYMBOLS, CHECKSUM_PERIOD } = mosaic;
+const TERM = 0x7e;
+const PIPE_CHUNK = 64 * 1024; // what fs and net streams typically hand over
+
+// xorshift32: fixed seed, so every run decodes the same bytes
+function prng(seed) {
+	let x = seed >>> 0;
+	return () => {
+		x ^= x << 13;
+		x ^= x >>> 17;
+		x ^= x << 5;
+		return x >>> 0;
+	};
+}
+
+// mosaic_encode_ex: noise before half the terminators, or none and a
+// leading mark in compact mode
+function encode(data, compact, rand) {
+	const out = Buffer.allocUnsafe(Math.ceil(data.length / BLOCK_BYTES) * 11 + 16);
+	const alpha = Buffer.from(ALPHABET, "latin1");
+	let o = 0;
+	let cs = 0;
+	if (compact && data.length) out[o++] = 0x63; // 'c'
+	for (let b = 0; b * BLOCK_BYTES < data.length; b++) {
+		let v = 0;
+		for (let i = 0; i < BLOCK_BYTES; i++) {
+			const x = data[b * BLOCK_BYTES + i] || 0;
+			v = v * 256 + x;
+			cs ^= x;
+		}
+		const rot = (b * 13 + 11) % BASE;
+		for (let k = BLOCK_SYMBOLS - 1; k >= 0; k--) {
+			out[o + k] = alpha[(v % BASE + rot) % BASE];
+			v = Math.floor(v / BASE);
+		}
+		o += BLOCK_SYMBOLS;
+		const r = rand();
+		if (!compact && r & 1) out[o++] = 0x61 + ((r >>> 8) % 26);
+		out[o++] = TERM;
+		if (b % CHECKSUM_PERIOD === CHECKSUM_PERIOD - 1) {
+			out[o++] = alpha[cs % BASE];
+			cs = 0;
+		}
+	}
+	const pad = (BLOCK_BYTES - (data.length % BLOCK_BYTES)) % BLOCK_BYTES;
+	out[o++] = TERM;
+	out[o++] = TERM;
+	out[o++] = alpha[pad];
+	return out.subarray(0, o);
+}
+
+function report(name, plainBytes, ms) {
+	const mbps = plainBytes / (1024 * 1024) / (ms / 1000);
+	console.log(`${name.padEnd(24)} ${mbps.toFixed(1).padStart(9)} MB/s`);
+}
+
+function benchSync(name, plain, ct, reps) {
+	if (!mosaic.decode(ct).equals(plain)) throw new Error(`${name}: wrong output`);
+	const t = process.hrtime.bigint();
+	for (let r = 0; r < reps; r++) mosaic.decode(ct);
+	report(name, plain.length * reps, Number(process.hrtime.bigint() - t) / 1e6);
+}
+
+// pipes ct through a DecodeStream in PIPE_CHUNK pieces, reps times over
+function benchStream(name, plain, ct, reps) {
+	return new Promise((resolve, reject) => {
+		let got = 0;
+		let left = reps;
+		const t = process.hrtime.bigint();
+		const run = () => {
+			const chunks = function* () {
+				for (let i = 0; i < ct.length; i += PIPE_CHUNK) yield ct.subarray(i, i + PIPE_CHUNK);
+			};
+			const sink = new Writable({
+				write(chunk, encoding, callback) {
+					got += chunk.length;
+					callback();
+				},
+			});
+			pipeline(Readable.from(chunks()), new mosaic.DecodeStream(), sink, (e) => {
+				if (e) return reject(e);
+				if (--left > 0) return run();
+				if (got !== plain.length * reps) return reject(new Error(`${name}: wrong output size`));
+				report(name, got, Number(process.hrtime.bigint() - t) / 1e6);
+				resolve();
+			});
+		};
+		run();
+	});
+}
+
+async function main() {
+	const sizeMb = Number(process.argv[2]) || 16;
+	const rand = prng(0x9e3779b9);
+	const plain = Buffer.allocUnsafe(sizeMb * 1024 * 1024);
+	for (let i = 0; i < plain.length; i++) plain[i] = rand() & 0xff;
+	const noisy = encode(plain, false, rand);
+	const compact = encode(plain, true, rand);
+	const reps = Math.max(1, Math.floor(64 / sizeMb));
+
+	console.log(`${sizeMb} MiB plaintext, ${reps} reps`);
+	benchSync("decode", plain, noisy, reps);
+	benchSync("decode (compact)", plain, compact, reps);
+	await benchStream("DecodeStream", plain, noisy, reps);
+	await benchStream("DecodeStream (compact)", plain, compact, reps);
+}
+
+main().catch((e) => {
+	console.error(e.message || e);
+	process.exit(1);
+});
@@ -0,0 +1,312 @@
+// Mosaic decoder for Node.
+//
+//   const mosaic = require("./mosaic");
+//   const plain = mosaic.decode(buf);                // Buffer | Uint8Array | string
+//   src.pipe(new mosaic.DecodeStream({ key: "k" })).pipe(dst);
+//
+// Ciphertext is read as bytes and looked up in Uint8Array tables built once
+// at load: no per-block strings, Maps or BigInts. DecodeStream carries the
+// block index, checksum window and held-back last block across chunks, so
+// a payload of any size decodes in constant memory.
+
+"use strict";
+
+const { Transform } = require("stream");
+
+const ALPHABET = "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789!@#$%^&*_-?";
+const TERM = 0x7e; // '~'
+const MARK_COMPRESS = 0x7a; // 'z': LZ frames under the blocks, not decoded here
+const MARK_WIDE = 0x77; // 'w': 8-byte blocks, not decoded here
+const BASE = 47;
+const BLOCK_BYTES = 5;
+const BLOCK_SYMBOLS = 8;
+const CHECKSUM_PERIOD = 4;
+const WINDOW_BYTES = BLOCK_BYTES * CHECKSUM_PERIOD;
+const BASE4 = BASE * BASE * BASE * BASE;
+
+const INVALID = 0xff;
+
+// REV_BASE[c]: index of byte c in ALPHABET, INVALID for non-symbols
+const REV_BASE = new Uint8Array(256).fill(INVALID);
+// ROTATION[b % 47]: rotation of block b; (b*13+11)%47 repeats every 47 blocks
+const ROTATION = new Uint8Array(BASE);
+// DIGIT[rot*256 + c]: the digit byte c stands for in a block with rotation rot
+const DIGIT = new Uint8Array(BASE * 256).fill(INVALID);
+// CLASS[c]: NOISE for a-z, SPACE for whitespace
+const NOISE = 1;
+const SPACE = 2;
+const CLASS = new Uint8Array(256);
+
+for (let i = 0; i < BASE; i++) REV_BASE[ALPHABET.charCodeAt(i)] = i;
+for (let b = 0; b < BASE; b++) ROTATION[b] = (b * 13 + 11) % BASE;
+for (let rot = 0; rot < BASE; rot++) {
+	for (let c = 0; c < 256; c++) {
+		if (REV_BASE[c] !== INVALID) DIGIT[rot * 256 + c] = (REV_BASE[c] + BASE - rot) % BASE;
+	}
+}
+for (let c = 0x61; c <= 0x7a; c++) CLASS[c] = NOISE;
+for (const c of [0x20, 0x09, 0x0a, 0x0b, 0x0c, 0x0d]) CLASS[c] = SPACE;
+
+// the most plaintext n bytes of ciphertext can decode to
+function maxDecodedLen(n) {
+	return (Math.floor(n / (BLOCK_SYMBOLS + 1)) + 2) * BLOCK_BYTES;
+}
+
+class MosaicError extends Error {
+	constructor(message, offset) {
+		super(`${message} at offset ${offset}`);
+		this.name = "MosaicError";
+		this.offset = offset; // offset into the ciphertext of the byte that failed
+	}
+}
+
+// where the next byte lands in "SSSSSSSS~", a window checksum, or "~~P"
+const ST_BLOCK = 0;
+const ST_SYMBOL = 1;
+const ST_TERM = 2;
+const ST_CHECKSUM = 3;
+const ST_TRAILER1 = 4;
+const ST_TRAILER2 = 5;
+const ST_DONE = 6;
+const ST_FAILED = 7;
+
+// Push decoder under decode() and DecodeStream. The last block is held back
+// until the trailer says how much of it is padding.
+class Decoder {
+	constructor() {
+		this.st = ST_BLOCK;
+		this.k = 0;
+		this.digits = new Uint8Array(BLOCK_SYMBOLS);
+		this.blocks = 0;
+		this.window = new Uint8Array(WINDOW_BYTES);
+		this.held = new Uint8Array(BLOCK_BYTES);
+		this.haveHeld = false;
+		this.consumed = 0;
+		this.err = null;
+	}
+
+	_fail(message, at) {
+		this.st = ST_FAILED;
+		this.err = new MosaicError(message, this.consumed + at);
+		throw this.err;
+	}
+
+	_checksum() {
+		let x = 0;
+		for (let i = 0; i < WINDOW_BYTES; i++) x ^= this.window[i];
+		return x % BASE;
+	}
+
+	// Decodes src into out from pos on and returns the new end. Writes at
+	// most maxDecodedLen(src.length) bytes. Throws MosaicError. The state
+	// lives in locals while the loop runs and is stored back at the end.
+	update(src, out, pos) {
+		if (this.st === ST_FAILED) throw this.err;
+		const n = src.length;
+		const digits = this.digits;
+		const w = this.window;
+		const h = this.held;
+		let st = this.st;
+		let k = this.k;
+		let blocks = this.blocks;
+		let haveHeld = this.haveHeld;
+		for (let i = 0; i < n; i++) {
+			const c = src[i];
+			let v = -1; // the value of a block that just ended
+			switch (st) {
+			case ST_BLOCK: {
+				// common case: eight symbols, at most one noise letter (the
+				// encoder puts it just before the terminator), the terminator
+				let e = i + BLOCK_SYMBOLS;
+				if (e < n && CLASS[src[e]] === NOISE) e++;
+				if (e < n && src[e] === TERM) {
+					const t = ROTATION[blocks % BASE] * 256;
+					const d0 = DIGIT[t + c], d1 = DIGIT[t + src[i + 1]];
+					const d2 = DIGIT[t + src[i + 2]], d3 = DIGIT[t + src[i + 3]];
+					const d4 = DIGIT[t + src[i + 4]], d5 = DIGIT[t + src[i + 5]];
+					const d6 = DIGIT[t + src[i + 6]], d7 = DIGIT[t + src[i + 7]];
+					if (((d0 | d1 | d2 | d3 | d4 | d5 | d6 | d7) & 0x80) === 0) {
+						v = (((d0 * BASE + d1) * BASE + d2) * BASE + d3) * BASE4 +
+							(((d4 * BASE + d5) * BASE + d6) * BASE + d7);
+						i = e; // the loop steps over the terminator
+						break;
+					}
+				}
+				if (CLASS[c] === SPACE) break;
+				if (c === TERM) {
+					st = ST_TRAILER1;
+					break;
+				}
+				// the marks sit before the first block; 'c' (compact) reads as noise
+				if (blocks === 0 && (c === MARK_COMPRESS || c === MARK_WIDE)) {
+					this._fail("unsupported stream (compressed or wide)", i);
+				}
+				// c is the first symbol (or noise): read it again as one
+				st = ST_SYMBOL;
+				k = 0;
+				i--;
+				break;
+			}
+			case ST_SYMBOL:
+				if (CLASS[c] !== NOISE) {
+					if (c === TERM) this._fail("unexpected terminator", i);
+					const d = DIGIT[ROTATION[blocks % BASE] * 256 + c];
+					if (d === INVALID) this._fail("invalid symbol", i);
+					digits[k++] = d;
+					if (k === BLOCK_SYMBOLS) st = ST_TERM;
+				}
+				break;
+			case ST_TERM:
+				if (CLASS[c] !== NOISE) {
+					if (c !== TERM) this._fail("missing block terminator", i);
+					v = 0; // 47^8 < 2^53: exact as a double
+					for (let j = 0; j < BLOCK_SYMBOLS; j++) v = v * BASE + digits[j];
+				}
+				break;
+			case ST_CHECKSUM:
+				if (CLASS[c] !== NOISE) {
+					const x = REV_BASE[c];
+					if (x === INVALID) this._fail("invalid checksum symbol", i);
+					if (x !== this._checksum()) this._fail("checksum mismatch", i);
+					st = ST_BLOCK;
+				}
+				break;
+			case ST_TRAILER1:
+				if (c !== TERM) this._fail("malformed trailer", i);
+				st = ST_TRAILER2;
+				break;
+			case ST_TRAILER2: {
+				const pad = REV_BASE[c];
+				if (pad >= BLOCK_BYTES || (pad > 0 && !haveHeld)) this._fail("invalid trailer pad digit", i);
+				if (haveHeld) {
+					for (let j = 0; j < BLOCK_BYTES - pad; j++) out[pos++] = h[j];
+					haveHeld = false;
+				}
+				st = ST_DONE;
+				break;
+			}
+			default: // ST_DONE: nothing but whitespace may follow the trailer
+				if (CLASS[c] !== SPACE) this._fail("extra data after trailer", i);
+			}
+			if (v < 0) continue;
+
+			// a block ended: release the held one, hold this one back
+			if (haveHeld) {
+				out[pos] = h[0];
+				out[pos + 1] = h[1];
+				out[pos + 2] = h[2];
+				out[pos + 3] = h[3];
+				out[pos + 4] = h[4];
+				pos += BLOCK_BYTES;
+			}
+			const hi = Math.floor(v / 0x100000000);
+			const lo = (v - hi * 0x100000000) >>> 0;
+			const slot = blocks % CHECKSUM_PERIOD;
+			const o = slot * BLOCK_BYTES;
+			w[o] = h[0] = hi;
+			w[o + 1] = h[1] = lo >>> 24;
+			w[o + 2] = h[2] = lo >>> 16;
+			w[o + 3] = h[3] = lo >>> 8;
+			w[o + 4] = h[4] = lo;
+			haveHeld = true;
+			blocks++;
+			st = slot === CHECKSUM_PERIOD - 1 ? ST_CHECKSUM : ST_BLOCK;
+		}
+		this.st = st;
+		this.k = k;
+		this.blocks = blocks;
+		this.haveHeld = haveHeld;
+		this.consumed += n;
+		return pos;
+	}
+
+	// Throws unless the input so far was a whole ciphertext.
+	finish() {
+		if (this.st === ST_FAILED) throw this.err;
+		if (this.st !== ST_DONE) this._fail("no trailer found", 0);
+	}
+}
+
+function toBytes(input) {
+	if (typeof input === "string") return Buffer.from(input, "latin1");
+	if (input instanceof Uint8Array) return input;
+	throw new TypeError("ciphertext must be a string, Buffer or Uint8Array");
+}
+
+// Decodes a whole ciphertext (Buffer, Uint8Array or string) to a Buffer.
+function decode(input) {
+	const src = toBytes(input);
+	const out = Buffer.allocUnsafe(maxDecodedLen(src.length));
+	const d = new Decoder();
+	const n = d.update(src, out, 0);
+	d.finish();
+	return out.subarray(0, n);
+}
+
+// XORs buf in place with the repeating key, as if buf started offset bytes
+// into the plaintext. Returns buf.
+function xorWithKey(buf, key, offset = 0) {
+	if (typeof key === "string") key = Buffer.from(key, "utf8");
+	const klen = key ? key.length : 0;
+	if (klen === 0) return buf;
+	let k = offset % klen;
+	for (let i = 0; i < buf.length; i++) {
+		buf[i] ^= key[k];
+		if (++k === klen) k = 0;
+	}
+	return buf;
+}
+
+// Transform stream: ciphertext in, plaintext out, chunk by chunk. Pass
+// { key } to undo the XOR too. Malformed input fails the stream with a
+// MosaicError as soon as the bad byte arrives.
+class DecodeStream extends Transform {
+	constructor(options = {}) {
+		const { key, ...rest } = options;
+		super(rest);
+		this._decoder = new Decoder();
+		this._key = key === undefined || key === null ? null : Buffer.from(key);
+		this._keyPos = 0;
+	}
+
+	_transform(chunk, encoding, callback) {
+		let n;
+		const out = Buffer.allocUnsafe(maxDecodedLen(chunk.length));
+		try {
+			n = this._decoder.update(chunk, out, 0);
+		} catch (e) {
+			return callback(e);
+		}
+		if (n > 0) {
+			const plain = out.subarray(0, n);
+			if (this._key) xorWithKey(plain, this._key, this._keyPos);
+			this._keyPos += n;
+			this.push(plain);
+		}
+		callback();
+	}
+
+	// the trailer already released the last block; only check it arrived
+	_flush(callback) {
+		try {
+			this._decoder.finish();
+		} catch (e) {
+			return callback(e);
+		}
+		callback();
+	}
+}
+
+module.exports = {
+	ALPHABET,
+	BASE,
+	BLOCK_BYTES,
+	BLOCK_SYMBOLS,
+	CHECKSUM_PERIOD,
+	Decoder,
+	DecodeStream,
+	MosaicError,
+	decode,
+	maxDecodedLen,
+	xorWithKey,
+};
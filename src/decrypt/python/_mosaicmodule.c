@@ -0,0 +1,297 @@
+/* _mosaic: CPython binding for the C core (src/mosaic.c, src/xor_key.c,
+ * src/lz.c).
+ *
+ * Inputs are taken through the buffer protocol (bytes, bytearray,
+ * memoryview, mmap, numpy arrays...) and read in place; str is accepted
+ * wherever ciphertext or a key is expected. Results are written straight
+ * into the returned bytes object. Calls on more than RELEASE_GIL_BYTES of
+ * input drop the GIL while the C code runs. */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include "mosaic.h"
+#include "xor_key.h"
+#include "lz.h"
+
+#include <ctype.h>
+#include <string.h>
+
+#define RELEASE_GIL_BYTES (64 * 1024)
+#define VERIFY_PIECE 4096
+
+static PyObject *MosaicError;
+
+/* drop the GIL only when the work outweighs the round trip */
+#define GIL_RELEASE(n) PyThreadState *gil_ts_ = (n) >= RELEASE_GIL_BYTES ? PyEval_SaveThread() : NULL
+#define GIL_ACQUIRE() do { if(gil_ts_) PyEval_RestoreThread(gil_ts_); } while(0)
+
+/* a key as the NUL-terminated string xor_with_key() expects */
+static char *key_cstr(const Py_buffer *key){
+  if(memchr(key->buf, '\0', (size_t)key->len)){
+    PyErr_SetString(PyExc_ValueError, "key must not contain NUL bytes");
+    return NULL;
+  }
+  char *k = PyMem_Malloc((size_t)key->len + 1);
+  if(!k){
+    PyErr_NoMemory();
+    return NULL;
+  }
+  memcpy(k, key->buf, (size_t)key->len);
+  k[key->len] = '\0';
+  return k;
+}
+
+static void key_free(char *k, Py_ssize_t len){
+  volatile char *v = k;
+  for(Py_ssize_t i = 0; i < len; i++) v[i] = 0;
+  PyMem_Free(k);
+}
+
+/* shared by encode/encrypt: plaintext -> ciphertext bytes, XORed with key
+ * first when key is non-NULL */
+static PyObject *encode_buffer(const Py_buffer *data, const char *key, unsigned opts){
+  size_t len = (size_t)data->len;
+  size_t cap = mosaic_encode_ex((const uint8_t*)data->buf, len, NULL, 0, opts);
+  if(cap == (size_t)-1){
+    PyErr_SetString(MosaicError, "input too large");
+    return NULL;
+  }
+
+  /* XOR needs a scratch copy; without a key the input is encoded in place */
+  uint8_t *scratch = NULL;
+  if(key && *key){
+    scratch = PyMem_Malloc(len ? len : 1);
+    if(!scratch) return PyErr_NoMemory();
+  }
+  PyObject *out = PyBytes_FromStringAndSize(NULL, (Py_ssize_t)cap);
+  if(!out){
+    PyMem_Free(scratch);
+    return NULL;
+  }
+
+  const uint8_t *src = (const uint8_t*)data->buf;
+  size_t wrote;
+  GIL_RELEASE(len);
+  if(scratch){
+    memcpy(scratch, src, len);
+    xor_with_key(scratch, len, key);
+    src = scratch;
+  }
+  wrote = mosaic_encode_ex(src, len, PyBytes_AS_STRING(out), cap, opts);
+  GIL_ACQUIRE();
+
+  if(scratch){
+    volatile uint8_t *v = scratch;
+    for(size_t i = 0; i < len; i++) v[i] = 0;
+    PyMem_Free(scratch);
+  }
+  if(wrote == (size_t)-1){
+    Py_DECREF(out);
+    PyErr_SetString(MosaicError, "encode failed");
+    return NULL;
+  }
+  if(wrote != cap && _PyBytes_Resize(&out, (Py_ssize_t)wrote) != 0) return NULL;
+  return out;
+}
+
+/* compressed streams (leading 'z' mark): *out holds the LZ frames, which
+ * are swapped for what they expand to. 0, or -1 with an exception set. */
+static int inflate_frames(PyObject **out, size_t len){
+  const uint8_t *z = (const uint8_t*)PyBytes_AS_STRING(*out);
+  size_t raw = mosaic_lz_decompressed_len(z, len);
+  if(raw == (size_t)-1){
+    PyErr_SetString(MosaicError, "malformed compressed payload");
+    return -1;
+  }
+  PyObject *plain = PyBytes_FromStringAndSize(NULL, (Py_ssize_t)raw);
+  if(!plain) return -1;
+  size_t wrote;
+  GIL_RELEASE(raw);
+  wrote = mosaic_lz_decompress(z, len, (uint8_t*)PyBytes_AS_STRING(plain), raw);
+  GIL_ACQUIRE();
+  if(wrote != raw){
+    Py_DECREF(plain);
+    PyErr_SetString(MosaicError, "malformed compressed payload");
+    return -1;
+  }
+  Py_SETREF(*out, plain);
+  return 0;
+}
+
+/* shared by decode/decrypt: ciphertext -> plaintext bytes, XORed with key
+ * afterwards when key is non-NULL, and decompressed after that when the
+ * stream is marked compressed */
+static PyObject *decode_buffer(const Py_buffer *ct, const char *key){
+  const char *in = (const char*)ct->buf;
+  size_t len = (size_t)ct->len;
+  /* an upper bound instead of a sizing pass over the input; trimmed below */
+  size_t cap = mosaic_decoder_bound(len);
+
+  PyObject *out = PyBytes_FromStringAndSize(NULL, (Py_ssize_t)cap);
+  if(!out) return NULL;
+
+  uint8_t *dst = (uint8_t*)PyBytes_AS_STRING(out);
+  size_t wrote;
+  GIL_RELEASE(len);
+  wrote = mosaic_decode(in, len, dst, cap);
+  if(wrote != (size_t)-1 && key && *key) xor_with_key(dst, wrote, key);
+  GIL_ACQUIRE();
+
+  if(wrote == (size_t)-1){
+    Py_DECREF(out);
+    PyErr_SetString(MosaicError, "malformed ciphertext or checksum mismatch");
+    return NULL;
+  }
+  if(mosaic_stream_opts(in, len) & MOSAIC_OPT_COMPRESS){
+    if(inflate_frames(&out, wrote) != 0){
+      Py_DECREF(out);
+      return NULL;
+    }
+    return out;
+  }
+  if(wrote != cap && _PyBytes_Resize(&out, (Py_ssize_t)wrote) != 0) return NULL;
+  return out;
+}
+
+static unsigned encode_opts(int compact, int wide){
+  return (compact ? MOSAIC_OPT_COMPACT : 0u) | (wide ? MOSAIC_OPT_WIDE : 0u);
+}
+
+PyDoc_STRVAR(encode_doc,
+"encode(data, compact=False, wide=False) -> bytes\n\n"
+"Encode a bytes-like object as Mosaic ciphertext (ASCII bytes). wide=True\n"
+"uses 8-byte blocks of 12 symbols, for shorter output.");
+
+static PyObject *py_encode(PyObject *self, PyObject *args, PyObject *kw){
+  static char *kwlist[] = { "data", "compact", "wide", NULL };
+  Py_buffer data;
+  int compact = 0, wide = 0;
+  (void)self;
+  if(!PyArg_ParseTupleAndKeywords(args, kw, "y*|pp:encode", kwlist, &data, &compact, &wide)) return NULL;
+  PyObject *r = encode_buffer(&data, NULL, encode_opts(compact, wide));
+  PyBuffer_Release(&data);
+  return r;
+}
+
+PyDoc_STRVAR(decode_doc,
+"decode(ciphertext) -> bytes\n\n"
+"Decode Mosaic ciphertext (str or bytes-like); compressed streams are\n"
+"decompressed. Raises MosaicError when it is malformed or a checksum does\n"
+"not match.");
+
+static PyObject *py_decode(PyObject *self, PyObject *args, PyObject *kw){
+  static char *kwlist[] = { "ciphertext", NULL };
+  Py_buffer ct;
+  (void)self;
+  if(!PyArg_ParseTupleAndKeywords(args, kw, "s*:decode", kwlist, &ct)) return NULL;
+  PyObject *r = decode_buffer(&ct, NULL);
+  PyBuffer_Release(&ct);
+  return r;
+}
+
+PyDoc_STRVAR(encrypt_doc,
+"encrypt(data, key, compact=False, wide=False) -> bytes\n\n"
+"XOR data with the repeating key, then encode. Same output format as\n"
+"mosaicCipher's encrypt command.");
+
+static PyObject *py_encrypt(PyObject *self, PyObject *args, PyObject *kw){
+  static char *kwlist[] = { "data", "key", "compact", "wide", NULL };
+  Py_buffer data, key;
+  int compact = 0, wide = 0;
+  (void)self;
+  if(!PyArg_ParseTupleAndKeywords(args, kw, "y*s*|pp:encrypt", kwlist, &data, &key, &compact, &wide)) return NULL;
+  PyObject *r = NULL;
+  char *k = key_cstr(&key);
+  if(k){
+    r = encode_buffer(&data, k, encode_opts(compact, wide));
+    key_free(k, key.len);
+  }
+  PyBuffer_Release(&key);
+  PyBuffer_Release(&data);
+  return r;
+}
+
+PyDoc_STRVAR(decrypt_doc,
+"decrypt(ciphertext, key) -> bytes\n\n"
+"Decode, then XOR with the repeating key (and decompress, for a compressed\n"
+"stream).");
+
+static PyObject *py_decrypt(PyObject *self, PyObject *args, PyObject *kw){
+  static char *kwlist[] = { "ciphertext", "key", NULL };
+  Py_buffer ct, key;
+  (void)self;
+  if(!PyArg_ParseTupleAndKeywords(args, kw, "s*s*:decrypt", kwlist, &ct, &key)) return NULL;
+  PyObject *r = NULL;
+  char *k = key_cstr(&key);
+  if(k){
+    r = decode_buffer(&ct, k);
+    key_free(k, key.len);
+  }
+  PyBuffer_Release(&key);
+  PyBuffer_Release(&ct);
+  return r;
+}
+
+PyDoc_STRVAR(verify_doc,
+"verify(ciphertext) -> bool\n\n"
+"True if the ciphertext is well formed and every checksum matches. Nothing\n"
+"is allocated: the plaintext goes through a small stack buffer.");
+
+static PyObject *py_verify(PyObject *self, PyObject *args, PyObject *kw){
+  static char *kwlist[] = { "ciphertext", NULL };
+  Py_buffer ct;
+  (void)self;
+  if(!PyArg_ParseTupleAndKeywords(args, kw, "s*:verify", kwlist, &ct)) return NULL;
+
+  const char *in = (const char*)ct.buf;
+  size_t len = (size_t)ct.len;
+  int ok = 1;
+  GIL_RELEASE(len);
+  mosaic_decoder d;
+  uint8_t sink[VERIFY_PIECE]; /* more than mosaic_decoder_bound(VERIFY_PIECE) */
+  mosaic_decoder_init(&d);
+  for(size_t i = 0; ok && i < len; i += VERIFY_PIECE){
+    size_t n = len - i < VERIFY_PIECE ? len - i : VERIFY_PIECE;
+    ok = mosaic_decoder_update(&d, in + i, n, sink, sizeof sink) != (size_t)-1;
+  }
+  ok = ok && mosaic_decoder_final(&d) == 0;
+  /* the stream decoder lets whitespace trail the trailer; decode() does not */
+  ok = ok && !isspace((unsigned char)in[len - 1]);
+  GIL_ACQUIRE();
+
+  PyBuffer_Release(&ct);
+  return PyBool_FromLong(ok);
+}
+
+static PyMethodDef mosaic_methods[] = {
+  { "encode",  (PyCFunction)(void(*)(void))py_encode,  METH_VARARGS | METH_KEYWORDS, encode_doc },
+  { "decode",  (PyCFunction)(void(*)(void))py_decode,  METH_VARARGS | METH_KEYWORDS, decode_doc },
+  { "encrypt", (PyCFunction)(void(*)(void))py_encrypt, METH_VARARGS | METH_KEYWORDS, encrypt_doc },
+  { "decrypt", (PyCFunction)(void(*)(void))py_decrypt, METH_VARARGS | METH_KEYWORDS, decrypt_doc },
+  { "verify",  (PyCFunction)(void(*)(void))py_verify,  METH_VARARGS | METH_KEYWORDS, verify_doc },
+  { NULL, NULL, 0, NULL }
+};
+
+static struct PyModuleDef mosaic_module = {
+  PyModuleDef_HEAD_INIT,
+  "_mosaic",
+  "Mosaic cipher, backed by the C core.",
+  -1,
+  mosaic_methods,
+  NULL, NULL, NULL, NULL
+};
+
+PyMODINIT_FUNC PyInit__mosaic(void){
+  PyObject *m = PyModule_Create(&mosaic_module);
+  if(!m) return NULL;
+  MosaicError = PyErr_NewException("_mosaic.MosaicError", PyExc_ValueError, NULL);
+  if(!MosaicError || PyModule_AddObject(m, "MosaicError", MosaicError) != 0){
+    Py_XDECREF(MosaicError);
+    Py_DECREF(m);
+    return NULL;
+  }
+  Py_INCREF(MosaicError);
+  PyModule_AddIntConstant(m, "RELEASE_GIL_BYTES", RELEASE_GIL_BYTES);
+  return m;
+}
@@ -2,6 +2,12 @@
 
 import sys
 
+# the C core, when the extension has been built (python3 setup.py build_ext --inplace)
+try:
+    import _mosaic
+except ImportError:
+    _mosaic = None
+
 ALPHABET = "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789!@#$%^&*_-?"
 NOISE_SET = "abcdefghijklmnopqrstuvwxyz"
 TERM = '~'
@@ -55,6 +61,10 @@ def decode_mosaic(s):
         if i >= n:
             break
 
+        # the marks sit before the first block; 'c' (compact) reads as noise
+        if block_index == 0 and s[i] in "zw":
+            raise ValueError("Unsupported stream (compressed or wide)")
+
         # trailer: "~~" + paddigit
         if i + 2 < n and s[i] == TERM and s[i+1] == TERM:
             pad_char = s[i+2]
@@ -139,13 +149,14 @@ def main():
     key = sys.argv[2] if len(sys.argv) >= 3 else "default-key"
 
     try:
-        raw = decode_mosaic(s)
+        if _mosaic is not None:
+            raw = _mosaic.decrypt(s, key)
+        else:
+            raw = xor_with_key(decode_mosaic(s), key.encode('utf-8'))
     except Exception as e:
         print("Decoding error:", e)
         return 2
 
-    raw = xor_with_key(raw, key.encode('utf-8'))
-
     print("Decoded bytes (hex):", raw.hex())
     try:
         text = raw.decode('utf-8')
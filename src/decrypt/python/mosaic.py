@@ -0,0 +1,55 @@
+"""Mosaic cipher for Python.
+
+encode/decode/encrypt/decrypt/verify run on the C core through the _mosaic
+extension (build it with `python3 setup.py build_ext --inplace`, or
+`make python` from the repository root). They take bytes, bytearray,
+memoryview or anything else with the buffer protocol without copying it,
+and release the GIL on large inputs.
+
+Without the extension the pure-Python decoder in decrypt.py stands in:
+decode, decrypt and verify still work, only slower, but reject compressed
+and wide streams, and encode/encrypt raise NotImplementedError. NATIVE tells which one is loaded.
+"""
+
+try:
+    from _mosaic import MosaicError, decode, decrypt, encode, encrypt, verify
+    NATIVE = True
+except ImportError:
+    import decrypt as _pure
+
+    NATIVE = False
+
+    class MosaicError(ValueError):
+        """Malformed ciphertext or checksum mismatch."""
+
+    def _text(ciphertext):
+        if isinstance(ciphertext, str):
+            return ciphertext
+        return bytes(ciphertext).decode("ascii", errors="replace")
+
+    def _key(key):
+        return key.encode("utf-8") if isinstance(key, str) else bytes(key)
+
+    def decode(ciphertext):
+        try:
+            return _pure.decode_mosaic(_text(ciphertext))
+        except ValueError as e:
+            raise MosaicError(str(e)) from None
+
+    def decrypt(ciphertext, key):
+        return _pure.xor_with_key(decode(ciphertext), _key(key))
+
+    def verify(ciphertext):
+        try:
+            decode(ciphertext)
+        except MosaicError:
+            return False
+        return True
+
+    def encode(data, compact=False, wide=False):
+        raise NotImplementedError("encoding needs the _mosaic extension")
+
+    def encrypt(data, key, compact=False, wide=False):
+        raise NotImplementedError("encoding needs the _mosaic extension")
+
+__all__ = ["MosaicError", "NATIVE", "decode", "decrypt", "encode", "encrypt", "verify"]
@@ -0,0 +1,29 @@
+"""Builds the _mosaic extension from the C core:
+
+    python3 setup.py build_ext --inplace
+
+or `make python` from the repository root. decrypt.py and mosaic.py pick
+it up when it is importable and fall back to pure Python otherwise."""
+
+import os
+from setuptools import setup, Extension
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+ROOT = os.path.normpath(os.path.join(HERE, "..", "..", ".."))
+CORE = ["mosaic.c", "lz.c", "xor_key.c", "arena.c", "stats.c", "kernels.c", "kernels_x86.c"]
+
+
+setup(
+    name="mosaic",
+    version="0.1.0",
+    py_modules=["mosaic", "decrypt"],
+    ext_modules=[
+        Extension(
+            "_mosaic",
+            sources=["_mosaicmodule.c"] + [os.path.join(ROOT, "src", f) for f in CORE],
+            include_dirs=[os.path.join(ROOT, "include")],
+            extra_compile_args=["-O2", "-pthread"],
+            extra_link_args=["-pthread"],
+        )
+    ],
+)
@@ -0,0 +1,159 @@
+//! Decoder throughput benchmark. Builds its own ciphertext (same format as
+//! the C encoder, fixed PRNG seed) so it needs nothing but the crate.
+//!
+//!     cargo run --release --bin mosaic_bench [size_mb]
+
+use std::env;
+use std::hint::black_box;
+use std::io::{self, Cursor, Read, Write};
+use std::time::Instant;
+
+use decrypt_mosaic::{
+    decode, decode_parallel, DecodeReader, DecodeWriter, MosaicDecoder, ALPHABET, BASE, BLOCK_BYTES, BLOCK_SYMBOLS,
+    CHECKSUM_PERIOD, TERM, WINDOWS_PER_TASK,
+};
+
+struct XorShift(u64);
+
+impl XorShift {
+    fn next(&mut self) -> u64 {
+        self.0 ^= self.0 << 13;
+        self.0 ^= self.0 >> 7;
+        self.0 ^= self.0 << 17;
+        self.0
+    }
+}
+
+/// mosaic_encode_ex: noise after half the blocks, or none in compact mode
+fn encode(data: &[u8], compact: bool, rng: &mut XorShift) -> Vec<u8> {
+    let mut out = Vec::with_capacity(data.len() / BLOCK_BYTES * 11 + 16);
+    if compact && !data.is_empty() {
+        out.push(b'c');
+    }
+    let mut cs = 0u8;
+    for (b, chunk) in data.chunks(BLOCK_BYTES).enumerate() {
+        let mut block = [0u8; BLOCK_BYTES];
+        block[..chunk.len()].copy_from_slice(chunk);
+        let mut v = block.iter().fold(0u64, |v, &x| (v << 8) | x as u64);
+        let mut digits = [0usize; BLOCK_SYMBOLS];
+        for d in digits.iter_mut().rev() {
+            *d = (v % BASE as u64) as usize;
+            v /= BASE as u64;
+        }
+        let rot = (b * 13 + 11) % 47;
+        for d in digits {
+            out.push(ALPHABET[(d + rot) % 47]);
+        }
+        let r = rng.next();
+        if !compact && r & 1 == 1 {
+            out.push(b'a' + ((r >> 8) % 26) as u8);
+        }
+        out.push(TERM);
+        cs ^= block.iter().fold(0, |x, &y| x ^ y);
+        if b % CHECKSUM_PERIOD == CHECKSUM_PERIOD - 1 {
+            out.push(ALPHABET[(cs as u32 % BASE) as usize]);
+            cs = 0;
+        }
+    }
+    let pad = (BLOCK_BYTES - data.len() % BLOCK_BYTES) % BLOCK_BYTES;
+    out.extend_from_slice(&[TERM, TERM, ALPHABET[pad]]);
+    out
+}
+
+fn report(name: &str, plain_bytes: usize, seconds: f64) {
+    let mb = plain_bytes as f64 / (1024.0 * 1024.0);
+    println!("{:<24} {:>9.1} MB/s", name, mb / seconds);
+}
+
+fn bench(name: &str, plain_bytes: usize, reps: u32, mut f: impl FnMut() -> usize) {
+    let expect = f(); // warm up, and check the result size
+    assert_eq!(expect, plain_bytes, "{}: wrong output size", name);
+    let t = Instant::now();
+    for _ in 0..reps {
+        black_box(f());
+    }
+    report(name, plain_bytes * reps as usize, t.elapsed().as_secs_f64());
+}
+
+fn main() -> io::Result<()> {
+    let size_mb: usize = env::args().nth(1).and_then(|s| s.parse().ok()).unwrap_or(16);
+    let n = size_mb * 1024 * 1024;
+    let reps = 3;
+
+    let mut rng = XorShift(0x9E37_79B9_7F4A_7C15);
+    let data: Vec<u8> = (0..n).map(|_| rng.next() as u8).collect();
+    let noisy = encode(&data, false, &mut rng);
+    let compact = encode(&data, true, &mut rng);
+    assert_eq!(decode(&noisy).expect("noisy stream decodes"), data);
+    assert_eq!(decode(&compact).expect("compact stream decodes"), data);
+    // the input spans many tasks, so every split point is exercised
+    assert!(n > WINDOWS_PER_TASK * CHECKSUM_PERIOD * BLOCK_BYTES * 2);
+    assert_eq!(decode_parallel(&noisy).expect("noisy stream decodes in parallel"), data);
+    assert_eq!(decode_parallel(&compact).expect("compact stream decodes in parallel"), data);
+    let mut bad = noisy.clone();
+    let at = (noisy.len() / 2..).find(|&i| ALPHABET.contains(&noisy[i])).unwrap();
+    bad[at] = TERM;
+    assert_eq!(decode_parallel(&bad).unwrap_err(), decode(&bad).unwrap_err());
+
+    println!("{} MiB random payload, {} reps", size_mb, reps);
+    println!("expansion: noisy {:.3}x, compact {:.3}x",
+             noisy.len() as f64 / n as f64, compact.len() as f64 / n as f64);
+
+    bench("decode", n, reps, || decode(&noisy).unwrap().len());
+    bench("decode compact", n, reps, || decode(&compact).unwrap().len());
+
+    // 64 KiB pushes into one reused buffer, as a network service would
+    let mut out = Vec::with_capacity(1 << 17);
+    bench("update 64k pieces", n, reps, || {
+        let mut dec = MosaicDecoder::new();
+        let mut total = 0;
+        for piece in noisy.chunks(64 * 1024) {
+            out.clear();
+            dec.update(piece, &mut out).unwrap();
+            total += out.len();
+        }
+        out.clear();
+        dec.update(&[], &mut out).unwrap();
+        dec.finish().unwrap();
+        total
+    });
+
+    let mut sink = vec![0u8; 64 * 1024];
+    bench("DecodeReader", n, reps, || {
+        let mut r = DecodeReader::new(Cursor::new(&noisy));
+        let mut total = 0;
+        loop {
+            let got = r.read(&mut sink).unwrap();
+            if got == 0 {
+                break total;
+            }
+            total += got;
+        }
+    });
+
+    bench("DecodeWriter", n, reps, || {
+        let mut w = DecodeWriter::new(Counter(0));
+        for piece in noisy.chunks(64 * 1024) {
+            w.write_all(piece).unwrap();
+        }
+        w.finish().unwrap().0
+    });
+
+    bench("decode_parallel", n, reps, || decode_parallel(&noisy).unwrap().len());
+
+    Ok(())
+}
+
+/// io::sink() that counts what it is given
+struct Counter(usize);
+
+impl Write for Counter {
+    fn write(&mut self, buf: &[u8]) -> io::Result<usize> {
+        self.0 += buf.len();
+        Ok(buf.len())
+    }
+
+    fn flush(&mut self) -> io::Result<()> {
+        Ok(())
+    }
+}
@@ -0,0 +1,573 @@
+//! Mosaic decoder.
+//!
+//! `MosaicDecoder` is a push decoder over `&[u8]`: feed it ciphertext in
+//! pieces of any size and it appends plaintext to a `Vec<u8>`. No per-block
+//! allocation and no char conversion; symbols are looked up in const tables.
+//! `DecodeReader` and `DecodeWriter` wrap it as `Read`/`Write` adapters for
+//! inputs too large to hold in memory, and `decode_parallel` decodes
+//! checksum windows on all cores.
+
+use std::fmt;
+use std::io::{self, Read, Write};
+
+pub const ALPHABET: &[u8; 47] = b"ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789!@#$%^&*_-?";
+pub const TERM: u8 = b'~';
+pub const BASE: u32 = 47;
+pub const BLOCK_BYTES: usize = 5;
+pub const BLOCK_SYMBOLS: usize = 8;
+pub const CHECKSUM_PERIOD: usize = 4;
+pub const WINDOW_BYTES: usize = BLOCK_BYTES * CHECKSUM_PERIOD;
+
+const INVALID: u8 = 0xFF;
+
+const fn build_rev() -> [u8; 256] {
+    let mut rev = [INVALID; 256];
+    let mut i = 0;
+    while i < ALPHABET.len() {
+        rev[ALPHABET[i] as usize] = i as u8;
+        i += 1;
+    }
+    rev
+}
+
+/// Base-alphabet index of each byte, INVALID for non-symbols.
+const REV: [u8; 256] = build_rev();
+
+const fn build_rotation() -> [u8; 47] {
+    let mut rot = [0u8; 47];
+    let mut b = 0;
+    while b < 47 {
+        rot[b] = ((b * 13 + 11) % 47) as u8;
+        b += 1;
+    }
+    rot
+}
+
+/// Rotation of block b is ROTATION[b % 47]; (b * 13 + 11) % 47 repeats every 47 blocks.
+const ROTATION: [u8; 47] = build_rotation();
+
+const fn build_digit() -> [[u8; 256]; 47] {
+    let mut t = [[INVALID; 256]; 47];
+    let mut rot = 0;
+    while rot < 47 {
+        let mut c = 0;
+        while c < 256 {
+            let v = REV[c];
+            if v != INVALID {
+                t[rot][c] = ((v as usize + 47 - rot) % 47) as u8;
+            }
+            c += 1;
+        }
+        rot += 1;
+    }
+    t
+}
+
+/// DIGIT[rot][byte]: the digit a byte stands for in a block with rotation rot.
+static DIGIT: [[u8; 256]; 47] = build_digit();
+
+fn rotation_for_block(block_index: u64) -> usize {
+    ROTATION[(block_index % 47) as usize] as usize
+}
+
+fn is_noise(c: u8) -> bool {
+    c.is_ascii_lowercase()
+}
+
+/// C's isspace(): unlike `u8::is_ascii_whitespace` this includes '\v'.
+fn is_space(c: u8) -> bool {
+    c == b' ' || (b'\t'..=b'\r').contains(&c)
+}
+
+fn digits_to_block(digits: &[u8; BLOCK_SYMBOLS]) -> [u8; BLOCK_BYTES] {
+    let mut val: u64 = 0;
+    for &d in digits {
+        val = val * BASE as u64 + d as u64;
+    }
+    let b = val.to_be_bytes();
+    [b[3], b[4], b[5], b[6], b[7]]
+}
+
+fn checksum47(window: &[u8; WINDOW_BYTES]) -> u8 {
+    (window.iter().fold(0u8, |x, &b| x ^ b) as u32 % BASE) as u8
+}
+
+/// XOR `data` with the repeating key, as if it started `offset` bytes into
+/// the plaintext.
+pub fn xor_with_key(data: &mut [u8], key: &[u8], offset: u64) {
+    if key.is_empty() {
+        return;
+    }
+    let mut k = (offset % key.len() as u64) as usize;
+    for b in data {
+        *b ^= key[k];
+        k += 1;
+        if k == key.len() {
+            k = 0;
+        }
+    }
+}
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum ErrorKind {
+    /// a byte that is neither a symbol, noise nor whitespace
+    Symbol,
+    /// block terminator missing or misplaced
+    Terminator,
+    /// window checksum does not match
+    Checksum,
+    /// trailer missing, malformed, or followed by more data
+    Trailer,
+    /// a compressed ('z') or wide ('w') stream, which this decoder cannot read
+    Unsupported,
+}
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct DecodeError {
+    pub kind: ErrorKind,
+    /// offset into the ciphertext of the byte that failed
+    pub offset: u64,
+}
+
+impl fmt::Display for DecodeError {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        let what = match self.kind {
+            ErrorKind::Symbol => "invalid symbol",
+            ErrorKind::Terminator => "missing block terminator",
+            ErrorKind::Checksum => "checksum mismatch",
+            ErrorKind::Trailer => "missing or malformed trailer",
+            ErrorKind::Unsupported => "unsupported stream (compressed or wide)",
+        };
+        write!(f, "{} at offset {}", what, self.offset)
+    }
+}
+
+impl std::error::Error for DecodeError {}
+
+impl From<DecodeError> for io::Error {
+    fn from(e: DecodeError) -> io::Error {
+        io::Error::new(io::ErrorKind::InvalidData, e)
+    }
+}
+
+/// Where the next ciphertext byte lands in "SSSSSSSS~", a window checksum,
+/// or the "~~P" trailer.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+enum State {
+    Block,
+    Symbol,
+    Term,
+    Checksum,
+    Trailer1,
+    Trailer2,
+    Done,
+    Failed,
+}
+
+/// Push decoder. The last block is held back until the trailer says how many
+/// of its bytes are padding.
+#[derive(Debug, Clone)]
+pub struct MosaicDecoder {
+    state: State,
+    k: usize,
+    digits: [u8; BLOCK_SYMBOLS],
+    blocks: u64,
+    window: [u8; WINDOW_BYTES],
+    held: [u8; BLOCK_BYTES],
+    have_held: bool,
+    consumed: u64,
+}
+
+impl Default for MosaicDecoder {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+impl MosaicDecoder {
+    pub const fn new() -> Self {
+        Self::starting_at(0)
+    }
+
+    /// decoder for a stream piece whose first block is `block_index`; it
+    /// must start a checksum window
+    const fn starting_at(block_index: u64) -> Self {
+        MosaicDecoder {
+            state: State::Block,
+            k: 0,
+            digits: [0; BLOCK_SYMBOLS],
+            blocks: block_index,
+            window: [0; WINDOW_BYTES],
+            held: [0; BLOCK_BYTES],
+            have_held: false,
+            consumed: 0,
+        }
+    }
+
+    /// blocks decoded so far
+    pub fn blocks(&self) -> u64 {
+        self.blocks
+    }
+
+    /// true once the trailer has been read
+    pub fn is_done(&self) -> bool {
+        self.state == State::Done
+    }
+
+    fn fail(&mut self, kind: ErrorKind, at: usize) -> Result<(), DecodeError> {
+        self.state = State::Failed;
+        Err(DecodeError { kind, offset: self.consumed + at as u64 })
+    }
+
+    fn end_block(&mut self, out: &mut Vec<u8>) {
+        let slot = (self.blocks % CHECKSUM_PERIOD as u64) as usize;
+        let block = digits_to_block(&self.digits);
+        self.window[slot * BLOCK_BYTES..(slot + 1) * BLOCK_BYTES].copy_from_slice(&block);
+        if self.have_held {
+            out.extend_from_slice(&self.held);
+        }
+        self.held = block;
+        self.have_held = true;
+        self.blocks += 1;
+        self.state = if slot == CHECKSUM_PERIOD - 1 { State::Checksum } else { State::Block };
+    }
+
+    /// Decode `input`, appending plaintext to `out`. After an error the
+    /// decoder stays failed.
+    pub fn update(&mut self, input: &[u8], out: &mut Vec<u8>) -> Result<(), DecodeError> {
+        if self.state == State::Failed {
+            return self.fail(ErrorKind::Trailer, 0);
+        }
+        out.reserve(input.len() / (BLOCK_SYMBOLS + 1) * BLOCK_BYTES + BLOCK_BYTES);
+
+        let mut i = 0;
+        while i < input.len() {
+            let c = input[i];
+            match self.state {
+                State::Block => {
+                    // common case: eight symbols and the terminator, no noise
+                    if input.len() - i > BLOCK_SYMBOLS && input[i + BLOCK_SYMBOLS] == TERM {
+                        let table = &DIGIT[rotation_for_block(self.blocks)];
+                        let mut bad = 0u8;
+                        for k in 0..BLOCK_SYMBOLS {
+                            let d = table[input[i + k] as usize];
+                            self.digits[k] = d;
+                            bad |= d & 0x80;
+                        }
+                        if bad == 0 {
+                            self.end_block(out);
+                            i += BLOCK_SYMBOLS + 1;
+                            continue;
+                        }
+                    }
+                    if is_space(c) {
+                        i += 1;
+                        continue;
+                    }
+                    if c == TERM {
+                        self.state = State::Trailer1;
+                        i += 1;
+                        continue;
+                    }
+                    // the marks sit before the first block; 'c' (compact) reads as noise
+                    if self.blocks == 0 && (c == b'z' || c == b'w') {
+                        return self.fail(ErrorKind::Unsupported, i);
+                    }
+                    self.state = State::Symbol;
+                    self.k = 0;
+                    // this byte is the first symbol (or noise): read it again
+                }
+                State::Symbol => {
+                    if !is_noise(c) {
+                        if c == TERM {
+                            return self.fail(ErrorKind::Terminator, i);
+                        }
+                        let d = DIGIT[rotation_for_block(self.blocks)][c as usize];
+                        if d == INVALID {
+                            return self.fail(ErrorKind::Symbol, i);
+                        }
+                        self.digits[self.k] = d;
+                        self.k += 1;
+                        if self.k == BLOCK_SYMBOLS {
+                            self.state = State::Term;
+                        }
+                    }
+                    i += 1;
+                }
+                State::Term => {
+                    if !is_noise(c) {
+                        if c != TERM {
+                            return self.fail(ErrorKind::Terminator, i);
+                        }
+                        self.end_block(out);
+                    }
+                    i += 1;
+                }
+                State::Checksum => {
+                    if !is_noise(c) {
+                        let v = REV[c as usize];
+                        if v == INVALID {
+                            return self.fail(ErrorKind::Symbol, i);
+                        }
+                        if v != checksum47(&self.window) {
+                            return self.fail(ErrorKind::Checksum, i);
+                        }
+                        self.state = State::Block;
+                    }
+                    i += 1;
+                }
+                State::Trailer1 => {
+                    if c != TERM {
+                        return self.fail(ErrorKind::Terminator, i);
+                    }
+                    self.state = State::Trailer2;
+                    i += 1;
+                }
+                State::Trailer2 => {
+                    let pad = REV[c as usize] as usize;
+                    if pad >= BLOCK_BYTES || (pad > 0 && !self.have_held) {
+                        return self.fail(ErrorKind::Trailer, i);
+                    }
+                    if self.have_held {
+                        out.extend_from_slice(&self.held[..BLOCK_BYTES - pad]);
+                        self.have_held = false;
+                    }
+                    self.state = State::Done;
+                    i += 1;
+                }
+                State::Done | State::Failed => {
+                    // nothing but whitespace may follow the trailer
+                    if !is_space(c) {
+                        return self.fail(ErrorKind::Trailer, i);
+                    }
+                    i += 1;
+                }
+            }
+        }
+        self.consumed += input.len() as u64;
+        Ok(())
+    }
+
+    /// Ok once the whole stream, trailer included, has been seen.
+    pub fn finish(&mut self) -> Result<(), DecodeError> {
+        if self.state == State::Done {
+            return Ok(());
+        }
+        self.fail(ErrorKind::Trailer, 0)
+    }
+}
+
+/// Decode a whole ciphertext.
+pub fn decode(input: &[u8]) -> Result<Vec<u8>, DecodeError> {
+    let mut dec = MosaicDecoder::new();
+    let mut out = Vec::with_capacity(input.len() / (BLOCK_SYMBOLS + 1) * BLOCK_BYTES + BLOCK_BYTES);
+    dec.update(input, &mut out)?;
+    dec.finish()?;
+    Ok(out)
+}
+
+const READ_CHUNK: usize = 64 * 1024;
+
+/// `Read` adapter: reads ciphertext from `inner`, yields plaintext.
+pub struct DecodeReader<R> {
+    inner: R,
+    dec: MosaicDecoder,
+    key: Vec<u8>,
+    key_pos: u64,
+    input: Box<[u8]>,
+    buf: Vec<u8>,
+    pos: usize,
+    eof: bool,
+}
+
+impl<R: Read> DecodeReader<R> {
+    pub fn new(inner: R) -> Self {
+        Self::with_key(inner, &[])
+    }
+
+    /// also undo the XOR with `key` (empty: no key)
+    pub fn with_key(inner: R, key: &[u8]) -> Self {
+        DecodeReader {
+            inner,
+            dec: MosaicDecoder::new(),
+            key: key.to_vec(),
+            key_pos: 0,
+            input: vec![0u8; READ_CHUNK].into_boxed_slice(),
+            buf: Vec::new(),
+            pos: 0,
+            eof: false,
+        }
+    }
+
+    pub fn into_inner(self) -> R {
+        self.inner
+    }
+}
+
+impl<R: Read> Read for DecodeReader<R> {
+    fn read(&mut self, dst: &mut [u8]) -> io::Result<usize> {
+        loop {
+            if self.pos < self.buf.len() {
+                let n = dst.len().min(self.buf.len() - self.pos);
+                dst[..n].copy_from_slice(&self.buf[self.pos..self.pos + n]);
+                self.pos += n;
+                return Ok(n);
+            }
+            if self.eof || dst.is_empty() {
+                return Ok(0);
+            }
+            self.buf.clear();
+            self.pos = 0;
+            let n = match self.inner.read(&mut self.input) {
+                Ok(n) => n,
+                Err(e) if e.kind() == io::ErrorKind::Interrupted => continue,
+                Err(e) => return Err(e),
+            };
+            if n == 0 {
+                self.dec.finish()?;
+                self.eof = true;
+                continue;
+            }
+            self.dec.update(&self.input[..n], &mut self.buf)?;
+            xor_with_key(&mut self.buf, &self.key, self.key_pos);
+            self.key_pos += self.buf.len() as u64;
+        }
+    }
+}
+
+/// `Write` adapter: takes ciphertext, writes plaintext to `inner`. Call
+/// `finish` at the end; it checks the stream was complete.
+pub struct DecodeWriter<W: Write> {
+    inner: W,
+    dec: MosaicDecoder,
+    key: Vec<u8>,
+    key_pos: u64,
+    buf: Vec<u8>,
+}
+
+impl<W: Write> DecodeWriter<W> {
+    pub fn new(inner: W) -> Self {
+        Self::with_key(inner, &[])
+    }
+
+    /// also undo the XOR with `key` (empty: no key)
+    pub fn with_key(inner: W, key: &[u8]) -> Self {
+        DecodeWriter { inner, dec: MosaicDecoder::new(), key: key.to_vec(), key_pos: 0, buf: Vec::new() }
+    }
+
+    pub fn finish(mut self) -> io::Result<W> {
+        self.dec.finish()?;
+        self.inner.flush()?;
+        Ok(self.inner)
+    }
+}
+
+impl<W: Write> Write for DecodeWriter<W> {
+    fn write(&mut self, src: &[u8]) -> io::Result<usize> {
+        self.buf.clear();
+        self.dec.update(src, &mut self.buf)?;
+        xor_with_key(&mut self.buf, &self.key, self.key_pos);
+        self.key_pos += self.buf.len() as u64;
+        self.inner.write_all(&self.buf)?;
+        Ok(src.len())
+    }
+
+    fn flush(&mut self) -> io::Result<()> {
+        self.inner.flush()
+    }
+}
+
+/// Windows per parallel task: about 150 KB of noisy ciphertext.
+pub const WINDOWS_PER_TASK: usize = 4096;
+
+/// Decode a whole ciphertext with its checksum windows spread over one
+/// scoped thread per core. A byte scan finds the window boundaries (every
+/// fourth terminator plus the checksum after it); each run of windows is
+/// then decoded on its own, starting at its block index, by whichever
+/// thread claims it next. Errors are reported exactly as `decode` reports
+/// them.
+pub fn decode_parallel(input: &[u8]) -> Result<Vec<u8>, DecodeError> {
+    use std::sync::atomic::{AtomicUsize, Ordering};
+    use std::sync::Mutex;
+    use std::thread;
+
+    // body is everything before the "~~P" trailer
+    let mut end = input.len();
+    while end > 0 && is_space(input[end - 1]) {
+        end -= 1;
+    }
+    if end < 3 || input[end - 3] != TERM || input[end - 2] != TERM {
+        return decode(input);
+    }
+    let body = &input[..end - 3];
+
+    // task boundaries, as (start offset, first block)
+    let mut starts: Vec<(usize, u64)> = vec![(0, 0)];
+    let mut terms = 0u64;
+    let mut i = 0;
+    while i < body.len() {
+        if body[i] == TERM {
+            terms += 1;
+            if terms.is_multiple_of((CHECKSUM_PERIOD * WINDOWS_PER_TASK) as u64) {
+                i += 1;
+                while i < body.len() && is_noise(body[i]) {
+                    i += 1;
+                }
+                starts.push((i + 1, terms));
+            }
+        }
+        i += 1;
+    }
+    // the last task must hold the last block, whose padding only the trailer knows
+    if starts.len() > 1 && !body[starts[starts.len() - 1].0.min(body.len())..].contains(&TERM) {
+        starts.pop();
+    }
+
+    type Part = Result<Vec<u8>, DecodeError>;
+    let decode_task = |t: usize| -> Part {
+        let (from, block) = starts[t];
+        let last = t + 1 == starts.len();
+        let to = if last { input.len() } else { starts[t + 1].0 };
+        let mut dec = MosaicDecoder::starting_at(block);
+        let mut out = Vec::new();
+        dec.update(&input[from.min(to)..to], &mut out)?;
+        if last {
+            dec.finish()?;
+        } else {
+            let expect = block + (CHECKSUM_PERIOD * WINDOWS_PER_TASK) as u64;
+            if dec.state != State::Block || dec.blocks != expect {
+                return Err(DecodeError { kind: ErrorKind::Terminator, offset: to as u64 });
+            }
+            out.extend_from_slice(&dec.held);
+        }
+        Ok(out)
+    };
+
+    let threads = thread::available_parallelism().map_or(1, |n| n.get()).min(starts.len());
+    let next = AtomicUsize::new(0);
+    let results: Vec<Mutex<Option<Part>>> = (0..starts.len()).map(|_| Mutex::new(None)).collect();
+    let work = || loop {
+        let t = next.fetch_add(1, Ordering::Relaxed);
+        if t >= starts.len() {
+            break;
+        }
+        *results[t].lock().unwrap() = Some(decode_task(t));
+    };
+    // the calling thread is one of the workers
+    thread::scope(|s| {
+        for _ in 1..threads {
+            s.spawn(work);
+        }
+        work();
+    });
+
+    let parts: Result<Vec<Vec<u8>>, DecodeError> =
+        results.into_iter().map(|r| r.into_inner().unwrap().unwrap()).collect();
+
+    match parts {
+        Ok(parts) => Ok(parts.concat()),
+        // the scan can mis-split malformed input; let the serial decoder say
+        // where it really breaks
+        Err(_) => decode(input),
+    }
+}
@@ -42,6 +42,10 @@ func decodeMosaic(_ s: String) throws -> Data {
     var i = 0
 
     while i < bytes.count {
+        // the marks sit before the first block; 'c' (compact) reads as noise
+        if blockIndex == 0 && (bytes[i] == UInt8(ascii: "z") || bytes[i] == UInt8(ascii: "w")) {
+            throw NSError(domain: "Unsupported stream (compressed or wide)", code: 1)
+        }
         while i < bytes.count && NOISE_SET.contains(Character(UnicodeScalar(bytes[i]))) { i += 1 }
         if i == bytes.count { break }
 
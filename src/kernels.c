@@ -0,0 +1,103 @@
+#include "kernels.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ---------------- Scalar variants ---------------- */
+
+static const char HEX_DIGITS[] = "0123456789ABCDEF";
+
+static void xor_stream_scalar(unsigned char *data, size_t len, const unsigned char *ekey,
+                              size_t period, size_t phase){
+  size_t p = phase;
+  for(size_t i = 0; i < len; i++){
+    data[i] ^= ekey[p];
+    if(++p == period) p = 0;
+  }
+}
+
+static void hex_encode_scalar(const unsigned char *in, size_t len, char *out){
+  for(size_t i = 0; i < len; i++){
+    out[2 * i] = HEX_DIGITS[in[i] >> 4];
+    out[2 * i + 1] = HEX_DIGITS[in[i] & 0x0F];
+  }
+}
+
+/* convert a single hex nibble to value, or -1 on error */
+static int hexval(char c){
+  if(c >= '0' && c <= '9') return c - '0';
+  if(c >= 'a' && c <= 'f') return 10 + (c - 'a');
+  if(c >= 'A' && c <= 'F') return 10 + (c - 'A');
+  return -1;
+}
+
+static int hex_decode_scalar(const char *in, size_t n_bytes, unsigned char *out){
+  for(size_t i = 0; i < n_bytes; i++){
+    int hi = hexval(in[2 * i]);
+    int lo = hexval(in[2 * i + 1]);
+    if(hi < 0 || lo < 0) return -1;
+    out[i] = (unsigned char)((hi << 4) | lo);
+  }
+  return 0;
+}
+
+static size_t span_clean_scalar(const char *in, size_t len){
+  size_t i = 0;
+  while(i < len){
+    unsigned char c = (unsigned char)in[i];
+    if((c >= 'a' && c <= 'z') || c == ' ' || (c >= '\t' && c <= '\r')) break;
+    i++;
+  }
+  return i;
+}
+
+const mosaic_kernels mosaic_kernels_scalar = {
+  "scalar",
+  xor_stream_scalar,
+  hex_encode_scalar,
+  hex_decode_scalar,
+  span_clean_scalar
+};
+
+size_t mosaic_stretch_key(unsigned char *ekey, const unsigned char *key, size_t klen){
+  size_t period = klen;
+  while(period < MOSAIC_XOR_WIDE) period += klen;
+  for(size_t j = 0; j < period + MOSAIC_XOR_WIDE; j++) ekey[j] = key[j % klen];
+  return period;
+}
+
+/* ---------------- Dispatch ---------------- */
+
+static const mosaic_kernels *active = &mosaic_kernels_scalar;
+static pthread_once_t select_once = PTHREAD_ONCE_INIT;
+
+static void select_kernels(void){
+#ifdef MOSAIC_HAVE_X86_KERNELS
+  /* candidates best-first; MOSAIC_ISA skips ahead to the named one (an
+   * unknown name, like "scalar", leaves the scalar kernels in place) */
+  __builtin_cpu_init();
+  const mosaic_kernels *const tiers[] = {
+    &mosaic_kernels_avx512, &mosaic_kernels_avx2, &mosaic_kernels_sse42
+  };
+  const int supported[] = {
+    __builtin_cpu_supports("avx512bw"),
+    __builtin_cpu_supports("avx2"),
+    __builtin_cpu_supports("sse4.2")
+  };
+  const char *cap = getenv("MOSAIC_ISA");
+  int capped = cap && *cap;
+  for(size_t t = 0; t < sizeof(tiers) / sizeof(tiers[0]); t++){
+    if(capped && strcmp(cap, tiers[t]->name) != 0) continue;
+    capped = 0;
+    if(supported[t]){
+      active = tiers[t];
+      return;
+    }
+  }
+#endif
+}
+
+const mosaic_kernels *mosaic_kernels_get(void){
+  pthread_once(&select_once, select_kernels);
+  return active;
+}
@@ -0,0 +1,221 @@
+#include "kernels.h"
+
+#ifdef MOSAIC_HAVE_X86_KERNELS
+
+#include <immintrin.h>
+#include <stdint.h>
+
+/* Each function carries its own target attribute, so this file builds with
+ * the project's plain flags and nothing here runs unless kernels.c has
+ * checked cpuid first. Loop tails fall back to the scalar kernels. */
+
+#define SSE42 __attribute__((target("sse4.2")))
+#define AVX2 __attribute__((target("avx2")))
+#define AVX512 __attribute__((target("avx512f,avx512bw")))
+
+/* ---------------- XOR ---------------- */
+
+SSE42 static void xor_stream_sse42(unsigned char *data, size_t len, const unsigned char *ekey,
+                                   size_t period, size_t phase){
+  size_t i = 0, p = phase;
+  for(; i + 16 <= len; i += 16){
+    __m128i d = _mm_loadu_si128((const __m128i*)(data + i));
+    __m128i k = _mm_loadu_si128((const __m128i*)(ekey + p));
+    _mm_storeu_si128((__m128i*)(data + i), _mm_xor_si128(d, k));
+    p += 16;
+    if(p >= period) p -= period;
+  }
+  mosaic_kernels_scalar.xor_stream(data + i, len - i, ekey, period, p);
+}
+
+AVX2 static void xor_stream_avx2(unsigned char *data, size_t len, const unsigned char *ekey,
+                                 size_t period, size_t phase){
+  size_t i = 0, p = phase;
+  for(; i + 32 <= len; i += 32){
+    __m256i d = _mm256_loadu_si256((const __m256i*)(data + i));
+    __m256i k = _mm256_loadu_si256((const __m256i*)(ekey + p));
+    _mm256_storeu_si256((__m256i*)(data + i), _mm256_xor_si256(d, k));
+    p += 32;
+    if(p >= period) p -= period;
+  }
+  mosaic_kernels_scalar.xor_stream(data + i, len - i, ekey, period, p);
+}
+
+AVX512 static void xor_stream_avx512(unsigned char *data, size_t len, const unsigned char *ekey,
+                                     size_t period, size_t phase){
+  size_t i = 0, p = phase;
+  for(; i + 64 <= len; i += 64){
+    __m512i d = _mm512_loadu_si512((const void*)(data + i));
+    __m512i k = _mm512_loadu_si512((const void*)(ekey + p));
+    _mm512_storeu_si512((void*)(data + i), _mm512_xor_si512(d, k));
+    p += 64;
+    if(p >= period) p -= period;
+  }
+  mosaic_kernels_scalar.xor_stream(data + i, len - i, ekey, period, p);
+}
+
+/* ---------------- Hex ---------------- */
+
+/* nibbles looked up with pshufb; unpack interleaves high/low digits */
+SSE42 static void hex_encode_sse42(const unsigned char *in, size_t len, char *out){
+  const __m128i digits = _mm_setr_epi8('0','1','2','3','4','5','6','7',
+                                       '8','9','A','B','C','D','E','F');
+  const __m128i lo_mask = _mm_set1_epi8(0x0F);
+  size_t i = 0;
+  for(; i + 16 <= len; i += 16){
+    __m128i x = _mm_loadu_si128((const __m128i*)(in + i));
+    __m128i hi = _mm_shuffle_epi8(digits, _mm_and_si128(_mm_srli_epi16(x, 4), lo_mask));
+    __m128i lo = _mm_shuffle_epi8(digits, _mm_and_si128(x, lo_mask));
+    _mm_storeu_si128((__m128i*)(out + 2 * i), _mm_unpacklo_epi8(hi, lo));
+    _mm_storeu_si128((__m128i*)(out + 2 * i + 16), _mm_unpackhi_epi8(hi, lo));
+  }
+  mosaic_kernels_scalar.hex_encode(in + i, len - i, out + 2 * i);
+}
+
+AVX2 static void hex_encode_avx2(const unsigned char *in, size_t len, char *out){
+  const __m256i digits = _mm256_setr_epi8('0','1','2','3','4','5','6','7',
+                                          '8','9','A','B','C','D','E','F',
+                                          '0','1','2','3','4','5','6','7',
+                                          '8','9','A','B','C','D','E','F');
+  const __m256i lo_mask = _mm256_set1_epi8(0x0F);
+  size_t i = 0;
+  for(; i + 32 <= len; i += 32){
+    __m256i x = _mm256_loadu_si256((const __m256i*)(in + i));
+    __m256i hi = _mm256_shuffle_epi8(digits, _mm256_and_si256(_mm256_srli_epi16(x, 4), lo_mask));
+    __m256i lo = _mm256_shuffle_epi8(digits, _mm256_and_si256(x, lo_mask));
+    /* unpack works per 128-bit lane; put the halves back in order */
+    __m256i a = _mm256_unpacklo_epi8(hi, lo);
+    __m256i b = _mm256_unpackhi_epi8(hi, lo);
+    _mm256_storeu_si256((__m256i*)(out + 2 * i), _mm256_permute2x128_si256(a, b, 0x20));
+    _mm256_storeu_si256((__m256i*)(out + 2 * i + 32), _mm256_permute2x128_si256(a, b, 0x31));
+  }
+  mosaic_kernels_scalar.hex_encode(in + i, len - i, out + 2 * i);
+}
+
+/* Map each digit to its value: '0'-'9' by range on the raw byte, 'a'-'f' by
+ * range after folding case with | 0x20 (the raw test keeps that fold from
+ * accepting 0x10-0x19). Signed compares reject bytes >= 0x80 for free. */
+SSE42 static int hex_decode_sse42(const char *in, size_t n_bytes, unsigned char *out){
+  const __m128i c0 = _mm_set1_epi8('0' - 1), c9 = _mm_set1_epi8('9' + 1);
+  const __m128i ca = _mm_set1_epi8('a' - 1), cf = _mm_set1_epi8('f' + 1);
+  const __m128i fold = _mm_set1_epi8(0x20);
+  const __m128i weights = _mm_set1_epi16(0x0110); /* hi * 16 + lo */
+  size_t i = 0;
+  for(; i + 8 <= n_bytes; i += 8){
+    __m128i c = _mm_loadu_si128((const __m128i*)(in + 2 * i));
+    __m128i lc = _mm_or_si128(c, fold);
+    __m128i is_dig = _mm_and_si128(_mm_cmpgt_epi8(c, c0), _mm_cmplt_epi8(c, c9));
+    __m128i is_alp = _mm_and_si128(_mm_cmpgt_epi8(lc, ca), _mm_cmplt_epi8(lc, cf));
+    if(_mm_movemask_epi8(_mm_or_si128(is_dig, is_alp)) != 0xFFFF) return -1;
+    __m128i v = _mm_blendv_epi8(_mm_sub_epi8(lc, _mm_set1_epi8('a' - 10)),
+                                _mm_sub_epi8(c, _mm_set1_epi8('0')), is_dig);
+    __m128i w = _mm_maddubs_epi16(v, weights);
+    _mm_storel_epi64((__m128i*)(out + i), _mm_packus_epi16(w, w));
+  }
+  return mosaic_kernels_scalar.hex_decode(in + 2 * i, n_bytes - i, out + i);
+}
+
+AVX2 static int hex_decode_avx2(const char *in, size_t n_bytes, unsigned char *out){
+  const __m256i c0 = _mm256_set1_epi8('0' - 1), c9 = _mm256_set1_epi8('9' + 1);
+  const __m256i ca = _mm256_set1_epi8('a' - 1), cf = _mm256_set1_epi8('f' + 1);
+  const __m256i fold = _mm256_set1_epi8(0x20);
+  const __m256i weights = _mm256_set1_epi16(0x0110);
+  size_t i = 0;
+  for(; i + 16 <= n_bytes; i += 16){
+    __m256i c = _mm256_loadu_si256((const __m256i*)(in + 2 * i));
+    __m256i lc = _mm256_or_si256(c, fold);
+    __m256i is_dig = _mm256_and_si256(_mm256_cmpgt_epi8(c, c0), _mm256_cmpgt_epi8(c9, c));
+    __m256i is_alp = _mm256_and_si256(_mm256_cmpgt_epi8(lc, ca), _mm256_cmpgt_epi8(cf, lc));
+    if((uint32_t)_mm256_movemask_epi8(_mm256_or_si256(is_dig, is_alp)) != 0xFFFFFFFFu) return -1;
+    __m256i v = _mm256_blendv_epi8(_mm256_sub_epi8(lc, _mm256_set1_epi8('a' - 10)),
+                                   _mm256_sub_epi8(c, _mm256_set1_epi8('0')), is_dig);
+    __m256i w = _mm256_maddubs_epi16(v, weights);
+    /* packus is per lane too: gather qwords 0 and 2 */
+    __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(w, w), 0x08);
+    _mm_storeu_si128((__m128i*)(out + i), _mm256_castsi256_si128(packed));
+  }
+  return mosaic_kernels_scalar.hex_decode(in + 2 * i, n_bytes - i, out + i);
+}
+
+/* ---------------- Classification ---------------- */
+
+SSE42 static size_t span_clean_sse42(const char *in, size_t len){
+  const __m128i a = _mm_set1_epi8('a' - 1), z = _mm_set1_epi8('z' + 1);
+  const __m128i sp = _mm_set1_epi8(' ');
+  const __m128i tab = _mm_set1_epi8('\t' - 1), cr = _mm_set1_epi8('\r' + 1);
+  size_t i = 0;
+  for(; i + 16 <= len; i += 16){
+    __m128i c = _mm_loadu_si128((const __m128i*)(in + i));
+    __m128i noise = _mm_and_si128(_mm_cmpgt_epi8(c, a), _mm_cmplt_epi8(c, z));
+    __m128i ws = _mm_or_si128(_mm_cmpeq_epi8(c, sp),
+                              _mm_and_si128(_mm_cmpgt_epi8(c, tab), _mm_cmplt_epi8(c, cr)));
+    unsigned m = (unsigned)_mm_movemask_epi8(_mm_or_si128(noise, ws));
+    if(m) return i + (size_t)__builtin_ctz(m);
+  }
+  return i + mosaic_kernels_scalar.span_clean(in + i, len - i);
+}
+
+AVX2 static size_t span_clean_avx2(const char *in, size_t len){
+  const __m256i a = _mm256_set1_epi8('a' - 1), z = _mm256_set1_epi8('z' + 1);
+  const __m256i sp = _mm256_set1_epi8(' ');
+  const __m256i tab = _mm256_set1_epi8('\t' - 1), cr = _mm256_set1_epi8('\r' + 1);
+  size_t i = 0;
+  for(; i + 32 <= len; i += 32){
+    __m256i c = _mm256_loadu_si256((const __m256i*)(in + i));
+    __m256i noise = _mm256_and_si256(_mm256_cmpgt_epi8(c, a), _mm256_cmpgt_epi8(z, c));
+    __m256i ws = _mm256_or_si256(_mm256_cmpeq_epi8(c, sp),
+                                 _mm256_and_si256(_mm256_cmpgt_epi8(c, tab), _mm256_cmpgt_epi8(cr, c)));
+    unsigned m = (unsigned)_mm256_movemask_epi8(_mm256_or_si256(noise, ws));
+    if(m) return i + (size_t)__builtin_ctz(m);
+  }
+  return i + mosaic_kernels_scalar.span_clean(in + i, len - i);
+}
+
+AVX512 static size_t span_clean_avx512(const char *in, size_t len){
+  const __m512i a = _mm512_set1_epi8('a'), tab = _mm512_set1_epi8('\t');
+  const __m512i sp = _mm512_set1_epi8(' ');
+  size_t i = 0;
+  for(; i + 64 <= len; i += 64){
+    __m512i c = _mm512_loadu_si512((const void*)(in + i));
+    /* unsigned range checks: (c - lo) <= hi - lo */
+    __mmask64 noise = _mm512_cmple_epu8_mask(_mm512_sub_epi8(c, a), _mm512_set1_epi8('z' - 'a'));
+    __mmask64 ws = _mm512_cmpeq_epi8_mask(c, sp) |
+                   _mm512_cmple_epu8_mask(_mm512_sub_epi8(c, tab), _mm512_set1_epi8('\r' - '\t'));
+    uint64_t m = (uint64_t)(noise | ws);
+    if(m) return i + (size_t)__builtin_ctzll(m);
+  }
+  return i + mosaic_kernels_scalar.span_clean(in + i, len - i);
+}
+
+/* ---------------- Tables ---------------- */
+
+const mosaic_kernels mosaic_kernels_sse42 = {
+  "sse4.2",
+  xor_stream_sse42,
+  hex_encode_sse42,
+  hex_decode_sse42,
+  span_clean_sse42
+};
+
+const mosaic_kernels mosaic_kernels_avx2 = {
+  "avx2",
+  xor_stream_avx2,
+  hex_encode_avx2,
+  hex_decode_avx2,
+  span_clean_avx2
+};
+
+/* hex reuses the AVX2 kernels */
+const mosaic_kernels mosaic_kernels_avx512 = {
+  "avx512",
+  xor_stream_avx512,
+  hex_encode_avx2,
+  hex_decode_avx2,
+  span_clean_avx512
+};
+
+#else
+
+typedef int kernels_x86_unused; /* ISO C forbids an empty translation unit */
+
+#endif
@@ -0,0 +1,235 @@
+#include "lz.h"
+#include <string.h>
+
+#define MIN_MATCH 4
+#define MAX_DIST 65535u
+#define HASH_BITS 14
+#define RUN_MASK 15u
+
+enum { FRAME_STORED = 0, FRAME_LZ = 1 };
+
+static uint32_t read32(const uint8_t *p){
+  uint32_t v;
+  memcpy(&v, p, 4);
+  return v;
+}
+
+static uint64_t read64(const uint8_t *p){
+  uint64_t v;
+  memcpy(&v, p, 8);
+  return v;
+}
+
+static uint32_t get_le32(const uint8_t *p){
+  return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static void put_le32(uint8_t *p, uint32_t v){
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+  p[2] = (uint8_t)(v >> 16);
+  p[3] = (uint8_t)(v >> 24);
+}
+
+static uint32_t hash4(uint32_t v){
+  return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+/* ---------------- Compress ---------------- */
+
+/* bytes a length of n takes past its token nibble */
+static size_t len_extra(size_t n){
+  return n < RUN_MASK ? 0 : (n - RUN_MASK) / 255 + 1;
+}
+
+static size_t put_len(uint8_t *out, size_t n){
+  size_t o = 0;
+  if(n < RUN_MASK) return 0;
+  n -= RUN_MASK;
+  while(n >= 255){ out[o++] = 255; n -= 255; }
+  out[o++] = (uint8_t)n;
+  return o;
+}
+
+/* one sequence: lit literals, then a match of mlen bytes dist back (mlen 0
+ * for the closing literals-only sequence). 0 if it does not fit in cap. */
+static size_t put_sequence(uint8_t *out, size_t cap, const uint8_t *lit, size_t lit_len,
+                           size_t dist, size_t mlen){
+  size_t ml = mlen ? mlen - MIN_MATCH : 0;
+  size_t need = 1 + len_extra(lit_len) + lit_len + (mlen ? 2 + len_extra(ml) : 0);
+  if(need > cap) return 0;
+
+  size_t o = 0;
+  uint8_t token = (uint8_t)((lit_len < RUN_MASK ? lit_len : RUN_MASK) << 4);
+  if(mlen) token |= (uint8_t)(ml < RUN_MASK ? ml : RUN_MASK);
+  out[o++] = token;
+  o += put_len(out + o, lit_len);
+  memcpy(out + o, lit, lit_len);
+  o += lit_len;
+  if(mlen){
+    out[o++] = (uint8_t)dist;
+    out[o++] = (uint8_t)(dist >> 8);
+    o += put_len(out + o, ml);
+  }
+  return o;
+}
+
+/* LZ body of in[0..len) in at most cap bytes, 0 if it does not fit. The
+ * hash table maps 4-byte prefixes to their last position; stale entries
+ * are harmless because every candidate is checked against the input. */
+static size_t lz_block(const uint8_t *in, size_t len, uint8_t *out, size_t cap, uint32_t *table){
+  size_t o = 0, anchor = 0, i = 0, misses = 0, w;
+  memset(table, 0, sizeof(uint32_t) << HASH_BITS);
+
+  while(i + MIN_MATCH <= len){
+    uint32_t v = read32(in + i);
+    uint32_t h = hash4(v);
+    size_t cand = table[h];
+    table[h] = (uint32_t)i;
+    if(cand >= i || i - cand > MAX_DIST || read32(in + cand) != v){
+      /* step faster through data that keeps missing */
+      i += 1 + (misses++ >> 6);
+      continue;
+    }
+
+    while(i > anchor && cand > 0 && in[i - 1] == in[cand - 1]){ i--; cand--; }
+    size_t m = MIN_MATCH;
+    while(i + m + 8 <= len && read64(in + i + m) == read64(in + cand + m)) m += 8;
+    while(i + m < len && in[i + m] == in[cand + m]) m++;
+
+    w = put_sequence(out + o, cap - o, in + anchor, i - anchor, i - cand, m);
+    if(!w) return 0;
+    o += w;
+    i += m;
+    anchor = i;
+    misses = 0;
+    if(i + 2 <= len) table[hash4(read32(in + i - 2))] = (uint32_t)(i - 2);
+  }
+
+  w = put_sequence(out + o, cap - o, in + anchor, len - anchor, 0, 0);
+  return w ? o + w : 0;
+}
+
+size_t mosaic_lz_bound(size_t in_len){
+  size_t frames = in_len / MOSAIC_LZ_FRAME_MAX + (in_len % MOSAIC_LZ_FRAME_MAX != 0);
+  return in_len + frames * MOSAIC_LZ_FRAME_HDR;
+}
+
+size_t mosaic_lz_compress(const uint8_t *in, size_t in_len, uint8_t *out, size_t out_cap){
+  uint32_t table[1u << HASH_BITS];
+  size_t need = mosaic_lz_bound(in_len);
+  if((!in && in_len) || need < in_len || out_cap < need) return (size_t)-1;
+
+  size_t o = 0;
+  while(in_len){
+    size_t n = in_len < MOSAIC_LZ_FRAME_MAX ? in_len : MOSAIC_LZ_FRAME_MAX;
+    uint8_t *hdr = out + o;
+    /* LZ only pays if it saves at least a byte; otherwise store */
+    size_t body = n > MIN_MATCH ? lz_block(in, n, hdr + MOSAIC_LZ_FRAME_HDR, n - 1, table) : 0;
+    if(body){
+      hdr[0] = FRAME_LZ;
+    } else {
+      hdr[0] = FRAME_STORED;
+      memcpy(hdr + MOSAIC_LZ_FRAME_HDR, in, n);
+      body = n;
+    }
+    put_le32(hdr + 1, (uint32_t)n);
+    put_le32(hdr + 5, (uint32_t)body);
+    o += MOSAIC_LZ_FRAME_HDR + body;
+    in += n;
+    in_len -= n;
+  }
+  return o;
+}
+
+/* ---------------- Decompress ---------------- */
+
+/* reads a 255-run length extension onto n; -1 if it runs off the input or
+ * past any sane frame */
+static int get_len(const uint8_t *in, size_t len, size_t *i, size_t *n){
+  uint8_t b;
+  do {
+    if(*i >= len) return -1;
+    b = in[(*i)++];
+    *n += b;
+    if(*n > MOSAIC_LZ_FRAME_MAX) return -1;
+  } while(b == 255);
+  return 0;
+}
+
+/* a whole LZ body that must come to exactly raw_len bytes */
+static int lz_unblock(const uint8_t *in, size_t len, uint8_t *out, size_t raw_len){
+  size_t i = 0, o = 0;
+  for(;;){
+    if(i >= len) return -1;
+    uint8_t token = in[i++];
+    size_t lit = token >> 4;
+    if(lit == RUN_MASK && get_len(in, len, &i, &lit) != 0) return -1;
+    if(lit > len - i || lit > raw_len - o) return -1;
+    memcpy(out + o, in + i, lit);
+    i += lit;
+    o += lit;
+    if(i == len) return o == raw_len ? 0 : -1; /* the closing literals */
+
+    if(len - i < 2) return -1;
+    size_t dist = (size_t)in[i] | (size_t)in[i + 1] << 8;
+    i += 2;
+    size_t m = token & RUN_MASK;
+    if(m == RUN_MASK && get_len(in, len, &i, &m) != 0) return -1;
+    m += MIN_MATCH;
+    if(dist == 0 || dist > o || m > raw_len - o) return -1;
+
+    uint8_t *d = out + o;
+    const uint8_t *s = d - dist;
+    if(dist >= m){
+      memcpy(d, s, m);
+    } else {
+      /* overlapping: a run, copied forward byte by byte */
+      for(size_t k = 0; k < m; k++) d[k] = s[k];
+    }
+    o += m;
+  }
+}
+
+size_t mosaic_lz_frame(const uint8_t *in, size_t in_len, size_t *raw_len){
+  if(in_len && in[0] != FRAME_STORED && in[0] != FRAME_LZ) return (size_t)-1;
+  if(in_len < MOSAIC_LZ_FRAME_HDR) return 0;
+  size_t raw = get_le32(in + 1);
+  size_t body = get_le32(in + 5);
+  if(raw == 0 || raw > MOSAIC_LZ_FRAME_MAX) return (size_t)-1;
+  /* the encoder only keeps LZ bodies that are smaller than the data */
+  if(in[0] == FRAME_STORED ? body != raw : body == 0 || body >= raw) return (size_t)-1;
+  if(in_len - MOSAIC_LZ_FRAME_HDR < body) return 0;
+  if(raw_len) *raw_len = raw;
+  return MOSAIC_LZ_FRAME_HDR + body;
+}
+
+size_t mosaic_lz_decompressed_len(const uint8_t *in, size_t in_len){
+  size_t total = 0, i = 0, raw;
+  if(!in && in_len) return (size_t)-1;
+  while(i < in_len){
+    size_t f = mosaic_lz_frame(in + i, in_len - i, &raw);
+    if(f == 0 || f == (size_t)-1) return (size_t)-1;
+    total += raw;
+    i += f;
+  }
+  return total;
+}
+
+size_t mosaic_lz_decompress(const uint8_t *in, size_t in_len, uint8_t *out, size_t out_cap){
+  size_t o = 0, i = 0, raw;
+  if(!in && in_len) return (size_t)-1;
+  while(i < in_len){
+    size_t f = mosaic_lz_frame(in + i, in_len - i, &raw);
+    if(f == 0 || f == (size_t)-1 || raw > out_cap - o) return (size_t)-1;
+    const uint8_t *body = in + i + MOSAIC_LZ_FRAME_HDR;
+    if(in[i] == FRAME_STORED){
+      memcpy(out + o, body, raw);
+    } else if(lz_unblock(body, f - MOSAIC_LZ_FRAME_HDR, out + o, raw) != 0){
+      return (size_t)-1;
+    }
+    o += raw;
+    i += f;
+  }
+  return o;
+}
@@ -1,7 +1,10 @@
 #include "cli.h"
 #include <stdio.h>
 
-int main(void){
+int main(int argc, char **argv){
+  /* mosaicCipher <command> [args...] runs a single command, no REPL */
+  if(argc > 1) return cli_run_args(argc - 1, argv + 1) == 0 ? 0 : 1;
+
   print_banner();
   printf("Welcome to Mosaic Cipher CLI!\n");
   cli_loop();
@@ -1,11 +1,22 @@
 #include "mosaic.h"
 #include "xor_key.h"
+#include "stats.h"
+#include "kernels.h"
+#include "lz.h"
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
 #include <time.h>
+#include <pthread.h>
+
+/* for loops that are instantiated once per block preset */
+#if defined(__GNUC__)
+#define ALWAYS_INLINE static inline __attribute__((always_inline))
+#else
+#define ALWAYS_INLINE static inline
+#endif
 
 /* ---------------- Core parameters ---------------- */
 static const char MOSAIC_ALPHABET[] =
@@ -14,6 +25,15 @@ static const char MOSAIC_ALPHABET[] =
 static const char NOISE_SET[] =
   "abcdefghijklmnopqrstuvwxyz";
 
+/* leading mark of a compact (noise-free) stream. It is taken from NOISE_SET
+ * on purpose: decoders that don't know about compact mode skip it as noise. */
+static const char COMPACT_MARK = 'c';
+/* leading mark of a compressed payload (MOSAIC_OPT_COMPRESS); it comes
+ * before the compact mark, so "zc" opens a compressed compact stream */
+static const char COMPRESS_MARK = 'z';
+/* leading mark of a wide-block stream (MOSAIC_OPT_WIDE), between the two */
+static const char WIDE_MARK = 'w';
+
 static const mosaic_params MOSAIC_PARAMS = {
   MOSAIC_ALPHABET,
   '~',
@@ -23,18 +43,36 @@ static const mosaic_params MOSAIC_PARAMS = {
   4
 };
 
+/* MOSAIC_OPT_WIDE: 8 bytes are one uint64_t, and 47^12 > 2^64, so a block
+ * is 12 symbols. Alphabet, rotation, checksum and trailer stay the same. */
+static const mosaic_params MOSAIC_PARAMS_WIDE = {
+  MOSAIC_ALPHABET,
+  '~',
+  47,
+  8,
+  12,
+  4
+};
+
 const mosaic_params* mosaic_get_params(void){
   return &MOSAIC_PARAMS;
 }
 
+const mosaic_params* mosaic_get_params_wide(void){
+  return &MOSAIC_PARAMS_WIDE;
+}
+
+static const mosaic_params *params_for(unsigned opts){
+  return (opts & MOSAIC_OPT_WIDE) ? &MOSAIC_PARAMS_WIDE : &MOSAIC_PARAMS;
+}
+
 /* ---------------- Helper functions ---------------- */
 
-/* rotate base alphabet left by `rot` */
-static void rotate_alphabet(char *dst, const char *base, int len, int rot){
-  rot %= len;
-  if(rot < 0) rot += len;
-  for(int i = 0; i < len; i++) dst[i] = base[(i + rot) % len];
-  dst[len] = '\0';
+/* alphabet written twice, so the rotated alphabet for `rot` is just
+ * dst + rot: symbol d of a block encodes as dst[rot + d] */
+static void double_alphabet(char *dst, const char *base, int len){
+  memcpy(dst, base, (size_t)len);
+  memcpy(dst + len, base, (size_t)len);
 }
 
 static void build_rev(int rev[256], const char *alpha, int len){
@@ -44,32 +82,62 @@ static void build_rev(int rev[256], const char *alpha, int len){
 
 /* ---------------- Encode/Decode helpers ---------------- */
 
-static void u40_to_base47(uint8_t in5[5], int base, int out_digits[8]){
-  uint8_t buf[5];
-  memcpy(buf, in5, 5);
+/* 40 bits fit comfortably in a uint64_t; the compiler turns the constant
+ * divisions into multiplies */
+static void u40_to_base47(const uint8_t in5[5], int base, int out_digits[8]){
+  uint64_t v = 0;
+  for(int i = 0; i < 5; i++) v = (v << 8) | in5[i];
   for(int d = 7; d >= 0; d--){
-    unsigned int rem = 0u;
-    for(int i = 0; i < 5; i++){
-      unsigned int cur = (rem << 8) | buf[i];
-      unsigned int q = cur / (unsigned)base;
-      rem = cur % (unsigned)base;
-      buf[i] = (uint8_t)q;
-    }
-    out_digits[d] = (int)rem;
+    out_digits[d] = (int)(v % (unsigned)base);
+    v /= (unsigned)base;
   }
 }
 
-static void base47_to_u40(const int digits[8], int base, uint8_t out5[5]){
-  uint8_t acc[5] = {0,0,0,0,0};
-  for(int d = 0; d < 8; d++){
-    unsigned int carry = (unsigned int)digits[d];
-    for(int i = 4; i >= 0; i--){
-      unsigned int v = (unsigned int)acc[i] * (unsigned)base + carry;
-      acc[i] = (uint8_t)(v & 0xFFu);
-      carry = v >> 8;
-    }
+/* returns nonzero if the digits don't fit in 40 bits (never true for
+ * encoder output, so a cheap sanity check on untrusted input) */
+static unsigned base47_to_u40(const int digits[8], int base, uint8_t out5[5]){
+  uint64_t v = 0; /* 47^8 < 2^45, no overflow */
+  for(int d = 0; d < 8; d++) v = v * (unsigned)base + (unsigned)digits[d];
+  for(int i = 4; i >= 0; i--){
+    out5[i] = (uint8_t)(v & 0xFFu);
+    v >>= 8;
   }
-  memcpy(out5, acc, 5);
+  return v != 0;
+}
+
+/* wide blocks: the same on a whole uint64_t */
+static void u64_to_base47(const uint8_t in8[8], int base, int out_digits[12]){
+  uint64_t v = 0;
+  for(int i = 0; i < 8; i++) v = (v << 8) | in8[i];
+  for(int d = 11; d >= 0; d--){
+    out_digits[d] = (int)(v % (unsigned)base);
+    v /= (unsigned)base;
+  }
+}
+
+/* 47^12 > 2^64: nonzero if the digits overflow 64 bits */
+static unsigned base47_to_u64(const int digits[12], int base, uint8_t out8[8]){
+  uint64_t v = 0;
+  unsigned over = 0;
+  for(int d = 0; d < 12; d++){
+    over |= v > (UINT64_MAX - (uint64_t)digits[d]) / (unsigned)base;
+    v = v * (unsigned)base + (unsigned)digits[d];
+  }
+  for(int i = 7; i >= 0; i--){
+    out8[i] = (uint8_t)(v & 0xFFu);
+    v >>= 8;
+  }
+  return over;
+}
+
+/* either preset, by block size */
+static void block_to_base47(const uint8_t *in, int block_bytes, int base, int *out_digits){
+  if(block_bytes == 8) u64_to_base47(in, base, out_digits);
+  else u40_to_base47(in, base, out_digits);
+}
+
+static unsigned base47_to_block(const int *digits, int block_bytes, int base, uint8_t *out){
+  return block_bytes == 8 ? base47_to_u64(digits, base, out) : base47_to_u40(digits, base, out);
 }
 
 /* compute rotation for block index (deterministic only on block_index)
@@ -79,116 +147,274 @@ static int rotation_for_block(size_t block_index){
   return (int)(((block_index * 13u) + 11u) % 47u);
 }
 
-/* compute checksum value (0..46) from `blocks` worth of 5-byte blocks */
-static int checksum47(const uint8_t *block5xN, size_t blocks){
+/* compute checksum value (0..46) from a window of `bytes` bytes */
+static int checksum47(const uint8_t *window, size_t bytes){
   unsigned int x = 0u;
-  for(size_t b = 0; b < blocks; b++){
-    for(int i = 0; i < 5; i++) x ^= block5xN[b * 5 + i];
-  }
+  for(size_t i = 0; i < bytes; i++) x ^= window[i];
   return (int)(x % 47u);
 }
 
-/* helper: insert a "noise" character (ignored by decoder) */
-static char noise_char(void){
-  return NOISE_SET[rand() % (sizeof(NOISE_SET) - 1)];
+/* noise PRNG (xorshift64*). Each encode carries its own state instead of
+ * sharing rand()'s, so a given seed always places the same noise and
+ * encoders on different threads don't disturb each other. One draw per
+ * block: bit 0 says whether noise goes in, the high bits pick the letter. */
+static uint64_t noise_seed(uint64_t seed){
+  uint64_t s = seed ^ 0x9E3779B97F4A7C15ull;
+  return s ? s : 1; /* 0 is xorshift's fixed point */
+}
+
+static uint32_t noise_next(uint64_t *s){
+  *s ^= *s >> 12;
+  *s ^= *s << 25;
+  *s ^= *s >> 27;
+  return (uint32_t)((*s * 0x2545F4914F6CDD1Dull) >> 32);
+}
+
+/* unseeded calls: different on every run, as with srand(time) before */
+static uint64_t noise_seed_auto(const void *salt){
+  return (uint64_t)time(NULL) ^ ((uint64_t)(uintptr_t)salt << 16);
 }
 
 /* ---------------- Capacity helper ---------------- */
-static size_t encode_capacity(size_t in_len){
-  const mosaic_params *P = mosaic_get_params();
+static size_t encode_capacity(size_t in_len, unsigned opts){
+  const mosaic_params *P = params_for(opts);
   size_t n_blocks = (in_len + P->block_bytes - 1) / P->block_bytes;
   size_t per_blocks = n_blocks * (size_t)(P->block_symbols + 1); /* symbols + terminator */
   size_t checksums = n_blocks / (size_t)P->checksum_period;
+  size_t noise = n_blocks; /* at most one noise char per block */
+  if(opts & MOSAIC_OPT_COMPACT) noise = 0;
+  if(n_blocks) noise += ((opts & MOSAIC_OPT_COMPACT) != 0) + ((opts & MOSAIC_OPT_COMPRESS) != 0) +
+                        ((opts & MOSAIC_OPT_WIDE) != 0); /* marks */
   /* trailer: "~~" + 1 digit */
-  return per_blocks + checksums + 3;
+  return per_blocks + checksums + noise + 3;
 }
 
 /* ---------------- Encode ---------------- */
-size_t mosaic_encode(const uint8_t *in, size_t in_len, char *out, size_t out_cap){
-  const mosaic_params *P = mosaic_get_params();
-  const int BASE = P->base;
+
+/* encode in_len bytes as blocks first_block, first_block + 1, ... into out.
+ * first_block must start a checksum window; a short last block is zero
+ * padded and a short last window gets no checksum. Returns chars written. */
+ALWAYS_INLINE size_t encode_blocks_with(const mosaic_params *P, const uint8_t *in, size_t in_len,
+                                        size_t first_block, int compact, uint64_t *rng,
+                                        const char *alpha2, char *out, size_t *noise){
   const int B = P->block_bytes;
   const int S = P->block_symbols;
-
-  if(!in) return (size_t)-1;
-
-  size_t need = encode_capacity(in_len);
-  if(!out) return need;
-  if(out_cap < need) return (size_t)-1;
-
   size_t o = 0;
   size_t blocks = (in_len + (B - 1)) / B;
   size_t full_blocks = in_len / B;
   size_t rem = in_len % B;
-  uint8_t buf5[5];
-  char rotated[48];
-  uint8_t cs_buf[4 * 5];
+  uint8_t buf5[8];
+  uint8_t cs_buf[4 * 8];
   size_t cs_count = 0;
 
-  /* seed randomness for noise insertion; ok to call here */
-  srand((unsigned)time(NULL) ^ (unsigned)(uintptr_t)in);
-
   for(size_t b = 0; b < blocks; b++){
-    memset(buf5, 0, 5);
+    memset(buf5, 0, sizeof buf5);
     if(b < full_blocks){
       memcpy(buf5, in + b * B, B);
     } else if(rem){
       memcpy(buf5, in + b * B, rem);
     }
 
-    int digits[8];
-    u40_to_base47(buf5, BASE, digits);
-
-    int rot = rotation_for_block(b);
-    rotate_alphabet(rotated, P->alphabet, BASE, rot);
+    int digits[12];
+    block_to_base47(buf5, B, P->base, digits);
 
+    const char *rotated = alpha2 + rotation_for_block(first_block + b);
     for(int i = 0; i < S; i++){
       out[o++] = rotated[digits[i]];
     }
 
     /* insert noise char 50% chance */
-    if(rand() & 1){
-      out[o++] = noise_char();
+    if(!compact){
+      uint32_t r = noise_next(rng);
+      if(r & 1){
+        out[o++] = NOISE_SET[(r >> 1) % (sizeof(NOISE_SET) - 1)];
+        (*noise)++;
+      }
     }
 
     /* block terminator */
     out[o++] = P->term_char;
 
     /* accumulate block for checksum window */
-    memcpy(cs_buf + cs_count * 5, buf5, 5);
+    memcpy(cs_buf + cs_count * B, buf5, B);
     cs_count++;
     if(cs_count == (size_t)P->checksum_period){
-      int c = checksum47(cs_buf, cs_count);
+      int c = checksum47(cs_buf, cs_count * B);
       out[o++] = P->alphabet[c];
       cs_count = 0;
     }
   }
+  return o;
+}
+
+/* the leading marks for opts; returns chars written */
+static size_t encode_marks(unsigned opts, char *out){
+  size_t o = 0;
+  if(opts & MOSAIC_OPT_COMPRESS) out[o++] = COMPRESS_MARK;
+  if(opts & MOSAIC_OPT_WIDE) out[o++] = WIDE_MARK;
+  if(opts & MOSAIC_OPT_COMPACT) out[o++] = COMPACT_MARK;
+  return o;
+}
+
+/* each preset gets its own copy of the loop, with the block shape known at
+ * compile time */
+static size_t encode_blocks(const mosaic_params *P, const uint8_t *in, size_t in_len,
+                            size_t first_block, int compact, uint64_t *rng, const char *alpha2,
+                            char *out, size_t *noise){
+  if(P == &MOSAIC_PARAMS_WIDE){
+    return encode_blocks_with(&MOSAIC_PARAMS_WIDE, in, in_len, first_block, compact, rng, alpha2,
+                              out, noise);
+  }
+  return encode_blocks_with(&MOSAIC_PARAMS, in, in_len, first_block, compact, rng, alpha2, out, noise);
+}
 
-  /* trailer: "~~" + pad_count digit */
+/* trailer: "~~" + pad_count digit */
+static size_t encode_trailer(const mosaic_params *P, size_t in_len, char *out){
+  const int B = P->block_bytes;
   size_t pad_count = (B - (in_len % B)) % B;
-  out[o++] = P->term_char;
-  out[o++] = P->term_char;
-  out[o++] = P->alphabet[pad_count];
+  out[0] = P->term_char;
+  out[1] = P->term_char;
+  out[2] = P->alphabet[pad_count];
+  return 3;
+}
 
+/* marks, blocks and trailer of one whole message */
+static size_t encode_message(const mosaic_params *P, const char *alpha2, const uint8_t *in,
+                             size_t in_len, unsigned opts, uint64_t *rng, char *out,
+                             size_t *noise){
+  size_t o = 0;
+  /* an empty payload has no blocks to mark, and "~~A" reads the same */
+  if(in_len) o += encode_marks(opts, out);
+  o += encode_blocks(P, in, in_len, 0, (opts & MOSAIC_OPT_COMPACT) != 0, rng, alpha2, out + o,
+                     noise);
+  return o + encode_trailer(P, in_len, out + o);
+}
+
+size_t mosaic_encode(const uint8_t *in, size_t in_len, char *out, size_t out_cap){
+  return mosaic_encode_ex(in, in_len, out, out_cap, 0u);
+}
+
+size_t mosaic_encode_ex(const uint8_t *in, size_t in_len, char *out, size_t out_cap, unsigned opts){
+  return mosaic_encode_seeded(in, in_len, out, out_cap, opts, noise_seed_auto(in));
+}
+
+size_t mosaic_encode_seeded(const uint8_t *in, size_t in_len, char *out, size_t out_cap,
+                            unsigned opts, uint64_t seed){
+  const mosaic_params *P = params_for(opts);
+  const int B = P->block_bytes;
+
+  if(!in) return (size_t)-1;
+
+  size_t need = encode_capacity(in_len, opts);
+  if(!out) return need;
+  if(out_cap < need) return (size_t)-1;
+
+  uint64_t t0 = STATS_NOW();
+  size_t noise = 0;
+  size_t blocks = (in_len + (B - 1)) / B;
+  uint64_t rng = noise_seed(seed);
+  char alpha2[2 * 47];
+  double_alphabet(alpha2, P->alphabet, P->base);
+
+  size_t o = encode_message(P, alpha2, in, in_len, opts, &rng, out, &noise);
+
+  STATS_NOISE(noise, 0);
+  STATS_RECORD(MOSAIC_OP_ENCODE, t0, in_len, o, blocks);
   return o;
 }
 
 /* ---------------- Decode ---------------- */
-size_t mosaic_decode(const char *in, size_t in_len, uint8_t *out, size_t out_cap){
-  const mosaic_params *P = mosaic_get_params();
+
+/* report why a decode gave up, then give up */
+#define DECODE_FAIL(reason) do { STATS_FAIL(reason); return (size_t)-1; } while(0)
+
+/* compact streams carry no noise, so nothing has to be scanned for: block b
+ * starts at (b / 4) * 37 + (b % 4) * 9 past the mark (53 and 13 for wide
+ * blocks), its window checksum right after the fourth terminator. `in`
+ * points just past the marks and ends at the trailer. Anything off that
+ * layout is a miss, not yet an error: whitespace or noise may have moved
+ * the blocks, and decode_message() reads the stream again as noisy. */
+#define COMPACT_MISS() return (size_t)-1
+
+ALWAYS_INLINE size_t decode_compact_with(const mosaic_params *P, const int rev_base[256],
+                                         const char *in, size_t in_len,
+                                         uint8_t *out, size_t out_cap, size_t *n_blocks){
   const int BASE = P->base;
   const int B = P->block_bytes;
   const int S = P->block_symbols;
+  const size_t period = (size_t)P->checksum_period;
+  const size_t block_chars = (size_t)S + 1;
+  const size_t window_chars = period * block_chars + 1;
 
-  if(!in) return (size_t)-1;
+  if(in_len < 3) COMPACT_MISS();
+  size_t body = in_len - 3;
+  size_t windows = body / window_chars;
+  size_t tail = body % window_chars;
+  if(tail % block_chars != 0) COMPACT_MISS();
+  size_t blocks = windows * period + tail / block_chars;
+  if(blocks == 0) COMPACT_MISS(); /* the encoder never marks empty payloads */
+
+  const char *tr = in + body;
+  if(tr[0] != P->term_char || tr[1] != P->term_char) COMPACT_MISS();
+  int pad = rev_base[(unsigned char)tr[2]];
+  if(pad < 0 || pad >= B) COMPACT_MISS();
+
+  size_t total = blocks * (size_t)B;
+  *n_blocks = blocks;
+  if(!out) return total;
+  if(out_cap < total) COMPACT_MISS();
+
+  for(size_t b = 0; b < blocks; b++){
+    const char *blk = in + (b / period) * window_chars + (b % period) * block_chars;
+    int rot = rotation_for_block(b);
+    int digits[12];
+    int bad = 0;
+    for(int k = 0; k < S; k++){
+      /* rotated[j] == alphabet[(j + rot) % BASE], so invert without a table */
+      int v = rev_base[(unsigned char)blk[k]];
+      bad |= v;
+      digits[k] = (v - rot + BASE) % BASE;
+    }
+    if(bad < 0) COMPACT_MISS();
+    if(blk[S] != P->term_char) COMPACT_MISS();
+    base47_to_block(digits, B, BASE, out + b * (size_t)B);
+
+    if(b % period == period - 1){
+      int got = rev_base[(unsigned char)blk[S + 1]];
+      int expect = checksum47(out + (b + 1 - period) * (size_t)B, period * (size_t)B);
+      if(got != expect) COMPACT_MISS();
+    }
+  }
+
+  return total - (size_t)pad;
+}
+
+static size_t decode_compact(const mosaic_params *P, const int rev_base[256], const char *in,
+                             size_t in_len, uint8_t *out, size_t out_cap, size_t *n_blocks){
+  if(P == &MOSAIC_PARAMS_WIDE){
+    return decode_compact_with(&MOSAIC_PARAMS_WIDE, rev_base, in, in_len, out, out_cap, n_blocks);
+  }
+  return decode_compact_with(&MOSAIC_PARAMS, rev_base, in, in_len, out, out_cap, n_blocks);
+}
+
+static int is_noise(char c){
+  return c >= 'a' && c <= 'z'; /* NOISE_SET */
+}
+
+ALWAYS_INLINE size_t decode_noisy_with(const mosaic_params *P, const int rev_base[256],
+                                       const char *in, size_t in_len,
+                                       uint8_t *out, size_t out_cap, size_t *n_blocks,
+                                       size_t *n_noise){
+  const int BASE = P->base;
+  const int B = P->block_bytes;
+  const int S = P->block_symbols;
+  const mosaic_kernels *K = mosaic_kernels_get();
 
   size_t o = 0;
   size_t block_index = 0;
   size_t i = 0;
-  int rev_rot[256];
-  int rev_base[256];
-  build_rev(rev_base, P->alphabet, BASE);
-  uint8_t cs_buf[4 * 5];
+  size_t clean_end = 0; /* in[i..clean_end) holds no noise or whitespace */
+  uint8_t cs_buf[4 * 8];
   size_t cs_count = 0;
 
   while(i < in_len){
@@ -199,102 +425,685 @@ size_t mosaic_decode(const char *in, size_t in_len, uint8_t *out, size_t out_cap
     /* trailer detection */
     if(in_len - i >= 3 && in[i] == P->term_char && in[i + 1] == P->term_char){
       int pad_digit = rev_base[(unsigned char)in[i + 2]];
-      if(pad_digit < 0 || pad_digit >= BASE) return (size_t)-1;
+      if(pad_digit < 0 || pad_digit >= B) DECODE_FAIL(MOSAIC_FAIL_TRAILER);
       size_t pad_count = (size_t)pad_digit;
       if(out){
-        if(o < pad_count) return (size_t)-1;
+        if(o < pad_count) DECODE_FAIL(MOSAIC_FAIL_TRAILER);
         o -= pad_count;
       }
       i += 3;
-      if(i != in_len) return (size_t)-1;
+      while(i < in_len && isspace((unsigned char)in[i])) i++;
+      if(i != in_len) DECODE_FAIL(MOSAIC_FAIL_TRAILER);
+      *n_blocks = block_index;
       return o;
     }
 
-    /* prepare rotated alphabet for this block */
-    char rotated[48];
+    /* rotated[j] == alphabet[(j + rot) % BASE], so a symbol's digit is its
+     * base-alphabet index minus rot; no per-block table needed */
     int rot = rotation_for_block(block_index);
-    rotate_alphabet(rotated, P->alphabet, BASE, rot);
-    build_rev(rev_rot, rotated, BASE);
+    int digits[12];
 
-    /* read S symbols, skipping noise characters */
-    int digits[8];
-    for(int k = 0; k < S; k++){
-      while(i < in_len && strchr(NOISE_SET, in[i])) i++;
-      if(i >= in_len) return (size_t)-1;
-      unsigned char c = (unsigned char)in[i++];
-      if(c == (unsigned char)P->term_char) return (size_t)-1;
-      int v = rev_rot[c];
-      if(v < 0) return (size_t)-1;
-      digits[k] = v;
+    if(clean_end <= i) clean_end = i + K->span_clean(in + i, in_len - i);
+    if(clean_end - i > (size_t)S){
+      /* common case: S symbols and the terminator with no noise between */
+      for(int k = 0; k < S; k++){
+        int v = rev_base[(unsigned char)in[i + k]];
+        if(v < 0){
+          if(in[i + k] == P->term_char) DECODE_FAIL(MOSAIC_FAIL_TERMINATOR);
+          DECODE_FAIL(MOSAIC_FAIL_SYMBOL);
+        }
+        digits[k] = v >= rot ? v - rot : v - rot + BASE;
+      }
+      i += (size_t)S;
+    } else {
+      /* read S symbols, skipping noise characters */
+      for(int k = 0; k < S; k++){
+        while(i < in_len && is_noise(in[i])){ i++; (*n_noise)++; }
+        if(i >= in_len) DECODE_FAIL(MOSAIC_FAIL_TRAILER);
+        unsigned char c = (unsigned char)in[i++];
+        if(c == (unsigned char)P->term_char) DECODE_FAIL(MOSAIC_FAIL_TERMINATOR);
+        int v = rev_base[c];
+        if(v < 0) DECODE_FAIL(MOSAIC_FAIL_SYMBOL);
+        digits[k] = v >= rot ? v - rot : v - rot + BASE;
+      }
     }
 
     /* skip noise then expect terminator */
-    while(i < in_len && strchr(NOISE_SET, in[i])) i++;
-    if(i >= in_len || in[i] != P->term_char) return (size_t)-1;
+    while(i < in_len && is_noise(in[i])){ i++; (*n_noise)++; }
+    if(i >= in_len || in[i] != P->term_char) DECODE_FAIL(MOSAIC_FAIL_TERMINATOR);
     i++; /* consume terminator */
 
-    uint8_t block5[5];
-    base47_to_u40(digits, BASE, block5);
+    uint8_t *block5 = cs_buf + cs_count * B;
+    base47_to_block(digits, B, BASE, block5);
 
     if(!out){
-      o += 5;
+      o += (size_t)B;
     } else {
-      if(out_cap - o < 5) return (size_t)-1;
-      memcpy(out + o, block5, 5);
-      o += 5;
+      if(out_cap - o < (size_t)B) DECODE_FAIL(MOSAIC_FAIL_CAPACITY);
+      memcpy(out + o, block5, (size_t)B);
+      o += (size_t)B;
     }
 
-    memcpy(cs_buf + cs_count * 5, block5, 5);
     cs_count++;
     block_index++;
 
     if(cs_count == (size_t)P->checksum_period){
-      while(i < in_len && strchr(NOISE_SET, in[i])) i++;
-      if(i >= in_len) return (size_t)-1;
+      while(i < in_len && is_noise(in[i])){ i++; (*n_noise)++; }
+      if(i >= in_len) DECODE_FAIL(MOSAIC_FAIL_TRAILER);
       unsigned char chk = (unsigned char)in[i++];
       int got = rev_base[chk];
-      if(got < 0) return (size_t)-1;
-      int expect = checksum47(cs_buf, cs_count);
-      if(got != expect) return (size_t)-1;
+      if(got < 0) DECODE_FAIL(MOSAIC_FAIL_SYMBOL);
+      int expect = checksum47(cs_buf, cs_count * B);
+      if(got != expect) DECODE_FAIL(MOSAIC_FAIL_CHECKSUM);
       cs_count = 0;
     }
   }
 
-  return (size_t)-1;
+  DECODE_FAIL(MOSAIC_FAIL_TRAILER);
+}
+
+static size_t decode_noisy(const mosaic_params *P, const int rev_base[256], const char *in,
+                           size_t in_len, uint8_t *out, size_t out_cap, size_t *n_blocks,
+                           size_t *n_noise){
+  if(P == &MOSAIC_PARAMS_WIDE){
+    return decode_noisy_with(&MOSAIC_PARAMS_WIDE, rev_base, in, in_len, out, out_cap, n_blocks,
+                             n_noise);
+  }
+  return decode_noisy_with(&MOSAIC_PARAMS, rev_base, in, in_len, out, out_cap, n_blocks, n_noise);
+}
+
+/* skips the marks and the whitespace around them, as the stream decoder
+ * does; returns where the blocks start */
+static size_t read_marks(const char *in, size_t in_len, unsigned *opts){
+  static const struct { char mark; unsigned opt; } marks[] = {
+    { COMPRESS_MARK, MOSAIC_OPT_COMPRESS }, { WIDE_MARK, MOSAIC_OPT_WIDE },
+    { COMPACT_MARK, MOSAIC_OPT_COMPACT }
+  };
+  size_t lead = 0;
+  *opts = 0;
+  for(size_t m = 0; m < sizeof marks / sizeof marks[0]; m++){
+    while(lead < in_len && isspace((unsigned char)in[lead])) lead++;
+    if(lead < in_len && in[lead] == marks[m].mark){ *opts |= marks[m].opt; lead++; }
+  }
+  while(lead < in_len && isspace((unsigned char)in[lead])) lead++;
+  return lead;
+}
+
+unsigned mosaic_stream_opts(const char *in, size_t in_len){
+  unsigned opts = 0;
+  if(in) read_marks(in, in_len, &opts);
+  return opts;
+}
+
+/* one whole ciphertext, marks included; the MOSAIC_OPT_* bits go to *opts */
+static size_t decode_message(const int rev_base[256], const char *in, size_t in_len,
+                             uint8_t *out, size_t out_cap, unsigned *opts, size_t *blocks,
+                             size_t *noise){
+  /* the marks must come first */
+  size_t lead = read_marks(in, in_len, opts);
+  if(*opts & MOSAIC_OPT_COMPACT){
+    size_t end = in_len;
+    while(end > lead && isspace((unsigned char)in[end - 1])) end--;
+    size_t r = decode_compact(params_for(*opts), rev_base, in + lead, end - lead, out, out_cap,
+                              blocks);
+    if(r != (size_t)-1) return r;
+    /* a compact stream is a noisy one that holds no noise: whitespace
+     * between blocks, or noise, only cost it the fixed layout */
+  }
+  return decode_noisy(params_for(*opts), rev_base, in + lead, in_len - lead, out, out_cap, blocks,
+                      noise);
+}
+
+size_t mosaic_decode(const char *in, size_t in_len, uint8_t *out, size_t out_cap){
+  if(!in) return (size_t)-1;
+
+  uint64_t t0 = STATS_NOW();
+  size_t blocks = 0, noise = 0;
+  unsigned opts;
+  int rev_base[256];
+  build_rev(rev_base, MOSAIC_ALPHABET, MOSAIC_PARAMS.base); /* both presets share it */
+
+  size_t r = decode_message(rev_base, in, in_len, out, out_cap, &opts, &blocks, &noise);
+
+  /* sizing passes (out == NULL) only count when they fail */
+  if(out && r != (size_t)-1){
+    STATS_NOISE(0, noise);
+    STATS_RECORD(MOSAIC_OP_DECODE, t0, in_len, r, blocks);
+  }
+  return r;
+}
+
+/* ---------------- Recovering decode ---------------- */
+
+enum { WINDOW_OK, WINDOW_TAIL, WINDOW_BAD };
+
+static int is_filler(char c){
+  return isspace((unsigned char)c) || is_noise(c);
+}
+
+static size_t skip_filler(const char *in, size_t in_len, size_t i){
+  while(i < in_len && is_filler(in[i])) i++;
+  return i;
+}
+
+/* "~~" + pad digit with nothing but whitespace after it */
+static int at_trailer(const mosaic_params *P, const char *in, size_t in_len, size_t i){
+  if(in_len - i < 3 || in[i] != P->term_char || in[i + 1] != P->term_char) return 0;
+  for(size_t j = i + 3; j < in_len; j++){
+    if(!isspace((unsigned char)in[j])) return 0;
+  }
+  return 1;
+}
+
+/* decode one checksum window (or the short tail before the trailer) starting
+ * at *pos. WINDOW_OK / WINDOW_TAIL fill `win` with *n_blocks blocks and move
+ * *pos past them; WINDOW_BAD leaves *pos alone. */
+static int parse_window(const mosaic_params *P, const char *in, size_t in_len, size_t *pos,
+                        size_t window, const int rev_base[256], uint8_t *win, int *n_blocks,
+                        int *pad){
+  const int BASE = P->base;
+  const int B = P->block_bytes;
+  const int S = P->block_symbols;
+  const int period = P->checksum_period;
+  size_t i = *pos;
+
+  for(int k = 0; k < period; k++){
+    i = skip_filler(in, in_len, i);
+    if(i < in_len && at_trailer(P, in, in_len, i)){
+      int p = rev_base[(unsigned char)in[i + 2]];
+      if(p < 0 || p >= B) return WINDOW_BAD;
+      *n_blocks = k;
+      *pad = p;
+      *pos = in_len;
+      return WINDOW_TAIL;
+    }
+
+    int rot = rotation_for_block(window * (size_t)period + (size_t)k);
+    int digits[12];
+    for(int d = 0; d < S; d++){
+      i = skip_filler(in, in_len, i);
+      if(i >= in_len) return WINDOW_BAD;
+      int v = rev_base[(unsigned char)in[i++]]; /* -1 for '~' too */
+      if(v < 0) return WINDOW_BAD;
+      digits[d] = (v - rot + BASE) % BASE;
+    }
+    i = skip_filler(in, in_len, i);
+    if(i >= in_len || in[i] != P->term_char) return WINDOW_BAD;
+    i++;
+    /* a wrong rotation almost always lands outside 40 bits (less often
+     * outside 64, which leaves the checksum to catch it) */
+    if(base47_to_block(digits, B, BASE, win + k * B)) return WINDOW_BAD;
+  }
+
+  i = skip_filler(in, in_len, i);
+  if(i >= in_len) return WINDOW_BAD;
+  int got = rev_base[(unsigned char)in[i++]];
+  if(got != checksum47(win, (size_t)period * (size_t)B)) return WINDOW_BAD;
+  *n_blocks = period;
+  *pos = i;
+  return WINDOW_OK;
+}
+
+/* record a zero-filled output range, merging with the previous one */
+static void note_damage(mosaic_damage *damage, size_t damage_cap, size_t *count,
+                        size_t offset, size_t len){
+  if(len == 0) return;
+  if(*count > 0 && *count <= damage_cap){
+    mosaic_damage *last = &damage[*count - 1];
+    if(last->offset + last->len == offset){
+      last->len += len;
+      return;
+    }
+  }
+  if(*count < damage_cap){
+    damage[*count].offset = offset;
+    damage[*count].len = len;
+  }
+  (*count)++;
+}
+
+size_t mosaic_decode_recover(const char *in, size_t in_len, uint8_t *out, size_t out_cap,
+                             mosaic_damage *damage, size_t damage_cap, size_t *damage_count){
+  const mosaic_params *P = params_for(mosaic_stream_opts(in, in_len));
+  const size_t B = (size_t)P->block_bytes;
+  const size_t period = (size_t)P->checksum_period;
+  const size_t window_bytes = period * B;
+
+  if(!in) return (size_t)-1;
+  if(!damage) damage_cap = 0;
+
+  /* resync can credit at most one window beyond the terminators it counts */
+  if(!out){
+    size_t terms = 0;
+    for(size_t i = 0; i < in_len; i++) terms += in[i] == P->term_char;
+    return (terms + period) * B;
+  }
+
+  uint64_t t0 = STATS_NOW();
+  int rev_base[256];
+  build_rev(rev_base, P->alphabet, P->base);
+
+  size_t n_damage = 0;
+  size_t pos = 0;
+  size_t w = 0;
+  size_t blocks = 0;
+  size_t pad = 0;
+  uint8_t win[4 * 8];
+
+  for(;;){
+    int n = 0, p = 0;
+    int r = parse_window(P, in, in_len, &pos, w, rev_base, win, &n, &p);
+    if(r != WINDOW_BAD){
+      size_t bytes = (size_t)n * B;
+      if(out_cap - blocks * B < bytes) return (size_t)-1;
+      memcpy(out + blocks * B, win, bytes);
+      blocks += (size_t)n;
+      if(r == WINDOW_TAIL){
+        pad = (size_t)p;
+        break;
+      }
+      w++;
+      continue;
+    }
+
+    /* Window w is damaged. Walk the terminators after it: every fourth one
+     * should be followed by a checksum and the start of a window whose index
+     * (and so rotation) follows from the count. Trying the neighbouring
+     * count as well covers a terminator that was lost or invented. */
+    size_t c = 0;
+    size_t next_w = 0, next_pos = 0;
+    int found = 0;
+    for(size_t t = pos; t < in_len && !found; t++){
+      if(in[t] != P->term_char) continue;
+      if(at_trailer(P, in, in_len, t)){
+        int tp = rev_base[(unsigned char)in[t + 2]];
+        pad = (tp >= 0 && (size_t)tp < B) ? (size_t)tp : 0;
+        break;
+      }
+      c++;
+      size_t j = skip_filler(in, in_len, t + 1);
+      if(j >= in_len || in[j] == P->term_char) continue;
+      size_t cand = j + 1;
+      size_t guesses[2] = { w + c / period, w + (c + period - 1) / period };
+      for(int g = 0; g < 2 && !found; g++){
+        if(guesses[g] <= w || (g == 1 && guesses[1] == guesses[0])) continue;
+        size_t q = cand;
+        int tn, tpad;
+        if(parse_window(P, in, in_len, &q, guesses[g], rev_base, win, &tn, &tpad) != WINDOW_BAD){
+          next_w = guesses[g];
+          next_pos = cand;
+          found = 1;
+        }
+      }
+    }
+
+    size_t lost = found ? (next_w - w) * period : c;
+    if(out_cap - blocks * B < lost * B) return (size_t)-1;
+    memset(out + blocks * B, 0, lost * B);
+    note_damage(damage, damage_cap, &n_damage, w * window_bytes, lost * B);
+    blocks += lost;
+    if(!found) break; /* ran into the trailer (or the end) while resyncing */
+    w = next_w;
+    pos = next_pos;
+  }
+
+  size_t total = blocks * B;
+  if(pad > total) pad = total;
+  total -= pad;
+
+  /* padding may have trimmed the last damaged range (never a whole one:
+   * ranges are whole blocks and pad is shorter than a block) */
+  if(n_damage > 0 && n_damage <= damage_cap){
+    mosaic_damage *last = &damage[n_damage - 1];
+    if(last->offset + last->len > total) last->len = total - last->offset;
+  }
+
+  if(damage_count) *damage_count = n_damage;
+  STATS_RECORD(MOSAIC_OP_RECOVER, t0, in_len, total, blocks);
+  return total;
+}
+
+/* ---------------- Streaming ---------------- */
+
+void mosaic_encoder_init(mosaic_encoder *e, unsigned opts){
+  mosaic_encoder_init_seeded(e, opts, noise_seed_auto(e));
+}
+
+void mosaic_encoder_init_seeded(mosaic_encoder *e, unsigned opts, uint64_t seed){
+  memset(e, 0, sizeof *e);
+  e->opts = opts;
+  e->rng = noise_seed(seed);
+}
+
+void mosaic_encoder_init_at(mosaic_encoder *e, unsigned opts, uint64_t seed, uint64_t offset){
+  mosaic_encoder_init_seeded(e, opts, seed);
+  const mosaic_params *P = params_for(opts);
+  e->blocks = (size_t)(offset / (uint64_t)P->block_bytes);
+  e->in_total = offset;
+  e->marked = offset != 0; /* the marks belong to the first part */
+}
+
+uint64_t mosaic_encoder_predict(const mosaic_encoder *e, uint64_t in_len, int final){
+  const mosaic_params *P = params_for(e->opts);
+  const uint64_t B = (uint64_t)P->block_bytes;
+  const uint64_t win = B * (uint64_t)P->checksum_period;
+  uint64_t bytes = e->carry_len + in_len;
+
+  /* update() only ever emits whole windows, final() the rest, so e->blocks
+   * always sits at a window boundary here */
+  uint64_t emitted = final ? bytes : bytes - bytes % win;
+  uint64_t blocks = (emitted + B - 1) / B;
+  uint64_t chars = blocks * (uint64_t)(P->block_symbols + 1) +
+                   blocks / (uint64_t)P->checksum_period;
+  if(blocks && !e->marked){
+    char marks[3];
+    chars += encode_marks(e->opts, marks);
+  }
+  if(!(e->opts & MOSAIC_OPT_COMPACT)){
+    uint64_t rng = e->rng;
+    for(uint64_t b = 0; b < blocks; b++) chars += noise_next(&rng) & 1;
+  }
+  return final ? chars + 3 : chars; /* trailer */
+}
+
+/* bytes per checksum window for opts */
+static size_t window_bytes(unsigned opts){
+  const mosaic_params *P = params_for(opts);
+  return (size_t)P->block_bytes * (size_t)P->checksum_period;
+}
+
+size_t mosaic_encoder_bound(size_t in_len, unsigned opts){
+  /* the carry adds at most one window, the mark and trailer are in there */
+  return encode_capacity(in_len + window_bytes(opts), opts);
+}
+
+/* encode whole windows (or, from final, the short tail) and advance */
+static size_t encoder_emit(mosaic_encoder *e, const uint8_t *in, size_t len, char *out,
+                           const char *alpha2, size_t *noise){
+  const mosaic_params *P = params_for(e->opts);
+  const int B = P->block_bytes;
+  const int compact = (e->opts & MOSAIC_OPT_COMPACT) != 0;
+  size_t o = 0;
+  if(!len) return 0;
+  if(!e->marked){
+    o += encode_marks(e->opts, out);
+    e->marked = 1;
+  }
+  o += encode_blocks(P, in, len, e->blocks, compact, &e->rng, alpha2, out + o, noise);
+  e->blocks += (len + (B - 1)) / B;
+  return o;
+}
+
+size_t mosaic_encoder_update(mosaic_encoder *e, const uint8_t *in, size_t in_len,
+                             char *out, size_t out_cap){
+  const mosaic_params *P = mosaic_get_params();
+  if(!e || (!in && in_len)) return (size_t)-1;
+  if(!out || out_cap < mosaic_encoder_bound(in_len, e->opts)) return (size_t)-1;
+
+  uint64_t t0 = STATS_NOW();
+  const size_t win = window_bytes(e->opts);
+  size_t noise = 0, o = 0, blocks = e->blocks;
+  char alpha2[2 * 47];
+  double_alphabet(alpha2, P->alphabet, P->base);
+  e->in_total += in_len;
+
+  /* top up a carried partial window first */
+  if(e->carry_len){
+    size_t take = win - e->carry_len;
+    if(take > in_len) take = in_len;
+    memcpy(e->carry + e->carry_len, in, take);
+    e->carry_len += take;
+    in += take;
+    in_len -= take;
+    if(e->carry_len < win) return 0;
+    o += encoder_emit(e, e->carry, win, out + o, alpha2, &noise);
+    e->carry_len = 0;
+  }
+
+  size_t whole = in_len - in_len % win;
+  o += encoder_emit(e, in, whole, out + o, alpha2, &noise);
+  memcpy(e->carry, in + whole, in_len - whole);
+  e->carry_len = in_len - whole;
+
+  STATS_NOISE(noise, 0);
+  STATS_RECORD(MOSAIC_OP_ENCODE, t0, in_len, o, e->blocks - blocks);
+  return o;
+}
+
+size_t mosaic_encoder_final(mosaic_encoder *e, char *out, size_t out_cap){
+  if(!e || !out || out_cap < mosaic_encoder_bound(0, e->opts)) return (size_t)-1;
+
+  const mosaic_params *P = params_for(e->opts);
+  size_t noise = 0, o = 0;
+  char alpha2[2 * 47];
+  double_alphabet(alpha2, P->alphabet, P->base);
+  o += encoder_emit(e, e->carry, e->carry_len, out, alpha2, &noise);
+  o += encode_trailer(P, (size_t)e->in_total, out + o);
+  e->carry_len = 0;
+  STATS_NOISE(noise, 0);
+  return o;
+}
+
+/* decoder states: where in "SSSSSSSS~" / checksum / "~~P" the next char lands.
+ * The compact mark changes nothing here: a compact stream is read by the
+ * noisy grammar, whitespace and noise included, as decode_message() reads
+ * one that is off the fixed layout. */
+enum { DS_BLOCK, DS_SYMBOL, DS_TERM, DS_CHECKSUM, DS_TRAILER1, DS_TRAILER2, DS_DONE, DS_FAILED };
+
+#define STREAM_FAIL(reason) do { d->state = DS_FAILED; STATS_FAIL(reason); return (size_t)-1; } while(0)
+
+void mosaic_decoder_init(mosaic_decoder *d){
+  memset(d, 0, sizeof *d);
+  d->state = DS_BLOCK;
+}
+
+static size_t decoder_bound_for(const mosaic_params *P, size_t in_len){
+  /* blocks finished by in_len chars, one already half read, plus the held one */
+  return (in_len / (size_t)(P->block_symbols + 1) + 2) * (size_t)P->block_bytes;
+}
+
+size_t mosaic_decoder_bound(size_t in_len){
+  /* the marks only arrive with the input, so cover both presets */
+  size_t a = decoder_bound_for(&MOSAIC_PARAMS, in_len);
+  size_t b = decoder_bound_for(&MOSAIC_PARAMS_WIDE, in_len);
+  return a > b ? a : b;
+}
+
+size_t mosaic_decoder_update(mosaic_decoder *d, const char *in, size_t in_len,
+                             uint8_t *out, size_t out_cap){
+  if(!d || d->state == DS_FAILED || (!in && in_len)) return (size_t)-1;
+  const mosaic_params *P = params_for(d->opts);
+  const int BASE = P->base;
+  const int period = P->checksum_period;
+  int B = P->block_bytes;
+  int S = P->block_symbols;
+  if(!out || out_cap < mosaic_decoder_bound(in_len)) STREAM_FAIL(MOSAIC_FAIL_CAPACITY);
+
+  uint64_t t0 = STATS_NOW();
+  size_t o = 0, noise = 0, blocks = d->blocks;
+  size_t clean_end = 0; /* in[i..clean_end) holds no noise or whitespace */
+  const mosaic_kernels *K = mosaic_kernels_get();
+  int rev_base[256];
+  build_rev(rev_base, P->alphabet, BASE);
+
+  for(size_t i = 0; i < in_len; i++){
+    char c = in[i];
+    int v = rev_base[(unsigned char)c];
+
+    switch(d->state){
+    case DS_BLOCK:
+      if(isspace((unsigned char)c)) continue;
+      if(c == P->term_char){ d->state = DS_TRAILER1; continue; }
+      /* marks sit before the first block, in a fixed order */
+      if(d->blocks == 0 && c == COMPRESS_MARK && !d->opts){ d->opts |= MOSAIC_OPT_COMPRESS; continue; }
+      if(d->blocks == 0 && c == WIDE_MARK && !(d->opts & (MOSAIC_OPT_WIDE | MOSAIC_OPT_COMPACT))){
+        d->opts |= MOSAIC_OPT_WIDE;
+        P = params_for(d->opts);
+        B = P->block_bytes;
+        S = P->block_symbols;
+        continue;
+      }
+      if(d->blocks == 0 && c == COMPACT_MARK && !(d->opts & MOSAIC_OPT_COMPACT)){
+        d->opts |= MOSAIC_OPT_COMPACT;
+        continue;
+      }
+      d->state = DS_SYMBOL;
+      d->k = 0;
+      /* fall through */
+    case DS_SYMBOL:
+      if(d->k == 0){
+        /* common case, as in decode_noisy_with(): a whole block of symbols
+         * with no noise between them, read in one go */
+        if(clean_end <= i) clean_end = i + K->span_clean(in + i, in_len - i);
+        if(clean_end - i >= (size_t)S){
+          int rot = rotation_for_block(d->blocks);
+          for(int k = 0; k < S; k++){
+            int u = rev_base[(unsigned char)in[i + k]];
+            if(u < 0){
+              if(in[i + k] == P->term_char) STREAM_FAIL(MOSAIC_FAIL_TERMINATOR);
+              STREAM_FAIL(MOSAIC_FAIL_SYMBOL);
+            }
+            d->digits[k] = u >= rot ? u - rot : u - rot + BASE;
+          }
+          d->k = S;
+          d->state = DS_TERM;
+          i += (size_t)S - 1;
+          continue;
+        }
+      }
+      if(is_noise(c)){ noise++; continue; }
+      if(c == P->term_char) STREAM_FAIL(MOSAIC_FAIL_TERMINATOR);
+      if(v < 0) STREAM_FAIL(MOSAIC_FAIL_SYMBOL);
+      {
+        int rot = rotation_for_block(d->blocks);
+        d->digits[d->k++] = v >= rot ? v - rot : v - rot + BASE;
+      }
+      if(d->k == S) d->state = DS_TERM;
+      continue;
+    case DS_TERM: {
+      if(is_noise(c)){ noise++; continue; }
+      if(c != P->term_char) STREAM_FAIL(MOSAIC_FAIL_TERMINATOR);
+      size_t slot = d->blocks % (size_t)period;
+      uint8_t *blk = d->window + slot * (size_t)B;
+      base47_to_block(d->digits, B, BASE, blk);
+      if(d->have_held){
+        memcpy(out + o, d->held, (size_t)B);
+        o += (size_t)B;
+      }
+      memcpy(d->held, blk, (size_t)B);
+      d->have_held = 1;
+      d->blocks++;
+      d->state = slot == (size_t)period - 1 ? DS_CHECKSUM : DS_BLOCK;
+      continue;
+    }
+    case DS_CHECKSUM:
+      if(is_noise(c)){ noise++; continue; }
+      if(v < 0) STREAM_FAIL(MOSAIC_FAIL_SYMBOL);
+      if(v != checksum47(d->window, (size_t)period * (size_t)B)) STREAM_FAIL(MOSAIC_FAIL_CHECKSUM);
+      d->state = DS_BLOCK;
+      continue;
+    case DS_TRAILER1:
+      if(c != P->term_char) STREAM_FAIL(MOSAIC_FAIL_TERMINATOR);
+      d->state = DS_TRAILER2;
+      continue;
+    case DS_TRAILER2:
+      if(v < 0 || v >= B || (v > 0 && !d->have_held)) STREAM_FAIL(MOSAIC_FAIL_TRAILER);
+      if(d->have_held){
+        memcpy(out + o, d->held, (size_t)(B - v));
+        o += (size_t)(B - v);
+        d->have_held = 0;
+      }
+      d->state = DS_DONE;
+      continue;
+    default: /* DS_DONE: nothing but whitespace may follow the trailer */
+      if(isspace((unsigned char)c)) continue;
+      STREAM_FAIL(MOSAIC_FAIL_TRAILER);
+    }
+  }
+
+  STATS_NOISE(0, noise);
+  STATS_RECORD(MOSAIC_OP_DECODE, t0, in_len, o, d->blocks - blocks);
+  return o;
+}
+
+int mosaic_decoder_final(mosaic_decoder *d){
+  if(!d || d->state != DS_DONE){
+    if(d && d->state != DS_FAILED) STATS_FAIL(MOSAIC_FAIL_TRAILER);
+    return -1;
+  }
+  return 0;
+}
+
+void mosaic_decoder_init_at(mosaic_decoder *d, unsigned opts, uint64_t offset){
+  mosaic_decoder_init(d);
+  d->opts = opts;
+  d->blocks = (size_t)(offset / (uint64_t)params_for(opts)->block_bytes);
+}
+
+size_t mosaic_decoder_flush(mosaic_decoder *d, uint8_t *out, size_t out_cap){
+  if(!d || !out) return (size_t)-1;
+  const mosaic_params *P = params_for(d->opts);
+  const size_t B = (size_t)P->block_bytes;
+  /* after a checksum, and after at least one window of this part */
+  if(d->state != DS_BLOCK || d->blocks % (size_t)P->checksum_period != 0 || !d->have_held ||
+     out_cap < B){
+    return (size_t)-1;
+  }
+  memcpy(out, d->held, B);
+  d->have_held = 0;
+  return B;
 }
 
 /* ---------------- CLI-friendly wrappers ---------------- */
 
 char* mosaic_encrypt(const char *plaintext, const char *key){
+  return mosaic_encrypt_ex(plaintext, key, 0u, NULL);
+}
+
+char* mosaic_encrypt_ex(const char *plaintext, const char *key, unsigned opts, mosaic_arena *arena){
   if(!plaintext || !key) return NULL;
 
   size_t in_len = strlen(plaintext);
+  uint8_t *buf;
 
-  // copy input into buffer we can mutate
-  uint8_t *buf = malloc(in_len + 1);
-  if(!buf) return NULL;
-  memcpy(buf, plaintext, in_len);
-  buf[in_len] = '\0';
+  if(opts & MOSAIC_OPT_COMPRESS){
+    // compress into the buffer the XOR works on
+    size_t zcap = mosaic_lz_bound(in_len);
+    buf = mosaic_alloc(arena, zcap + 1);
+    if(!buf) return NULL;
+    in_len = mosaic_lz_compress((const uint8_t*)plaintext, in_len, buf, zcap);
+    if(in_len == (size_t)-1){ mosaic_release(arena, buf); return NULL; }
+  } else {
+    // copy input into buffer we can mutate
+    buf = mosaic_alloc(arena, in_len + 1);
+    if(!buf) return NULL;
+    memcpy(buf, plaintext, in_len);
+    buf[in_len] = '\0';
+  }
 
   // XOR with key
   xor_with_key(buf, in_len, key);
 
   // encode XORed buffer
-  size_t cap = mosaic_encode(buf, in_len, NULL, 0);
-  if(cap == (size_t)-1){ free(buf); return NULL; }
+  size_t cap = mosaic_encode_ex(buf, in_len, NULL, 0, opts);
+  if(cap == (size_t)-1){ mosaic_release(arena, buf); return NULL; }
 
-  char *out = malloc(cap + 1);
-  if(!out){ free(buf); return NULL; }
+  char *out = mosaic_alloc(arena, cap + 1);
+  if(!out){ mosaic_release(arena, buf); return NULL; }
 
-  size_t wrote = mosaic_encode(buf, in_len, out, cap);
-  free(buf);
-  if(wrote == (size_t)-1){ free(out); return NULL; }
+  size_t wrote = mosaic_encode_ex(buf, in_len, out, cap, opts);
+  mosaic_release(arena, buf);
+  if(wrote == (size_t)-1){ mosaic_release(arena, out); return NULL; }
 
   out[wrote] = '\0';
   return out;
 }
 
 char* mosaic_decrypt(const char *ciphertext, const char *key){
+  return mosaic_decrypt_ex(ciphertext, key, NULL);
+}
+
+char* mosaic_decrypt_ex(const char *ciphertext, const char *key, mosaic_arena *arena){
   if(!ciphertext || !key) return NULL;
 
   size_t in_len = strlen(ciphertext);
@@ -303,15 +1112,296 @@ char* mosaic_decrypt(const char *ciphertext, const char *key){
   size_t cap = mosaic_decode(ciphertext, in_len, NULL, 0);
   if (cap == (size_t)-1) return NULL;
 
-  uint8_t *buf = malloc(cap + 1);
+  uint8_t *buf = mosaic_alloc(arena, cap + 1);
   if(!buf) return NULL;
 
   size_t wrote = mosaic_decode(ciphertext, in_len, buf, cap);
-  if(wrote == (size_t)-1){ free(buf); return NULL; };
+  if(wrote == (size_t)-1){ mosaic_release(arena, buf); return NULL; };
   buf[wrote] = '\0';
 
   // XOR with key to get back the plaintext
   xor_with_key(buf, wrote, key);
+  if(!(mosaic_stream_opts(ciphertext, in_len) & MOSAIC_OPT_COMPRESS)) return (char*)buf; // already null terminated
+
+  // compressed payload: the frames expand into a second buffer
+  size_t raw = mosaic_lz_decompressed_len(buf, wrote);
+  uint8_t *plain = raw == (size_t)-1 ? NULL : mosaic_alloc(arena, raw + 1);
+  if(plain && mosaic_lz_decompress(buf, wrote, plain, raw) == raw){
+    plain[raw] = '\0';
+  } else {
+    mosaic_release(arena, plain);
+    plain = NULL;
+  }
+  mosaic_release(arena, buf);
+  return (char*)plain;
+}
+
+/* ---------------- Batches ---------------- */
+
+/* output a thread should have to itself before another one pays off */
+#define BATCH_MIN_RUN (64u * 1024u)
+/* keyed messages are XORed through a stack buffer this big; a whole number
+ * of windows for both presets */
+#define BATCH_PIECE 4000
+
+/* set up once and read by every run of a batch */
+typedef struct {
+  const mosaic_msg *msgs;
+  unsigned opts;
+  uint64_t seed;
+  const unsigned char *key;
+  size_t klen;                /* 0: no key */
+  size_t period;              /* stretched key period, 0 when too long to stretch */
+  unsigned char ekey[MOSAIC_EKEY_SIZE];
+  char alpha2[2 * 47];
+  int rev_base[256];
+  int *status;
+} batch_shared;
+
+/* messages [first, last), written one after another from out + start */
+typedef struct batch_run {
+  const batch_shared *sh;
+  size_t first, last;
+  void *out;
+  size_t start, end;          /* end: where this run's output stops */
+  size_t limit;               /* and where its share of out_cap stops */
+  size_t *offsets;
+  int failed;
+  pthread_t thread;
+} batch_run;
+
+/* data is `offset` bytes into its message */
+static void batch_xor(const batch_shared *sh, uint8_t *data, size_t len, size_t offset){
+  if(!sh->klen) return;
+  if(sh->period && len >= MOSAIC_XOR_WIDE){
+    mosaic_kernels_get()->xor_stream(data, len, sh->ekey, sh->period, offset % sh->period);
+    return;
+  }
+  size_t phase = offset % sh->klen;
+  for(size_t i = 0; i < len; i++){
+    data[i] = (uint8_t)(data[i] ^ sh->key[phase]);
+    if(++phase == sh->klen) phase = 0;
+  }
+}
+
+static size_t batch_encode_one(const batch_shared *sh, const uint8_t *in, size_t len,
+                               uint64_t *rng, char *out, size_t *noise){
+  const mosaic_params *P = params_for(sh->opts);
+  if(!sh->klen) return encode_message(P, sh->alpha2, in, len, sh->opts, rng, out, noise);
+
+  /* XOR a piece at a time into the stack, each piece a run of whole windows */
+  uint8_t buf[BATCH_PIECE];
+  size_t o = len ? encode_marks(sh->opts, out) : 0;
+  for(size_t done = 0; done < len;){
+    size_t n = len - done < sizeof buf ? len - done : sizeof buf;
+    memcpy(buf, in + done, n);
+    batch_xor(sh, buf, n, done);
+    o += encode_blocks(P, buf, n, done / (size_t)P->block_bytes,
+                       (sh->opts & MOSAIC_OPT_COMPACT) != 0, rng, sh->alpha2, out + o, noise);
+    done += n;
+  }
+  return o + encode_trailer(P, len, out + o);
+}
+
+static void *batch_encode_run(void *arg){
+  batch_run *r = arg;
+  const batch_shared *sh = r->sh;
+  const size_t B = (size_t)params_for(sh->opts)->block_bytes;
+  char *out = r->out;
+  uint64_t t0 = STATS_NOW();
+  size_t o = r->start, in_total = 0, blocks = 0, noise = 0;
+
+  for(size_t i = r->first; i < r->last; i++){
+    const mosaic_msg *m = &sh->msgs[i];
+    uint64_t rng = noise_seed(sh->seed + i);
+    r->offsets[i] = o;
+    o += batch_encode_one(sh, m->data, m->len, &rng, out + o, &noise);
+    in_total += m->len;
+    blocks += (m->len + B - 1) / B;
+  }
+  r->end = o;
+
+  STATS_NOISE(noise, 0);
+  STATS_RECORD(MOSAIC_OP_ENCODE, t0, in_total, o - r->start, blocks);
+  return NULL;
+}
+
+static void *batch_decode_run(void *arg){
+  batch_run *r = arg;
+  const batch_shared *sh = r->sh;
+  uint8_t *out = r->out;
+  uint64_t t0 = STATS_NOW();
+  size_t o = r->start, in_total = 0, blocks = 0, noise = 0;
+
+  for(size_t i = r->first; i < r->last; i++){
+    const mosaic_msg *m = &sh->msgs[i];
+    unsigned opts;
+    r->offsets[i] = o;
+    size_t got = decode_message(sh->rev_base, m->data, m->len, out + o, r->limit - o, &opts,
+                                &blocks, &noise);
+    /* compressed payloads would need the frames undone after the XOR */
+    if(got == (size_t)-1 || (opts & MOSAIC_OPT_COMPRESS)){
+      if(!sh->status){
+        r->failed = 1;
+        return NULL;
+      }
+      sh->status[i] = -1;
+      continue;
+    }
+    if(sh->status) sh->status[i] = 0;
+    batch_xor(sh, out + o, got, 0);
+    o += got;
+    in_total += m->len;
+  }
+  r->end = o;
+
+  STATS_NOISE(0, noise);
+  STATS_RECORD(MOSAIC_OP_DECODE, t0, in_total, o - r->start, blocks);
+  return NULL;
+}
+
+/* splits the batch into runs of about equal output, runs them and packs
+ * their output together; returns the bytes written */
+static size_t batch_run_all(batch_shared *sh, size_t n, const size_t *caps, size_t total,
+                            void *out, size_t *offsets, int threads, void *(*fn)(void *)){
+  batch_run runs[64];
+  size_t max_runs = total / BATCH_MIN_RUN + 1;
+  size_t n_runs = threads > 1 ? (size_t)threads : 1;
+  if(n_runs > sizeof runs / sizeof runs[0]) n_runs = sizeof runs / sizeof runs[0];
+  if(n_runs > max_runs) n_runs = max_runs;
+  if(n_runs > n) n_runs = n ? n : 1;
+
+  size_t i = 0, at = 0;
+  for(size_t k = 0; k < n_runs; k++){
+    batch_run *r = &runs[k];
+    size_t goal = k + 1 == n_runs ? total : total / n_runs * (k + 1);
+    r->sh = sh;
+    r->first = i;
+    r->start = at;
+    while(i < n && (at < goal || k + 1 == n_runs)) at += caps[i++];
+    r->last = i;
+    r->limit = at;
+    r->end = at;
+    r->out = out;
+    r->offsets = offsets;
+    r->failed = 0;
+  }
+
+  /* the calling thread takes the first run; a thread that will not start
+   * leaves its run for the calling thread too */
+  int started[64] = {0};
+  for(size_t k = 1; k < n_runs; k++){
+    started[k] = pthread_create(&runs[k].thread, NULL, fn, &runs[k]) == 0;
+  }
+  fn(&runs[0]);
+  for(size_t k = 1; k < n_runs; k++){
+    if(started[k]) pthread_join(runs[k].thread, NULL);
+    else fn(&runs[k]);
+  }
+
+  size_t pos = 0;
+  for(size_t k = 0; k < n_runs; k++){
+    batch_run *r = &runs[k];
+    if(r->failed) return (size_t)-1;
+    size_t shift = r->start - pos;
+    if(shift){
+      memmove((char*)out + pos, (char*)out + r->start, r->end - r->start);
+      for(size_t j = r->first; j < r->last; j++) offsets[j] -= shift;
+    }
+    pos += r->end - r->start;
+  }
+  offsets[n] = pos;
+  return pos;
+}
+
+static void batch_setup(batch_shared *sh, const mosaic_msg *msgs, const char *key){
+  sh->msgs = msgs;
+  sh->key = (const unsigned char*)key;
+  sh->klen = key ? strlen(key) : 0;
+  sh->period = 0;
+  if(sh->klen && sh->klen <= MOSAIC_XOR_MAX_KEY){
+    sh->period = mosaic_stretch_key(sh->ekey, sh->key, sh->klen);
+  }
+  sh->status = NULL;
+}
+
+static void batch_wipe(batch_shared *sh){
+  /* the stretched key is key material too */
+  volatile unsigned char *vp = sh->ekey;
+  for(size_t i = 0; i < sizeof sh->ekey; i++) vp[i] = 0;
+}
+
+/* per-message capacities for out == NULL and for splitting the batch; the
+ * caller frees the array. (size_t)-1 in *total for a bad message list. */
+static size_t *batch_caps(const mosaic_msg *msgs, size_t n, int decoding, unsigned opts,
+                          size_t *total){
+  size_t *caps = malloc((n ? n : 1) * sizeof *caps);
+  *total = (size_t)-1;
+  if(!caps) return NULL;
+  size_t sum = 0;
+  for(size_t i = 0; i < n; i++){
+    if(!msgs[i].data && msgs[i].len){ free(caps); return NULL; }
+    if(decoding){
+      unsigned m;
+      read_marks(msgs[i].data, msgs[i].len, &m);
+      caps[i] = decoder_bound_for(params_for(m), msgs[i].len);
+    } else {
+      caps[i] = encode_capacity(msgs[i].len, opts);
+    }
+    if(caps[i] > SIZE_MAX - sum){ free(caps); return NULL; }
+    sum += caps[i];
+  }
+  *total = sum;
+  return caps;
+}
+
+size_t mosaic_encode_batch(const mosaic_msg *msgs, size_t n, char *out, size_t out_cap,
+                           size_t *offsets, const char *key, unsigned opts, uint64_t seed,
+                           int threads){
+  if((!msgs && n) || (opts & ~(MOSAIC_OPT_COMPACT | MOSAIC_OPT_WIDE))) return (size_t)-1;
+  if(out && !offsets) return (size_t)-1;
+
+  size_t total;
+  size_t *caps = batch_caps(msgs, n, 0, opts, &total);
+  if(!caps) return (size_t)-1;
+  if(!out || out_cap < total){
+    free(caps);
+    return out ? (size_t)-1 : total;
+  }
+
+  batch_shared sh;
+  batch_setup(&sh, msgs, key);
+  sh.opts = opts;
+  sh.seed = seed;
+  const mosaic_params *P = params_for(opts);
+  double_alphabet(sh.alpha2, P->alphabet, P->base);
+
+  size_t r = batch_run_all(&sh, n, caps, total, out, offsets, threads, batch_encode_run);
+  batch_wipe(&sh);
+  free(caps);
+  return r;
+}
+
+size_t mosaic_decode_batch(const mosaic_msg *msgs, size_t n, uint8_t *out, size_t out_cap,
+                           size_t *offsets, int *status, const char *key, int threads){
+  if(!msgs && n) return (size_t)-1;
+  if(out && !offsets) return (size_t)-1;
+
+  size_t total;
+  size_t *caps = batch_caps(msgs, n, 1, 0u, &total);
+  if(!caps) return (size_t)-1;
+  if(!out || out_cap < total){
+    free(caps);
+    return out ? (size_t)-1 : total;
+  }
+
+  batch_shared sh;
+  batch_setup(&sh, msgs, key);
+  sh.status = status;
+  build_rev(sh.rev_base, MOSAIC_ALPHABET, MOSAIC_PARAMS.base);
 
-  return (char*)buf; // already null terminated
+  size_t r = batch_run_all(&sh, n, caps, total, out, offsets, threads, batch_decode_run);
+  batch_wipe(&sh);
+  free(caps);
+  return r;
 }
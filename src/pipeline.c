@@ -0,0 +1,808 @@
+#define _GNU_SOURCE /* syscall(), posix_memalign() */
+
+#include "pipeline.h"
+#include "mosaic.h"
+#include "xor_key.h"
+#include "lz.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__linux__) && defined(__has_include) && !defined(MOSAIC_NO_URING)
+#if __has_include(<linux/io_uring.h>)
+#define MOSAIC_HAVE_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+#endif
+
+const char *mosaic_pipe_engine_name(mosaic_pipe_engine engine){
+  switch(engine){
+  case MOSAIC_ENGINE_URING:   return "io_uring";
+  case MOSAIC_ENGINE_THREADS: return "threads";
+  case MOSAIC_ENGINE_INLINE:  return "inline";
+  default:                    return "auto";
+  }
+}
+
+static void wipe(void *p, size_t n){
+  volatile unsigned char *v = (volatile unsigned char *)p;
+  while(n--) *v++ = 0;
+}
+
+/* ---------------- Codec step (shared by both engines) ---------------- */
+
+/* Chunks reach the codec strictly in order, so the encoder's block index and
+ * the XOR key phase simply carry over from one chunk to the next. With
+ * MOSAIC_OPT_COMPRESS every chunk is compressed into its own frames before
+ * the XOR; on the way back frames may straddle chunks, so decoded bytes are
+ * gathered in z until a frame is whole. */
+typedef struct {
+  mosaic_pipe_mode mode;
+  const char *key;
+  uint64_t offset;            // payload bytes so far (XOR key phase)
+  mosaic_encoder enc;
+  mosaic_decoder dec;
+  uint8_t *z;                 // compressed bytes: encode scratch, or partial frames
+  size_t z_len, z_cap;
+} pipe_codec;
+
+static size_t out_capacity(const pipe_codec *c, unsigned opts, size_t chunk){
+  if(c->mode == MOSAIC_PIPE_DECODE) return mosaic_decoder_bound(chunk);
+  if(opts & MOSAIC_OPT_COMPRESS) chunk = mosaic_lz_bound(chunk);
+  return mosaic_encoder_bound(chunk, opts) + mosaic_encoder_bound(0, opts); /* + final */
+}
+
+static void codec_free(pipe_codec *c){
+  if(c->z){ wipe(c->z, c->z_cap); free(c->z); }
+  c->z = NULL;
+  c->z_len = c->z_cap = 0;
+}
+
+/* swaps *buf for one of at least need bytes, keeping the first keep */
+static int grow_buffer(uint8_t **buf, size_t *cap, size_t need, size_t keep){
+  size_t n = *cap ? *cap : 4096;
+  while(n < need) n *= 2;
+  uint8_t *b = malloc(n);
+  if(!b){ errno = ENOMEM; return -1; }
+  if(keep) memcpy(b, *buf, keep);
+  if(*buf){ wipe(*buf, *cap); free(*buf); }
+  *buf = b;
+  *cap = n;
+  return 0;
+}
+
+/* adds len decoded bytes to the gathered frames and expands every whole
+ * one into *out, which grows when a frame does not fit */
+static size_t codec_inflate(pipe_codec *c, const uint8_t *zin, size_t len, int last,
+                            uint8_t **out, size_t *cap){
+  if(!len && !c->z_len) return 0;
+  if(c->z_len + len > c->z_cap && grow_buffer(&c->z, &c->z_cap, c->z_len + len, c->z_len) != 0){
+    return (size_t)-1;
+  }
+  memcpy(c->z + c->z_len, zin, len);
+  c->z_len += len;
+
+  size_t pos = 0, o = 0, raw, f;
+  while((f = mosaic_lz_frame(c->z + pos, c->z_len - pos, &raw)) != 0){
+    if(f == (size_t)-1){ errno = EILSEQ; return f; }
+    if(o + raw > *cap && grow_buffer(out, cap, o + raw, o) != 0) return (size_t)-1;
+    if(mosaic_lz_decompress(c->z + pos, f, *out + o, raw) != raw){ errno = EILSEQ; return (size_t)-1; }
+    o += raw;
+    pos += f;
+  }
+  memmove(c->z, c->z + pos, c->z_len - pos);
+  c->z_len -= pos;
+  if(last && c->z_len){ errno = EILSEQ; return (size_t)-1; } /* a frame was cut short */
+  return o;
+}
+
+/* in is scratch: encoding XORs it in place. *out holds *cap bytes, at least
+ * out_capacity(); decompressing may swap it for a larger buffer. Returns
+ * bytes written to *out, or (size_t)-1 with errno set. */
+static size_t codec_step(pipe_codec *c, uint8_t *in, size_t len, int last,
+                         uint8_t **out, size_t *cap){
+  const int keyed = c->key && *c->key;
+  size_t w;
+
+  if(c->mode == MOSAIC_PIPE_ENCODE){
+    if(c->z){
+      len = mosaic_lz_compress(in, len, c->z, c->z_cap);
+      if(len == (size_t)-1){ errno = EINVAL; return len; }
+      in = c->z;
+    }
+    if(keyed) xor_with_key_at(in, len, c->key, c->offset);
+    c->offset += len;
+    w = mosaic_encoder_update(&c->enc, in, len, (char*)*out, *cap);
+    if(w == (size_t)-1){ errno = EINVAL; return w; }
+    if(last){
+      size_t t = mosaic_encoder_final(&c->enc, (char*)*out + w, *cap - w);
+      if(t == (size_t)-1){ errno = EINVAL; return t; }
+      w += t;
+    }
+  } else {
+    w = mosaic_decoder_update(&c->dec, (const char*)in, len, *out, *cap);
+    if(w == (size_t)-1 || (last && mosaic_decoder_final(&c->dec) != 0)){
+      errno = EILSEQ;
+      return (size_t)-1;
+    }
+    if(keyed) xor_with_key_at(*out, w, c->key, c->offset);
+    c->offset += w;
+    /* the marks come before any block, so this is known from the first byte on */
+    if(c->dec.opts & MOSAIC_OPT_COMPRESS) w = codec_inflate(c, *out, w, last, out, cap);
+  }
+  return w;
+}
+
+/* ---------------- Chunk slots ---------------- */
+
+enum { SLOT_FREE, SLOT_READING, SLOT_READY, SLOT_PENDING, SLOT_WRITING };
+
+typedef struct {
+  uint8_t *in;
+  uint8_t *out;
+  int state;
+  int eof;                    // last chunk of the input
+  uint64_t seq;               // chunk number, fixes processing/write order
+  uint64_t in_off;            // file offset of the read (seekable input)
+  size_t want;                // bytes asked of this read
+  size_t filled;              // bytes read so far
+  uint64_t out_off;           // file offset of the write (seekable output)
+  size_t out_size;            // out's size: out_cap, unless decompression grew it
+  size_t out_len;
+  size_t written;
+} pipe_slot;
+
+typedef struct {
+  const mosaic_pipe_config *cfg;
+  pipe_codec codec;
+  pipe_slot *slots;
+  int depth;
+  size_t chunk;
+  size_t out_cap;
+
+  int in_fd, out_fd;
+  int in_seekable;            // regular file: positional reads, several in flight
+  int out_seekable;           // regular file, no O_APPEND: positional writes
+  uint64_t in_base, in_size;
+  uint64_t out_base;
+
+  uint64_t bytes_in, bytes_out;
+} pipe_job;
+
+static void free_slots(pipe_job *j){
+  if(!j->slots) return;
+  for(int i = 0; i < j->depth; i++){
+    /* either side may hold plaintext */
+    if(j->slots[i].in){ wipe(j->slots[i].in, j->chunk); free(j->slots[i].in); }
+    if(j->slots[i].out){ wipe(j->slots[i].out, j->slots[i].out_size); free(j->slots[i].out); }
+  }
+  free(j->slots);
+  j->slots = NULL;
+}
+
+static int alloc_slots(pipe_job *j){
+  j->slots = calloc((size_t)j->depth, sizeof *j->slots);
+  if(!j->slots) return -1;
+  for(int i = 0; i < j->depth; i++){
+    /* page aligned, so the ring can pin them cheaply */
+    void *a = NULL, *b = NULL;
+    if(posix_memalign(&a, 4096, j->chunk) != 0 || posix_memalign(&b, 4096, j->out_cap) != 0){
+      free(a);
+      free_slots(j);
+      errno = ENOMEM;
+      return -1;
+    }
+    j->slots[i].in = a;
+    j->slots[i].out = b;
+    j->slots[i].out_size = j->out_cap;
+  }
+  return 0;
+}
+
+static pipe_slot *slot_with_seq(pipe_job *j, int state, uint64_t seq){
+  for(int i = 0; i < j->depth; i++){
+    if(j->slots[i].state == state && j->slots[i].seq == seq) return &j->slots[i];
+  }
+  return NULL;
+}
+
+static pipe_slot *free_slot(pipe_job *j){
+  for(int i = 0; i < j->depth; i++){
+    if(j->slots[i].state == SLOT_FREE) return &j->slots[i];
+  }
+  return NULL;
+}
+
+/* run the codec on a slot that has been read; it moves on to SLOT_PENDING */
+static int process_slot(pipe_job *j, pipe_slot *s){
+  size_t w = codec_step(&j->codec, s->in, s->filled, s->eof, &s->out, &s->out_size);
+  if(w == (size_t)-1) return -1;
+  j->bytes_in += s->filled;
+  s->out_len = w;
+  s->written = 0;
+  s->out_off = j->out_base + j->bytes_out;
+  j->bytes_out += w;
+  s->state = SLOT_PENDING;
+  return 0;
+}
+
+/* ---------------- io_uring engine ---------------- */
+
+#ifdef MOSAIC_HAVE_URING
+
+/* liburing is not assumed to be installed; the ring is driven directly
+ * through the three syscalls and the shared memory they map. */
+typedef struct {
+  int fd;
+  unsigned sq_entries;
+  unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+  unsigned *cq_head, *cq_tail, *cq_mask;
+  struct io_uring_sqe *sqes;
+  struct io_uring_cqe *cqes;
+  void *sq_ptr, *cq_ptr;
+  size_t sq_size, cq_size, sqes_size;
+  unsigned to_submit;
+  int fixed;                  // buffers registered: use READ_FIXED / WRITE_FIXED
+} uring;
+
+static void uring_teardown(uring *r){
+  if(r->sqes) munmap(r->sqes, r->sqes_size);
+  if(r->cq_ptr && r->cq_ptr != r->sq_ptr) munmap(r->cq_ptr, r->cq_size);
+  if(r->sq_ptr) munmap(r->sq_ptr, r->sq_size);
+  if(r->fd >= 0) close(r->fd);
+}
+
+static int uring_setup(uring *r, unsigned entries){
+  struct io_uring_params p;
+  memset(r, 0, sizeof *r);
+  memset(&p, 0, sizeof p);
+  r->fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+  if(r->fd < 0) return -1;
+
+  r->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  r->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  if(p.features & IORING_FEAT_SINGLE_MMAP){
+    if(r->cq_size > r->sq_size) r->sq_size = r->cq_size;
+    r->cq_size = r->sq_size;
+  }
+  r->sq_ptr = mmap(NULL, r->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   r->fd, IORING_OFF_SQ_RING);
+  if(r->sq_ptr == MAP_FAILED) goto fail;
+  if(p.features & IORING_FEAT_SINGLE_MMAP){
+    r->cq_ptr = r->sq_ptr;
+  } else {
+    r->cq_ptr = mmap(NULL, r->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     r->fd, IORING_OFF_CQ_RING);
+    if(r->cq_ptr == MAP_FAILED){ r->cq_ptr = NULL; goto fail; }
+  }
+  r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+  r->sqes = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                 r->fd, IORING_OFF_SQES);
+  if(r->sqes == MAP_FAILED){ r->sqes = NULL; goto fail; }
+
+  char *sq = r->sq_ptr, *cq = r->cq_ptr;
+  r->sq_entries = p.sq_entries;
+  r->sq_head = (unsigned*)(sq + p.sq_off.head);
+  r->sq_tail = (unsigned*)(sq + p.sq_off.tail);
+  r->sq_mask = (unsigned*)(sq + p.sq_off.ring_mask);
+  r->sq_array = (unsigned*)(sq + p.sq_off.array);
+  r->cq_head = (unsigned*)(cq + p.cq_off.head);
+  r->cq_tail = (unsigned*)(cq + p.cq_off.tail);
+  r->cq_mask = (unsigned*)(cq + p.cq_off.ring_mask);
+  r->cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+  return 0;
+
+fail:
+  if(r->sq_ptr == MAP_FAILED) r->sq_ptr = NULL;
+  uring_teardown(r);
+  return -1;
+}
+
+/* submit what has been queued; with wait, block for at least one completion */
+static int uring_enter(uring *r, int wait){
+  for(;;){
+    unsigned flags = wait ? IORING_ENTER_GETEVENTS : 0;
+    long n = syscall(__NR_io_uring_enter, r->fd, r->to_submit, wait ? 1u : 0u, flags, NULL, 0);
+    if(n >= 0){
+      r->to_submit -= (unsigned)n;
+      return 0;
+    }
+    if(errno != EINTR) return -1;
+  }
+}
+
+static struct io_uring_sqe *uring_sqe(uring *r){
+  unsigned tail = *r->sq_tail;
+  unsigned head = __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+  if(tail - head >= r->sq_entries){
+    if(uring_enter(r, 0) != 0) return NULL;
+    head = __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+    if(tail - head >= r->sq_entries){ errno = EBUSY; return NULL; }
+  }
+  unsigned idx = tail & *r->sq_mask;
+  struct io_uring_sqe *sqe = &r->sqes[idx];
+  memset(sqe, 0, sizeof *sqe);
+  r->sq_array[idx] = idx;
+  return sqe;
+}
+
+static void uring_push(uring *r){
+  __atomic_store_n(r->sq_tail, *r->sq_tail + 1, __ATOMIC_RELEASE);
+  r->to_submit++;
+}
+
+/* user_data: slot index * 2, +1 for a write. buf_index < 0: not a
+ * registered buffer */
+static int uring_io(uring *r, int write, int fd, int slot, int buf_index,
+                    void *addr, size_t len, uint64_t off){
+  struct io_uring_sqe *sqe = uring_sqe(r);
+  if(!sqe) return -1;
+  if(r->fixed && buf_index >= 0){
+    sqe->opcode = write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+    sqe->buf_index = (uint16_t)buf_index;
+  } else {
+    sqe->opcode = write ? IORING_OP_WRITE : IORING_OP_READ;
+  }
+  sqe->fd = fd;
+  sqe->addr = (uint64_t)(uintptr_t)addr;
+  sqe->len = (uint32_t)len;
+  sqe->off = off;
+  sqe->user_data = (uint64_t)slot * 2u + (write ? 1u : 0u);
+  uring_push(r);
+  return 0;
+}
+
+static int uring_read(uring *r, pipe_job *j, pipe_slot *s){
+  int i = (int)(s - j->slots);
+  uint64_t off = j->in_seekable ? s->in_off + s->filled : (uint64_t)-1;
+  return uring_io(r, 0, j->in_fd, i, i, s->in + s->filled, s->want - s->filled, off);
+}
+
+static int uring_write(uring *r, pipe_job *j, pipe_slot *s){
+  int i = (int)(s - j->slots);
+  uint64_t off = j->out_seekable ? s->out_off + s->written : (uint64_t)-1;
+  /* a buffer grown by decompression has replaced the registered one */
+  int buf_index = s->out_size == j->out_cap ? j->depth + i : -1;
+  return uring_io(r, 1, j->out_fd, i, buf_index, s->out + s->written,
+                  s->out_len - s->written, off);
+}
+
+/* 0 done, -1 failed (errno), 1 no ring to be had: nothing was touched */
+static int run_uring(pipe_job *j){
+  uring r;
+  unsigned entries = 1;
+  while(entries < (unsigned)j->depth * 2u) entries <<= 1;
+  if(uring_setup(&r, entries) != 0) return 1;
+
+  /* in buffers are 0..depth-1, out buffers depth..2*depth-1. Registering
+   * pins them once instead of on every request; if the kernel refuses
+   * (memlock limits on older kernels) plain READ/WRITE still works. */
+  struct iovec *iov = calloc((size_t)j->depth * 2u, sizeof *iov);
+  if(!iov){ uring_teardown(&r); errno = ENOMEM; return -1; }
+  for(int i = 0; i < j->depth; i++){
+    iov[i].iov_base = j->slots[i].in;
+    iov[i].iov_len = j->chunk;
+    iov[j->depth + i].iov_base = j->slots[i].out;
+    iov[j->depth + i].iov_len = j->out_cap;
+  }
+  r.fixed = syscall(__NR_io_uring_register, r.fd, IORING_REGISTER_BUFFERS,
+                    iov, (unsigned)j->depth * 2u) == 0;
+  free(iov);
+
+  uint64_t next_read = 0, next_proc = 0, next_write = 0;
+  uint64_t read_off = j->in_base;
+  int reads_done = 0;         // the eof chunk has been scheduled
+  int proc_done = 0;          // the eof chunk has been through the codec
+  int reads_inflight = 0, writes_inflight = 0;
+  int err = 0;
+
+  for(;;){
+    /* keep every free slot reading ahead; a pipe only takes one at a time */
+    pipe_slot *s;
+    while(!err && !reads_done && (j->in_seekable || reads_inflight == 0) && (s = free_slot(j))){
+      s->seq = next_read++;
+      s->filled = 0;
+      s->eof = 0;
+      if(j->in_seekable){
+        if(read_off >= j->in_base + j->in_size){
+          /* nothing left: an empty last chunk carries the eof */
+          s->eof = 1;
+          s->state = SLOT_READY;
+          reads_done = 1;
+          break;
+        }
+        uint64_t left = j->in_base + j->in_size - read_off;
+        s->in_off = read_off;
+        s->want = left < j->chunk ? (size_t)left : j->chunk;
+        read_off += s->want;
+      } else {
+        s->want = j->chunk;
+      }
+      if(uring_read(&r, j, s) != 0){ err = errno; break; }
+      s->state = SLOT_READING;
+      reads_inflight++;
+    }
+
+    /* codec work happens here, while the submitted reads and writes run */
+    while(!err && !proc_done && (s = slot_with_seq(j, SLOT_READY, next_proc))){
+      if(process_slot(j, s) != 0){ err = errno; break; }
+      next_proc++;
+      if(s->eof) proc_done = 1;
+    }
+
+    /* writes go out in chunk order; a pipe only takes one at a time */
+    while(!err && (j->out_seekable || writes_inflight == 0) &&
+          (s = slot_with_seq(j, SLOT_PENDING, next_write))){
+      next_write++;
+      if(s->out_len == 0){ s->state = SLOT_FREE; continue; }
+      if(uring_write(&r, j, s) != 0){ err = errno; break; }
+      s->state = SLOT_WRITING;
+      writes_inflight++;
+    }
+
+    if(reads_inflight + writes_inflight == 0){
+      if(err) break;
+      if(proc_done && next_write == next_proc) break;
+      if(!proc_done && !free_slot(j) && !slot_with_seq(j, SLOT_READY, next_proc)){
+        err = EIO; /* cannot happen: every slot is stuck */
+        break;
+      }
+      continue;
+    }
+
+    /* on error, stop issuing but drain: the kernel may still be filling
+     * buffers we are about to free */
+    if(uring_enter(&r, 1) != 0){ err = errno; break; }
+
+    unsigned head = *r.cq_head;
+    unsigned tail = __atomic_load_n(r.cq_tail, __ATOMIC_ACQUIRE);
+    for(; head != tail; head++){
+      struct io_uring_cqe *cqe = &r.cqes[head & *r.cq_mask];
+      pipe_slot *c = &j->slots[cqe->user_data / 2u];
+      int res = cqe->res;
+      if(cqe->user_data & 1u){
+        writes_inflight--;
+        if(res < 0 && res != -EINTR && res != -EAGAIN){ if(!err) err = -res; c->state = SLOT_FREE; continue; }
+        if(res == 0){ if(!err) err = EIO; c->state = SLOT_FREE; continue; }
+        if(res > 0) c->written += (size_t)res;
+        if(c->written < c->out_len && !err){
+          if(uring_write(&r, j, c) != 0){ err = errno; c->state = SLOT_FREE; continue; }
+          writes_inflight++;
+        } else {
+          c->state = SLOT_FREE;
+        }
+      } else {
+        reads_inflight--;
+        if(res < 0 && res != -EINTR && res != -EAGAIN){ if(!err) err = -res; c->state = SLOT_FREE; continue; }
+        if(res == 0){
+          c->eof = 1;
+          reads_done = 1;
+        } else if(res > 0){
+          c->filled += (size_t)res;
+        }
+        /* a short read of a regular file is finished off; from a pipe,
+         * whatever arrived is passed on as it is */
+        if(!c->eof && c->filled < c->want && !err && (j->in_seekable || res < 0)){
+          if(uring_read(&r, j, c) != 0){ err = errno; c->state = SLOT_FREE; continue; }
+          reads_inflight++;
+        } else {
+          c->state = SLOT_READY;
+        }
+      }
+    }
+    __atomic_store_n(r.cq_head, head, __ATOMIC_RELEASE);
+  }
+
+  uring_teardown(&r);
+  if(err){ errno = err; return -1; }
+  return 0;
+}
+
+#endif /* MOSAIC_HAVE_URING */
+
+/* ---------------- Thread engine ---------------- */
+
+/* Slots travel free -> reader -> codec (this thread) -> writer -> free through
+ * three small queues. On error every stage keeps passing slots along without
+ * doing work until the eof slot comes through, so nobody blocks forever. */
+typedef struct {
+  pipe_slot **items;
+  int cap, head, count;
+  pthread_mutex_t lock;
+  pthread_cond_t ready;
+} slot_queue;
+
+static int queue_init(slot_queue *q, int cap){
+  q->items = calloc((size_t)cap, sizeof *q->items);
+  if(!q->items) return -1;
+  q->cap = cap;
+  q->head = q->count = 0;
+  pthread_mutex_init(&q->lock, NULL);
+  pthread_cond_init(&q->ready, NULL);
+  return 0;
+}
+
+static void queue_destroy(slot_queue *q){
+  free(q->items);
+  pthread_mutex_destroy(&q->lock);
+  pthread_cond_destroy(&q->ready);
+}
+
+static void queue_push(slot_queue *q, pipe_slot *s){
+  pthread_mutex_lock(&q->lock);
+  q->items[(q->head + q->count) % q->cap] = s;
+  q->count++;
+  pthread_cond_signal(&q->ready);
+  pthread_mutex_unlock(&q->lock);
+}
+
+static pipe_slot *queue_pop(slot_queue *q){
+  pthread_mutex_lock(&q->lock);
+  while(q->count == 0) pthread_cond_wait(&q->ready, &q->lock);
+  pipe_slot *s = q->items[q->head];
+  q->head = (q->head + 1) % q->cap;
+  q->count--;
+  pthread_mutex_unlock(&q->lock);
+  return s;
+}
+
+typedef struct {
+  pipe_job *job;
+  slot_queue free_q, read_q, write_q;
+  int err;                    // first error; the reader checks it to stop early
+  pthread_mutex_t err_lock;
+} thread_pipe;
+
+static void set_error(thread_pipe *t, int e){
+  pthread_mutex_lock(&t->err_lock);
+  if(!t->err) t->err = e ? e : EIO;
+  pthread_mutex_unlock(&t->err_lock);
+}
+
+static int get_error(thread_pipe *t){
+  pthread_mutex_lock(&t->err_lock);
+  int e = t->err;
+  pthread_mutex_unlock(&t->err_lock);
+  return e;
+}
+
+static void *reader_main(void *arg){
+  thread_pipe *t = arg;
+  pipe_job *j = t->job;
+  for(;;){
+    pipe_slot *s = queue_pop(&t->free_q);
+    s->filled = 0;
+    s->eof = 0;
+    /* fill regular files chunk by chunk; pass pipe data on as it arrives */
+    while(!get_error(t) && s->filled < j->chunk){
+      ssize_t n = read(j->in_fd, s->in + s->filled, j->chunk - s->filled);
+      if(n < 0){
+        if(errno == EINTR) continue;
+        set_error(t, errno);
+        break;
+      }
+      if(n == 0){ s->eof = 1; break; }
+      s->filled += (size_t)n;
+      if(!j->in_seekable) break;
+    }
+    if(get_error(t)) s->eof = 1;
+    queue_push(&t->read_q, s);
+    if(s->eof) return NULL;
+  }
+}
+
+static void *writer_main(void *arg){
+  thread_pipe *t = arg;
+  pipe_job *j = t->job;
+  for(;;){
+    pipe_slot *s = queue_pop(&t->write_q);
+    int eof = s->eof;
+    while(!get_error(t) && s->written < s->out_len){
+      ssize_t n = write(j->out_fd, s->out + s->written, s->out_len - s->written);
+      if(n < 0){
+        if(errno == EINTR) continue;
+        set_error(t, errno);
+        break;
+      }
+      s->written += (size_t)n;
+    }
+    queue_push(&t->free_q, s);
+    if(eof) return NULL;
+  }
+}
+
+static int run_threads(pipe_job *j){
+  thread_pipe t;
+  memset(&t, 0, sizeof t);
+  t.job = j;
+  if(queue_init(&t.free_q, j->depth) != 0 || queue_init(&t.read_q, j->depth) != 0 ||
+     queue_init(&t.write_q, j->depth) != 0){
+    free(t.free_q.items);
+    free(t.read_q.items);
+    free(t.write_q.items);
+    errno = ENOMEM;
+    return -1;
+  }
+  pthread_mutex_init(&t.err_lock, NULL);
+  for(int i = 0; i < j->depth; i++) queue_push(&t.free_q, &j->slots[i]);
+
+  /* plain read/write from the current positions */
+  pthread_t reader, writer;
+  int rc = pthread_create(&reader, NULL, reader_main, &t);
+  if(rc == 0){
+    rc = pthread_create(&writer, NULL, writer_main, &t);
+    if(rc != 0){
+      set_error(&t, rc);
+      /* drain the reader by hand */
+      for(;;){
+        pipe_slot *s = queue_pop(&t.read_q);
+        int eof = s->eof;
+        queue_push(&t.free_q, s);
+        if(eof) break;
+      }
+      pthread_join(reader, NULL);
+    }
+  }
+  if(rc == 0){
+    for(;;){
+      pipe_slot *s = queue_pop(&t.read_q);
+      int eof = s->eof;
+      if(!get_error(&t)){
+        if(process_slot(j, s) != 0) set_error(&t, errno);
+      }
+      if(get_error(&t)) s->out_len = 0;
+      s->written = 0;
+      queue_push(&t.write_q, s);
+      if(eof) break;
+    }
+    pthread_join(reader, NULL);
+    pthread_join(writer, NULL);
+  } else if(!t.err){
+    t.err = rc;
+  }
+
+  int err = t.err;
+  queue_destroy(&t.free_q);
+  queue_destroy(&t.read_q);
+  queue_destroy(&t.write_q);
+  pthread_mutex_destroy(&t.err_lock);
+  if(err){ errno = err; return -1; }
+  return 0;
+}
+
+/* ---------------- Inline engine ---------------- */
+
+/* one slot, plain read/write from the current positions */
+static int run_inline(pipe_job *j){
+  pipe_slot *s = &j->slots[0];
+  do {
+    s->filled = 0;
+    s->eof = 0;
+    while(s->filled < j->chunk){
+      ssize_t n = read(j->in_fd, s->in + s->filled, j->chunk - s->filled);
+      if(n < 0){
+        if(errno == EINTR) continue;
+        return -1;
+      }
+      if(n == 0){ s->eof = 1; break; }
+      s->filled += (size_t)n;
+      if(!j->in_seekable) break;
+    }
+    if(process_slot(j, s) != 0) return -1;
+    while(s->written < s->out_len){
+      ssize_t n = write(j->out_fd, s->out + s->written, s->out_len - s->written);
+      if(n < 0){
+        if(errno == EINTR) continue;
+        return -1;
+      }
+      s->written += (size_t)n;
+    }
+  } while(!s->eof);
+  return 0;
+}
+
+/* ---------------- Entry point ---------------- */
+
+static double now_seconds(void){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+int mosaic_pipe_run(int in_fd, int out_fd, const mosaic_pipe_config *cfg, mosaic_pipe_result *res){
+  if(!cfg || in_fd < 0 || out_fd < 0){ errno = EINVAL; return -1; }
+
+  pipe_job j;
+  memset(&j, 0, sizeof j);
+  j.cfg = cfg;
+  j.in_fd = in_fd;
+  j.out_fd = out_fd;
+  j.depth = cfg->depth > 0 ? cfg->depth : MOSAIC_PIPE_DEPTH;
+  if(cfg->engine == MOSAIC_ENGINE_INLINE) j.depth = 1;
+  j.chunk = cfg->chunk_size ? cfg->chunk_size : MOSAIC_PIPE_CHUNK;
+  /* whole checksum windows, so the encoder never has to carry bytes over */
+  size_t window = (cfg->opts & MOSAIC_OPT_WIDE) ? MOSAIC_WIDE_WINDOW_BYTES : MOSAIC_WINDOW_BYTES;
+  j.chunk -= j.chunk % window;
+  if(j.chunk == 0) j.chunk = window;
+
+  j.codec.mode = cfg->mode;
+  j.codec.key = cfg->key;
+  mosaic_encoder_init(&j.codec.enc, cfg->opts);
+  mosaic_decoder_init(&j.codec.dec);
+  j.out_cap = out_capacity(&j.codec, cfg->opts, j.chunk);
+  if(cfg->mode == MOSAIC_PIPE_ENCODE && (cfg->opts & MOSAIC_OPT_COMPRESS)){
+    j.codec.z_cap = mosaic_lz_bound(j.chunk);
+    j.codec.z = malloc(j.codec.z_cap);
+    if(!j.codec.z){ errno = ENOMEM; return -1; }
+  }
+
+  struct stat st;
+  off_t pos;
+  if(fstat(in_fd, &st) == 0 && S_ISREG(st.st_mode) && (pos = lseek(in_fd, 0, SEEK_CUR)) >= 0){
+    j.in_seekable = 1;
+    j.in_base = (uint64_t)pos;
+    j.in_size = (uint64_t)st.st_size > j.in_base ? (uint64_t)st.st_size - j.in_base : 0;
+  }
+  int fl = fcntl(out_fd, F_GETFL);
+  if(fstat(out_fd, &st) == 0 && S_ISREG(st.st_mode) && fl >= 0 && !(fl & O_APPEND) &&
+     (pos = lseek(out_fd, 0, SEEK_CUR)) >= 0){
+    j.out_seekable = 1;
+    j.out_base = (uint64_t)pos;
+  }
+
+  if(alloc_slots(&j) != 0){ codec_free(&j.codec); return -1; }
+
+  double t0 = now_seconds();
+  int rc = -1;
+  mosaic_pipe_engine used = MOSAIC_ENGINE_THREADS;
+  if(cfg->engine == MOSAIC_ENGINE_INLINE){
+    used = MOSAIC_ENGINE_INLINE;
+    rc = run_inline(&j);
+  }
+#ifdef MOSAIC_HAVE_URING
+  if(cfg->engine == MOSAIC_ENGINE_AUTO || cfg->engine == MOSAIC_ENGINE_URING){
+    used = MOSAIC_ENGINE_URING;
+    rc = run_uring(&j);
+    if(rc == 1 && cfg->engine == MOSAIC_ENGINE_URING) rc = -1;
+  }
+  /* no ring (ENOSYS, or EPERM under seccomp): fall back */
+  if(rc == 1 || cfg->engine == MOSAIC_ENGINE_THREADS){
+    used = MOSAIC_ENGINE_THREADS;
+    rc = run_threads(&j);
+  }
+#else
+  if(cfg->engine == MOSAIC_ENGINE_URING){
+    errno = ENOSYS;
+  } else if(cfg->engine != MOSAIC_ENGINE_INLINE){
+    rc = run_threads(&j);
+  }
+#endif
+  int saved = errno;
+
+  /* positional I/O leaves the file offsets alone; move them past what was
+   * consumed and produced, as plain read/write would have */
+  if(used == MOSAIC_ENGINE_URING){
+    if(j.in_seekable) lseek(in_fd, (off_t)(j.in_base + j.bytes_in), SEEK_SET);
+    if(j.out_seekable) lseek(out_fd, (off_t)(j.out_base + j.bytes_out), SEEK_SET);
+  }
+
+  free_slots(&j);
+  codec_free(&j.codec);
+  if(res){
+    res->bytes_in = j.bytes_in;
+    res->bytes_out = j.bytes_out;
+    res->seconds = now_seconds() - t0;
+    res->engine = used;
+  }
+  errno = saved;
+  return rc == 0 ? 0 : -1;
+}
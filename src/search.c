@@ -0,0 +1,262 @@
+#define _POSIX_C_SOURCE 200809L /* sysconf() */
+
+#include "search.h"
+#include "lz.h"
+#include "xor_key.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MAX_WORKERS 256
+
+static void wipe(void *p, size_t n){
+  volatile unsigned char *v = (volatile unsigned char *)p;
+  while(n--) *v++ = 0;
+}
+
+static void wipe_free(void *p, size_t n){
+  if(!p) return;
+  wipe(p, n);
+  free(p);
+}
+
+/* ---------------- One stream ---------------- */
+
+int mosaic_search_init(mosaic_searcher *s, const void *pattern, size_t pattern_len,
+                       const char *key){
+  memset(s, 0, sizeof *s);
+  if(!pattern || pattern_len == 0 || pattern_len > MOSAIC_SEARCH_PATTERN_MAX){
+    errno = EINVAL;
+    return -1;
+  }
+  mosaic_decoder_init(&s->dec);
+  s->key = key;
+  s->pattern_len = pattern_len;
+  s->pattern = malloc(pattern_len);
+  s->tail = malloc(pattern_len);
+  s->win = malloc(pattern_len + mosaic_decoder_bound(MOSAIC_SEARCH_SLICE));
+  if(!s->pattern || !s->tail || !s->win){
+    mosaic_search_free(s);
+    errno = ENOMEM;
+    return -1;
+  }
+  memcpy(s->pattern, pattern, pattern_len);
+  return 0;
+}
+
+void mosaic_search_free(mosaic_searcher *s){
+  size_t head = s->pattern_len;
+  wipe_free(s->pattern, s->pattern_len);
+  wipe_free(s->tail, s->pattern_len);
+  wipe_free(s->win, head + mosaic_decoder_bound(MOSAIC_SEARCH_SLICE));
+  wipe_free(s->z, MOSAIC_LZ_FRAME_HDR + MOSAIC_LZ_FRAME_MAX);
+  wipe_free(s->raw, head + MOSAIC_LZ_FRAME_MAX);
+  memset(s, 0, sizeof *s);
+}
+
+/* the next n plaintext bytes sit at buf, which has pattern_len bytes of
+ * room before it: the carry goes there, so a match may start in it (it
+ * cannot have been reported yet, as it did not fit before) */
+static int scan(mosaic_searcher *s, uint8_t *buf, size_t n, mosaic_match_fn fn, void *ctx){
+  const size_t m = s->pattern_len;
+  uint8_t *p = buf - s->carry;
+  size_t len = s->carry + n;
+  uint64_t base = s->plain - s->carry;
+  memcpy(p, s->tail, s->carry);
+
+  if(len >= m){
+    const uint8_t *q = p, *last = p + (len - m);
+    while(q <= last && (q = memchr(q, s->pattern[0], (size_t)(last - q) + 1)) != NULL){
+      if(memcmp(q + 1, s->pattern + 1, m - 1) == 0){
+        s->matches++;
+        if(fn && fn(ctx, base + (uint64_t)(q - p)) != 0){
+          s->stopped = 1;
+          break;
+        }
+      }
+      q++;
+    }
+  }
+
+  s->plain += n;
+  s->carry = len < m - 1 ? len : m - 1;
+  memcpy(s->tail, p + len - s->carry, s->carry);
+  return s->stopped;
+}
+
+/* compressed streams: gathers decoded bytes until a frame is whole and
+ * scans its expansion. A frame is at most header + MOSAIC_LZ_FRAME_MAX
+ * bytes, so a partial one always leaves room to add to it. */
+static int inflate(mosaic_searcher *s, const uint8_t *in, size_t len, mosaic_match_fn fn,
+                   void *ctx){
+  const size_t z_cap = MOSAIC_LZ_FRAME_HDR + MOSAIC_LZ_FRAME_MAX;
+  if(!s->z){
+    s->z = malloc(z_cap);
+    s->raw = malloc(s->pattern_len + MOSAIC_LZ_FRAME_MAX);
+    if(!s->z || !s->raw){ errno = ENOMEM; return -1; }
+  }
+
+  while(len){
+    size_t n = len < z_cap - s->z_len ? len : z_cap - s->z_len;
+    memcpy(s->z + s->z_len, in, n);
+    s->z_len += n;
+    in += n;
+    len -= n;
+
+    size_t pos = 0, raw, f;
+    while((f = mosaic_lz_frame(s->z + pos, s->z_len - pos, &raw)) != 0){
+      if(f == (size_t)-1){ errno = EILSEQ; return -1; }
+      uint8_t *out = s->raw + s->pattern_len;
+      if(mosaic_lz_decompress(s->z + pos, f, out, raw) != raw){ errno = EILSEQ; return -1; }
+      pos += f;
+      if(scan(s, out, raw, fn, ctx)) return 1;
+    }
+    memmove(s->z, s->z + pos, s->z_len - pos);
+    s->z_len -= pos;
+  }
+  return 0;
+}
+
+int mosaic_search_update(mosaic_searcher *s, const char *in, size_t in_len,
+                         mosaic_match_fn fn, void *ctx){
+  if(s->stopped) return 1;
+  const int keyed = s->key && *s->key;
+  uint8_t *out = s->win + s->pattern_len;
+  const size_t cap = mosaic_decoder_bound(MOSAIC_SEARCH_SLICE);
+
+  while(in_len){
+    size_t n = in_len < MOSAIC_SEARCH_SLICE ? in_len : MOSAIC_SEARCH_SLICE;
+    size_t w = mosaic_decoder_update(&s->dec, in, n, out, cap);
+    if(w == (size_t)-1){ errno = EILSEQ; return -1; }
+    if(keyed) xor_with_key_at(out, w, s->key, s->payload);
+    s->payload += w;
+    /* the marks come before any block, so this is known from the first byte on */
+    int rc = (s->dec.opts & MOSAIC_OPT_COMPRESS) ? inflate(s, out, w, fn, ctx)
+                                                 : scan(s, out, w, fn, ctx);
+    if(rc) return rc;
+    in += n;
+    in_len -= n;
+  }
+  return 0;
+}
+
+int mosaic_search_final(mosaic_searcher *s){
+  if(s->stopped) return 0;
+  if(mosaic_decoder_final(&s->dec) != 0 || s->z_len){ /* a frame was cut short */
+    errno = EILSEQ;
+    return -1;
+  }
+  return 0;
+}
+
+/* ---------------- Many files ---------------- */
+
+typedef struct {
+  const char *const *paths;
+  size_t n;
+  const void *pattern;
+  size_t pattern_len;
+  const char *key;
+  int first_only;
+  mosaic_file_match_fn on_match;
+  void *ctx;
+  mosaic_search_result *results;
+  pthread_mutex_t lock;       // guards next and the on_match calls
+  size_t next;
+} search_pool;
+
+typedef struct {
+  search_pool *pool;
+  size_t file;
+} file_match;
+
+static int report_match(void *arg, uint64_t offset){
+  file_match *fm = arg;
+  search_pool *p = fm->pool;
+  int stop = p->first_only;
+  if(p->on_match){
+    pthread_mutex_lock(&p->lock);
+    if(p->on_match(p->ctx, fm->file, offset) != 0) stop = 1;
+    pthread_mutex_unlock(&p->lock);
+  }
+  return stop;
+}
+
+/* 0 or an errno value */
+static int search_file(search_pool *p, size_t i, char *buf){
+  mosaic_searcher s;
+  file_match fm = { p, i };
+  int fd = open(p->paths[i], O_RDONLY);
+  if(fd < 0) return errno;
+  if(mosaic_search_init(&s, p->pattern, p->pattern_len, p->key) != 0){
+    int err = errno;
+    close(fd);
+    return err;
+  }
+
+  int err = 0, rc = 0;
+  while(rc == 0){
+    ssize_t r = read(fd, buf, MOSAIC_SEARCH_SLICE);
+    if(r < 0 && errno == EINTR) continue;
+    if(r < 0){ err = errno; break; }
+    if(r == 0){
+      if(mosaic_search_final(&s) != 0) err = errno;
+      break;
+    }
+    rc = mosaic_search_update(&s, buf, (size_t)r, report_match, &fm);
+    if(rc < 0) err = errno;
+  }
+  p->results[i].matches = s.matches;
+  mosaic_search_free(&s);
+  close(fd);
+  return err;
+}
+
+static void *search_worker(void *arg){
+  search_pool *p = arg;
+  char *buf = malloc(MOSAIC_SEARCH_SLICE);
+  for(;;){
+    pthread_mutex_lock(&p->lock);
+    size_t i = p->next < p->n ? p->next++ : p->n;
+    pthread_mutex_unlock(&p->lock);
+    if(i == p->n) break;
+    p->results[i].matches = 0;
+    p->results[i].err = buf ? search_file(p, i, buf) : ENOMEM;
+  }
+  free(buf);
+  return NULL;
+}
+
+int mosaic_search_files(const char *const *paths, size_t n, const void *pattern,
+                        size_t pattern_len, const char *key, int first_only, int threads,
+                        mosaic_file_match_fn on_match, void *ctx,
+                        mosaic_search_result *results){
+  if((!paths && n) || (!results && n) || !pattern || pattern_len == 0 ||
+     pattern_len > MOSAIC_SEARCH_PATTERN_MAX){
+    errno = EINVAL;
+    return -1;
+  }
+
+  search_pool p = { paths, n, pattern, pattern_len, key, first_only, on_match, ctx, results,
+                    PTHREAD_MUTEX_INITIALIZER, 0 };
+
+  long cpus = threads > 0 ? threads : sysconf(_SC_NPROCESSORS_ONLN);
+  if(cpus < 1) cpus = 1;
+  if(cpus > MAX_WORKERS) cpus = MAX_WORKERS;
+  if((size_t)cpus > n) cpus = n ? (long)n : 1;
+
+  /* the calling thread is one of the workers */
+  pthread_t tids[MAX_WORKERS];
+  long started = 0;
+  while(started + 1 < cpus && pthread_create(&tids[started], NULL, search_worker, &p) == 0){
+    started++;
+  }
+  search_worker(&p);
+  for(long t = 0; t < started; t++) pthread_join(tids[t], NULL);
+  pthread_mutex_destroy(&p.lock);
+  return 0;
+}
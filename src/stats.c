@@ -0,0 +1,296 @@
+#define _POSIX_C_SOURCE 200809L /* clock_gettime */
+
+#include "stats.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static const char *const OP_NAMES[MOSAIC_OP_COUNT] = {
+  "encode", "decode", "recover", "xor", "command"
+};
+
+static const char *const FAIL_NAMES[MOSAIC_FAIL_COUNT] = {
+  "symbol", "terminator", "checksum", "trailer", "capacity"
+};
+
+#ifndef MOSAIC_NO_STATS
+
+/* Each thread writes only its own block, so recording needs no lock and no
+ * read-modify-write: a relaxed load and a relaxed store of the sum, which
+ * snapshots read with relaxed loads, whole. Blocks are linked into a global
+ * list for snapshots; when a thread exits its block is folded into
+ * `retired` and released. */
+typedef struct stats_block {
+  mosaic_stats s;
+  struct stats_block *next;
+} stats_block;
+
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t stats_once = PTHREAD_ONCE_INIT;
+static pthread_key_t stats_key;
+static stats_block *stats_threads = NULL;
+static mosaic_stats retired;
+static __thread stats_block *tls_block = NULL;
+
+#if defined(__GNUC__)
+#define LOAD(x)     __atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define STORE(x, v) __atomic_store_n(&(x), (v), __ATOMIC_RELAXED)
+#else
+#define LOAD(x)     (x)
+#define STORE(x, v) ((x) = (v))
+#endif
+/* only ever on the calling thread's own block */
+#define BUMP(x, v)  STORE((x), LOAD(x) + (v))
+
+/* dst is private to the caller (or `retired`, under stats_lock); src may be
+ * a block its thread is still recording into */
+static void merge_into(mosaic_stats *dst, mosaic_stats *src){
+  for(int o = 0; o < MOSAIC_OP_COUNT; o++){
+    mosaic_op_stats *d = &dst->op[o];
+    mosaic_op_stats *s = &src->op[o];
+    d->calls += LOAD(s->calls);
+    d->bytes_in += LOAD(s->bytes_in);
+    d->bytes_out += LOAD(s->bytes_out);
+    d->blocks += LOAD(s->blocks);
+    for(int b = 0; b < MOSAIC_STATS_BUCKETS; b++) d->latency[b] += LOAD(s->latency[b]);
+  }
+  dst->noise_emitted += LOAD(src->noise_emitted);
+  dst->noise_skipped += LOAD(src->noise_skipped);
+  for(int r = 0; r < MOSAIC_FAIL_COUNT; r++) dst->fail[r] += LOAD(src->fail[r]);
+
+  /* command names are static strings, so pointer identity is enough */
+  for(int i = 0; i < MOSAIC_STATS_MAX_COMMANDS; i++){
+    const char *name = LOAD(src->command_name[i]);
+    if(!name) break;
+    int j = 0;
+    while(j < MOSAIC_STATS_MAX_COMMANDS && dst->command_name[j] &&
+          dst->command_name[j] != name) j++;
+    if(j == MOSAIC_STATS_MAX_COMMANDS) break;
+    dst->command_name[j] = name;
+    dst->command_calls[j] += LOAD(src->command_calls[i]);
+  }
+}
+
+/* zeroes a block, field by field, while its thread may be recording */
+static void clear_stats(mosaic_stats *s){
+  for(int o = 0; o < MOSAIC_OP_COUNT; o++){
+    mosaic_op_stats *op = &s->op[o];
+    STORE(op->calls, 0);
+    STORE(op->bytes_in, 0);
+    STORE(op->bytes_out, 0);
+    STORE(op->blocks, 0);
+    for(int b = 0; b < MOSAIC_STATS_BUCKETS; b++) STORE(op->latency[b], 0);
+  }
+  STORE(s->noise_emitted, 0);
+  STORE(s->noise_skipped, 0);
+  for(int r = 0; r < MOSAIC_FAIL_COUNT; r++) STORE(s->fail[r], 0);
+  for(int i = 0; i < MOSAIC_STATS_MAX_COMMANDS; i++){
+    STORE(s->command_calls[i], 0);
+    STORE(s->command_name[i], NULL);
+  }
+}
+
+static void retire_block(void *p){
+  stats_block *blk = (stats_block*)p;
+  pthread_mutex_lock(&stats_lock);
+  merge_into(&retired, &blk->s);
+  for(stats_block **pp = &stats_threads; *pp; pp = &(*pp)->next){
+    if(*pp == blk){
+      *pp = blk->next;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&stats_lock);
+  free(blk);
+}
+
+static void make_key(void){
+  pthread_key_create(&stats_key, retire_block);
+}
+
+/* NULL only if the first allocation on this thread fails; stats then
+ * silently stop for that thread rather than taking the codec down */
+static mosaic_stats *local_stats(void){
+  if(tls_block) return &tls_block->s;
+  stats_block *blk = (stats_block*)calloc(1, sizeof(*blk));
+  if(!blk) return NULL;
+  pthread_once(&stats_once, make_key);
+  pthread_setspecific(stats_key, blk);
+  pthread_mutex_lock(&stats_lock);
+  blk->next = stats_threads;
+  stats_threads = blk;
+  pthread_mutex_unlock(&stats_lock);
+  tls_block = blk;
+  return &blk->s;
+}
+
+static int bucket_for(uint64_t ns){
+  if(ns == 0) return 0;
+#if defined(__GNUC__)
+  int b = 63 - __builtin_clzll(ns);
+#else
+  int b = 0;
+  while(ns >>= 1) b++;
+#endif
+  return b < MOSAIC_STATS_BUCKETS ? b : MOSAIC_STATS_BUCKETS - 1;
+}
+
+uint64_t mosaic_stats_now(void){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+void mosaic_stats_record(mosaic_stats_op op, uint64_t t0, uint64_t bytes_in,
+                         uint64_t bytes_out, uint64_t blocks){
+  mosaic_stats *s = local_stats();
+  if(!s) return;
+  mosaic_op_stats *o = &s->op[op];
+  BUMP(o->calls, 1);
+  BUMP(o->bytes_in, bytes_in);
+  BUMP(o->bytes_out, bytes_out);
+  BUMP(o->blocks, blocks);
+  BUMP(o->latency[bucket_for(mosaic_stats_now() - t0)], 1);
+}
+
+void mosaic_stats_noise(uint64_t emitted, uint64_t skipped){
+  mosaic_stats *s = local_stats();
+  if(!s) return;
+  BUMP(s->noise_emitted, emitted);
+  BUMP(s->noise_skipped, skipped);
+}
+
+void mosaic_stats_failure(mosaic_stats_fail reason){
+  mosaic_stats *s = local_stats();
+  if(s) BUMP(s->fail[reason], 1);
+}
+
+void mosaic_stats_command(const char *name){
+  mosaic_stats *s = local_stats();
+  if(!s || !name) return;
+  for(int i = 0; i < MOSAIC_STATS_MAX_COMMANDS; i++){
+    const char *seen = LOAD(s->command_name[i]);
+    if(!seen) STORE(s->command_name[i], seen = name);
+    if(seen == name){
+      BUMP(s->command_calls[i], 1);
+      return;
+    }
+  }
+}
+
+void mosaic_stats_snapshot(mosaic_stats *out){
+  if(!out) return;
+  memset(out, 0, sizeof(*out));
+  pthread_mutex_lock(&stats_lock);
+  merge_into(out, &retired);
+  for(stats_block *b = stats_threads; b; b = b->next) merge_into(out, &b->s);
+  pthread_mutex_unlock(&stats_lock);
+}
+
+/* Every counter is zeroed with a relaxed store, so none is ever torn. A
+ * thread recording at that instant may have loaded a counter before the
+ * store and write it back after, plus its own delta: that counter keeps its
+ * pre-reset count. Likewise a snapshot taken meanwhile may mix counters from
+ * before and after the reset. Recording stays lock-free at that price; a
+ * reset made while no other thread records is exact. */
+void mosaic_stats_reset(void){
+  pthread_mutex_lock(&stats_lock);
+  memset(&retired, 0, sizeof(retired));
+  for(stats_block *b = stats_threads; b; b = b->next) clear_stats(&b->s);
+  pthread_mutex_unlock(&stats_lock);
+}
+
+#else /* MOSAIC_NO_STATS */
+
+uint64_t mosaic_stats_now(void){ return 0; }
+void mosaic_stats_record(mosaic_stats_op op, uint64_t t0, uint64_t bytes_in,
+                         uint64_t bytes_out, uint64_t blocks){
+  (void)op; (void)t0; (void)bytes_in; (void)bytes_out; (void)blocks;
+}
+void mosaic_stats_noise(uint64_t emitted, uint64_t skipped){ (void)emitted; (void)skipped; }
+void mosaic_stats_failure(mosaic_stats_fail reason){ (void)reason; }
+void mosaic_stats_command(const char *name){ (void)name; }
+void mosaic_stats_snapshot(mosaic_stats *out){ if(out) memset(out, 0, sizeof(*out)); }
+void mosaic_stats_reset(void){}
+
+#endif
+
+/* ---------------- Reporting ---------------- */
+
+#ifndef MOSAIC_NO_STATS
+/* upper edge of the bucket holding the q-th quantile, 0 if no samples */
+static uint64_t latency_quantile(const mosaic_op_stats *o, double q){
+  if(o->calls == 0) return 0;
+  uint64_t rank = (uint64_t)(q * (double)(o->calls - 1)) + 1;
+  uint64_t seen = 0;
+  for(int b = 0; b < MOSAIC_STATS_BUCKETS; b++){
+    seen += o->latency[b];
+    if(seen >= rank) return (uint64_t)2 << b;
+  }
+  return (uint64_t)2 << (MOSAIC_STATS_BUCKETS - 1);
+}
+#endif
+
+static void print_text(FILE *f, const mosaic_stats *s){
+#ifdef MOSAIC_NO_STATS
+  (void)s;
+  fprintf(f, "Statistics were compiled out (MOSAIC_NO_STATS).\n");
+#else
+  fprintf(f, "%-8s %10s %12s %12s %10s %10s %10s\n",
+          "op", "calls", "bytes in", "bytes out", "blocks", "p50 ns", "p99 ns");
+  for(int o = 0; o < MOSAIC_OP_COUNT; o++){
+    const mosaic_op_stats *op = &s->op[o];
+    fprintf(f, "%-8s %10llu %12llu %12llu %10llu %10llu %10llu\n", OP_NAMES[o],
+            (unsigned long long)op->calls, (unsigned long long)op->bytes_in,
+            (unsigned long long)op->bytes_out, (unsigned long long)op->blocks,
+            (unsigned long long)latency_quantile(op, 0.50),
+            (unsigned long long)latency_quantile(op, 0.99));
+  }
+  fprintf(f, "noise: %llu emitted, %llu skipped\n",
+          (unsigned long long)s->noise_emitted, (unsigned long long)s->noise_skipped);
+  fprintf(f, "decode failures:");
+  for(int r = 0; r < MOSAIC_FAIL_COUNT; r++){
+    fprintf(f, " %s=%llu", FAIL_NAMES[r], (unsigned long long)s->fail[r]);
+  }
+  fprintf(f, "\ncommands:");
+  if(!s->command_name[0]) fprintf(f, " none");
+  for(int i = 0; i < MOSAIC_STATS_MAX_COMMANDS && s->command_name[i]; i++){
+    fprintf(f, " %s=%llu", s->command_name[i], (unsigned long long)s->command_calls[i]);
+  }
+  fprintf(f, "\n");
+#endif
+}
+
+static void print_json(FILE *f, const mosaic_stats *s){
+  fprintf(f, "{\"ops\":{");
+  for(int o = 0; o < MOSAIC_OP_COUNT; o++){
+    const mosaic_op_stats *op = &s->op[o];
+    fprintf(f, "%s\"%s\":{\"calls\":%llu,\"bytes_in\":%llu,\"bytes_out\":%llu,\"blocks\":%llu,"
+               "\"latency_log2_ns\":[", o ? "," : "", OP_NAMES[o],
+            (unsigned long long)op->calls, (unsigned long long)op->bytes_in,
+            (unsigned long long)op->bytes_out, (unsigned long long)op->blocks);
+    for(int b = 0; b < MOSAIC_STATS_BUCKETS; b++){
+      fprintf(f, "%s%llu", b ? "," : "", (unsigned long long)op->latency[b]);
+    }
+    fprintf(f, "]}");
+  }
+  fprintf(f, "},\"noise\":{\"emitted\":%llu,\"skipped\":%llu},\"failures\":{",
+          (unsigned long long)s->noise_emitted, (unsigned long long)s->noise_skipped);
+  for(int r = 0; r < MOSAIC_FAIL_COUNT; r++){
+    fprintf(f, "%s\"%s\":%llu", r ? "," : "", FAIL_NAMES[r], (unsigned long long)s->fail[r]);
+  }
+  fprintf(f, "},\"commands\":{");
+  /* command names come from the CLI table: plain identifiers, no escaping needed */
+  for(int i = 0; i < MOSAIC_STATS_MAX_COMMANDS && s->command_name[i]; i++){
+    fprintf(f, "%s\"%s\":%llu", i ? "," : "", s->command_name[i],
+            (unsigned long long)s->command_calls[i]);
+  }
+  fprintf(f, "}}\n");
+}
+
+void mosaic_stats_print(FILE *f, const mosaic_stats *s, int json){
+  if(!f || !s) return;
+  if(json) print_json(f, s);
+  else print_text(f, s);
+}
@@ -1,4 +1,6 @@
 #include "xor_key.h"
+#include "stats.h"
+#include "kernels.h"
 #include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -6,51 +8,65 @@
 
 /* apply XOR with repeating key */
 void xor_with_key(unsigned char *data, size_t len, const char *key){
+  xor_with_key_at(data, len, key, 0);
+}
+
+void xor_with_key_at(unsigned char *data, size_t len, const char *key, unsigned long long offset){
   if(!data || !key) return;
   size_t klen = strlen(key);
   if(klen == 0) return; /* theres nothing to do if key is empty */
-  for(size_t i = 0; i < len; i++){
-    data[i] = (unsigned char)(data[i] ^ (unsigned char)key[i % klen]);
+  uint64_t t0 = STATS_NOW();
+  size_t phase = (size_t)(offset % klen);
+  if(len < MOSAIC_XOR_WIDE || klen > MOSAIC_XOR_MAX_KEY){
+    /* not worth stretching the key for */
+    for(size_t i = 0; i < len; i++){
+      data[i] = (unsigned char)(data[i] ^ (unsigned char)key[phase]);
+      if(++phase == klen) phase = 0;
+    }
+  } else {
+    unsigned char ekey[MOSAIC_EKEY_SIZE];
+    size_t period = mosaic_stretch_key(ekey, (const unsigned char*)key, klen);
+    mosaic_kernels_get()->xor_stream(data, len, ekey, period, phase);
+    /* the stretched key is key material too */
+    volatile unsigned char *vp = ekey;
+    for(size_t i = 0; i < period + MOSAIC_XOR_WIDE; i++) vp[i] = 0;
   }
+  STATS_RECORD(MOSAIC_OP_XOR, t0, len, len, 0);
 }
 
-/* convert a single hex nibble to value, or -1 on error */
-/* I'll be honest, no idea what the hell a hex nibble was until now. */
-static int hexval(char c){
-  if(c >= '0' && c <= '9') return c - '0';
-  if(c >= 'a' && c <= 'f') return 10 + (c - 'a');
-  if(c >= 'A' && c <= 'F') return 10 + (c - 'A');
-  return -1;
+char *xor_encrypt(const char *plaintext, const char *key){
+  return xor_encrypt_ex(plaintext, key, NULL);
 }
 
-char *xor_encrypt(const char *plaintext, const char *key){
+char *xor_decrypt(const char *ciphertext, const char *key){
+  return xor_decrypt_ex(ciphertext, key, NULL);
+}
+
+char *xor_encrypt_ex(const char *plaintext, const char *key, mosaic_arena *arena){
   if(!plaintext) return NULL;
   if(!key || !*key) key = "default-key"; /* fallback */
 
   size_t n = strlen(plaintext);
   /* work on a mutable copy */
-  unsigned char *buf = (unsigned char*)malloc(n ? n : 1);
+  unsigned char *buf = (unsigned char*)mosaic_alloc(arena, n ? n : 1);
   if(!buf) return NULL;
   if(n) memcpy(buf, plaintext, n);
 
   xor_with_key(buf, n, key);
 
   /* hex-encode */
-  char *out = (char*)malloc(n * 2 + 1);
+  char *out = (char*)mosaic_alloc(arena, n * 2 + 1);
   if(!out){
-    free(buf);
+    mosaic_release(arena, buf);
     return NULL;
   }
-  for(size_t i = 0; i < n; i++){
-    /* write two hex chars per byte */
-    sprintf(out + (i * 2), "%02X", buf[i]);
-  }
+  mosaic_kernels_get()->hex_encode(buf, n, out);
   out[n * 2] = '\0';
-  free(buf);
+  mosaic_release(arena, buf);
   return out;
 }
 
-char *xor_decrypt(const char *ciphertext, const char *key){
+char *xor_decrypt_ex(const char *ciphertext, const char *key, mosaic_arena *arena){
   if(!ciphertext) return NULL;
   if(!key || !*key) key = "default-key"; /* fallback */
 
@@ -58,18 +74,13 @@ char *xor_decrypt(const char *ciphertext, const char *key){
   if(L % 2 != 0) return NULL; /* must be even length hex */
 
   size_t n = L / 2;
-  unsigned char *buf = (unsigned char*)malloc(n + 1);
+  unsigned char *buf = (unsigned char*)mosaic_alloc(arena, n + 1);
   if(!buf) return NULL;
 
   /* hex-decode with validation */
-  for(size_t i = 0; i < n; i++){
-    int hi = hexval(ciphertext[2 * i]);
-    int lo = hexval(ciphertext[2 * i + 1]);
-    if(hi < 0 || lo < 0){
-      free(buf);
-      return NULL;
-    }
-    buf[i] = (unsigned char)((hi << 4) | lo);
+  if(mosaic_kernels_get()->hex_decode(ciphertext, n, buf) != 0){
+    mosaic_release(arena, buf);
+    return NULL;
   }
 
   xor_with_key(buf, n, key);
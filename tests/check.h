@@ -0,0 +1,29 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <stdio.h>
+
+/* Minimal test harness: CHECK() reports a failure and goes on, so one run
+ * lists every broken case; main() returns check_report(). */
+
+static int check_failures = 0;
+
+#define CHECK(cond, ...) do { \
+    if(!(cond)){ \
+      check_failures++; \
+      fprintf(stderr, "%s:%d: check failed: %s: ", __FILE__, __LINE__, #cond); \
+      fprintf(stderr, __VA_ARGS__); \
+      fputc('\n', stderr); \
+    } \
+  } while(0)
+
+static int check_report(const char *name){
+  if(check_failures){
+    fprintf(stderr, "%s: %d check(s) failed\n", name, check_failures);
+    return 1;
+  }
+  printf("%s: ok\n", name);
+  return 0;
+}
+
+#endif
@@ -0,0 +1,48 @@
+#!/bin/sh
+# Compiles the Java decoder and its benchmark, then runs RoundTrip over
+# streams the C CLI wrote in every mode. The JDK is taken from JAVA_HOME,
+# else from PATH; without one the check is skipped, or fails when
+# REQUIRE_JAVA=1 (for machines that must run it).
+set -e
+
+if [ -n "$JAVA_HOME" ]; then
+  javac="$JAVA_HOME/bin/javac"
+  java="$JAVA_HOME/bin/java"
+else
+  javac=$(command -v javac || true)
+  java=$(command -v java || true)
+fi
+if [ ! -x "$javac" ] || [ ! -x "$java" ]; then
+  if [ "$REQUIRE_JAVA" = 1 ]; then
+    echo "java_roundtrip: no JDK (set JAVA_HOME or PATH), and REQUIRE_JAVA=1"
+    exit 1
+  fi
+  echo "java_roundtrip: skipped (no JDK)"
+  exit 0
+fi
+
+root=$(cd "$(dirname "$0")/.." && pwd)
+cli="$root/mosaicCipher"
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+"$java" -version 2>&1 | head -n 1 | sed 's/^/java_roundtrip: /'
+"$javac" -Xlint:all -d "$tmp" "$root"/src/decrypt/java/*.java
+
+# about 2.7 MB: many times WINDOWS_PER_TASK windows, so decodeParallel splits
+seq 1 400000 > "$tmp/plain.txt"
+
+enc(){ # enc <out> <set_mode> <set_compress>
+  printf 'set_mode %s\nset_compress %s\nencrypt-file %s %s key\n' "$2" "$3" \
+    "$tmp/plain.txt" "$tmp/$1" | "$cli" >/dev/null 2>&1
+  test -s "$tmp/$1" || { echo "java_roundtrip: $cli did not write $1"; exit 1; }
+}
+enc standard.m standard off
+enc compact.m compact off
+enc z.m standard on
+enc zc.m compact on
+enc w.m wide off
+enc wc.m wide-compact off
+
+cd "$tmp"
+"$java" -cp "$tmp" RoundTrip key plain.txt standard.m compact.m z.m zc.m w.m wc.m
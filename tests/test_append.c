@@ -0,0 +1,281 @@
+/* mosaic_append() must leave a stream that decrypts exactly like one
+ * written in one go: in every combination of options, with and without a
+ * key, started empty or from the pipeline's output, and in compact streams
+ * broken into lines, where the block index has to be counted instead of
+ * computed. Every chunk leaves a stream that decodes, should the input
+ * stall or the append die. A stream that does not end in a well-formed
+ * trailer is refused and left as it was. */
+
+#define _POSIX_C_SOURCE 200809L /* mkstemp(), pread(), kill(), nanosleep() */
+
+#include "check.h"
+#include "append.h"
+#include "mosaic.h"
+#include "pipeline.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define PLAIN_LEN 5000
+
+static const size_t pieces[] = { 0, 1, 4, 5, 19, 20, 21, 64, 333, 4099 };
+static const char *const keys[] = { NULL, "k3y" };
+
+/* an unlinked scratch file */
+static int temp_fd(void){
+  char path[] = "/tmp/mosaic_test_XXXXXX";
+  int fd = mkstemp(path);
+  if(fd >= 0) unlink(path);
+  return fd;
+}
+
+static int put(int fd, const void *buf, size_t len){
+  if(ftruncate(fd, 0) != 0 || lseek(fd, 0, SEEK_SET) != 0) return -1;
+  return write(fd, buf, len) == (ssize_t)len ? 0 : -1;
+}
+
+/* the whole of fd, malloc'd; NULL on error */
+static char *slurp(int fd, size_t *len){
+  off_t end = lseek(fd, 0, SEEK_END);
+  char *buf = end >= 0 ? malloc((size_t)end + 1) : NULL;
+  if(!buf) return NULL;
+  if(pread(fd, buf, (size_t)end, 0) != end){
+    free(buf);
+    return NULL;
+  }
+  *len = (size_t)end;
+  return buf;
+}
+
+static int run(mosaic_pipe_mode mode, int in_fd, int out_fd, const char *key, unsigned opts){
+  mosaic_pipe_config cfg = { mode, opts, key, 0, 0, MOSAIC_ENGINE_INLINE };
+  if(lseek(in_fd, 0, SEEK_SET) != 0 || ftruncate(out_fd, 0) != 0 ||
+     lseek(out_fd, 0, SEEK_SET) != 0) return -1;
+  return mosaic_pipe_run(in_fd, out_fd, &cfg, NULL);
+}
+
+/* 1 if fd decrypts to plain[0..len) */
+static int decrypts_to(int fd, const char *key, const uint8_t *plain, size_t len){
+  int out = temp_fd();
+  size_t got = 0;
+  char *buf = NULL;
+  int ok = out >= 0 && run(MOSAIC_PIPE_DECODE, fd, out, key, 0) == 0 &&
+           (buf = slurp(out, &got)) != NULL && got == len && memcmp(buf, plain, len) == 0;
+  free(buf);
+  if(out >= 0) close(out);
+  return ok;
+}
+
+static int append_bytes(int fd, const uint8_t *data, size_t len, const char *key, unsigned opts){
+  int in = temp_fd();
+  int rc = in >= 0 && put(in, data, len) == 0 && lseek(in, 0, SEEK_SET) == 0
+               ? mosaic_append(fd, in, key, opts, NULL)
+               : -1;
+  if(in >= 0) close(in);
+  return rc;
+}
+
+/* fd holds plain[0..len) encrypted by the pipeline */
+static int encrypt_into(int fd, const uint8_t *plain, size_t len, const char *key, unsigned opts){
+  int in = temp_fd();
+  int rc = in >= 0 && put(in, plain, len) == 0 ? run(MOSAIC_PIPE_ENCODE, in, fd, key, opts) : -1;
+  if(in >= 0) close(in);
+  return rc;
+}
+
+/* every piece appended in turn to an empty file */
+static void check_from_empty(const uint8_t *plain, unsigned opts, const char *key){
+  int fd = temp_fd();
+  size_t len = 0;
+  for(size_t p = 0; p < sizeof pieces / sizeof pieces[0]; p++){
+    int rc = append_bytes(fd, plain + len, pieces[p], key, opts);
+    CHECK(rc == 0, "append: opts %u, key %s, %zu + %zu bytes", opts, key ? key : "-", len,
+          pieces[p]);
+    len += pieces[p];
+    CHECK(decrypts_to(fd, key, plain, len), "from empty: opts %u, key %s, %zu bytes", opts,
+          key ? key : "-", len);
+  }
+  close(fd);
+}
+
+/* the pipeline writes the first `split` bytes, append the rest */
+static void check_split(const uint8_t *plain, unsigned opts, const char *key, size_t split,
+                        size_t len){
+  int fd = temp_fd();
+  CHECK(encrypt_into(fd, plain, split, key, opts) == 0, "encrypt: opts %u, %zu bytes", opts,
+        split);
+  CHECK(append_bytes(fd, plain + split, len - split, key, 0) == 0,
+        "append: opts %u, key %s, %zu + %zu bytes", opts, key ? key : "-", split, len - split);
+  CHECK(decrypts_to(fd, key, plain, len), "split: opts %u, key %s, %zu + %zu bytes", opts,
+        key ? key : "-", split, len - split);
+  close(fd);
+}
+
+/* a compact stream with a line break after every window, a space after
+ * the first block of each, a leading blank line and a trailing newline:
+ * its size no longer gives the block index */
+static void check_wrapped(const uint8_t *plain, unsigned opts, size_t split, size_t len){
+  const mosaic_params *P = (opts & MOSAIC_OPT_WIDE) ? mosaic_get_params_wide()
+                                                    : mosaic_get_params();
+  const size_t block_chars = (size_t)P->block_symbols + 1;
+  const size_t window_chars = block_chars * (size_t)P->checksum_period + 1;
+  const size_t lead = ((opts & MOSAIC_OPT_COMPACT) != 0) + ((opts & MOSAIC_OPT_WIDE) != 0) +
+                      ((opts & MOSAIC_OPT_COMPRESS) != 0);
+  int fd = temp_fd();
+  size_t n = 0;
+  char *ct = NULL;
+  if(encrypt_into(fd, plain, split, NULL, opts) != 0 || !(ct = slurp(fd, &n))){
+    CHECK(0, "encrypt: opts %u, %zu bytes", opts, split);
+    free(ct);
+    close(fd);
+    return;
+  }
+  char *wrapped = malloc(2 * n + 2);
+  size_t w = 0;
+  wrapped[w++] = '\n';
+  for(size_t i = 0; i < n; i++){
+    wrapped[w++] = ct[i];
+    if(i < lead || i + 3 >= n) continue; /* not inside the marks or the trailer */
+    size_t at = (i + 1 - lead) % window_chars;
+    if(at == 0) wrapped[w++] = '\n';
+    else if(at == block_chars) wrapped[w++] = ' ';
+  }
+  wrapped[w++] = '\n';
+
+  CHECK(put(fd, wrapped, w) == 0 && decrypts_to(fd, NULL, plain, split),
+        "wrapped stream does not decode: opts %u, %zu bytes", opts, split);
+  CHECK(append_bytes(fd, plain + split, len - split, NULL, 0) == 0,
+        "append to wrapped: opts %u, %zu + %zu bytes", opts, split, len - split);
+  CHECK(decrypts_to(fd, NULL, plain, len), "wrapped: opts %u, %zu + %zu bytes", opts, split,
+        len - split);
+  free(wrapped);
+  free(ct);
+  close(fd);
+}
+
+/* an append whose input stalls after one whole chunk: while it waits the
+ * file decodes to everything appended so far, it still does once the
+ * append is killed there, and a later append carries on from it */
+static void check_stalled(unsigned opts){
+  const size_t head = 77, first = MOSAIC_PIPE_CHUNK, len = head + first + 1000;
+  uint8_t *data = malloc(len);
+  for(size_t i = 0; i < len; i++) data[i] = (uint8_t)((i * 2654435761u) >> 11);
+  int fd = temp_fd(), p[2];
+  CHECK(encrypt_into(fd, data, head, NULL, opts) == 0, "encrypt: opts %u", opts);
+  if(pipe(p) != 0){
+    CHECK(0, "pipe: %s", strerror(errno));
+    free(data);
+    close(fd);
+    return;
+  }
+  pid_t pid = fork();
+  if(pid == 0){
+    close(p[1]);
+    _exit(mosaic_append(fd, p[0], NULL, 0, NULL) == 0 ? 0 : 1);
+  }
+  close(p[0]);
+  size_t sent = 0;
+  while(pid > 0 && sent < first){
+    ssize_t n = write(p[1], data + head + sent, first - sent);
+    if(n <= 0) break;
+    sent += (size_t)n;
+  }
+  CHECK(pid > 0 && sent == first, "feeding the append: opts %u", opts);
+
+  /* the append works through the chunk, then waits for the next one */
+  int ok = 0;
+  const struct timespec tick = { 0, 10 * 1000 * 1000 };
+  for(int i = 0; i < 2000 && !ok; i++){
+    ok = decrypts_to(fd, NULL, data, head + first);
+    if(!ok) nanosleep(&tick, NULL);
+  }
+  CHECK(ok, "stalled append left no decodable stream: opts %u", opts);
+  if(pid > 0){
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+  }
+  close(p[1]);
+  CHECK(decrypts_to(fd, NULL, data, head + first), "killed append: opts %u", opts);
+  CHECK(append_bytes(fd, data + head + first, len - head - first, NULL, 0) == 0,
+        "append after kill: opts %u", opts);
+  CHECK(decrypts_to(fd, NULL, data, len), "append after kill: opts %u", opts);
+  free(data);
+  close(fd);
+}
+
+/* ct is refused with EILSEQ and left untouched */
+static void check_refused(const char *what, unsigned opts, const char *ct, size_t n){
+  int fd = temp_fd();
+  const uint8_t more[] = "more";
+  CHECK(put(fd, ct, n) == 0, "write: %s", what);
+  errno = 0;
+  int rc = append_bytes(fd, more, sizeof more - 1, NULL, opts);
+  CHECK(rc == -1 && errno == EILSEQ, "%s accepted: opts %u, rc %d, errno %d", what, opts, rc,
+        errno);
+  size_t got = 0;
+  char *after = slurp(fd, &got);
+  CHECK(after && got == n && memcmp(after, ct, n) == 0, "%s: stream changed: opts %u", what,
+        opts);
+  free(after);
+  close(fd);
+}
+
+static void check_trailers(const uint8_t *plain, unsigned opts){
+  const mosaic_params *P = (opts & MOSAIC_OPT_WIDE) ? mosaic_get_params_wide()
+                                                    : mosaic_get_params();
+  int fd = temp_fd();
+  size_t n = 0;
+  char *ct = NULL;
+  if(encrypt_into(fd, plain, 23, NULL, opts) != 0 || !(ct = slurp(fd, &n))){
+    CHECK(0, "encrypt: opts %u", opts);
+    free(ct);
+    close(fd);
+    return;
+  }
+  close(fd);
+
+  const char good = ct[n - 1];
+  for(int digit = P->block_bytes; digit < P->base; digit++){
+    ct[n - 1] = P->alphabet[digit];
+    check_refused("pad digit at or above the block size", opts, ct, n);
+  }
+  ct[n - 1] = '~';
+  check_refused("terminator as pad digit", opts, ct, n);
+  ct[n - 1] = good;
+  check_refused("truncated trailer", opts, ct, n - 1);
+  check_refused("no trailer", opts, ct, n - 3);
+  free(ct);
+}
+
+int main(void){
+  static uint8_t plain[PLAIN_LEN];
+  /* runs for the LZ coder to find, mixed with bytes it cannot shrink */
+  for(size_t i = 0; i < sizeof plain; i++){
+    plain[i] = (i / 7) % 3 ? (uint8_t)('a' + i % 5) : (uint8_t)((i * 2654435761u) >> 13);
+  }
+
+  for(unsigned opts = 0; opts < 8; opts++){
+    const unsigned o = ((opts & 1) ? MOSAIC_OPT_COMPACT : 0) |
+                       ((opts & 2) ? MOSAIC_OPT_WIDE : 0) |
+                       ((opts & 4) ? MOSAIC_OPT_COMPRESS : 0);
+    for(size_t k = 0; k < sizeof keys / sizeof keys[0]; k++){
+      check_from_empty(plain, o, keys[k]);
+      check_split(plain, o, keys[k], 97, 160);
+      check_split(plain, o, keys[k], 160, 4097);
+    }
+    if(o & MOSAIC_OPT_COMPACT){
+      check_wrapped(plain, o, 5, 40);
+      check_wrapped(plain, o, 1000, 1333);
+    }
+    check_trailers(plain, o);
+  }
+  check_stalled(0);
+  check_stalled(MOSAIC_OPT_COMPACT | MOSAIC_OPT_COMPRESS);
+  check_refused("not a stream", 0, "plain text\n", 11);
+  return check_report("test_append");
+}
@@ -0,0 +1,247 @@
+/* mosaic_bulk_run() must round-trip a tree with files cut into parts, which
+ * a small split_size forces on small files: in every mode, with and without
+ * a key. Compact streams broken into lines, or padded so their size still
+ * adds up to whole windows, decode whole instead of at the fixed offsets.
+ * A damaged stream is reported once, as EILSEQ, and leaves no result and no
+ * temporary file behind. */
+
+#define _POSIX_C_SOURCE 200809L /* mkdtemp(), pread() */
+
+#include "check.h"
+#include "bulk.h"
+#include "mosaic.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SPLIT 64
+
+static const size_t sizes[] = { 0, 1, 19, 20, 21, 333, 1000, 4099, 10007 };
+#define N_SIZES (sizeof sizes / sizeof sizes[0])
+static const char *const keys[] = { NULL, "k3y" };
+
+static uint8_t plain[10007];
+
+static void path_of(char *buf, const char *dir, size_t i, const char *suffix){
+  snprintf(buf, PATH_MAX, "%s/f%zu%s", dir, i, suffix);
+}
+
+static int put_file(const char *path, const void *buf, size_t len){
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if(fd < 0) return -1;
+  int rc = write(fd, buf, len) == (ssize_t)len ? 0 : -1;
+  close(fd);
+  return rc;
+}
+
+/* the whole of path, malloc'd; NULL on error */
+static char *slurp(const char *path, size_t *len){
+  int fd = open(path, O_RDONLY);
+  if(fd < 0) return NULL;
+  off_t end = lseek(fd, 0, SEEK_END);
+  char *buf = end >= 0 ? malloc((size_t)end + 1) : NULL;
+  if(buf && pread(fd, buf, (size_t)end, 0) != end){
+    free(buf);
+    buf = NULL;
+  }
+  close(fd);
+  if(buf) *len = (size_t)end;
+  return buf;
+}
+
+/* empties a directory of plain files */
+static void clear_dir(const char *dir){
+  DIR *d = opendir(dir);
+  struct dirent *e;
+  char path[PATH_MAX];
+  if(!d) return;
+  while((e = readdir(d)) != NULL){
+    if(strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0) continue;
+    snprintf(path, sizeof path, "%s/%s", dir, e->d_name);
+    unlink(path);
+  }
+  closedir(d);
+}
+
+static size_t count_entries(const char *dir){
+  DIR *d = opendir(dir);
+  struct dirent *e;
+  size_t n = 0;
+  if(!d) return 0;
+  while((e = readdir(d)) != NULL) n += strcmp(e->d_name, ".") != 0 && strcmp(e->d_name, "..") != 0;
+  closedir(d);
+  return n;
+}
+
+static int bulk(mosaic_pipe_mode mode, const char *src, const char *dst, const char *key,
+                unsigned opts, mosaic_bulk_result *res){
+  mosaic_bulk_config cfg = { mode, opts, key, 2, SPLIT };
+  return mosaic_bulk_run(src, dst, &cfg, res);
+}
+
+/* decrypts enc into dec and checks every file against its plaintext */
+static void check_decrypt(const char *enc, const char *dec, const char *key, const char *what){
+  mosaic_bulk_result res;
+  clear_dir(dec);
+  CHECK(bulk(MOSAIC_PIPE_DECODE, enc, dec, key, 0, &res) == 0, "%s: run", what);
+  CHECK(res.n_errors == 0, "%s: %zu error(s), first %s: %s", what, res.n_errors,
+        res.n_errors ? res.errors[0].path : "", res.n_errors ? strerror(res.errors[0].err) : "");
+  CHECK(res.files == N_SIZES, "%s: %llu files", what, (unsigned long long)res.files);
+  mosaic_bulk_result_free(&res);
+
+  for(size_t i = 0; i < N_SIZES; i++){
+    char path[PATH_MAX];
+    size_t len = 0;
+    path_of(path, dec, i, "");
+    char *got = slurp(path, &len);
+    CHECK(got && len == sizes[i] && memcmp(got, plain, len) == 0, "%s: %zu bytes", what, sizes[i]);
+    free(got);
+  }
+}
+
+/* rewrites every compact stream in enc with fill inserted after every
+ * window of the body (or only the middle one), and a newline at the end */
+static void reshape(const char *enc, unsigned opts, const char *fill, int every){
+  const mosaic_params *P = (opts & MOSAIC_OPT_WIDE) ? mosaic_get_params_wide() : mosaic_get_params();
+  const size_t window = (size_t)(P->block_symbols + 1) * (size_t)P->checksum_period + 1;
+  const size_t lead = 1 + ((opts & MOSAIC_OPT_WIDE) != 0);
+  const size_t fill_len = strlen(fill);
+
+  for(size_t i = 0; i < N_SIZES; i++){
+    char path[PATH_MAX];
+    size_t len = 0;
+    path_of(path, enc, i, MOSAIC_BULK_SUFFIX);
+    char *ct = slurp(path, &len);
+    char *out = ct ? malloc(len + (len / window + 2) * fill_len + 1) : NULL;
+    if(!out){
+      CHECK(0, "reshape %s", path);
+      free(ct);
+      continue;
+    }
+    size_t o = 0, mid = lead + (len - lead) / window / 2 * window;
+    memcpy(out, ct, lead);
+    o = lead;
+    for(size_t at = lead; at < len; at++){
+      if(at > lead && (every ? (at - lead) % window == 0 : at == mid)){
+        memcpy(out + o, fill, fill_len);
+        o += fill_len;
+      }
+      out[o++] = ct[at];
+    }
+    out[o++] = '\n';
+    CHECK(put_file(path, out, o) == 0, "rewrite %s", path);
+    free(out);
+    free(ct);
+  }
+}
+
+/* a terminator where a symbol near the middle of the largest stream was */
+static void check_damaged(const char *enc, const char *dec, const char *key){
+  const mosaic_params *P = mosaic_get_params();
+  char path[PATH_MAX], out[PATH_MAX];
+  size_t len = 0;
+  path_of(path, enc, N_SIZES - 1, MOSAIC_BULK_SUFFIX);
+  char *ct = slurp(path, &len);
+  if(!ct){
+    CHECK(0, "read %s", path);
+    return;
+  }
+  size_t i = len / 2;
+  while(i < len && !strchr(P->alphabet, ct[i])) i++;
+  ct[i] = '~';
+  CHECK(put_file(path, ct, len) == 0, "rewrite %s", path);
+  free(ct);
+
+  mosaic_bulk_result res;
+  clear_dir(dec);
+  CHECK(bulk(MOSAIC_PIPE_DECODE, enc, dec, key, 0, &res) == 0, "damaged: run");
+  CHECK(res.n_errors == 1 && res.errors[0].err == EILSEQ, "damaged: %zu error(s), %s", res.n_errors,
+        res.n_errors ? strerror(res.errors[0].err) : "");
+  CHECK(res.files == N_SIZES - 1, "damaged: %llu files", (unsigned long long)res.files);
+  mosaic_bulk_result_free(&res);
+  path_of(out, dec, N_SIZES - 1, "");
+  CHECK(access(out, F_OK) != 0, "damaged: %s written", out);
+  CHECK(count_entries(dec) == N_SIZES - 1, "damaged: %zu entries left", count_entries(dec));
+}
+
+static void encrypt(const char *src, const char *enc, const char *key, unsigned opts,
+                    const char *what){
+  mosaic_bulk_result res;
+  clear_dir(enc);
+  CHECK(bulk(MOSAIC_PIPE_ENCODE, src, enc, key, opts, &res) == 0, "%s: encrypt", what);
+  CHECK(res.n_errors == 0 && res.files == N_SIZES, "%s: encrypted %llu, %zu error(s)", what,
+        (unsigned long long)res.files, res.n_errors);
+  mosaic_bulk_result_free(&res);
+}
+
+static void check_opts(const char *src, const char *enc, const char *dec, unsigned opts){
+  for(size_t k = 0; k < sizeof keys / sizeof keys[0]; k++){
+    const char *key = keys[k];
+    char what[64];
+    snprintf(what, sizeof what, "opts %u key %s", opts, key ? key : "-");
+
+    encrypt(src, enc, key, opts, what);
+    check_decrypt(enc, dec, key, what);
+
+    if((opts & MOSAIC_OPT_COMPACT) && !(opts & MOSAIC_OPT_COMPRESS)){
+      char shaped[96];
+      /* the sizes no longer add up: decoded whole from the start */
+      reshape(enc, opts, "\n", 1);
+      snprintf(shaped, sizeof shaped, "%s, in lines", what);
+      check_decrypt(enc, dec, key, shaped);
+
+      /* a window's worth of blank lines: the sizes add up again, and the
+       * parts after it find the layout off */
+      const mosaic_params *P = (opts & MOSAIC_OPT_WIDE) ? mosaic_get_params_wide() : mosaic_get_params();
+      char fill[64];
+      size_t window = (size_t)(P->block_symbols + 1) * (size_t)P->checksum_period + 1;
+      memset(fill, '\n', window - 1);
+      fill[window - 1] = '\0';
+      encrypt(src, enc, key, opts, what);
+      reshape(enc, opts, fill, 0);
+      snprintf(shaped, sizeof shaped, "%s, padded", what);
+      check_decrypt(enc, dec, key, shaped);
+
+      encrypt(src, enc, key, opts, what);
+      check_damaged(enc, dec, key);
+    }
+  }
+}
+
+int main(void){
+  char src[] = "/tmp/mosaic_bulk_src_XXXXXX";
+  char enc[] = "/tmp/mosaic_bulk_enc_XXXXXX";
+  char dec[] = "/tmp/mosaic_bulk_dec_XXXXXX";
+  if(!mkdtemp(src) || !mkdtemp(enc) || !mkdtemp(dec)){
+    perror("mkdtemp");
+    return 1;
+  }
+
+  srand(43);
+  for(size_t i = 0; i < sizeof plain; i++) plain[i] = (uint8_t)(i % 3 ? rand() : 'a' + (int)(i % 26));
+  for(size_t i = 0; i < N_SIZES; i++){
+    char path[PATH_MAX];
+    path_of(path, src, i, "");
+    CHECK(put_file(path, plain, sizes[i]) == 0, "write %s", path);
+  }
+
+  static const unsigned modes[] = {
+    0, MOSAIC_OPT_COMPACT, MOSAIC_OPT_WIDE | MOSAIC_OPT_COMPACT,
+    MOSAIC_OPT_COMPACT | MOSAIC_OPT_COMPRESS,
+  };
+  for(size_t m = 0; m < sizeof modes / sizeof modes[0]; m++) check_opts(src, enc, dec, modes[m]);
+
+  clear_dir(src);
+  clear_dir(enc);
+  clear_dir(dec);
+  rmdir(src);
+  rmdir(enc);
+  rmdir(dec);
+  return check_report("test_bulk");
+}
@@ -0,0 +1,116 @@
+/* One-shot and streaming decoders must agree on every input: same
+ * accept/reject decision, same bytes. Covers the trailer's pad digit, which
+ * has to stay below the block size in every preset, and whitespace, noise
+ * and damage anywhere in the stream: a compact stream is a noisy stream
+ * that happens to hold no noise, so it may gain either where a noisy one
+ * could. */
+
+#include "check.h"
+#include "mosaic.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_PLAIN 64
+
+static const unsigned presets[] = {
+  0u, MOSAIC_OPT_COMPACT, MOSAIC_OPT_WIDE, MOSAIC_OPT_WIDE | MOSAIC_OPT_COMPACT
+};
+
+/* (size_t)-1 if the stream decoder rejects in, fed `step` chars at a time */
+static size_t stream_decode(const char *in, size_t in_len, size_t step, uint8_t *out){
+  mosaic_decoder d;
+  mosaic_decoder_init(&d);
+  uint8_t buf[MAX_PLAIN * 4 + 64];
+  size_t o = 0;
+  for(size_t i = 0; i < in_len; i += step){
+    size_t n = in_len - i < step ? in_len - i : step;
+    size_t w = mosaic_decoder_update(&d, in + i, n, buf, sizeof buf);
+    if(w == (size_t)-1) return w;
+    memcpy(out + o, buf, w);
+    o += w;
+  }
+  return mosaic_decoder_final(&d) == 0 ? o : (size_t)-1;
+}
+
+static void check_agree(const char *what, unsigned opts, size_t len, const char *ct,
+                        size_t ct_len){
+  uint8_t a[MAX_PLAIN * 4 + 64], b[MAX_PLAIN * 4 + 64];
+  size_t ra = mosaic_decode(ct, ct_len, a, sizeof a);
+  for(size_t step = 1; step <= ct_len; step = step * 3 + 1){
+    size_t rb = stream_decode(ct, ct_len, step, b);
+    CHECK(ra == rb && (ra == (size_t)-1 || memcmp(a, b, ra) == 0),
+          "%s: opts %u, %zu bytes, step %zu: one-shot %lld, streaming %lld", what, opts, len,
+          step, (long long)ra, (long long)rb);
+  }
+}
+
+/* one char inserted, replaced or dropped at every position: both decoders
+ * agree, and whitespace or noise that is accepted changes nothing */
+static void check_mutations(unsigned opts, const uint8_t *plain, size_t len, const char *ct,
+                            size_t n){
+  static const char inserts[] = { ' ', '\n', 'q', 'c' };
+  char m[MAX_PLAIN * 4 + 64];
+  uint8_t out[MAX_PLAIN * 4 + 64];
+  for(size_t i = 0; i <= n; i++){
+    for(size_t j = 0; j < sizeof inserts; j++){
+      memcpy(m, ct, i);
+      m[i] = inserts[j];
+      memcpy(m + i + 1, ct + i, n - i);
+      size_t r = mosaic_decode(m, n + 1, out, sizeof out);
+      CHECK(r == (size_t)-1 || (r == len && memcmp(out, plain, len) == 0),
+            "'%c' at %zu changed the plaintext: opts %u, %zu bytes", inserts[j], i, opts, len);
+      check_agree("insert", opts, len, m, n + 1);
+    }
+    if(i == n) break;
+    memcpy(m, ct, n);
+    m[i] = 'q';
+    check_agree("replace", opts, len, m, n);
+    memcpy(m, ct, i);
+    memcpy(m + i, ct + i + 1, n - i - 1);
+    check_agree("drop", opts, len, m, n - 1);
+  }
+}
+
+int main(void){
+  uint8_t plain[MAX_PLAIN], out[MAX_PLAIN * 4 + 64];
+  char ct[MAX_PLAIN * 4 + 64];
+  for(size_t i = 0; i < sizeof plain; i++) plain[i] = (uint8_t)(i * 131 + 7);
+
+  for(size_t p = 0; p < sizeof presets / sizeof presets[0]; p++){
+    const unsigned opts = presets[p];
+    const mosaic_params *P = (opts & MOSAIC_OPT_WIDE) ? mosaic_get_params_wide()
+                                                      : mosaic_get_params();
+    for(size_t len = 1; len <= MAX_PLAIN; len++){
+      size_t n = mosaic_encode_seeded(plain, len, ct, sizeof ct, opts, len);
+      CHECK(n != (size_t)-1, "encode: opts %u, %zu bytes", opts, len);
+      if(n == (size_t)-1) continue;
+
+      size_t r = mosaic_decode(ct, n, out, sizeof out);
+      CHECK(r == len && memcmp(out, plain, len) == 0, "round trip: opts %u, %zu bytes", opts,
+            len);
+      check_agree("valid", opts, len, ct, n);
+      if(len % 7 == 1 || len % 20 == 0) check_mutations(opts, plain, len, ct, n);
+
+      /* every other pad digit: at or above the block size it is always an
+       * error; below it, both decoders still have to agree */
+      const char good = ct[n - 1];
+      for(int digit = 0; digit < P->base; digit++){
+        ct[n - 1] = P->alphabet[digit];
+        if(digit >= P->block_bytes){
+          CHECK(mosaic_decode(ct, n, out, sizeof out) == (size_t)-1,
+                "pad digit %d accepted: opts %u, %zu bytes", digit, opts, len);
+        }
+        check_agree("pad digit", opts, len, ct, n);
+      }
+      ct[n - 1] = good;
+
+      /* cut short, or no trailer at all */
+      CHECK(mosaic_decode(ct, n - 1, out, sizeof out) == (size_t)-1,
+            "truncated trailer accepted: opts %u, %zu bytes", opts, len);
+      check_agree("truncated", opts, len, ct, n - 1);
+      check_agree("no trailer", opts, len, ct, n - 3);
+    }
+  }
+  return check_report("test_decode");
+}